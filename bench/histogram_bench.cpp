@@ -0,0 +1,84 @@
+/**
+ * Histogram::observe throughput
+ *
+ * Records log-normally distributed latencies (median 4 ms) into one
+ * shared histogram from 1, 2, 4 and 8 threads, for the default latency
+ * buckets and for a fine layout of 64 buckets, and reports nanoseconds
+ * per observation. Arguments: [observations per run] (default 20000000).
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "metrics/collector.hpp"
+
+using namespace onnx_server;
+
+namespace {
+
+double run(Histogram &histogram, const std::vector<double> &values,
+           size_t observations, size_t threads) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      size_t mask = values.size() - 1;
+      for (size_t i = 0; i < observations / threads; ++i) {
+        histogram.observe(values[(i + t * 977) & mask]);
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         static_cast<double>(observations);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t observations = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                 : 20000000;
+
+  std::mt19937 rng(1);
+  std::lognormal_distribution<double> latency(std::log(0.004), 1.0);
+  std::vector<double> values(1 << 16); // Power of two, indexed by mask
+  for (auto &value : values) {
+    value = latency(rng);
+  }
+
+  std::vector<double> fine;
+  for (int i = 0; i < 64; ++i) {
+    fine.push_back(1e-5 * std::pow(1.25, i));
+  }
+
+  struct Layout {
+    const char *name;
+    std::vector<double> buckets;
+  };
+  const Layout layouts[] = {{"default", MetricsConfig().latency_buckets},
+                            {"fine-64", fine}};
+
+  std::printf("%-10s %8s %12s\n", "buckets", "threads", "ns/observe");
+  for (const auto &layout : layouts) {
+    for (size_t threads : {1, 2, 4, 8}) {
+      Histogram histogram(layout.buckets);
+      double ns = run(histogram, values, observations, threads);
+      std::printf("%-10s %8zu %12.2f\n", layout.name, threads, ns);
+      if (histogram.count() != observations / threads * threads) {
+        std::fprintf(stderr, "lost observations: %llu\n",
+                     static_cast<unsigned long long>(histogram.count()));
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
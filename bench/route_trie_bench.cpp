@@ -0,0 +1,142 @@
+/**
+ * Route resolution: RouteTrie against one std::regex per route
+ *
+ * Registers the server's route table both ways and resolves a mix of
+ * request paths (parameterized, literal, and unmatched), reporting
+ * nanoseconds per lookup for each. The regex side is what the router did
+ * before the trie: try every route's pattern in order until one matches
+ * with the right method. Arguments: [lookups per path] (default 200000).
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "server/route_trie.hpp"
+
+using namespace onnx_server;
+
+namespace {
+
+struct RouteSpec {
+  const char *method;
+  const char *pattern;
+};
+
+// As registered by Handlers::register_routes
+const RouteSpec ROUTES[] = {
+    {"GET", "/health"},
+    {"GET", "/ready"},
+    {"GET", "/"},
+    {"GET", "/v1/models"},
+    {"GET", "/v1/models/:name"},
+    {"POST", "/v1/models/:name/reload"},
+    {"POST", "/v1/models/:name/infer"},
+    {"POST", "/v1/models/:name/infer:stream"},
+    {"POST", "/v1/infer:multi"},
+    {"POST", "/v2/models/:name/infer"},
+    {"GET", "/v2/systemsharedmemory/status"},
+    {"GET", "/v2/systemsharedmemory/region/:name/status"},
+    {"POST", "/v2/systemsharedmemory/region/:name/register"},
+    {"POST", "/v2/systemsharedmemory/unregister"},
+    {"POST", "/v2/systemsharedmemory/region/:name/unregister"},
+    {"GET", "/v1/jobs/:id"},
+    {"DELETE", "/v1/jobs/:id"},
+    {"GET", "/metrics"},
+    {"GET", "/v1/stats"},
+};
+
+const RouteSpec REQUESTS[] = {
+    {"POST", "/v1/models/resnet50/infer"},
+    {"POST", "/v2/models/resnet50/infer"},
+    {"POST", "/v2/systemsharedmemory/region/r1/unregister"},
+    {"GET", "/health"},
+    {"GET", "/metrics"},
+    {"GET", "/v1/jobs/job-42"},
+    {"GET", "/no/such/route"},
+};
+
+struct RegexRoute {
+  std::string method;
+  std::regex pattern;
+};
+
+// `:param` segments become ([^/]+) groups, as Router used to build them
+std::string to_regex(const std::string &pattern) {
+  std::string out;
+  for (size_t i = 0; i < pattern.size();) {
+    if (pattern[i] == ':') {
+      out += "([^/]+)";
+      while (i < pattern.size() && pattern[i] != '/')
+        ++i;
+    } else {
+      out += pattern[i++];
+    }
+  }
+  return out;
+}
+
+template <typename F> double time_ns(size_t lookups, F &&lookup) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < lookups; ++i) {
+    lookup();
+  }
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         static_cast<double>(lookups);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t lookups =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+
+  using Methods = std::vector<std::string>;
+  RouteTrie<Methods> trie;
+  std::vector<RegexRoute> regexes;
+  for (const auto &route : ROUTES) {
+    std::vector<std::string> names;
+    trie.insert(route.pattern, names)->push_back(route.method);
+    regexes.push_back({route.method, std::regex(to_regex(route.pattern))});
+  }
+
+  std::printf("%-7s %-46s %10s %10s\n", "method", "path", "regex ns",
+              "trie ns");
+  volatile size_t sink = 0;
+  for (const auto &request : REQUESTS) {
+    std::string method = request.method;
+    std::string path = request.pattern;
+
+    double regex_ns = time_ns(lookups, [&] {
+      std::smatch match;
+      for (const auto &route : regexes) {
+        if (std::regex_match(path, match, route.pattern) &&
+            route.method == method) {
+          sink = sink + match.size();
+          break;
+        }
+      }
+    });
+
+    double trie_ns = time_ns(lookups, [&] {
+      RouteTrie<Methods>::Match match;
+      if (!trie.match(path, match))
+        return;
+      for (const auto &candidate : *match.value) {
+        if (candidate == method) {
+          sink = sink + match.param_count;
+          break;
+        }
+      }
+    });
+
+    std::printf("%-7s %-46s %10.1f %10.1f\n", method.c_str(), path.c_str(),
+                regex_ns, trie_ns);
+  }
+  return 0;
+}
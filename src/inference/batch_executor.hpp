@@ -1,14 +1,17 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <future>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include <thread>
 
+#include "batch_merge.hpp"
 #include "metrics/collector.hpp"
 #include "model_registry.hpp"
 #include "session_manager.hpp"
@@ -23,7 +26,24 @@ namespace onnx_server {
 struct PendingRequest {
   InferenceRequest request;
   std::promise<InferenceResponse> promise;
+  // When set, receives the response instead of `promise`
+  std::function<void(InferenceResponse)> on_done;
   std::chrono::steady_clock::time_point enqueue_time;
+
+  void complete(InferenceResponse response) {
+    if (!on_done) {
+      promise.set_value(std::move(response));
+      return;
+    }
+    try {
+      on_done(std::move(response));
+    } catch (const std::exception &e) {
+      LOG_ERROR("Completion callback for {} failed: {}", request.request_id,
+                e.what());
+    } catch (...) {
+      LOG_ERROR("Completion callback for {} failed", request.request_id);
+    }
+  }
 };
 
 /**
@@ -79,26 +99,24 @@ public:
   std::future<InferenceResponse> submit(InferenceRequest request) {
     auto pending = std::make_shared<PendingRequest>();
     pending->request = std::move(request);
-    pending->enqueue_time = std::chrono::steady_clock::now();
-
     auto future = pending->promise.get_future();
-
-    if (!config_.enabled) {
-      // Process immediately without batching
-      auto response = model_registry_.run_inference(pending->request);
-      pending->promise.set_value(std::move(response));
-      return future;
-    }
-
-    {
-      std::lock_guard<std::mutex> lock(queue_mutex_);
-      pending_requests_.push(std::move(pending));
-    }
-
-    queue_cv_.notify_one();
+    enqueue(std::move(pending));
     return future;
   }
 
+  /**
+   * Submit a request and have `on_done` called with its response, on the
+   * executor thread (inline when batching is disabled). For callers that
+   * must not block a thread per request.
+   */
+  void submit(InferenceRequest request,
+              std::function<void(InferenceResponse)> on_done) {
+    auto pending = std::make_shared<PendingRequest>();
+    pending->request = std::move(request);
+    pending->on_done = std::move(on_done);
+    enqueue(std::move(pending));
+  }
+
   /**
    * Get current queue size
    */
@@ -124,6 +142,27 @@ private:
   std::atomic<bool> running_;
   std::thread executor_thread_;
 
+  void enqueue(std::shared_ptr<PendingRequest> pending) {
+    pending->enqueue_time = std::chrono::steady_clock::now();
+    pending->request.trace.mark(RequestTrace::Enqueued,
+                                pending->enqueue_time);
+
+    if (!config_.enabled) {
+      // Process immediately without batching
+      pending->request.trace.mark(RequestTrace::BatchFormed,
+                                  pending->enqueue_time);
+      pending->complete(model_registry_.run_inference(pending->request));
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      pending_requests_.push(std::move(pending));
+    }
+
+    queue_cv_.notify_one();
+  }
+
   /**
    * Main executor loop
    */
@@ -187,17 +226,17 @@ private:
   /**
    * Process a batch of requests
    *
-   * Note: For simplicity, this currently processes requests sequentially.
-   * A production implementation would:
-   * 1. Group requests by model
-   * 2. Pad/reshape tensors to create true batched inputs
-   * 3. Run single batched inference call
-   * 4. Demultiplex outputs
+   * Requests are grouped by model. Within a group, requests whose inputs
+   * differ only in their first dimension are concatenated and run as one
+   * ONNX Runtime call, then the outputs are split back by row. Requests
+   * that cannot be merged (static batch dimension, mismatched shapes,
+   * caller output buffers) run individually.
    */
   void process_batch(std::vector<std::shared_ptr<PendingRequest>> batch) {
     LOG_DEBUG("Processing batch of {} requests", batch.size());
 
     auto batch_start = std::chrono::steady_clock::now();
+    size_t batch_size = batch.size();
 
     // Group by model name for efficient processing
     std::unordered_map<std::string,
@@ -207,26 +246,36 @@ private:
       by_model[req->request.model_name].push_back(std::move(req));
     }
 
-    // Process each model group
     for (auto &[model_name, requests] : by_model) {
-      // For now, process individually but in sequence
-      // TODO: Implement true batched inference with tensor concatenation
-      for (auto &pending : requests) {
-        auto queue_time =
-            std::chrono::steady_clock::now() - pending->enqueue_time;
-        double queue_ms =
-            std::chrono::duration<double, std::milli>(queue_time).count();
-
-        try {
-          auto response = model_registry_.run_inference(pending->request);
-          response.queue_time_ms = queue_ms;
-          pending->promise.set_value(std::move(response));
-        } catch (const std::exception &e) {
-          InferenceResponse error_response;
-          error_response.success = false;
-          error_response.error = e.what();
-          error_response.queue_time_ms = queue_ms;
-          pending->promise.set_value(std::move(error_response));
+      metrics_.record_model_batch(model_name, requests.size(),
+                                  config_.max_batch_size);
+
+      std::optional<ModelInfo> info;
+      if (requests.size() > 1 && concatenates(model_name))
+        info = model_registry_.get(model_name);
+
+      while (!requests.empty()) {
+        // Take the first request plus everything that can share its run
+        std::vector<std::shared_ptr<PendingRequest>> group;
+        std::vector<std::shared_ptr<PendingRequest>> rest;
+        group.push_back(std::move(requests.front()));
+        const InferenceRequest &lead = group.front()->request;
+        bool mergeable = info && batch_merge::batchable(lead, *info);
+
+        for (size_t i = 1; i < requests.size(); ++i) {
+          if (mergeable &&
+              batch_merge::compatible(lead, requests[i]->request) &&
+              batch_merge::batchable(requests[i]->request, *info)) {
+            group.push_back(std::move(requests[i]));
+          } else {
+            rest.push_back(std::move(requests[i]));
+          }
+        }
+        requests = std::move(rest);
+
+        if (group.size() < 2 || !run_merged(group)) {
+          for (auto &pending : group)
+            run_single(*pending);
         }
       }
     }
@@ -236,12 +285,94 @@ private:
         std::chrono::duration<double, std::milli>(batch_duration).count();
 
     // Record batch metrics
-    metrics_.record_batch(batch.size(), batch_time_ms / 1000.0);
+    metrics_.record_batch(batch_size, batch_time_ms / 1000.0);
 
-    LOG_DEBUG("Batch of {} requests completed in {:.2f}ms", batch.size(),
+    LOG_DEBUG("Batch of {} requests completed in {:.2f}ms", batch_size,
               batch_time_ms);
   }
 
+  /**
+   * Whether `model`'s requests may be concatenated: dimension 0 must be a
+   * batch axis, which only configuration can tell
+   */
+  bool concatenates(const std::string &model) const {
+    return config_.concatenate ||
+           std::find(config_.concatenate_models.begin(),
+                     config_.concatenate_models.end(),
+                     model) != config_.concatenate_models.end();
+  }
+
+  static double queue_ms(const PendingRequest &pending,
+                         std::chrono::steady_clock::time_point now) {
+    return std::chrono::duration<double, std::milli>(now -
+                                                     pending.enqueue_time)
+        .count();
+  }
+
+  /**
+   * Run one request on its own
+   */
+  void run_single(PendingRequest &pending) {
+    auto now = std::chrono::steady_clock::now();
+    double queued = queue_ms(pending, now);
+    pending.request.trace.mark(RequestTrace::BatchFormed, now);
+    try {
+      auto response = model_registry_.run_inference(pending.request);
+      response.queue_time_ms = queued;
+      pending.complete(std::move(response));
+    } catch (const std::exception &e) {
+      InferenceResponse error_response;
+      error_response.success = false;
+      error_response.error = e.what();
+      error_response.queue_time_ms = queued;
+      pending.complete(std::move(error_response));
+    }
+  }
+
+  /**
+   * Run a group of compatible requests as one concatenated call. Returns
+   * false without completing any promise if the merged run fails or its
+   * outputs cannot be split by row; the caller then runs them one by one
+   * so each request gets its own result or error.
+   */
+  bool run_merged(std::vector<std::shared_ptr<PendingRequest>> &group) {
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<const InferenceRequest *> parts;
+    std::vector<int64_t> part_rows;
+    for (const auto &pending : group) {
+      pending->request.trace.mark(RequestTrace::BatchFormed, now);
+      parts.push_back(&pending->request);
+      part_rows.push_back(batch_merge::rows(pending->request.inputs.front()));
+    }
+
+    std::vector<InferenceResponse> responses;
+    RequestTrace run_trace; // Run marks of the merged call
+    try {
+      InferenceResponse merged =
+          model_registry_.run_inference(batch_merge::merge(parts));
+      if (!merged.success ||
+          !batch_merge::split(merged, part_rows, responses)) {
+        return false;
+      }
+      run_trace = merged.trace;
+    } catch (const std::exception &e) {
+      LOG_DEBUG("Merged run of {} requests failed: {}", group.size(),
+                e.what());
+      return false;
+    }
+
+    auto split_end = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < group.size(); ++i) {
+      responses[i].queue_time_ms = queue_ms(*group[i], now);
+      responses[i].trace = group[i]->request.trace;
+      responses[i].trace.merge(run_trace);
+      responses[i].trace.mark(RequestTrace::Extracted, split_end);
+      group[i]->complete(std::move(responses[i]));
+    }
+    return true;
+  }
+
   /**
    * Drain and process remaining requests on shutdown
    */
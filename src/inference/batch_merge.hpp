@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "dtype.hpp"
+#include "session_manager.hpp"
+
+namespace onnx_server {
+
+/**
+ * Helpers for running several queued requests as one ONNX Runtime call:
+ * inputs are concatenated along the first (batch) dimension and the
+ * outputs are split back by row.
+ */
+namespace batch_merge {
+
+/**
+ * Rows of a tensor along dimension 0 (-1 for scalars)
+ */
+inline int64_t rows(const TensorData &tensor) {
+  return tensor.shape.empty() ? -1 : tensor.shape[0];
+}
+
+/**
+ * Whether `request` may be concatenated with others: every input and
+ * output of the model has a dynamic first dimension, the inputs agree on
+ * their row count and their buffers match their shapes, and no output is
+ * bound to a caller buffer.
+ */
+inline bool batchable(const InferenceRequest &request, const ModelInfo &info) {
+  if (request.inputs.empty() || !request.output_buffers.empty() ||
+      request.inputs.size() != info.input_names.size())
+    return false;
+
+  for (const auto &shape : info.output_shapes) {
+    if (shape.empty() || shape[0] >= 0)
+      return false;
+  }
+
+  int64_t count = rows(request.inputs.front());
+  for (const auto &input : request.inputs) {
+    auto it = std::find(info.input_names.begin(), info.input_names.end(),
+                        input.name);
+    if (it == info.input_names.end())
+      return false;
+    const auto &declared = info.input_shapes[it - info.input_names.begin()];
+    if (declared.empty() || declared[0] >= 0)
+      return false;
+
+    size_t width = dtype::element_size(input.dtype);
+    auto bytes = dtype::checked_byte_size(input.shape, width);
+    if (rows(input) <= 0 || rows(input) != count || width == 0 || !bytes ||
+        input.byte_size() != *bytes)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Whether two batchable requests can share a run: same inputs in the same
+ * order, with equal dtypes and equal shapes beyond dimension 0
+ */
+inline bool compatible(const InferenceRequest &a, const InferenceRequest &b) {
+  if (a.inputs.size() != b.inputs.size() || !b.output_buffers.empty())
+    return false;
+  for (size_t i = 0; i < a.inputs.size(); ++i) {
+    const auto &x = a.inputs[i];
+    const auto &y = b.inputs[i];
+    if (x.name != y.name || x.dtype != y.dtype ||
+        x.shape.size() != y.shape.size() ||
+        !std::equal(x.shape.begin() + 1, x.shape.end(), y.shape.begin() + 1))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Concatenate compatible requests along dimension 0
+ */
+inline InferenceRequest
+merge(const std::vector<const InferenceRequest *> &parts) {
+  InferenceRequest merged;
+  merged.model_name = parts.front()->model_name;
+  merged.request_id = parts.front()->request_id;
+
+  for (size_t i = 0; i < parts.front()->inputs.size(); ++i) {
+    const TensorData &first = parts.front()->inputs[i];
+    TensorData input;
+    input.name = first.name;
+    input.dtype = first.dtype;
+    input.shape = first.shape;
+    input.shape[0] = 0;
+
+    size_t bytes = 0;
+    for (const auto *part : parts)
+      bytes += part->inputs[i].byte_size();
+    input.raw_data.resize(bytes);
+
+    size_t offset = 0;
+    for (const auto *part : parts) {
+      const TensorData &source = part->inputs[i];
+      if (source.byte_size() > 0)
+        std::memcpy(input.raw_data.data() + offset, source.data(),
+                    source.byte_size());
+      offset += source.byte_size();
+      input.shape[0] += source.shape[0];
+    }
+    merged.inputs.push_back(std::move(input));
+  }
+  return merged;
+}
+
+/**
+ * Copy rows [begin, begin + count) of `tensor`, keeping its storage kind
+ * (borrowed buffers become owned raw bytes)
+ */
+inline TensorData slice_rows(const TensorData &tensor, int64_t begin,
+                             int64_t count) {
+  TensorData slice;
+  slice.name = tensor.name;
+  slice.dtype = tensor.dtype;
+  slice.shape = tensor.shape;
+
+  int64_t total = rows(tensor);
+  if (total <= 0)
+    return slice;
+  slice.shape[0] = count;
+
+  auto take = [&](const auto &source, auto &target) {
+    size_t per_row = source.size() / static_cast<size_t>(total);
+    auto first = source.begin() + static_cast<std::ptrdiff_t>(begin * per_row);
+    target.assign(first, first + static_cast<std::ptrdiff_t>(count * per_row));
+  };
+
+  if (tensor.external_data) {
+    const auto *bytes = static_cast<const uint8_t *>(tensor.external_data);
+    size_t per_row = tensor.external_size / static_cast<size_t>(total);
+    slice.raw_data.assign(bytes + begin * per_row,
+                          bytes + (begin + count) * per_row);
+  } else if (!tensor.raw_data.empty()) {
+    take(tensor.raw_data, slice.raw_data);
+  } else if (!tensor.float_data.empty()) {
+    take(tensor.float_data, slice.float_data);
+  } else {
+    take(tensor.int_data, slice.int_data);
+  }
+  return slice;
+}
+
+/**
+ * Split a merged response into one response per part, given each part's
+ * row count. Returns false if an output's first dimension is not the total
+ * row count, i.e. the model does not batch along dimension 0.
+ */
+inline bool split(const InferenceResponse &merged,
+                  const std::vector<int64_t> &part_rows,
+                  std::vector<InferenceResponse> &out) {
+  int64_t total = 0;
+  for (int64_t n : part_rows)
+    total += n;
+  for (const auto &output : merged.outputs) {
+    if (rows(output) != total)
+      return false;
+  }
+
+  out.assign(part_rows.size(), InferenceResponse{});
+  int64_t begin = 0;
+  for (size_t p = 0; p < part_rows.size(); ++p) {
+    for (const auto &output : merged.outputs)
+      out[p].outputs.push_back(slice_rows(output, begin, part_rows[p]));
+    out[p].inference_time_ms = merged.inference_time_ms;
+    begin += part_rows[p];
+  }
+  return true;
+}
+
+} // namespace batch_merge
+
+} // namespace onnx_server
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+namespace onnx_server {
+
+/**
+ * Tensor element type helpers shared by the request codecs and the session
+ * manager. Types are identified by their NumPy-style name ("float32", ...).
+ */
+namespace dtype {
+
+/**
+ * Size in bytes of one element, or 0 for unknown/variable-size types
+ */
+inline size_t element_size(const std::string &dtype) {
+  if (dtype == "float32" || dtype == "int32" || dtype == "uint32")
+    return 4;
+  if (dtype == "float64" || dtype == "int64" || dtype == "uint64")
+    return 8;
+  if (dtype == "float16" || dtype == "bfloat16" || dtype == "int16" ||
+      dtype == "uint16")
+    return 2;
+  if (dtype == "int8" || dtype == "uint8" || dtype == "bool")
+    return 1;
+  return 0;
+}
+
+/**
+ * Map a dtype name to the ONNX tensor element type
+ */
+inline ONNXTensorElementDataType to_onnx(const std::string &dtype) {
+  if (dtype == "float32")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+  if (dtype == "float64")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE;
+  if (dtype == "float16")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
+  if (dtype == "bfloat16")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16;
+  if (dtype == "int8")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8;
+  if (dtype == "int16")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16;
+  if (dtype == "int32")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32;
+  if (dtype == "int64")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64;
+  if (dtype == "uint8")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8;
+  if (dtype == "uint16")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16;
+  if (dtype == "uint32")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32;
+  if (dtype == "uint64")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64;
+  if (dtype == "bool")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL;
+  if (dtype == "string")
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING;
+  return ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+}
+
+/**
+ * Map an ONNX tensor element type to its dtype name
+ */
+inline std::string from_onnx(ONNXTensorElementDataType type) {
+  switch (type) {
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+    return "float32";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
+    return "float64";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+    return "float16";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16:
+    return "bfloat16";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+    return "int32";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+    return "int64";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
+    return "int8";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+    return "uint8";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
+    return "int16";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
+    return "uint16";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:
+    return "uint32";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
+    return "uint64";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
+    return "bool";
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING:
+    return "string";
+  default:
+    return "unknown";
+  }
+}
+
+/**
+ * Number of elements described by a shape (1 for scalars). Dynamic (-1)
+ * dimensions count as 0 and the product is not overflow-checked, so sizes
+ * derived from request shapes use checked_element_count() instead.
+ */
+inline size_t element_count(const std::vector<int64_t> &shape) {
+  size_t count = 1;
+  for (auto dim : shape) {
+    count *= static_cast<size_t>(dim < 0 ? 0 : dim);
+  }
+  return count;
+}
+
+/**
+ * Number of elements described by a client-supplied shape, or nullopt if a
+ * dimension is negative or the product does not fit in size_t
+ */
+inline std::optional<size_t>
+checked_element_count(const std::vector<int64_t> &shape) {
+  size_t count = 1;
+  for (auto dim : shape) {
+    if (dim < 0)
+      return std::nullopt;
+    size_t n = static_cast<size_t>(dim);
+    if (n != 0 && count > std::numeric_limits<size_t>::max() / n)
+      return std::nullopt;
+    count *= n;
+  }
+  return count;
+}
+
+/**
+ * Byte size of a tensor of `shape` with `width`-byte elements, or nullopt
+ * under the same conditions as checked_element_count()
+ */
+inline std::optional<size_t>
+checked_byte_size(const std::vector<int64_t> &shape, size_t width) {
+  auto count = checked_element_count(shape);
+  if (!count ||
+      (width != 0 && *count > std::numeric_limits<size_t>::max() / width))
+    return std::nullopt;
+  return *count * width;
+}
+
+/**
+ * Widen an IEEE 754 half-precision value to float
+ */
+inline float half_to_float(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1F;
+  uint32_t mantissa = half & 0x3FF;
+  uint32_t bits;
+  if (exponent == 0x1F) {
+    bits = sign | 0x7F800000 | (mantissa << 13); // Inf / NaN
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    // Subnormal: shift the leading one into the implicit bit
+    exponent = 113;
+    while (!(mantissa & 0x400)) {
+      mantissa <<= 1;
+      --exponent;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+  }
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/**
+ * Widen a bfloat16 value (the upper half of a float) to float
+ */
+inline float bfloat16_to_float(uint16_t value) {
+  uint32_t bits = static_cast<uint32_t>(value) << 16;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+/**
+ * Append JSON-style numbers to a typed little-endian byte buffer
+ */
+template <typename T>
+inline void append_value(std::vector<uint8_t> &buffer, T value) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+inline bool append_number(std::vector<uint8_t> &buffer,
+                          const std::string &dtype, double value) {
+  if (dtype == "float32")
+    append_value(buffer, static_cast<float>(value));
+  else if (dtype == "float64")
+    append_value(buffer, value);
+  else if (dtype == "int8")
+    append_value(buffer, static_cast<int8_t>(value));
+  else if (dtype == "int16")
+    append_value(buffer, static_cast<int16_t>(value));
+  else if (dtype == "int32")
+    append_value(buffer, static_cast<int32_t>(value));
+  else if (dtype == "int64")
+    append_value(buffer, static_cast<int64_t>(value));
+  else if (dtype == "uint8")
+    append_value(buffer, static_cast<uint8_t>(value));
+  else if (dtype == "uint16")
+    append_value(buffer, static_cast<uint16_t>(value));
+  else if (dtype == "uint32")
+    append_value(buffer, static_cast<uint32_t>(value));
+  else if (dtype == "uint64")
+    append_value(buffer, static_cast<uint64_t>(value));
+  else if (dtype == "bool")
+    append_value(buffer, static_cast<uint8_t>(value != 0));
+  else
+    return false;
+  return true;
+}
+
+/**
+ * Read element `index` of a typed little-endian buffer as a double
+ */
+inline double read_number(const void *data, const std::string &dtype,
+                          size_t index) {
+  auto read = [&](auto tag) {
+    using T = decltype(tag);
+    return static_cast<double>(static_cast<const T *>(data)[index]);
+  };
+  if (dtype == "float32")
+    return read(float{});
+  if (dtype == "float64")
+    return read(double{});
+  if (dtype == "int8")
+    return read(int8_t{});
+  if (dtype == "int16")
+    return read(int16_t{});
+  if (dtype == "int32")
+    return read(int32_t{});
+  if (dtype == "int64")
+    return read(int64_t{});
+  if (dtype == "uint8" || dtype == "bool")
+    return read(uint8_t{});
+  if (dtype == "uint16")
+    return read(uint16_t{});
+  if (dtype == "uint32")
+    return read(uint32_t{});
+  if (dtype == "uint64")
+    return read(uint64_t{});
+  return 0.0;
+}
+
+} // namespace dtype
+
+} // namespace onnx_server
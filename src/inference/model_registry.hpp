@@ -96,6 +96,14 @@ public:
     return result;
   }
 
+  /**
+   * Load (or replace) a single model file under `name`, without scanning
+   * the models directory
+   */
+  bool load(const std::string &path, const std::string &name) {
+    return load_model(path, name);
+  }
+
   /**
    * Reload a specific model
    */
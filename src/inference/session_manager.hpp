@@ -1,14 +1,19 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "dtype.hpp"
 #include "utils/config.hpp"
 #include "utils/logging.hpp"
+#include "utils/request_trace.hpp"
 #include <onnxruntime_cxx_api.h>
 
 namespace onnx_server {
@@ -23,6 +28,51 @@ struct TensorData {
   std::vector<float> float_data;
   std::vector<int64_t> int_data;
   std::vector<uint8_t> raw_data;
+
+  // Borrowed little-endian buffer in `dtype` layout (e.g. a slice of the
+  // request body). Takes precedence over the owned vectors; the owner must
+  // keep it alive until inference completes.
+  const void *external_data = nullptr;
+  size_t external_size = 0;
+
+  /**
+   * Pointer to the typed element buffer, whichever storage holds it
+   */
+  const void *data() const {
+    if (external_data)
+      return external_data;
+    if (!raw_data.empty())
+      return raw_data.data();
+    if (!float_data.empty())
+      return float_data.data();
+    if (!int_data.empty())
+      return int_data.data();
+    return nullptr;
+  }
+
+  /**
+   * Size in bytes of the buffer returned by data()
+   */
+  size_t byte_size() const {
+    if (external_data)
+      return external_size;
+    if (!raw_data.empty())
+      return raw_data.size();
+    if (!float_data.empty())
+      return float_data.size() * sizeof(float);
+    return int_data.size() * sizeof(int64_t);
+  }
+};
+
+/**
+ * Caller-owned destination for one model output (e.g. a shared memory
+ * region). The output is written into `data` instead of a TensorData
+ * vector and returned as external data pointing at it.
+ */
+struct OutputBuffer {
+  std::string name;
+  void *data = nullptr;
+  size_t capacity = 0;
 };
 
 /**
@@ -32,9 +82,11 @@ struct InferenceRequest {
   std::string model_name;
   std::string request_id;
   std::vector<TensorData> inputs;
+  std::vector<OutputBuffer> output_buffers; // Optional, by output name
 
   // Timing metadata
   std::chrono::steady_clock::time_point enqueue_time;
+  RequestTrace trace;
 };
 
 /**
@@ -46,6 +98,7 @@ struct InferenceResponse {
   double queue_time_ms = 0;
   std::string error;
   bool success = true;
+  RequestTrace trace; // The request's, extended by run_inference()
 };
 
 /**
@@ -114,7 +167,7 @@ public:
         auto tensor_info = type_info.GetTensorTypeAndShapeInfo();
         info.input_shapes.push_back(tensor_info.GetShape());
         info.input_types.push_back(
-            onnx_type_to_string(tensor_info.GetElementType()));
+            dtype::from_onnx(tensor_info.GetElementType()));
       }
 
       // Get output info
@@ -127,7 +180,7 @@ public:
         auto tensor_info = type_info.GetTensorTypeAndShapeInfo();
         info.output_shapes.push_back(tensor_info.GetShape());
         info.output_types.push_back(
-            onnx_type_to_string(tensor_info.GetElementType()));
+            dtype::from_onnx(tensor_info.GetElementType()));
       }
 
       auto duration = std::chrono::steady_clock::now() - start;
@@ -152,6 +205,7 @@ public:
                                   const InferenceRequest &request,
                                   const ModelInfo &info) {
     InferenceResponse response;
+    response.trace = request.trace;
     auto start = std::chrono::steady_clock::now();
 
     try {
@@ -166,7 +220,19 @@ public:
         input_names.push_back(input.name.c_str());
 
         // Create tensor from data
-        if (!input.float_data.empty()) {
+        if (input.external_data || !input.raw_data.empty()) {
+          auto element_type = dtype::to_onnx(input.dtype);
+          if (element_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED ||
+              element_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING) {
+            throw std::invalid_argument("Unsupported dtype for input '" +
+                                        input.name + "': " + input.dtype);
+          }
+          auto tensor = Ort::Value::CreateTensor(
+              memory_info, const_cast<void *>(input.data()),
+              input.byte_size(), input.shape.data(), input.shape.size(),
+              element_type);
+          input_tensors.push_back(std::move(tensor));
+        } else if (!input.float_data.empty()) {
           auto tensor = Ort::Value::CreateTensor<float>(
               memory_info, const_cast<float *>(input.float_data.data()),
               input.float_data.size(), input.shape.data(), input.shape.size());
@@ -186,9 +252,24 @@ public:
       }
 
       // Run inference
-      auto output_tensors = session.Run(
-          Ort::RunOptions{nullptr}, input_names.data(), input_tensors.data(),
-          input_tensors.size(), output_names.data(), output_names.size());
+      std::vector<Ort::Value> output_tensors;
+      std::vector<const OutputBuffer *> buffers;
+      if (!request.output_buffers.empty()) {
+        buffers = bind_output_buffers(request, info, memory_info,
+                                      output_tensors);
+      }
+      response.trace.mark(RequestTrace::RunStarted);
+      if (request.output_buffers.empty()) {
+        output_tensors = session.Run(
+            Ort::RunOptions{nullptr}, input_names.data(), input_tensors.data(),
+            input_tensors.size(), output_names.data(), output_names.size());
+      } else {
+        session.Run(Ort::RunOptions{nullptr}, input_names.data(),
+                    input_tensors.data(), input_tensors.size(),
+                    output_names.data(), output_tensors.data(),
+                    output_tensors.size());
+      }
+      response.trace.mark(RequestTrace::RunFinished);
 
       // Extract outputs
       for (size_t i = 0; i < output_tensors.size(); ++i) {
@@ -205,7 +286,10 @@ public:
         auto element_type = type_info.GetElementType();
         size_t element_count = type_info.GetElementCount();
 
-        if (element_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+        if (!buffers.empty() && buffers[i]) {
+          write_output_buffer(*buffers[i], tensor, element_type,
+                              element_count, output);
+        } else if (element_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
           const float *data = tensor.GetTensorData<float>();
           output.float_data.assign(data, data + element_count);
           output.dtype = "float32";
@@ -215,10 +299,15 @@ public:
           output.dtype = "int64";
         } else if (element_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32) {
           const int32_t *data = tensor.GetTensorData<int32_t>();
-          for (size_t j = 0; j < element_count; ++j) {
-            output.int_data.push_back(data[j]);
-          }
+          output.int_data.assign(data, data + element_count);
           output.dtype = "int32";
+        } else if (element_type != ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING) {
+          // Other fixed-width types are passed through as raw bytes
+          output.dtype = dtype::from_onnx(element_type);
+          const auto *data =
+              static_cast<const uint8_t *>(tensor.GetTensorRawData());
+          output.raw_data.assign(
+              data, data + element_count * dtype::element_size(output.dtype));
         }
 
         response.outputs.push_back(std::move(output));
@@ -226,7 +315,7 @@ public:
 
       response.success = true;
 
-    } catch (const Ort::Exception &e) {
+    } catch (const std::exception &e) {
       response.success = false;
       response.error = e.what();
       LOG_ERROR("Inference error: {}", e.what());
@@ -235,10 +324,79 @@ public:
     auto end = std::chrono::steady_clock::now();
     response.inference_time_ms =
         std::chrono::duration<double, std::milli>(end - start).count();
+    response.trace.mark(RequestTrace::Extracted, end);
 
     return response;
   }
 
+  /**
+   * Match output buffers to model outputs. An output with a fully static
+   * declared shape is pre-bound: ORT writes straight into the caller's
+   * buffer. Others are left for ORT to allocate (their shape is only known
+   * after Run) and copied over once by write_output_buffer().
+   */
+  static std::vector<const OutputBuffer *>
+  bind_output_buffers(const InferenceRequest &request, const ModelInfo &info,
+                      const Ort::MemoryInfo &memory_info,
+                      std::vector<Ort::Value> &output_tensors) {
+    std::vector<const OutputBuffer *> buffers(info.output_names.size(),
+                                              nullptr);
+    output_tensors.clear();
+    output_tensors.reserve(info.output_names.size());
+
+    for (size_t i = 0; i < info.output_names.size(); ++i) {
+      for (const auto &buffer : request.output_buffers) {
+        if (buffer.name == info.output_names[i])
+          buffers[i] = &buffer;
+      }
+
+      const OutputBuffer *buffer = buffers[i];
+      const auto &shape = info.output_shapes[i];
+      const std::string &type = info.output_types[i];
+      bool is_static = std::all_of(shape.begin(), shape.end(),
+                                   [](int64_t dim) { return dim >= 0; });
+      size_t bytes = dtype::element_count(shape) * dtype::element_size(type);
+
+      if (buffer && is_static && dtype::element_size(type) > 0 &&
+          bytes <= buffer->capacity) {
+        output_tensors.push_back(Ort::Value::CreateTensor(
+            memory_info, buffer->data, bytes, shape.data(), shape.size(),
+            dtype::to_onnx(type)));
+      } else {
+        output_tensors.emplace_back(nullptr);
+      }
+    }
+    return buffers;
+  }
+
+  /**
+   * Describe an output that lives in a caller buffer, copying it there
+   * first unless ORT already wrote it in place
+   */
+  static void write_output_buffer(const OutputBuffer &buffer,
+                                  Ort::Value &tensor,
+                                  ONNXTensorElementDataType element_type,
+                                  size_t element_count, TensorData &output) {
+    if (element_type == ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING) {
+      throw std::invalid_argument("String output '" + output.name +
+                                  "' cannot be written to a buffer");
+    }
+    output.dtype = dtype::from_onnx(element_type);
+    size_t bytes = element_count * dtype::element_size(output.dtype);
+    if (bytes > buffer.capacity) {
+      throw std::invalid_argument(
+          "Output '" + output.name + "' needs " + std::to_string(bytes) +
+          " bytes but its buffer holds " + std::to_string(buffer.capacity));
+    }
+
+    const void *data = tensor.GetTensorRawData();
+    if (data != buffer.data && bytes > 0)
+      std::memcpy(buffer.data, data, bytes);
+
+    output.external_data = buffer.data;
+    output.external_size = bytes;
+  }
+
   /**
    * Get the ONNX Runtime environment
    */
@@ -316,33 +474,6 @@ private:
     }
   }
 
-  static std::string onnx_type_to_string(ONNXTensorElementDataType type) {
-    switch (type) {
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
-      return "float32";
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
-      return "float64";
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
-      return "int32";
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
-      return "int64";
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
-      return "int8";
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
-      return "uint8";
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
-      return "int16";
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
-      return "uint16";
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
-      return "bool";
-    case ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING:
-      return "string";
-    default:
-      return "unknown";
-    }
-  }
-
   static std::string get_iso_timestamp() {
     auto now = std::chrono::system_clock::now();
     auto time = std::chrono::system_clock::to_time_t(now);
@@ -6,12 +6,17 @@
  *
  * Usage:
  *   onnx-server [options]
+ *   onnx-server run --model <name|path> --input <path> --output <path>
  *
  * Options:
  *   --config <path>      Path to configuration file (default: config.yaml)
  *   --models <path>      Path to models directory (overrides config)
  *   --port <port>        Server port (overrides config)
+ *   --unix-socket <path> Also serve on a Unix domain socket
  *   --help               Show this help message
+ *
+ * The `run` subcommand scores a file or directory offline through the
+ * batching engine and exits, without starting the HTTP server.
  */
 
 #include <atomic>
@@ -23,6 +28,7 @@
 #include "inference/model_registry.hpp"
 #include "inference/session_manager.hpp"
 #include "metrics/collector.hpp"
+#include "offline/offline_runner.hpp"
 #include "server/handlers.hpp"
 #include "server/http_server.hpp"
 #include "server/router.hpp"
@@ -47,12 +53,24 @@ struct CommandLineArgs {
   std::string config_path = "config.yaml";
   std::string models_path;
   int port = -1;
+  std::string unix_socket;
   bool help = false;
 
+  // `run` subcommand
+  bool offline = false;
+  OfflineOptions offline_options;
+  int batch_size = -1;
+
   static CommandLineArgs parse(int argc, char *argv[]) {
     CommandLineArgs args;
 
-    for (int i = 1; i < argc; ++i) {
+    int first = 1;
+    if (argc > 1 && std::string(argv[1]) == "run") {
+      args.offline = true;
+      first = 2;
+    }
+
+    for (int i = first; i < argc; ++i) {
       std::string arg = argv[i];
 
       if (arg == "--help" || arg == "-h") {
@@ -63,6 +81,20 @@ struct CommandLineArgs {
         args.models_path = argv[++i];
       } else if ((arg == "--port" || arg == "-p") && i + 1 < argc) {
         args.port = std::stoi(argv[++i]);
+      } else if (arg == "--unix-socket" && i + 1 < argc) {
+        args.unix_socket = argv[++i];
+      } else if (arg == "--model" && i + 1 < argc) {
+        args.offline_options.model = argv[++i];
+      } else if ((arg == "--input" || arg == "-i") && i + 1 < argc) {
+        args.offline_options.input = argv[++i];
+      } else if ((arg == "--output" || arg == "-o") && i + 1 < argc) {
+        args.offline_options.output = argv[++i];
+      } else if (arg == "--rows" && i + 1 < argc) {
+        args.offline_options.rows_per_request = std::stoll(argv[++i]);
+      } else if (arg == "--max-in-flight" && i + 1 < argc) {
+        args.offline_options.max_in_flight = std::stoul(argv[++i]);
+      } else if (arg == "--batch-size" && i + 1 < argc) {
+        args.batch_size = std::stoi(argv[++i]);
       }
     }
 
@@ -74,20 +106,34 @@ struct CommandLineArgs {
 ONNX Inference Server
 
 Usage: onnx-server [options]
+       onnx-server run --model <name|path> --input <path> --output <path>
 
 Options:
   -c, --config <path>   Path to configuration file (default: config.yaml)
   -m, --models <path>   Path to models directory (overrides config)
   -p, --port <port>     Server port (overrides config)
+  --unix-socket <path>  Also serve on a Unix domain socket (overrides config)
   -h, --help            Show this help message
 
+Offline batch inference (onnx-server run):
+  --model <name|path>   Model name in the models directory, or a .onnx file
+  -i, --input <path>    .npy, .npz or .ndjson file, or a directory of
+                        .npy/.npz files (one request per file)
+  -o, --output <path>   .ndjson or .npz file, or a directory
+  --rows <n>            Rows of a .npy/.npz input per request (default: 1)
+  --batch-size <n>      Maximum batch size (overrides batching.max_batch_size)
+  --max-in-flight <n>   Requests queued at the batcher (default: 4x batch size)
+
 Examples:
   onnx-server --config /etc/onnx-server/config.yaml
   onnx-server --models /models --port 8080
+  onnx-server run --model resnet50 --input images.npy --output scores.npz
   
 Environment Variables:
   ONNX_SERVER_HOST      Server bind address
   ONNX_SERVER_PORT      Server port
+  ONNX_SERVER_UNIX_SOCKET
+                        Unix domain socket path
   ONNX_MODELS_DIR       Models directory
   ONNX_LOG_LEVEL        Log level (debug, info, warn, error)
 
@@ -95,6 +141,40 @@ Environment Variables:
   }
 };
 
+/**
+ * `onnx-server run`: score inputs through the batching engine and exit
+ */
+int run_offline(Config &config, const CommandLineArgs &args) {
+  const auto &options = args.offline_options;
+  if (options.model.empty() || options.input.empty() ||
+      options.output.empty()) {
+    std::cerr << "run requires --model, --input and --output" << std::endl;
+    return 2;
+  }
+
+  // Offline scoring is all about throughput, so always batch
+  config.batching.enabled = true;
+  if (args.batch_size > 0)
+    config.batching.max_batch_size = args.batch_size;
+
+  try {
+    MetricsCollector metrics(config.metrics);
+    SessionManager session_manager(config.inference);
+    ModelRegistry model_registry(session_manager, config.models);
+    BatchExecutor batch_executor(model_registry, metrics, config.batching);
+    batch_executor.start();
+
+    OfflineRunner runner(model_registry, batch_executor, config, options);
+    int code = runner.run();
+
+    batch_executor.stop();
+    return code;
+  } catch (const std::exception &e) {
+    LOG_ERROR("Fatal error: {}", e.what());
+    return 1;
+  }
+}
+
 int main(int argc, char *argv[]) {
   // Parse command line
   auto args = CommandLineArgs::parse(argc, argv);
@@ -122,11 +202,17 @@ int main(int argc, char *argv[]) {
   if (args.port > 0) {
     config.server.port = args.port;
   }
+  if (!args.unix_socket.empty()) {
+    config.server.unix_socket = args.unix_socket;
+  }
 
   // Initialize logging
   Logger::instance().set_level(config.logging.level);
   Logger::instance().set_json_format(config.logging.format == "json");
 
+  if (args.offline)
+    return run_offline(config, args);
+
   LOG_INFO("Starting ONNX Inference Server v1.0.0");
   LOG_INFO("Configuration: {}", config.to_json().dump());
 
@@ -155,6 +241,8 @@ int main(int argc, char *argv[]) {
     // Setup handlers
     router.setup_error_handling();
     router.setup_request_logging();
+    router.setup_worker_metrics();
+    router.setup_compression(config.compression);
 
     Handlers handlers(model_registry, batch_executor, metrics, config);
     handlers.register_routes(router);
@@ -162,8 +250,11 @@ int main(int argc, char *argv[]) {
     // Start server in async mode
     http_server.start_async();
 
-    LOG_INFO("Server listening on {}:{}", config.server.host,
-             config.server.port);
+    if (config.server.tcp_enabled)
+      LOG_INFO("Server listening on {}:{}", config.server.host,
+               config.server.port);
+    if (!config.server.unix_socket.empty())
+      LOG_INFO("Server listening on unix:{}", config.server.unix_socket);
     LOG_INFO("Models directory: {}", config.models.directory);
     LOG_INFO("Loaded {} model(s)", model_registry.count());
 
@@ -178,6 +269,8 @@ int main(int argc, char *argv[]) {
     // Graceful shutdown
     LOG_INFO("Shutting down...");
 
+    handlers.stop_jobs();
+    handlers.stop_pipeline();
     batch_executor.stop();
     model_registry.stop_watcher();
     http_server.stop();
@@ -1,95 +1,178 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "metric_shard.hpp"
+#include "quantile_sketch.hpp"
 #include "utils/config.hpp"
 #include "utils/logging.hpp"
+#include "utils/request_trace.hpp"
 
 namespace onnx_server {
 
+namespace detail {
+
 /**
- * Histogram bucket for latency tracking
- * Uses pointer to atomic to allow vector storage
+ * One cache line of atomic cells, so shards never share a line
  */
-struct HistogramBucket {
-  double upper_bound;
-  mutable std::unique_ptr<std::atomic<uint64_t>> count;
-
-  HistogramBucket(double bound)
-      : upper_bound(bound), count(std::make_unique<std::atomic<uint64_t>>(0)) {}
-  HistogramBucket(HistogramBucket &&other) noexcept
-      : upper_bound(other.upper_bound), count(std::move(other.count)) {}
-  HistogramBucket &operator=(HistogramBucket &&other) noexcept {
-    upper_bound = other.upper_bound;
-    count = std::move(other.count);
-    return *this;
-  }
-  HistogramBucket(const HistogramBucket &) = delete;
-  HistogramBucket &operator=(const HistogramBucket &) = delete;
+struct alignas(CACHE_LINE) CellLine {
+  static constexpr size_t CELLS = CACHE_LINE / sizeof(std::atomic<uint64_t>);
+  std::atomic<uint64_t> cells[CELLS]{};
 };
 
+} // namespace detail
+
 /**
- * Histogram for latency metrics with percentile support
+ * Histogram for latency metrics
+ *
+ * Each thread records into its own shard of cache-line-aligned cells, so
+ * concurrent observations do not contend. An observation finds its bucket
+ * by binary search and increments only that bucket; cumulative counts, the
+ * total count and the sum are assembled from the shards on export.
  */
 class Histogram {
 public:
   explicit Histogram(const std::vector<double> &buckets = {0.001, 0.005, 0.01,
                                                            0.025, 0.05, 0.1,
-                                                           0.25, 0.5, 1.0}) {
-    buckets_.reserve(buckets.size() + 1);
-    for (double bound : buckets) {
-      buckets_.emplace_back(bound);
-    }
+                                                           0.25, 0.5, 1.0})
+      : bounds_(buckets) {
+    std::sort(bounds_.begin(), bounds_.end());
     // Add +Inf bucket
-    buckets_.emplace_back(std::numeric_limits<double>::infinity());
+    bounds_.push_back(std::numeric_limits<double>::infinity());
+
+    // Per shard: one cell per bucket, then the sum (a double's bits)
+    size_t cells = bounds_.size() + 1;
+    lines_per_shard_ =
+        (cells + detail::CellLine::CELLS - 1) / detail::CellLine::CELLS;
+    lines_ = std::make_unique<detail::CellLine[]>(detail::METRIC_SHARDS *
+                                                  lines_per_shard_);
   }
 
   void observe(double value) {
-    sum_.fetch_add(static_cast<uint64_t>(value * 1e9),
-                   std::memory_order_relaxed);
-    count_.fetch_add(1, std::memory_order_relaxed);
+    size_t shard = detail::metric_shard();
+    cell(shard, bucket_index(value)).fetch_add(1, std::memory_order_relaxed);
 
-    for (auto &bucket : buckets_) {
-      if (value <= bucket.upper_bound) {
-        bucket.count->fetch_add(1, std::memory_order_relaxed);
-      }
+    // Uncontended unless threads share the shard, so the loop rarely spins
+    auto &sum = cell(shard, sum_cell());
+    uint64_t old_bits = sum.load(std::memory_order_relaxed);
+    uint64_t new_bits;
+    do {
+      new_bits = to_bits(from_bits(old_bits) + value);
+    } while (!sum.compare_exchange_weak(old_bits, new_bits,
+                                        std::memory_order_relaxed));
+  }
+
+  /**
+   * Bucket `value` falls in: the first whose upper bound is >= value
+   * (NaN goes to +Inf)
+   */
+  size_t bucket_index(double value) const {
+    if (std::isnan(value))
+      return bounds_.size() - 1;
+    return static_cast<size_t>(
+        std::lower_bound(bounds_.begin(), bounds_.end() - 1, value) -
+        bounds_.begin());
+  }
+
+  uint64_t count() const {
+    uint64_t count = 0;
+    for (size_t i = 0; i < bounds_.size(); ++i) {
+      count += total(i);
     }
+    return count;
   }
 
-  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
   double sum() const {
-    return static_cast<double>(sum_.load(std::memory_order_relaxed)) / 1e9;
+    double sum = 0;
+    for (size_t shard = 0; shard < detail::METRIC_SHARDS; ++shard) {
+      sum += from_bits(cell(shard, sum_cell()).load(std::memory_order_relaxed));
+    }
+    return sum;
   }
 
-  const std::vector<HistogramBucket> &buckets() const { return buckets_; }
+  /**
+   * Upper bounds, the last one +Inf
+   */
+  const std::vector<double> &bounds() const { return bounds_; }
+
+  /**
+   * Cumulative count of each bucket, merged across shards
+   */
+  std::vector<uint64_t> bucket_counts() const {
+    std::vector<uint64_t> counts(bounds_.size());
+    uint64_t running = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+      running += total(i);
+      counts[i] = running;
+    }
+    return counts;
+  }
 
 private:
-  std::vector<HistogramBucket> buckets_;
-  std::atomic<uint64_t> count_{0};
-  std::atomic<uint64_t> sum_{0}; // Stored as nanoseconds for atomic operations
+  std::vector<double> bounds_;
+  size_t lines_per_shard_;
+  std::unique_ptr<detail::CellLine[]> lines_;
+
+  size_t sum_cell() const { return bounds_.size(); }
+
+  std::atomic<uint64_t> &cell(size_t shard, size_t index) const {
+    return lines_[shard * lines_per_shard_ + index / detail::CellLine::CELLS]
+        .cells[index % detail::CellLine::CELLS];
+  }
+
+  uint64_t total(size_t index) const {
+    uint64_t sum = 0;
+    for (size_t shard = 0; shard < detail::METRIC_SHARDS; ++shard) {
+      sum += cell(shard, index).load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+  static uint64_t to_bits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  static double from_bits(uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
 };
 
 /**
- * Counter metric
+ * Counter metric, sharded like Histogram
  */
 class Counter {
 public:
   void inc(uint64_t delta = 1) {
-    value_.fetch_add(delta, std::memory_order_relaxed);
+    shards_[detail::metric_shard()].cells[0].fetch_add(
+        delta, std::memory_order_relaxed);
   }
 
-  uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+  uint64_t value() const {
+    uint64_t sum = 0;
+    for (const auto &shard : shards_) {
+      sum += shard.cells[0].load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
 
 private:
-  std::atomic<uint64_t> value_{0};
+  std::array<detail::CellLine, detail::METRIC_SHARDS> shards_;
 };
 
 /**
@@ -120,22 +203,150 @@ private:
  */
 class MetricsCollector {
 public:
+  /**
+   * Responses of one route and method, by status class (1xx..5xx).
+   * Registered once by the router, so recording needs no lookup.
+   */
+  struct RouteMetrics {
+    RouteMetrics(std::string method, std::string endpoint)
+        : method(std::move(method)), endpoint(std::move(endpoint)) {}
+
+    std::string method;
+    std::string endpoint;
+    std::array<Counter, 5> responses;
+  };
+
+  /**
+   * Per-model counters and latency sketches: end-to-end (request received
+   * to response written), batch queue wait, and session run
+   */
+  struct ModelMetrics {
+    ModelMetrics(const std::shared_ptr<const SketchMapping> &mapping,
+                 const std::vector<double> &latency_buckets)
+        : end_to_end(mapping, SKETCH_SLOT, SKETCH_SLOTS),
+          queue(mapping, SKETCH_SLOT, SKETCH_SLOTS),
+          run(mapping, SKETCH_SLOT, SKETCH_SLOTS),
+          request_seconds(latency_buckets), queue_seconds(latency_buckets),
+          run_seconds(latency_buckets), batch_size(BATCH_SIZE_BUCKETS),
+          batch_fill(BATCH_FILL_BUCKETS) {}
+
+    Counter inferences;
+    WindowedSketch end_to_end;
+    WindowedSketch queue;
+    WindowedSketch run;
+
+    // The same three as Prometheus histograms
+    Histogram request_seconds;
+    Histogram queue_seconds;
+    Histogram run_seconds;
+    // The model's requests per executed batch, and that count as a
+    // fraction of batching.max_batch_size
+    Histogram batch_size;
+    Histogram batch_fill;
+  };
+
+  static inline const std::vector<double> BATCH_SIZE_BUCKETS = {
+      1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+  static inline const std::vector<double> BATCH_FILL_BUCKETS = {
+      0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 1.0};
+
+  // Sketch windows reach back 15 minutes in 10 second steps
+  static constexpr std::chrono::seconds SKETCH_SLOT{10};
+  static constexpr size_t SKETCH_SLOTS = 90;
+
+  /**
+   * One request pipeline stage (decode, execute, encode): queue depth,
+   * time spent queued, time spent running, and work refused on a full
+   * queue
+   */
+  struct StageMetrics {
+    explicit StageMetrics(const std::vector<double> &buckets)
+        : wait(buckets), duration(buckets) {}
+
+    Gauge depth;
+    Histogram wait;
+    Histogram duration;
+    Counter rejected;
+  };
+
+  /**
+   * Compression (direction "response") or decompression (direction
+   * "request") passes of one codec
+   */
+  struct CompressionMetrics {
+    explicit CompressionMetrics(std::string labels)
+        : labels(std::move(labels)) {}
+
+    std::string labels; // Prometheus label set
+    Counter operations;
+    Counter uncompressed_bytes;
+    Counter compressed_bytes;
+    Counter nanoseconds;
+  };
+
   explicit MetricsCollector(const MetricsConfig &config)
       : config_(config), request_latency_(config.latency_buckets),
         inference_latency_(config.latency_buckets),
         batch_latency_(config.latency_buckets),
-        start_time_(std::chrono::steady_clock::now()) {}
+        worker_queue_wait_(config.latency_buckets),
+        sketch_mapping_(std::make_shared<SketchMapping>(
+            config.quantile_accuracy, 1e-6, 1e4)),
+        start_time_(std::chrono::steady_clock::now()),
+        id_(next_id().fetch_add(1, std::memory_order_relaxed)) {
+    for (auto &phase : phase_latency_) {
+      phase = std::make_unique<Histogram>(config.latency_buckets);
+    }
+  }
 
   /**
-   * Record an HTTP request
+   * Handle for a route's request metrics; the same handle is returned for
+   * the same method and endpoint, and stays valid for the collector's life
    */
-  void record_request(const std::string &endpoint, const std::string &method,
-                      int status, double latency_seconds) {
-    std::string key = method + "_" + endpoint + "_" + std::to_string(status);
+  RouteMetrics &register_route(const std::string &method,
+                               const std::string &endpoint) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return routes_.try_emplace(method + " " + endpoint, method, endpoint)
+        .first->second;
+  }
 
-    {
-      std::lock_guard<std::mutex> lock(mutex_);
-      request_counts_[key].inc();
+  /**
+   * Handle for a model's metrics, created on first use
+   */
+  ModelMetrics &register_model(const std::string &model) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return models_
+        .try_emplace(model, sketch_mapping_, config_.latency_buckets)
+        .first->second;
+  }
+
+  /**
+   * Handle for a pipeline stage's metrics, created on first use
+   */
+  StageMetrics &register_stage(const std::string &stage) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stages_.try_emplace(stage, config_.latency_buckets).first->second;
+  }
+
+  /**
+   * Handle for one codec and direction's compression metrics, created on
+   * first use
+   */
+  CompressionMetrics &register_compression(const std::string &encoding,
+                                           const std::string &direction) {
+    std::string labels =
+        "encoding=\"" + encoding + "\",direction=\"" + direction + "\"";
+    std::lock_guard<std::mutex> lock(mutex_);
+    return compression_.try_emplace(labels, labels).first->second;
+  }
+
+  /**
+   * Record an HTTP request
+   */
+  void record_request(RouteMetrics &route, int status,
+                      double latency_seconds) {
+    int status_class = status / 100;
+    if (status_class >= 1 && status_class <= 5) {
+      route.responses[status_class - 1].inc();
     }
 
     requests_total_.inc();
@@ -147,14 +358,61 @@ public:
   }
 
   /**
-   * Record an inference operation
+   * Record an inference operation: session run time and time spent
+   * waiting in the batch queue
    */
-  void record_inference(const std::string &model, double latency_seconds) {
+  void record_inference(ModelMetrics &model, double latency_seconds,
+                        double queue_seconds = 0) {
     inference_total_.inc();
     inference_latency_.observe(latency_seconds);
+    model.inferences.inc();
 
+    auto now = WindowedSketch::Clock::now();
+    model.run.record(latency_seconds, now);
+    model.queue.record(queue_seconds, now);
+    model.run_seconds.observe(latency_seconds);
+    model.queue_seconds.observe(queue_seconds);
+  }
+
+  void record_inference(const std::string &model, double latency_seconds,
+                        double queue_seconds = 0) {
+    record_inference(cached_model(model), latency_seconds, queue_seconds);
+  }
+
+  /**
+   * Record a successful inference request end to end, from receipt to
+   * the response being ready
+   */
+  void record_model_request(const std::string &model,
+                            double latency_seconds) {
+    ModelMetrics &metrics = cached_model(model);
+    metrics.end_to_end.record(latency_seconds);
+    metrics.request_seconds.observe(latency_seconds);
+  }
+
+  /**
+   * Record the phases a successful inference request went through
+   */
+  void record_request_trace(const RequestTrace &trace) {
+    for (size_t i = 0; i < RequestTrace::PHASE_COUNT; ++i) {
+      double seconds = trace.phase_seconds(i);
+      if (seconds >= 0)
+        phase_latency_[i]->observe(seconds);
+    }
+  }
+
+  /**
+   * Visit every model's metrics, in name order, under the collector lock
+   */
+  template <typename F> void for_each_model(F &&visit) const {
     std::lock_guard<std::mutex> lock(mutex_);
-    model_inference_counts_[model].inc();
+    for (const auto &[name, model] : models_) {
+      visit(name, model);
+    }
+  }
+
+  double quantile_accuracy() const {
+    return sketch_mapping_->relative_accuracy();
   }
 
   /**
@@ -164,10 +422,23 @@ public:
     batches_total_.inc();
     batch_latency_.observe(latency_seconds);
 
-    std::lock_guard<std::mutex> lock(mutex_);
-    batch_sizes_.push_back(batch_size);
-    if (batch_sizes_.size() > 1000) {
-      batch_sizes_.erase(batch_sizes_.begin());
+    // Ring of the last RECENT_BATCHES sizes, averaged on export
+    uint64_t seen = batches_seen_.fetch_add(1, std::memory_order_relaxed);
+    recent_batch_sizes_[seen % RECENT_BATCHES].store(
+        batch_size, std::memory_order_relaxed);
+  }
+
+  /**
+   * Record one model's share of an executed batch: how many of its
+   * requests the batch held, out of at most `max_batch_size`
+   */
+  void record_model_batch(const std::string &model, size_t requests,
+                          size_t max_batch_size) {
+    ModelMetrics &metrics = cached_model(model);
+    metrics.batch_size.observe(static_cast<double>(requests));
+    if (max_batch_size > 0) {
+      metrics.batch_fill.observe(static_cast<double>(requests) /
+                                 static_cast<double>(max_batch_size));
     }
   }
 
@@ -179,6 +450,32 @@ public:
     model_load_times_[model] = load_time_seconds;
   }
 
+  /**
+   * Record one compression or decompression pass
+   */
+  void record_compression(CompressionMetrics &stats,
+                          size_t uncompressed_bytes, size_t compressed_bytes,
+                          double cpu_seconds) {
+    stats.operations.inc();
+    stats.uncompressed_bytes.inc(uncompressed_bytes);
+    stats.compressed_bytes.inc(compressed_bytes);
+    stats.nanoseconds.inc(static_cast<uint64_t>(cpu_seconds * 1e9));
+  }
+
+  /**
+   * HTTP worker queue: current depth, time a task waited for a worker,
+   * and work refused because the queue was full
+   */
+  void set_worker_queue_depth(size_t depth) {
+    worker_queue_depth_.set(static_cast<double>(depth));
+  }
+
+  void record_worker_queue_wait(double wait_seconds) {
+    worker_queue_wait_.observe(wait_seconds);
+  }
+
+  void record_worker_queue_rejection() { worker_queue_rejected_.inc(); }
+
   /**
    * Set number of active sessions
    */
@@ -219,6 +516,27 @@ public:
     export_histogram(ss, "onnx_request_duration_seconds", request_latency_);
     ss << "\n";
 
+    // Per-route responses
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!routes_.empty()) {
+        ss << "# HELP onnx_http_requests_total HTTP requests per route and "
+              "status class\n";
+        ss << "# TYPE onnx_http_requests_total counter\n";
+        for (const auto &[key, route] : routes_) {
+          for (size_t i = 0; i < route.responses.size(); ++i) {
+            uint64_t count = route.responses[i].value();
+            if (count == 0)
+              continue;
+            ss << "onnx_http_requests_total{method=\"" << route.method
+               << "\",endpoint=\"" << route.endpoint << "\",status=\""
+               << i + 1 << "xx\"} " << count << "\n";
+          }
+        }
+        ss << "\n";
+      }
+    }
+
     // Inference metrics
     ss << "# HELP onnx_inference_total Total number of inference requests\n";
     ss << "# TYPE onnx_inference_total counter\n";
@@ -232,18 +550,57 @@ public:
     // Per-model inference counts
     {
       std::lock_guard<std::mutex> lock(mutex_);
-      if (!model_inference_counts_.empty()) {
+      if (!models_.empty()) {
         ss << "# HELP onnx_model_inference_total Inference requests per "
               "model\n";
         ss << "# TYPE onnx_model_inference_total counter\n";
-        for (const auto &[model, counter] : model_inference_counts_) {
+        for (const auto &[model, stats] : models_) {
           ss << "onnx_model_inference_total{model=\"" << model << "\"} "
-             << counter.value() << "\n";
+             << stats.inferences.value() << "\n";
         }
         ss << "\n";
       }
     }
 
+    // Per-model distributions
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!models_.empty()) {
+        export_model_histogram(ss, "onnx_model_request_duration_seconds",
+                               "End-to-end request latency per model",
+                               &ModelMetrics::request_seconds);
+        export_model_histogram(ss, "onnx_model_queue_wait_seconds",
+                               "Batch queue wait per model",
+                               &ModelMetrics::queue_seconds);
+        export_model_histogram(ss, "onnx_model_run_duration_seconds",
+                               "Session run time per model",
+                               &ModelMetrics::run_seconds);
+        export_model_histogram(ss, "onnx_model_batch_size",
+                               "Requests of a model per executed batch",
+                               &ModelMetrics::batch_size);
+        export_model_histogram(ss, "onnx_model_batch_fill_ratio",
+                               "Batch size as a fraction of max_batch_size",
+                               &ModelMetrics::batch_fill);
+      }
+    }
+
+    // Per-model latency quantiles
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!models_.empty()) {
+        export_summary(ss, "onnx_model_request_seconds",
+                       "End-to-end request latency per model",
+                       &ModelMetrics::end_to_end,
+                       &ModelMetrics::request_seconds);
+        export_summary(ss, "onnx_model_queue_seconds",
+                       "Batch queue wait per model", &ModelMetrics::queue,
+                       &ModelMetrics::queue_seconds);
+        export_summary(ss, "onnx_model_run_seconds",
+                       "Session run time per model", &ModelMetrics::run,
+                       &ModelMetrics::run_seconds);
+      }
+    }
+
     // Batch metrics
     ss << "# HELP onnx_batches_total Total number of batch executions\n";
     ss << "# TYPE onnx_batches_total counter\n";
@@ -256,13 +613,15 @@ public:
 
     // Average batch size
     {
-      std::lock_guard<std::mutex> lock(mutex_);
-      if (!batch_sizes_.empty()) {
-        double avg_batch = 0;
-        for (auto size : batch_sizes_) {
-          avg_batch += size;
-        }
-        avg_batch /= batch_sizes_.size();
+      uint64_t seen = batches_seen_.load(std::memory_order_relaxed);
+      if (seen > 0) {
+        size_t count = static_cast<size_t>(
+            std::min<uint64_t>(seen, RECENT_BATCHES));
+        uint64_t sum = 0;
+        for (size_t i = 0; i < count; ++i)
+          sum += recent_batch_sizes_[i].load(std::memory_order_relaxed);
+        double avg_batch =
+            static_cast<double>(sum) / static_cast<double>(count);
 
         ss << "# HELP onnx_average_batch_size Average batch size\n";
         ss << "# TYPE onnx_average_batch_size gauge\n";
@@ -270,6 +629,145 @@ public:
       }
     }
 
+    // Compression
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      bool any = false;
+      for (const auto &[labels, stats] : compression_)
+        any = any || stats.operations.value() > 0;
+      if (any) {
+        ss << "# HELP onnx_compression_operations_total Compression and "
+              "decompression passes\n";
+        ss << "# TYPE onnx_compression_operations_total counter\n";
+        for (const auto &[labels, stats] : compression_) {
+          if (stats.operations.value() == 0)
+            continue;
+          ss << "onnx_compression_operations_total{" << labels << "} "
+             << stats.operations.value() << "\n";
+        }
+        ss << "\n";
+
+        ss << "# HELP onnx_compression_uncompressed_bytes_total Bytes before "
+              "compression\n";
+        ss << "# TYPE onnx_compression_uncompressed_bytes_total counter\n";
+        for (const auto &[labels, stats] : compression_) {
+          if (stats.operations.value() == 0)
+            continue;
+          ss << "onnx_compression_uncompressed_bytes_total{" << labels << "} "
+             << stats.uncompressed_bytes.value() << "\n";
+        }
+        ss << "\n";
+
+        ss << "# HELP onnx_compression_compressed_bytes_total Bytes after "
+              "compression\n";
+        ss << "# TYPE onnx_compression_compressed_bytes_total counter\n";
+        for (const auto &[labels, stats] : compression_) {
+          if (stats.operations.value() == 0)
+            continue;
+          ss << "onnx_compression_compressed_bytes_total{" << labels << "} "
+             << stats.compressed_bytes.value() << "\n";
+        }
+        ss << "\n";
+
+        ss << "# HELP onnx_compression_ratio Cumulative uncompressed / "
+              "compressed size\n";
+        ss << "# TYPE onnx_compression_ratio gauge\n";
+        for (const auto &[labels, stats] : compression_) {
+          if (stats.operations.value() == 0)
+            continue;
+          uint64_t compressed = stats.compressed_bytes.value();
+          ss << "onnx_compression_ratio{" << labels << "} "
+             << (compressed ? static_cast<double>(
+                                  stats.uncompressed_bytes.value()) /
+                                  compressed
+                            : 0.0)
+             << "\n";
+        }
+        ss << "\n";
+
+        ss << "# HELP onnx_compression_seconds_total CPU time spent "
+              "compressing and decompressing\n";
+        ss << "# TYPE onnx_compression_seconds_total counter\n";
+        for (const auto &[labels, stats] : compression_) {
+          if (stats.operations.value() == 0)
+            continue;
+          ss << "onnx_compression_seconds_total{" << labels << "} "
+             << stats.nanoseconds.value() / 1e9 << "\n";
+        }
+        ss << "\n";
+      }
+    }
+
+    // Worker queue
+    ss << "# HELP onnx_worker_queue_depth Tasks waiting for an HTTP worker\n";
+    ss << "# TYPE onnx_worker_queue_depth gauge\n";
+    ss << "onnx_worker_queue_depth " << worker_queue_depth_.value() << "\n\n";
+
+    ss << "# HELP onnx_worker_queue_wait_seconds Time spent waiting for an "
+          "HTTP worker\n";
+    ss << "# TYPE onnx_worker_queue_wait_seconds histogram\n";
+    export_histogram(ss, "onnx_worker_queue_wait_seconds", worker_queue_wait_);
+    ss << "\n";
+
+    ss << "# HELP onnx_worker_queue_rejected_total Work refused because the "
+          "worker queue was full\n";
+    ss << "# TYPE onnx_worker_queue_rejected_total counter\n";
+    ss << "onnx_worker_queue_rejected_total " << worker_queue_rejected_.value()
+       << "\n\n";
+
+    // Request phases
+    ss << "# HELP onnx_request_phase_seconds Time successful inference "
+          "requests spent in each phase\n";
+    ss << "# TYPE onnx_request_phase_seconds histogram\n";
+    for (size_t i = 0; i < RequestTrace::PHASE_COUNT; ++i) {
+      export_histogram(ss, "onnx_request_phase_seconds", *phase_latency_[i],
+                       std::string("phase=\"") + RequestTrace::PHASES[i] +
+                           "\"");
+    }
+    ss << "\n";
+
+    // Pipeline stages
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!stages_.empty()) {
+        ss << "# HELP onnx_stage_queue_depth Work waiting for a pipeline "
+              "stage\n";
+        ss << "# TYPE onnx_stage_queue_depth gauge\n";
+        for (const auto &[stage, stats] : stages_) {
+          ss << "onnx_stage_queue_depth{stage=\"" << stage << "\"} "
+             << stats.depth.value() << "\n";
+        }
+        ss << "\n";
+
+        ss << "# HELP onnx_stage_queue_wait_seconds Time spent queued for a "
+              "pipeline stage\n";
+        ss << "# TYPE onnx_stage_queue_wait_seconds histogram\n";
+        for (const auto &[stage, stats] : stages_) {
+          export_histogram(ss, "onnx_stage_queue_wait_seconds", stats.wait,
+                           "stage=\"" + stage + "\"");
+        }
+        ss << "\n";
+
+        ss << "# HELP onnx_stage_duration_seconds Time spent in a pipeline "
+              "stage\n";
+        ss << "# TYPE onnx_stage_duration_seconds histogram\n";
+        for (const auto &[stage, stats] : stages_) {
+          export_histogram(ss, "onnx_stage_duration_seconds", stats.duration,
+                           "stage=\"" + stage + "\"");
+        }
+        ss << "\n";
+
+        ss << "# HELP onnx_stage_rejected_total Work refused because a "
+              "stage queue was full\n";
+        ss << "# TYPE onnx_stage_rejected_total counter\n";
+        for (const auto &[stage, stats] : stages_) {
+          ss << "onnx_stage_rejected_total{stage=\"" << stage << "\"} "
+             << stats.rejected.value() << "\n";
+        }
+        ss << "\n";
+      }
+    }
+
     // Gauges
     ss << "# HELP onnx_active_sessions Currently active inference sessions\n";
     ss << "# TYPE onnx_active_sessions gauge\n";
@@ -291,37 +789,128 @@ private:
   Counter request_errors_;
   Counter inference_total_;
   Counter batches_total_;
+  Counter worker_queue_rejected_;
 
   // Histograms
   Histogram request_latency_;
   Histogram inference_latency_;
   Histogram batch_latency_;
+  Histogram worker_queue_wait_;
+  // By RequestTrace phase
+  std::array<std::unique_ptr<Histogram>, RequestTrace::PHASE_COUNT>
+      phase_latency_;
 
   // Gauges
   Gauge active_sessions_;
   Gauge loaded_models_;
+  Gauge worker_queue_depth_;
 
-  // Per-model/endpoint metrics
-  std::unordered_map<std::string, Counter> request_counts_;
-  std::unordered_map<std::string, Counter> model_inference_counts_;
   std::unordered_map<std::string, double> model_load_times_;
-  std::vector<size_t> batch_sizes_;
-
+  static constexpr size_t RECENT_BATCHES = 1000;
+  std::array<std::atomic<uint64_t>, RECENT_BATCHES> recent_batch_sizes_{};
+  std::atomic<uint64_t> batches_seen_{0};
+
+  // Handles; map nodes keep references stable
+  std::map<std::string, RouteMetrics> routes_; // Keyed by "METHOD endpoint"
+  std::map<std::string, ModelMetrics> models_;
+  std::map<std::string, StageMetrics> stages_;
+  // Keyed by Prometheus label set (encoding, direction)
+  std::map<std::string, CompressionMetrics> compression_;
+
+  std::shared_ptr<const SketchMapping> sketch_mapping_;
   std::chrono::steady_clock::time_point start_time_;
 
+  const uint64_t id_; // Tells collectors apart in thread-local caches
+
+  static std::atomic<uint64_t> &next_id() {
+    static std::atomic<uint64_t> id{1};
+    return id;
+  }
+
+  /**
+   * Model handle through a per-thread cache, so a thread takes the lock
+   * only the first time it records a given model
+   */
+  ModelMetrics &cached_model(const std::string &model) {
+    thread_local uint64_t owner = 0;
+    thread_local std::unordered_map<std::string, ModelMetrics *> cache;
+    if (owner != id_) {
+      cache.clear();
+      owner = id_;
+    }
+    auto it = cache.find(model);
+    if (it == cache.end()) {
+      it = cache.emplace(model, &register_model(model)).first;
+    }
+    return *it->second;
+  }
+
+  /**
+   * One sketch of every model as a Prometheus summary; quantiles cover the
+   * last `quantile_window_sec`, sum and count all time, taken from the
+   * histogram recorded alongside the sketch. Caller holds mutex_.
+   */
+  void export_summary(std::stringstream &ss, const std::string &name,
+                      const std::string &help,
+                      WindowedSketch ModelMetrics::*sketch,
+                      Histogram ModelMetrics::*totals) const {
+    static const std::vector<double> quantiles = {0.5, 0.9, 0.95, 0.99};
+    std::chrono::seconds window(std::max(1, config_.quantile_window_sec));
+
+    ss << "# HELP " << name << " " << help << "\n";
+    ss << "# TYPE " << name << " summary\n";
+    for (const auto &[model, stats] : models_) {
+      auto summary = (stats.*sketch).summarize(window, quantiles);
+      const Histogram &all_time = stats.*totals;
+      for (size_t i = 0; i < quantiles.size(); ++i) {
+        ss << name << "{model=\"" << model << "\",quantile=\""
+           << quantiles[i] << "\"} " << summary.values[i] << "\n";
+      }
+      ss << name << "_sum{model=\"" << model << "\"} " << all_time.sum()
+         << "\n";
+      ss << name << "_count{model=\"" << model << "\"} "
+         << all_time.count() << "\n";
+    }
+    ss << "\n";
+  }
+
+  /**
+   * One histogram of every model, labelled by model. Caller holds mutex_.
+   */
+  void export_model_histogram(std::stringstream &ss, const std::string &name,
+                              const std::string &help,
+                              Histogram ModelMetrics::*histogram) const {
+    ss << "# HELP " << name << " " << help << "\n";
+    ss << "# TYPE " << name << " histogram\n";
+    for (const auto &[model, stats] : models_) {
+      export_histogram(ss, name, stats.*histogram,
+                       "model=\"" + model + "\"");
+    }
+    ss << "\n";
+  }
+
+  /**
+   * Histogram series, with `labels` (e.g. `stage="decode"`) added to each
+   */
   void export_histogram(std::stringstream &ss, const std::string &name,
-                        const Histogram &hist) const {
-    for (const auto &bucket : hist.buckets()) {
-      ss << name << "_bucket{le=\"";
-      if (std::isinf(bucket.upper_bound)) {
+                        const Histogram &hist,
+                        const std::string &labels = "") const {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+    const auto &bounds = hist.bounds();
+    std::vector<uint64_t> counts = hist.bucket_counts();
+    for (size_t i = 0; i < bounds.size(); ++i) {
+      ss << name << "_bucket{" << prefix << "le=\"";
+      if (std::isinf(bounds[i])) {
         ss << "+Inf";
       } else {
-        ss << bucket.upper_bound;
+        ss << bounds[i];
       }
-      ss << "\"} " << bucket.count->load(std::memory_order_relaxed) << "\n";
+      ss << "\"} " << counts[i] << "\n";
     }
-    ss << name << "_sum " << hist.sum() << "\n";
-    ss << name << "_count " << hist.count() << "\n";
+    ss << name << "_sum" << suffix << " " << hist.sum() << "\n";
+    // The +Inf bucket, so the two always agree
+    ss << name << "_count" << suffix << " " << counts.back() << "\n";
   }
 };
 
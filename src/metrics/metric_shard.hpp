@@ -0,0 +1,26 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace onnx_server {
+
+namespace detail {
+
+constexpr size_t CACHE_LINE = 64;
+constexpr size_t METRIC_SHARDS = 16;
+
+/**
+ * Shard of the calling thread, assigned round-robin on first use. Threads
+ * that share a shard still update it atomically, just less often.
+ */
+inline size_t metric_shard() {
+  static std::atomic<size_t> next{0};
+  thread_local size_t shard =
+      next.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+  return shard;
+}
+
+} // namespace detail
+
+} // namespace onnx_server
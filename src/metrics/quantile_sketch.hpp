@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "metric_shard.hpp"
+
+namespace onnx_server {
+
+/**
+ * Bucket layout of a DDSketch: bucket k holds values in
+ * (gamma^(k-1), gamma^k] with gamma = (1 + a) / (1 - a), so reporting the
+ * bucket's midpoint 2 gamma^k / (gamma + 1) is within relative error `a`
+ * of any value in it. The range is fixed: values at or below `min_value`
+ * share the first bucket and values at or above `max_value` the last.
+ * Sketches with the same layout merge by adding counts.
+ */
+class SketchMapping {
+public:
+  SketchMapping(double relative_accuracy, double min_value, double max_value)
+      : accuracy_(std::clamp(relative_accuracy, 1e-4, 0.5)),
+        min_value_(min_value), max_value_(max_value) {
+    gamma_ = (1 + accuracy_) / (1 - accuracy_);
+    inv_log_gamma_ = 1 / std::log(gamma_);
+    first_ = raw_index(min_value_);
+    size_ = static_cast<size_t>(raw_index(max_value_) - first_ + 1);
+  }
+
+  double relative_accuracy() const { return accuracy_; }
+  size_t size() const { return size_; }
+
+  size_t index(double value) const {
+    if (!(value > min_value_)) // Also NaN
+      return 0;
+    if (value >= max_value_)
+      return size_ - 1;
+    return static_cast<size_t>(raw_index(value) - first_);
+  }
+
+  /**
+   * Representative value of a bucket
+   */
+  double value(size_t index) const {
+    return 2 * std::pow(gamma_, static_cast<double>(first_) + index) /
+           (gamma_ + 1);
+  }
+
+private:
+  double accuracy_;
+  double min_value_;
+  double max_value_;
+  double gamma_;
+  double inv_log_gamma_;
+  long first_;
+  size_t size_;
+
+  long raw_index(double value) const {
+    return static_cast<long>(std::ceil(std::log(value) * inv_log_gamma_));
+  }
+};
+
+/**
+ * Quantile sketch of recent observations, queryable over sliding windows
+ * up to `slot * slots` long
+ *
+ * Time is cut into slots, each with its own bucket counts, kept in a ring;
+ * a query merges the slots inside its window, so the window's far edge is
+ * exact to one slot. Recording is one log and one relaxed increment into
+ * the calling thread's shard of the slot, so threads do not contend; slot
+ * counts are allocated when the slot is first used. All-time count and
+ * sum are left to a Histogram fed the same observations.
+ */
+class WindowedSketch {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Summary {
+    uint64_t count = 0;
+    std::vector<double> values; // One per requested quantile; 0 if empty
+  };
+
+  WindowedSketch(std::shared_ptr<const SketchMapping> mapping,
+                 std::chrono::seconds slot, size_t slots)
+      : mapping_(std::move(mapping)),
+        slot_(std::max<Clock::duration>(slot, std::chrono::seconds(1))),
+        slots_(std::max<size_t>(slots, 1)),
+        lines_per_shard_((mapping_->size() + CountLine::COUNTS - 1) /
+                         CountLine::COUNTS) {}
+
+  void record(double value) { record(value, Clock::now()); }
+
+  void record(double value, Clock::time_point now) {
+    Slot &slot = slot_for(epoch(now));
+    count(slot, detail::metric_shard() % SHARDS, mapping_->index(value))
+        .fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Quantiles (each in [0, 1]) of the observations in the last `window`
+   */
+  Summary summarize(std::chrono::seconds window,
+                    const std::vector<double> &quantiles,
+                    Clock::time_point now = Clock::now()) const {
+    std::vector<uint64_t> counts(mapping_->size());
+    Summary summary;
+
+    int64_t current = epoch(now);
+    int64_t span = std::clamp<int64_t>(
+        (std::chrono::duration_cast<Clock::duration>(window) + slot_ -
+         Clock::duration(1)) /
+            slot_,
+        1, static_cast<int64_t>(slots_.size()));
+    {
+      std::lock_guard<std::mutex> lock(rotate_mutex_);
+      for (const auto &slot : slots_) {
+        int64_t slot_epoch = slot.epoch.load(std::memory_order_relaxed);
+        if (!slot.lines || slot_epoch > current ||
+            slot_epoch <= current - span)
+          continue;
+        for (size_t shard = 0; shard < SHARDS; ++shard) {
+          for (size_t i = 0; i < counts.size(); ++i) {
+            uint64_t n =
+                count(slot, shard, i).load(std::memory_order_relaxed);
+            counts[i] += n;
+            summary.count += n;
+          }
+        }
+      }
+    }
+
+    summary.values.reserve(quantiles.size());
+    for (double q : quantiles) {
+      summary.values.push_back(quantile(counts, summary.count, q));
+    }
+    return summary;
+  }
+
+  std::chrono::seconds max_window() const {
+    return std::chrono::duration_cast<std::chrono::seconds>(slot_ *
+                                                            slots_.size());
+  }
+
+private:
+  // Fewer shards than Histogram's: every slot of the window holds a copy
+  // of the bucket counts per shard
+  static constexpr size_t SHARDS = 4;
+
+  /**
+   * One cache line of bucket counts, so shards never share a line
+   */
+  struct alignas(detail::CACHE_LINE) CountLine {
+    static constexpr size_t COUNTS =
+        detail::CACHE_LINE / sizeof(std::atomic<uint32_t>);
+    std::atomic<uint32_t> counts[COUNTS]{};
+  };
+
+  struct Slot {
+    std::atomic<int64_t> epoch{-1};
+    std::unique_ptr<CountLine[]> lines; // lines_per_shard_ per shard
+  };
+
+  std::shared_ptr<const SketchMapping> mapping_;
+  Clock::duration slot_;
+  std::vector<Slot> slots_;
+  size_t lines_per_shard_;
+  mutable std::mutex rotate_mutex_;
+
+  std::atomic<uint32_t> &count(const Slot &slot, size_t shard,
+                               size_t index) const {
+    return slot.lines[shard * lines_per_shard_ + index / CountLine::COUNTS]
+        .counts[index % CountLine::COUNTS];
+  }
+
+  int64_t epoch(Clock::time_point now) const {
+    return now.time_since_epoch() / slot_;
+  }
+
+  /**
+   * The slot of `epoch`, reset first if it still holds an older epoch
+   */
+  Slot &slot_for(int64_t epoch) {
+    Slot &slot = slots_[static_cast<size_t>(epoch) % slots_.size()];
+    if (slot.epoch.load(std::memory_order_acquire) == epoch)
+      return slot;
+
+    std::lock_guard<std::mutex> lock(rotate_mutex_);
+    if (slot.epoch.load(std::memory_order_relaxed) != epoch) {
+      size_t lines = SHARDS * lines_per_shard_;
+      if (!slot.lines) {
+        slot.lines = std::make_unique<CountLine[]>(lines);
+      } else {
+        for (size_t i = 0; i < lines; ++i) {
+          for (auto &n : slot.lines[i].counts)
+            n.store(0, std::memory_order_relaxed);
+        }
+      }
+      slot.epoch.store(epoch, std::memory_order_release);
+    }
+    return slot;
+  }
+
+  double quantile(const std::vector<uint64_t> &counts, uint64_t total,
+                  double q) const {
+    if (total == 0)
+      return 0;
+    auto rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * (total - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+      seen += counts[i];
+      if (seen > rank)
+        return mapping_->value(i);
+    }
+    return mapping_->value(counts.size() - 1);
+  }
+};
+
+} // namespace onnx_server
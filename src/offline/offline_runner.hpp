@@ -0,0 +1,557 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "inference/batch_executor.hpp"
+#include "inference/batch_merge.hpp"
+#include "inference/model_registry.hpp"
+#include "server/content_codec.hpp"
+#include "server/json_writer.hpp"
+#include "server/npy.hpp"
+#include "server/tensor_codec.hpp"
+#include "utils/config.hpp"
+#include "utils/logging.hpp"
+
+namespace onnx_server {
+
+namespace fs = std::filesystem;
+
+/**
+ * Options for `onnx-server run`
+ */
+struct OfflineOptions {
+  std::string model;  // Name in models.directory, or a path to a .onnx file
+  std::string input;  // .npy, .npz or .ndjson file, or a directory of .npy/.npz
+  std::string output; // .ndjson or .npz file, or a directory
+  int64_t rows_per_request = 1; // Rows of a .npy/.npz file per request
+  size_t max_in_flight = 0;     // Submitted, unwritten requests (0 = auto)
+  size_t prefetch = 0;          // Decoded requests read ahead (0 = auto)
+};
+
+/**
+ * Blocking bounded FIFO between pipeline stages
+ */
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity)
+      : capacity_(std::max<size_t>(1, capacity)) {}
+
+  void push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+  }
+
+  /**
+   * Take the next item; false once the queue is closed and drained
+   */
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    if (items_.empty())
+      return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  std::deque<T> items_;
+  bool closed_ = false;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
+
+/**
+ * Offline batch scoring through the same registry, session manager and
+ * batch executor as the HTTP server, without HTTP.
+ *
+ * Three stages run concurrently: a reader thread decodes inputs ahead into
+ * a bounded queue, the calling thread submits them to the batcher keeping
+ * up to `max_in_flight` outstanding (so it always has full batches to
+ * form), and a writer thread collects results in input order.
+ */
+class OfflineRunner {
+public:
+  OfflineRunner(ModelRegistry &model_registry, BatchExecutor &batch_executor,
+                const Config &config, OfflineOptions options)
+      : model_registry_(model_registry), batch_executor_(batch_executor),
+        config_(config), options_(std::move(options)) {
+    size_t batch = std::max<size_t>(1, config_.batching.max_batch_size);
+    if (options_.max_in_flight == 0)
+      options_.max_in_flight = 4 * batch;
+    if (options_.prefetch == 0)
+      options_.prefetch = options_.max_in_flight;
+    options_.rows_per_request = std::max<int64_t>(1, options_.rows_per_request);
+  }
+
+  /**
+   * Score every input and write the results. Returns the process exit code.
+   */
+  int run() {
+    if (!load_model() || !open_output())
+      return 1;
+
+    BoundedQueue<Item> decoded(options_.prefetch);
+    BoundedQueue<Item> in_flight(options_.max_in_flight);
+
+    auto start = std::chrono::steady_clock::now();
+    bool read_ok = true;
+
+    std::thread reader([&] {
+      try {
+        read_inputs(decoded);
+      } catch (const std::exception &e) {
+        LOG_ERROR("Failed to read {}: {}", options_.input, e.what());
+        read_ok = false;
+      }
+      decoded.close();
+    });
+    std::thread writer([&] { write_results(in_flight); });
+
+    Item item;
+    while (decoded.pop(item)) {
+      item.submitted = std::chrono::steady_clock::now();
+      if (item.error.empty())
+        item.result = batch_executor_.submit(std::move(item.request));
+      in_flight.push(std::move(item));
+    }
+    in_flight.close();
+
+    reader.join();
+    writer.join();
+    bool write_ok = close_output();
+
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    print_summary(elapsed);
+    return read_ok && write_ok && errors_ == 0 ? 0 : 1;
+  }
+
+private:
+  enum class OutputKind { Ndjson, Npz, Directory };
+
+  /**
+   * One request moving through the pipeline
+   */
+  struct Item {
+    size_t index = 0;
+    std::string id;
+    int64_t rows = 1;
+    InferenceRequest request;
+    std::shared_ptr<const std::string> backing; // Borrowed input buffers
+    std::string error;
+    std::future<InferenceResponse> result;
+    std::chrono::steady_clock::time_point submitted;
+  };
+
+  ModelRegistry &model_registry_;
+  BatchExecutor &batch_executor_;
+  const Config &config_;
+  OfflineOptions options_;
+
+  std::string model_name_;
+  ModelInfo info_;
+
+  OutputKind output_kind_ = OutputKind::Directory;
+  std::ofstream ndjson_;
+  std::vector<std::vector<TensorData>> collected_; // Npz output
+  size_t next_index_ = 0;
+
+  // Written by the writer thread, read after it is joined
+  size_t instances_ = 0;
+  size_t rows_ = 0;
+  size_t errors_ = 0;
+  std::vector<double> latencies_ms_;
+
+  bool load_model() {
+    fs::path path(options_.model);
+    if (path.extension() == ".onnx") {
+      model_name_ = path.stem().string();
+    } else {
+      model_name_ = options_.model;
+      path = fs::path(config_.models.directory) / (model_name_ + ".onnx");
+    }
+
+    if (!fs::exists(path)) {
+      LOG_ERROR("Model file not found: {}", path.string());
+      return false;
+    }
+    if (!model_registry_.load(path.string(), model_name_))
+      return false;
+    info_ = *model_registry_.get(model_name_);
+    return true;
+  }
+
+  bool open_output() {
+    fs::path path(options_.output);
+    std::string ext = path.extension().string();
+    if (ext == ".ndjson" || ext == ".jsonl") {
+      output_kind_ = OutputKind::Ndjson;
+      ndjson_.open(path, std::ios::binary | std::ios::trunc);
+      if (!ndjson_) {
+        LOG_ERROR("Cannot open output file: {}", options_.output);
+        return false;
+      }
+    } else if (ext == ".npz") {
+      output_kind_ = OutputKind::Npz;
+    } else {
+      output_kind_ = OutputKind::Directory;
+      std::error_code ec;
+      fs::create_directories(path, ec);
+      if (!fs::is_directory(path)) {
+        LOG_ERROR("Cannot create output directory: {}", options_.output);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Reader stage
+
+  void read_inputs(BoundedQueue<Item> &queue) {
+    fs::path path(options_.input);
+    if (fs::is_directory(path)) {
+      std::vector<fs::path> files;
+      for (const auto &entry : fs::directory_iterator(path)) {
+        std::string ext = entry.path().extension().string();
+        if (entry.is_regular_file() && (ext == ".npy" || ext == ".npz"))
+          files.push_back(entry.path());
+      }
+      std::sort(files.begin(), files.end());
+      for (const auto &file : files)
+        read_array_file(file, false, queue);
+      return;
+    }
+
+    std::string ext = path.extension().string();
+    if (ext == ".ndjson" || ext == ".jsonl") {
+      read_ndjson(path, queue);
+    } else if (ext == ".npy" || ext == ".npz") {
+      read_array_file(path, true, queue);
+    } else {
+      throw std::invalid_argument(
+          "Unsupported input (expected .npy, .npz, .ndjson or a directory)");
+    }
+  }
+
+  Item make_item() {
+    Item item;
+    item.index = next_index_++;
+    item.id = std::to_string(item.index);
+    item.request.model_name = model_name_;
+    item.request.request_id = "offline-" + item.id;
+    return item;
+  }
+
+  void read_ndjson(const fs::path &path, BoundedQueue<Item> &queue) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      throw std::runtime_error("cannot open file");
+
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos)
+        continue;
+
+      Item item = make_item();
+      try {
+        json extra =
+            content_codec::decode_json_instance(line, item.request.inputs);
+        if (extra.contains("id"))
+          item.id = extra["id"].is_string() ? extra["id"].get<std::string>()
+                                            : extra["id"].dump();
+        if (!item.request.inputs.empty())
+          item.rows = std::max<int64_t>(
+              1, batch_merge::rows(item.request.inputs.front()));
+      } catch (const std::exception &e) {
+        item.error = e.what();
+      }
+      queue.push(std::move(item));
+    }
+  }
+
+  /**
+   * A .npy file feeds the model's only input; .npz members are matched to
+   * inputs by name. A single input file is split into requests of
+   * `rows_per_request` rows; each file of a directory is one request.
+   */
+  void read_array_file(const fs::path &path, bool split_rows,
+                       BoundedQueue<Item> &queue) {
+    auto data = std::make_shared<std::string>();
+    {
+      std::ifstream in(path, std::ios::binary);
+      if (!in)
+        throw std::runtime_error("cannot open " + path.string());
+      data->assign(std::istreambuf_iterator<char>(in),
+                   std::istreambuf_iterator<char>());
+    }
+
+    std::vector<TensorData> tensors;
+    if (path.extension() == ".npy") {
+      if (info_.input_names.size() != 1)
+        throw std::invalid_argument(
+            "a .npy input needs a single-input model; use .npz");
+      TensorData tensor;
+      tensor.name = info_.input_names.front();
+      npy::parse_npy(data->data(), data->size(), tensor);
+      tensors.push_back(std::move(tensor));
+    } else {
+      tensors = npy::parse_npz(*data);
+    }
+
+    if (!split_rows) {
+      Item item = make_item();
+      item.id = path.stem().string();
+      item.request.inputs = std::move(tensors);
+      if (!item.request.inputs.empty())
+        item.rows = std::max<int64_t>(
+            1, batch_merge::rows(item.request.inputs.front()));
+      item.backing = std::move(data);
+      queue.push(std::move(item));
+      return;
+    }
+
+    int64_t total = tensors.empty() ? 0 : batch_merge::rows(tensors.front());
+    for (const auto &tensor : tensors) {
+      if (total <= 0 || batch_merge::rows(tensor) != total)
+        throw std::invalid_argument(
+            "all arrays need the same non-empty first dimension");
+    }
+
+    for (int64_t begin = 0; begin < total;
+         begin += options_.rows_per_request) {
+      int64_t count = std::min(options_.rows_per_request, total - begin);
+      Item item = make_item();
+      item.rows = count;
+      for (const auto &tensor : tensors)
+        item.request.inputs.push_back(
+            batch_merge::slice_rows(tensor, begin, count));
+      queue.push(std::move(item));
+    }
+  }
+
+  // Writer stage
+
+  void write_results(BoundedQueue<Item> &queue) {
+    Item item;
+    while (queue.pop(item)) {
+      InferenceResponse response;
+      if (item.error.empty()) {
+        response = item.result.get();
+        if (!response.success)
+          item.error = response.error;
+      }
+      latencies_ms_.push_back(std::chrono::duration<double, std::milli>(
+                                  std::chrono::steady_clock::now() -
+                                  item.submitted)
+                                  .count());
+      ++instances_;
+      rows_ += static_cast<size_t>(item.rows);
+
+      if (!item.error.empty()) {
+        ++errors_;
+        LOG_ERROR("Instance {} ({}) failed: {}", item.index, item.id,
+                  item.error);
+      }
+
+      try {
+        write_result(item, response);
+      } catch (const std::exception &e) {
+        ++errors_;
+        LOG_ERROR("Failed to write result {}: {}", item.id, e.what());
+      }
+    }
+  }
+
+  void write_result(const Item &item, InferenceResponse &response) {
+    switch (output_kind_) {
+    case OutputKind::Ndjson: {
+      JsonWriter writer(config_.server.json_float_precision);
+      writer.begin_object();
+      writer.key("index").value(item.index);
+      writer.key("id").value(item.id);
+      if (item.error.empty()) {
+        writer.key("outputs").tensors(response.outputs);
+      } else {
+        writer.key("error").value(item.error);
+      }
+      writer.end_object();
+      std::string line = writer.take();
+      line += '\n';
+      ndjson_.write(line.data(), static_cast<std::streamsize>(line.size()));
+      break;
+    }
+    case OutputKind::Npz:
+      if (item.error.empty())
+        collected_.push_back(std::move(response.outputs));
+      break;
+    case OutputKind::Directory: {
+      if (!item.error.empty())
+        break;
+      std::string payload;
+      std::string ext;
+      if (response.outputs.size() == 1) {
+        payload = npy::write_npy(response.outputs.front());
+        ext = ".npy";
+      } else {
+        std::vector<const TensorData *> outputs;
+        for (const auto &output : response.outputs)
+          outputs.push_back(&output);
+        payload = npy::write_npz(outputs);
+        ext = ".npz";
+      }
+      write_file(fs::path(options_.output) / (file_stem(item) + ext),
+                 payload);
+      break;
+    }
+    }
+  }
+
+  /**
+   * An id is only used as a file name if it stays inside the output
+   * directory; anything else falls back to the instance index
+   */
+  static std::string file_stem(const Item &item) {
+    const std::string &id = item.id;
+    if (id.empty() || id == "." || id == ".." ||
+        id.find_first_of(std::string("/\\:\0", 4)) != std::string::npos)
+      return std::to_string(item.index);
+    return id;
+  }
+
+  static void write_file(const fs::path &path, const std::string &payload) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    if (!out)
+      throw std::runtime_error("cannot write " + path.string());
+  }
+
+  /** Whether two outputs agree on name, dtype and all but the first dim */
+  static bool same_layout(const TensorData &a, const TensorData &b) {
+    return a.name == b.name && a.dtype == b.dtype && !a.shape.empty() &&
+           a.shape.size() == b.shape.size() &&
+           std::equal(a.shape.begin() + 1, a.shape.end(), b.shape.begin() + 1);
+  }
+
+  /**
+   * Flush the output; an .npz output concatenates every result along
+   * dimension 0 and is only written if all instances succeeded and agree
+   * on each output's dtype and trailing shape
+   */
+  bool close_output() {
+    if (output_kind_ == OutputKind::Ndjson) {
+      ndjson_.close();
+      if (!ndjson_) {
+        LOG_ERROR("Failed to write {}", options_.output);
+        return false;
+      }
+      return true;
+    }
+    if (output_kind_ != OutputKind::Npz)
+      return true;
+
+    if (errors_ > 0) {
+      LOG_ERROR("Not writing {}: {} instance(s) failed", options_.output,
+                errors_);
+      return false;
+    }
+    if (collected_.empty())
+      return true;
+
+    std::vector<TensorData> merged;
+    for (size_t i = 0; i < collected_.front().size(); ++i) {
+      TensorData output;
+      output.name = collected_.front()[i].name;
+      output.dtype = collected_.front()[i].dtype;
+      output.shape = collected_.front()[i].shape;
+      if (output.shape.empty()) {
+        LOG_ERROR("Output '{}' has no batch dimension to concatenate",
+                  output.name);
+        return false;
+      }
+      output.shape[0] = 0;
+      for (size_t n = 0; n < collected_.size(); ++n) {
+        const auto &outputs = collected_[n];
+        if (outputs.size() != collected_.front().size() ||
+            !same_layout(outputs[i], collected_.front()[i])) {
+          LOG_ERROR("Cannot concatenate output '{}': result {} has a "
+                    "different dtype or trailing shape",
+                    output.name, n);
+          return false;
+        }
+        append_tensor_bytes(output.raw_data, outputs[i]);
+        output.shape[0] += outputs[i].shape[0];
+      }
+      merged.push_back(std::move(output));
+    }
+
+    std::vector<const TensorData *> outputs;
+    for (const auto &output : merged)
+      outputs.push_back(&output);
+    try {
+      write_file(options_.output, npy::write_npz(outputs));
+    } catch (const std::exception &e) {
+      LOG_ERROR("Failed to write {}: {}", options_.output, e.what());
+      return false;
+    }
+    return true;
+  }
+
+  void print_summary(double elapsed_sec) {
+    std::vector<double> sorted = latencies_ms_;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double q) {
+      if (sorted.empty())
+        return 0.0;
+      size_t rank = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+      return sorted[std::min(rank, sorted.size() - 1)];
+    };
+    double mean = 0;
+    for (double ms : sorted)
+      mean += ms;
+    if (!sorted.empty())
+      mean /= static_cast<double>(sorted.size());
+    double seconds = elapsed_sec > 0 ? elapsed_sec : 1e-9;
+
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer),
+                  "Scored %zu instance(s) (%zu rows) with '%s' in %.3f s\n"
+                  "  throughput: %.1f instances/s, %.1f rows/s\n"
+                  "  latency ms: mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  "
+                  "max %.2f\n"
+                  "  errors: %zu\n",
+                  instances_, rows_, model_name_.c_str(), elapsed_sec,
+                  instances_ / seconds, rows_ / seconds, mean,
+                  percentile(0.50), percentile(0.90), percentile(0.99),
+                  sorted.empty() ? 0.0 : sorted.back(), errors_);
+    std::cout << buffer << std::flush;
+  }
+};
+
+} // namespace onnx_server
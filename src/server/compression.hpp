@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+#include <zlib.h>
+#endif
+
+#ifdef ONNX_SERVER_ZSTD_SUPPORT
+#include <zstd.h>
+#endif
+
+namespace onnx_server {
+
+/**
+ * HTTP content codings used for response compression and request bodies.
+ *
+ * gzip is available when the build defines CPPHTTPLIB_ZLIB_SUPPORT (which
+ * also makes cpp-httplib inflate gzip/deflate request bodies; the epoll
+ * backend leaves them to decompress_gzip()); zstd when it defines
+ * ONNX_SERVER_ZSTD_SUPPORT.
+ */
+namespace compression {
+
+enum class Codec { Identity, Gzip, Zstd };
+
+inline const char *name(Codec codec) {
+  switch (codec) {
+  case Codec::Gzip:
+    return "gzip";
+  case Codec::Zstd:
+    return "zstd";
+  default:
+    return "identity";
+  }
+}
+
+/**
+ * Whether this build can produce `codec`
+ */
+inline bool available(Codec codec) {
+  switch (codec) {
+  case Codec::Identity:
+    return true;
+  case Codec::Gzip:
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    return true;
+#else
+    return false;
+#endif
+  case Codec::Zstd:
+#ifdef ONNX_SERVER_ZSTD_SUPPORT
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+namespace detail {
+
+inline std::string normalize(std::string coding) {
+  coding.erase(0, coding.find_first_not_of(' '));
+  coding.erase(coding.find_last_not_of(' ') + 1);
+  std::transform(coding.begin(), coding.end(), coding.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return coding;
+}
+
+} // namespace detail
+
+/**
+ * Parse a coding name ("gzip", "x-gzip", "zstd"); false if unknown
+ */
+inline bool from_name(std::string coding, Codec &codec) {
+  coding = detail::normalize(std::move(coding));
+
+  if (coding == "gzip" || coding == "x-gzip") {
+    codec = Codec::Gzip;
+    return true;
+  }
+  if (coding == "zstd") {
+    codec = Codec::Zstd;
+    return true;
+  }
+  if (coding == "identity") {
+    codec = Codec::Identity;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Parse a request Content-Encoding. Unlike from_name() this accepts
+ * "deflate", whose zlib stream decompress_gzip() also inflates; it is
+ * never chosen for responses.
+ */
+inline bool from_content_encoding(const std::string &coding, Codec &codec) {
+  if (from_name(coding, codec))
+    return true;
+  if (detail::normalize(coding) == "deflate") {
+    codec = Codec::Gzip;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Choose a response coding from Accept-Encoding. Among the codings the
+ * client accepts (q > 0), the highest q wins and ties go to the server's
+ * `preferred` order. Only codings this build supports are considered.
+ */
+inline Codec negotiate(const std::string &accept_encoding,
+                       const std::vector<Codec> &preferred) {
+  if (accept_encoding.empty())
+    return Codec::Identity;
+
+  Codec best = Codec::Identity;
+  double best_q = 0.0;
+  size_t best_rank = preferred.size();
+
+  size_t pos = 0;
+  while (pos < accept_encoding.size()) {
+    size_t comma = accept_encoding.find(',', pos);
+    if (comma == std::string::npos)
+      comma = accept_encoding.size();
+    std::string item = accept_encoding.substr(pos, comma - pos);
+    pos = comma + 1;
+
+    double q = 1.0;
+    auto semicolon = item.find(';');
+    if (semicolon != std::string::npos) {
+      auto q_pos = item.find("q=", semicolon);
+      if (q_pos != std::string::npos)
+        q = std::atof(item.c_str() + q_pos + 2);
+      item.resize(semicolon);
+    }
+    if (q <= 0.0)
+      continue;
+
+    auto consider = [&](Codec codec) {
+      auto it = std::find(preferred.begin(), preferred.end(), codec);
+      if (it == preferred.end() || !available(codec))
+        return;
+      size_t rank = static_cast<size_t>(it - preferred.begin());
+      if (q > best_q || (q == best_q && rank < best_rank)) {
+        best = codec;
+        best_q = q;
+        best_rank = rank;
+      }
+    };
+
+    Codec codec;
+    if (item.find('*') != std::string::npos) {
+      for (Codec candidate : preferred)
+        consider(candidate);
+    } else if (from_name(item, codec) && codec != Codec::Identity) {
+      consider(codec);
+    }
+  }
+  return best;
+}
+
+/**
+ * Compress `size` bytes into `out`. Returns false if the codec is not
+ * available or the library reports an error.
+ */
+inline bool compress(Codec codec, const char *data, size_t size, int level,
+                     std::string &out) {
+  switch (codec) {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+  case Codec::Gzip: {
+    z_stream stream{};
+    // windowBits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
+
+    out.resize(deflateBound(&stream, static_cast<uLong>(size)));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+
+    int ret = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return ret == Z_STREAM_END;
+  }
+#endif
+#ifdef ONNX_SERVER_ZSTD_SUPPORT
+  case Codec::Zstd: {
+    out.resize(ZSTD_compressBound(size));
+    size_t written = ZSTD_compress(&out[0], out.size(), data, size, level);
+    if (ZSTD_isError(written))
+      return false;
+    out.resize(written);
+    return true;
+  }
+#endif
+  default:
+    // Without zlib or zstd no case above uses the buffers
+    (void)data;
+    (void)size;
+    (void)level;
+    (void)out;
+    return false;
+  }
+}
+
+/**
+ * Outcome of inflating a request body
+ */
+enum class Inflate { Ok, Invalid, TooLarge };
+
+/**
+ * Inflate a gzip or zlib (HTTP "deflate") request body into `out`,
+ * refusing to produce more than `max_size` bytes
+ */
+inline Inflate decompress_gzip(const std::string &in, size_t max_size,
+                               std::string &out) {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+  z_stream stream{};
+  // windowBits 15 + 32 detects the gzip or zlib header
+  if (inflateInit2(&stream, 15 + 32) != Z_OK)
+    return Inflate::Invalid;
+
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+  stream.avail_in = static_cast<uInt>(in.size());
+  std::vector<char> chunk(64 * 1024);
+  Inflate result = Inflate::Ok;
+  int ret = Z_OK;
+
+  out.clear();
+  while (ret != Z_STREAM_END) {
+    stream.next_out = reinterpret_cast<Bytef *>(chunk.data());
+    stream.avail_out = static_cast<uInt>(chunk.size());
+    ret = inflate(&stream, Z_NO_FLUSH);
+    size_t produced = chunk.size() - stream.avail_out;
+    // Z_BUF_ERROR without output means the stream ended early
+    if ((ret != Z_OK && ret != Z_STREAM_END) ||
+        (ret == Z_OK && produced == 0 && stream.avail_in == 0)) {
+      result = Inflate::Invalid;
+      break;
+    }
+    if (produced > max_size - out.size()) {
+      result = Inflate::TooLarge;
+      break;
+    }
+    out.append(chunk.data(), produced);
+  }
+
+  inflateEnd(&stream);
+  return result;
+#else
+  (void)in;
+  (void)max_size;
+  (void)out;
+  return Inflate::Invalid;
+#endif
+}
+
+/**
+ * Inflate a zstd request body into `out`, refusing to produce more than
+ * `max_size` bytes
+ */
+inline Inflate decompress_zstd(const std::string &in, size_t max_size,
+                               std::string &out) {
+#ifdef ONNX_SERVER_ZSTD_SUPPORT
+  ZSTD_DStream *stream = ZSTD_createDStream();
+  if (!stream)
+    return Inflate::Invalid;
+
+  ZSTD_inBuffer input = {in.data(), in.size(), 0};
+  std::vector<char> chunk(ZSTD_DStreamOutSize());
+  Inflate result = Inflate::Ok;
+  size_t ret = 1;
+
+  out.clear();
+  while (ret != 0 && result == Inflate::Ok) {
+    ZSTD_outBuffer output = {chunk.data(), chunk.size(), 0};
+    ret = ZSTD_decompressStream(stream, &output, &input);
+    if (ZSTD_isError(ret)) {
+      result = Inflate::Invalid;
+      break;
+    }
+    if (output.pos > max_size - out.size()) {
+      result = Inflate::TooLarge;
+      break;
+    }
+    out.append(chunk.data(), output.pos);
+    // Truncated frame: no input left and the decoder made no progress
+    if (ret != 0 && input.pos == input.size && output.pos < output.size)
+      result = Inflate::Invalid;
+  }
+
+  ZSTD_freeDStream(stream);
+  return result;
+#else
+  (void)in;
+  (void)max_size;
+  (void)out;
+  return Inflate::Invalid;
+#endif
+}
+
+/**
+ * Content types not worth compressing (already compressed or streamed)
+ */
+inline bool compressible(const std::string &content_type) {
+  return content_type.find("text/event-stream") == std::string::npos &&
+         content_type.find("application/zip") == std::string::npos &&
+         content_type.find("application/gzip") == std::string::npos &&
+         content_type.find("application/zstd") == std::string::npos;
+}
+
+} // namespace compression
+
+} // namespace onnx_server
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "httplib.h"
+#include "inference/session_manager.hpp"
+#include "json.hpp"
+#include "json_tensor_parser.hpp"
+#include "tensor_codec.hpp"
+
+namespace onnx_server {
+
+using json = nlohmann::json;
+
+/**
+ * Document encodings negotiated through Content-Type and Accept. All three
+ * map onto the same nlohmann::json document model; MessagePack and CBOR
+ * additionally carry tensors as native binary (typed array) values.
+ */
+enum class Encoding { Json, MsgPack, Cbor };
+
+namespace content_codec {
+
+inline const char *content_type(Encoding encoding) {
+  switch (encoding) {
+  case Encoding::MsgPack:
+    return "application/msgpack";
+  case Encoding::Cbor:
+    return "application/cbor";
+  default:
+    return "application/json";
+  }
+}
+
+inline const char *name(Encoding encoding) {
+  switch (encoding) {
+  case Encoding::MsgPack:
+    return "MessagePack";
+  case Encoding::Cbor:
+    return "CBOR";
+  default:
+    return "JSON";
+  }
+}
+
+/**
+ * Match a single media type (parameters ignored); false if unsupported
+ */
+inline bool from_media_type(std::string media_type, Encoding &encoding) {
+  auto semicolon = media_type.find(';');
+  if (semicolon != std::string::npos)
+    media_type.resize(semicolon);
+  media_type.erase(0, media_type.find_first_not_of(' '));
+  media_type.erase(media_type.find_last_not_of(' ') + 1);
+  std::transform(media_type.begin(), media_type.end(), media_type.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+
+  if (media_type == "application/msgpack" ||
+      media_type == "application/x-msgpack" ||
+      media_type == "application/vnd.msgpack") {
+    encoding = Encoding::MsgPack;
+    return true;
+  }
+  if (media_type == "application/cbor") {
+    encoding = Encoding::Cbor;
+    return true;
+  }
+  if (media_type == "application/json" || media_type == "text/json") {
+    encoding = Encoding::Json;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Encoding of the request body (JSON unless Content-Type says otherwise)
+ */
+inline Encoding request_encoding(const httplib::Request &req) {
+  Encoding encoding = Encoding::Json;
+  from_media_type(req.get_header_value("Content-Type"), encoding);
+  return encoding;
+}
+
+/**
+ * Pick the response encoding from the Accept header. Wildcards or a missing
+ * header answer in the request's own encoding.
+ */
+inline Encoding response_encoding(const httplib::Request &req,
+                                  Encoding fallback = Encoding::Json) {
+  std::string accept = req.get_header_value("Accept");
+  if (accept.empty())
+    return fallback;
+
+  Encoding best = fallback;
+  double best_q = -1.0;
+
+  size_t pos = 0;
+  while (pos < accept.size()) {
+    size_t comma = accept.find(',', pos);
+    if (comma == std::string::npos)
+      comma = accept.size();
+    std::string range = accept.substr(pos, comma - pos);
+    pos = comma + 1;
+
+    double q = 1.0;
+    auto q_pos = range.find(";q=");
+    if (q_pos != std::string::npos) {
+      q = std::atof(range.c_str() + q_pos + 3);
+    }
+
+    Encoding candidate;
+    if (from_media_type(range, candidate)) {
+      if (q > best_q) {
+        best = candidate;
+        best_q = q;
+      }
+    } else if (range.find("*/*") != std::string::npos ||
+               range.find("application/*") != std::string::npos) {
+      if (q > best_q) {
+        best = fallback;
+        best_q = q;
+      }
+    }
+  }
+  return best;
+}
+
+/**
+ * Decode a request body; throws json::exception on malformed input
+ */
+inline json decode(const std::string &body, Encoding encoding) {
+  switch (encoding) {
+  case Encoding::MsgPack:
+    return json::from_msgpack(body);
+  case Encoding::Cbor:
+    // Keep tags so RFC 8746 typed arrays reach us as tagged binaries
+    return json::from_cbor(body, true, true, json::cbor_tag_handler_t::store);
+  default:
+    return json::parse(body);
+  }
+}
+
+/**
+ * Encode a response document
+ */
+inline std::string encode(const json &document, Encoding encoding) {
+  switch (encoding) {
+  case Encoding::MsgPack: {
+    std::string out;
+    json::to_msgpack(document, out);
+    return out;
+  }
+  case Encoding::Cbor: {
+    std::string out;
+    json::to_cbor(document, out);
+    return out;
+  }
+  default:
+    return document.dump();
+  }
+}
+
+/**
+ * RFC 8746 little-endian typed array tag for a dtype (0 if none)
+ */
+inline uint64_t cbor_tag_for(const std::string &dtype) {
+  if (dtype == "uint8")
+    return 64;
+  if (dtype == "uint16")
+    return 69;
+  if (dtype == "uint32")
+    return 70;
+  if (dtype == "uint64")
+    return 71;
+  if (dtype == "int8")
+    return 72;
+  if (dtype == "int16")
+    return 77;
+  if (dtype == "int32")
+    return 78;
+  if (dtype == "int64")
+    return 79;
+  if (dtype == "float16")
+    return 84;
+  if (dtype == "float32")
+    return 85;
+  if (dtype == "float64")
+    return 86;
+  return 0;
+}
+
+/**
+ * dtype of an RFC 8746 typed array tag; sets `big_endian` for the BE
+ * variants. Empty for tags that are not typed arrays.
+ */
+inline std::string dtype_for_cbor_tag(uint64_t tag, bool &big_endian) {
+  big_endian = false;
+  switch (tag) {
+  case 64:
+  case 68:
+    return "uint8";
+  case 72:
+    return "int8";
+  case 65:
+    big_endian = true;
+    [[fallthrough]];
+  case 69:
+    return "uint16";
+  case 66:
+    big_endian = true;
+    [[fallthrough]];
+  case 70:
+    return "uint32";
+  case 67:
+    big_endian = true;
+    [[fallthrough]];
+  case 71:
+    return "uint64";
+  case 73:
+    big_endian = true;
+    [[fallthrough]];
+  case 77:
+    return "int16";
+  case 74:
+    big_endian = true;
+    [[fallthrough]];
+  case 78:
+    return "int32";
+  case 75:
+    big_endian = true;
+    [[fallthrough]];
+  case 79:
+    return "int64";
+  case 80:
+    big_endian = true;
+    [[fallthrough]];
+  case 84:
+    return "float16";
+  case 81:
+    big_endian = true;
+    [[fallthrough]];
+  case 85:
+    return "float32";
+  case 82:
+    big_endian = true;
+    [[fallthrough]];
+  case 86:
+    return "float64";
+  default:
+    return "";
+  }
+}
+
+/**
+ * Move a binary `data` value into a tensor buffer. CBOR typed array tags
+ * override the declared dtype; big-endian arrays are swapped in place.
+ * (MessagePack ext types also surface as subtypes and are ignored.)
+ */
+inline void take_binary_data(json &data, TensorData &tensor,
+                             Encoding encoding) {
+  auto &binary = data.get_ref<json::binary_t &>();
+
+  if (encoding == Encoding::Cbor && binary.has_subtype()) {
+    bool big_endian = false;
+    std::string tagged = dtype_for_cbor_tag(binary.subtype(), big_endian);
+    if (!tagged.empty()) {
+      tensor.dtype = tagged;
+      size_t width = dtype::element_size(tagged);
+      if (big_endian && width > 1) {
+        for (size_t i = 0; i + width <= binary.size(); i += width) {
+          std::reverse(binary.begin() + i, binary.begin() + i + width);
+        }
+      }
+    }
+  }
+
+  tensor.raw_data = std::move(static_cast<std::vector<uint8_t> &>(binary));
+}
+
+/**
+ * Output tensor as a native binary value (tagged typed array for CBOR)
+ */
+inline json binary_tensor(const TensorData &tensor, Encoding encoding) {
+  std::vector<uint8_t> buffer;
+  buffer.reserve(tensor.byte_size());
+  append_tensor_bytes(buffer, tensor);
+
+  uint64_t tag = encoding == Encoding::Cbor ? cbor_tag_for(tensor.dtype) : 0;
+  if (tag != 0) {
+    return json::binary(std::move(buffer), tag);
+  }
+  return json::binary(std::move(buffer));
+}
+
+/**
+ * Flatten a nested JSON `data` array into a tensor; int64 tensors keep
+ * exact integers, everything else is stored as float data. The buffer grows
+ * with the values actually present; the declared shape is not trusted to
+ * size it.
+ */
+inline void json_tensor_data(const json &data, TensorData &tensor) {
+  bool as_int = tensor.dtype == "int64";
+
+  std::function<void(const json &)> flatten = [&](const json &arr) {
+    if (arr.is_array()) {
+      for (const auto &item : arr) {
+        flatten(item);
+      }
+    } else if (as_int && arr.is_number()) {
+      tensor.int_data.push_back(arr.is_number_float()
+                                    ? static_cast<int64_t>(arr.get<double>())
+                                    : arr.get<int64_t>());
+    } else if (arr.is_number_float()) {
+      tensor.float_data.push_back(arr.get<float>());
+    } else if (arr.is_number_integer()) {
+      tensor.float_data.push_back(static_cast<float>(arr.get<int64_t>()));
+    }
+  };
+
+  flatten(data);
+}
+
+/**
+ * Decode the `inputs` object of a v1 request document (JSON DOM,
+ * MessagePack or CBOR) into tensors
+ */
+inline void decode_inputs(json &inputs, Encoding encoding,
+                          std::vector<TensorData> &out) {
+  for (auto &[name, tensor] : inputs.items()) {
+    TensorData input;
+    input.name = name;
+
+    if (tensor.contains("shape")) {
+      input.shape = tensor["shape"].get<std::vector<int64_t>>();
+    }
+
+    if (tensor.contains("dtype")) {
+      input.dtype = tensor["dtype"];
+    }
+
+    if (tensor.contains("data")) {
+      // Handle different data types
+      if (tensor["data"].is_array()) {
+        json_tensor_data(tensor["data"], input);
+      } else if (tensor["data"].is_binary()) {
+        // MessagePack bin / CBOR byte string or typed array
+        take_binary_data(tensor["data"], input, encoding);
+        auto expected = dtype::checked_byte_size(
+            input.shape, dtype::element_size(input.dtype));
+        if (!expected || input.raw_data.size() != *expected) {
+          throw std::invalid_argument("Binary data of input '" + name +
+                                      "' does not match its shape and dtype");
+        }
+      }
+    }
+
+    out.push_back(std::move(input));
+  }
+}
+
+/**
+ * Decode one JSON v1 request document (an NDJSON line) into packed input
+ * tensors. Returns the document's other top-level members (e.g. "id").
+ */
+inline json decode_json_instance(std::string_view document,
+                                 std::vector<TensorData> &inputs) {
+  json extra = json::object();
+  JsonTensorParser::Result result;
+  if (JsonTensorParser(document).parse(result)) {
+    if (!result.has_inputs)
+      throw std::invalid_argument("Missing 'inputs' field");
+    inputs = std::move(result.inputs);
+    extra = std::move(result.extra);
+  } else {
+    json parsed = json::parse(document.begin(), document.end());
+    if (!parsed.is_object() || !parsed.contains("inputs"))
+      throw std::invalid_argument("Missing 'inputs' field");
+    decode_inputs(parsed["inputs"], Encoding::Json, inputs);
+    parsed.erase("inputs");
+    extra = std::move(parsed);
+  }
+
+  // JSON numbers arrive as float32/int64; pack them as the declared dtype
+  for (auto &input : inputs) {
+    coerce_to_dtype(input);
+  }
+  return extra;
+}
+
+} // namespace content_codec
+
+} // namespace onnx_server
@@ -0,0 +1,4 @@
+#include "deferred_response.hpp"
+
+// Implementation is header-only for this module
+// This file exists for build system compatibility
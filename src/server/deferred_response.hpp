@@ -0,0 +1,86 @@
+#pragma once
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace onnx_server {
+
+/**
+ * Lets a handler complete its response after it returns, from any thread,
+ * so that it does not hold a worker while its request waits elsewhere.
+ *
+ * A backend that can send a response later publishes a Backend scope
+ * around each handler call. Each layer in between that has work to do
+ * once the response is complete (logging, metrics) publishes a Layer
+ * scope inside it. A handler that calls detach() gets a Completion and
+ * marks every enclosing scope detached. A scope's owner must then return
+ * without touching the response; its callback finishes the response
+ * instead. The handler keeps writing the same Response, must not throw
+ * after detaching, and calls the Completion exactly once when the
+ * response is ready. That runs the callbacks innermost first.
+ *
+ * Without a Backend scope, e.g. under cpp-httplib, detach() returns an
+ * empty Completion and the handler must finish before it returns.
+ */
+class DeferredResponse {
+public:
+  using Completion = std::function<void()>;
+
+  class Scope {
+  public:
+    enum class Role { Backend, Layer };
+
+    explicit Scope(Completion on_complete, Role role = Role::Layer)
+        : on_complete_(std::move(on_complete)), role_(role),
+          outer_(current()) {
+      current() = this;
+    }
+    ~Scope() { current() = outer_; }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    bool detached() const { return detached_; }
+
+  private:
+    friend class DeferredResponse;
+
+    Completion on_complete_;
+    Role role_;
+    Scope *outer_;
+    bool detached_ = false;
+  };
+
+  /**
+   * Take over completing the current response, or an empty Completion if
+   * the backend cannot send it later or it is already detached
+   */
+  static Completion detach() {
+    Scope *root = current();
+    if (!root || root->detached_)
+      return {};
+    while (root->outer_)
+      root = root->outer_;
+    if (root->role_ != Scope::Role::Backend)
+      return {};
+
+    std::vector<Completion> chain;
+    for (Scope *scope = current(); scope; scope = scope->outer_) {
+      scope->detached_ = true;
+      chain.push_back(scope->on_complete_);
+    }
+    return [chain = std::move(chain)] {
+      for (const auto &step : chain)
+        step();
+    };
+  }
+
+private:
+  static Scope *&current() {
+    thread_local Scope *scope = nullptr;
+    return scope;
+  }
+};
+
+} // namespace onnx_server
@@ -0,0 +1,1816 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "deferred_response.hpp"
+#include "httplib.h"
+#include "unix_socket.hpp"
+#include "utils/logging.hpp"
+#include "utils/request_trace.hpp"
+#include "utils/thread_pool.hpp"
+#include "websocket.hpp"
+
+namespace onnx_server {
+
+/**
+ * Event-driven HTTP/1.1 backend for HttpServer (Linux only)
+ *
+ * N event loops each own an epoll instance and a SO_REUSEPORT listener on
+ * the same address, so the kernel spreads accepted connections across
+ * loops. Sockets are non-blocking; requests (including pipelined ones) are
+ * parsed incrementally into httplib::Request objects, so Router and
+ * Handlers run unchanged. Handlers execute on the worker ThreadPool and
+ * post their serialized response back to the owning loop through an
+ * eventfd; an idle keep-alive connection therefore costs no thread, and a
+ * handler blocked on the batcher never stalls other connections.
+ *
+ * Responses on one connection are written in request order: the next
+ * pipelined request is dispatched once the previous response is queued.
+ * A content provider's body is posted piece by piece as the worker
+ * produces it (chunked when its length is unknown), at most STREAM_WINDOW
+ * bytes ahead of what the socket has taken.
+ *
+ * A connection upgraded to WebSocket instead carries independent messages:
+ * each one goes to a worker as soon as it is complete and its reply is
+ * written whenever it is ready, so replies may overtake each other. Reading
+ * pauses while `websocket_max_in_flight` messages await a reply.
+ */
+class EpollServer {
+public:
+  using Handler =
+      std::function<void(const httplib::Request &, httplib::Response &)>;
+  using PreRoutingHandler = std::function<httplib::Server::HandlerResponse(
+      const httplib::Request &, httplib::Response &)>;
+  using ExceptionHandler =
+      std::function<void(const httplib::Request &, httplib::Response &,
+                         std::exception_ptr)>;
+  // Status for an `Expect: 100-continue` header block: 100 invites the
+  // body, anything else is sent (with `res`) and the connection closed
+  using ExpectContinueHandler =
+      std::function<int(const httplib::Request &, httplib::Response &)>;
+  // Accepts a WebSocket upgrade by returning the connection's session, or
+  // refuses it by returning nullptr with an error status set in `res`
+  using WebSocketOpener = std::function<std::shared_ptr<websocket::Session>(
+      const httplib::Request &, httplib::Response &,
+      std::shared_ptr<websocket::Channel>)>;
+
+  struct Options {
+    std::string host = "0.0.0.0";
+    int port = 8080;
+    bool tcp = true;
+    std::string unix_path; // Also accept on this Unix socket when set
+    int unix_mode = 0660;
+    size_t loops = 0; // 0 = one per hardware thread
+    size_t keep_alive_max_count = 100;
+    int keep_alive_timeout_sec = 30;
+    int read_timeout_sec = 30;
+    int write_timeout_sec = 30; // Streamed body stalled by the client
+    size_t payload_max_length = 100 * 1024 * 1024;
+    size_t header_max_length = 64 * 1024;
+    size_t websocket_max_in_flight = 64; // Unanswered messages per socket
+    int websocket_idle_timeout_sec = 300;
+  };
+
+  explicit EpollServer(ThreadPool &workers) : workers_(workers) {}
+
+  ~EpollServer() { stop(); }
+
+  EpollServer(const EpollServer &) = delete;
+  EpollServer &operator=(const EpollServer &) = delete;
+
+  /**
+   * Register a handler for `method` on a regex path pattern
+   */
+  void route(const std::string &method, const std::string &pattern,
+             Handler handler) {
+    routes_.push_back({method, std::regex(pattern), std::move(handler)});
+  }
+
+  /**
+   * Accept WebSocket upgrades (GET with `Upgrade: websocket`) on a regex
+   * path pattern
+   */
+  void websocket(const std::string &pattern, WebSocketOpener opener) {
+    websocket_routes_.push_back({std::regex(pattern), std::move(opener)});
+  }
+
+  /**
+   * Handler for requests no route matches (instead of 404/405)
+   */
+  void set_fallback_handler(Handler handler) {
+    fallback_handler_ = std::move(handler);
+  }
+
+  void set_error_handler(Handler handler) {
+    error_handler_ = std::move(handler);
+  }
+
+  void set_exception_handler(ExceptionHandler handler) {
+    exception_handler_ = std::move(handler);
+  }
+
+  void set_pre_routing_handler(PreRoutingHandler handler) {
+    pre_routing_handler_ = std::move(handler);
+  }
+
+  void set_expect_continue_handler(ExpectContinueHandler handler) {
+    expect_continue_handler_ = std::move(handler);
+  }
+
+  /**
+   * Bind one listener per loop and start the loop threads. Returns false if
+   * the address cannot be bound.
+   */
+  bool start(const Options &options) {
+    if (running_)
+      return false;
+    options_ = options;
+
+    if (!options_.tcp && options_.unix_path.empty()) {
+      LOG_ERROR("epoll backend has no listener configured");
+      return false;
+    }
+    if (!options_.unix_path.empty()) {
+      unix_fd_ = open_unix_listener();
+      if (unix_fd_ < 0)
+        return false;
+    }
+
+    size_t count = options_.loops;
+    if (count == 0)
+      count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < count; ++i) {
+      auto loop = std::make_shared<Loop>();
+      loop->self = loop;
+      if (!open_loop(*loop)) {
+        loops_.clear();
+        close_unix_listener();
+        return false;
+      }
+      loops_.push_back(std::move(loop));
+    }
+
+    running_ = true;
+    for (auto &loop : loops_) {
+      loop->thread = std::thread([this, loop] { run_loop(loop); });
+    }
+
+    if (options_.tcp)
+      LOG_INFO("epoll backend listening on {}:{} with {} event loop(s)",
+               options_.host, options_.port, loops_.size());
+    if (unix_fd_ >= 0)
+      LOG_INFO("epoll backend listening on unix:{} with {} event loop(s)",
+               options_.unix_path, loops_.size());
+    return true;
+  }
+
+  /**
+   * Block until stop() is called
+   */
+  void wait() {
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    state_cv_.wait(lock, [this] { return !running_; });
+  }
+
+  /**
+   * Stop all loops and close their sockets
+   */
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(state_mutex_);
+      if (!running_)
+        return;
+      running_ = false;
+    }
+    state_cv_.notify_all();
+
+    for (auto &loop : loops_) {
+      loop->wake();
+    }
+    for (auto &loop : loops_) {
+      if (loop->thread.joinable())
+        loop->thread.join();
+    }
+    loops_.clear();
+    close_unix_listener();
+  }
+
+  bool is_running() const { return running_; }
+
+  /**
+   * Decode a chunked body starting at `pos`. Returns 1 when complete, 0 if
+   * more data is needed, -1 on malformed input and -2 if too large.
+   * Public for the parser tests.
+   */
+  static int decode_chunked(const std::string &in, size_t pos,
+                            std::string &body, size_t &consumed,
+                            size_t max_length) {
+    body.clear();
+    while (true) {
+      size_t line_end = in.find("\r\n", pos);
+      if (line_end == std::string::npos)
+        return 0;
+      // 1*HEXDIG, optionally followed by chunk extensions
+      uint64_t size = 0;
+      size_t digits = 0;
+      for (; pos + digits < line_end; ++digits) {
+        int value = hex_value(in[pos + digits]);
+        if (value < 0)
+          break;
+        if (digits == 16)
+          return -1;
+        size = size << 4 | static_cast<uint64_t>(value);
+      }
+      char next = pos + digits < line_end ? in[pos + digits] : '\r';
+      if (digits == 0 || (next != '\r' && next != ';' && next != ' ' &&
+                          next != '\t'))
+        return -1;
+      pos = line_end + 2;
+
+      if (size == 0) {
+        // Optional trailer fields, then an empty line
+        if (in.compare(pos, 2, "\r\n") == 0) {
+          consumed = pos + 2;
+          return 1;
+        }
+        size_t trailer_end = in.find("\r\n\r\n", pos);
+        if (trailer_end == std::string::npos)
+          return 0;
+        consumed = trailer_end + 4;
+        return 1;
+      }
+
+      if (size > max_length - body.size())
+        return -2;
+      if (size > in.size() - pos || in.size() - pos - size < 2)
+        return 0;
+      if (in.compare(pos + size, 2, "\r\n") != 0)
+        return -1;
+      body.append(in, pos, size);
+      pos += size + 2;
+    }
+  }
+
+private:
+  // epoll data ids below FIRST_CONNECTION_ID are the loop's own fds
+  static constexpr uint64_t LISTEN_ID = 0;
+  static constexpr uint64_t WAKE_ID = 1;
+  static constexpr uint64_t UNIX_LISTEN_ID = 2;
+  static constexpr uint64_t FIRST_CONNECTION_ID = 3;
+
+  // Bytes a streamed response body may run ahead of the socket
+  static constexpr size_t STREAM_WINDOW = 1024 * 1024;
+  // Unsent WebSocket output beyond which incoming frames are not decoded
+  static constexpr size_t WS_OUTPUT_HIGH_WATER = 1024 * 1024;
+
+  /**
+   * Flow control between a worker streaming a response body and the loop
+   * writing it to the socket
+   */
+  class StreamWindow {
+  public:
+    void posted(size_t bytes) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      unsent_ += bytes;
+    }
+
+    void sent(size_t bytes) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unsent_ -= std::min(bytes, unsent_);
+      }
+      cv_.notify_all();
+    }
+
+    void abort() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        aborted_ = true;
+      }
+      cv_.notify_all();
+    }
+
+    bool aborted() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return aborted_;
+    }
+
+    /**
+     * Wait until at most `limit` bytes are unsent. False if the connection
+     * went away or nothing was sent for `timeout`.
+     */
+    bool wait(size_t limit, std::chrono::seconds timeout) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!aborted_ && unsent_ > limit) {
+        size_t before = unsent_;
+        if (cv_.wait_for(lock, timeout) == std::cv_status::timeout &&
+            unsent_ == before)
+          return false;
+      }
+      return !aborted_;
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t unsent_ = 0;
+    bool aborted_ = false;
+  };
+
+  struct Route {
+    std::string method;
+    std::regex pattern;
+    Handler handler;
+  };
+
+  struct WebSocketRoute {
+    std::regex pattern;
+    WebSocketOpener open;
+  };
+
+  struct Connection {
+    int fd = -1;
+    uint64_t id = 0;
+    std::string remote_addr;
+    int remote_port = -1;
+    std::string local_addr;
+    int local_port = -1;
+
+    std::string in;  // Received, not yet consumed bytes
+    std::string out; // Serialized responses not yet written
+    size_t out_offset = 0;
+
+    // Current request once its header block is parsed
+    std::unique_ptr<httplib::Request> head;
+    std::chrono::steady_clock::time_point head_received;
+    size_t header_end = 0;
+    size_t content_length = 0;
+    bool chunked = false;
+    bool continue_sent = false;
+
+    bool busy = false; // Request handed to a worker
+    bool close_after_write = false;
+    bool peer_closed = false; // Read side shut; EPOLLIN dropped
+    bool want_write = false; // EPOLLOUT registered
+    size_t requests = 0;
+    std::chrono::steady_clock::time_point last_activity;
+
+    // Set once upgraded to WebSocket
+    std::shared_ptr<websocket::Session> ws;
+    size_t ws_in_flight = 0; // Messages handed to workers, not yet answered
+    bool ws_paused = false;  // EPOLLIN dropped for flow control
+    bool ws_fragmented = false;
+    bool ws_binary = false;
+    std::string ws_message; // Fragments received so far
+
+    // Response body a worker is still streaming; stopped if the
+    // connection goes away first
+    std::shared_ptr<StreamWindow> stream;
+
+    ~Connection() {
+      if (stream)
+        stream->abort();
+    }
+  };
+
+  // A request and its response, shared with a handler that completes the
+  // response after returning (see DeferredResponse)
+  struct Exchange {
+    httplib::Request req;
+    httplib::Response res;
+    bool keep_alive = false;
+  };
+
+  struct Completion {
+    uint64_t connection_id;
+    std::string wire;
+    bool keep_alive;
+    bool frame = false; // A WebSocket reply rather than an HTTP response
+    // Part of a streamed response; more follows from `stream`
+    std::shared_ptr<StreamWindow> stream = nullptr;
+  };
+
+  struct Loop {
+    int epoll_fd = -1;
+    int listen_fd = -1;
+    int wake_fd = -1;
+    std::thread thread;
+    std::weak_ptr<Loop> self; // Handed to workers posting completions
+    uint64_t next_id = FIRST_CONNECTION_ID;
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+
+    std::mutex mutex;
+    std::vector<Completion> completions;
+
+    ~Loop() {
+      for (auto &[id, conn] : connections) {
+        ::close(conn->fd);
+      }
+      for (int fd : {listen_fd, wake_fd, epoll_fd}) {
+        if (fd >= 0)
+          ::close(fd);
+      }
+    }
+
+    void wake() {
+      uint64_t one = 1;
+      ssize_t ignored = ::write(wake_fd, &one, sizeof(one));
+      (void)ignored;
+    }
+
+    /**
+     * Called from worker threads
+     */
+    void post(Completion completion) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        completions.push_back(std::move(completion));
+      }
+      wake();
+    }
+  };
+
+  /**
+   * Channel of one upgraded connection: replies are posted to its loop,
+   * deferred work to the server's workers
+   */
+  class LoopChannel : public websocket::Channel {
+  public:
+    LoopChannel(std::weak_ptr<Loop> loop, uint64_t connection_id,
+                ThreadPool &workers)
+        : loop_(std::move(loop)), connection_id_(connection_id),
+          workers_(workers) {}
+
+    void reply(std::string payload, bool binary) override {
+      auto loop = loop_.lock();
+      if (!loop)
+        return;
+      auto opcode = binary ? websocket::Opcode::Binary : websocket::Opcode::Text;
+      loop->post({connection_id_, websocket::encode_frame(opcode, payload),
+                  true, true});
+    }
+
+    void defer(std::function<void()> task) override {
+      // Not bounded by the queue limit: a connection has at most
+      // websocket_max_in_flight replies outstanding. enqueue() throws
+      // before taking the task once the pool is stopped.
+      try {
+        workers_.enqueue(std::move(task));
+      } catch (const std::runtime_error &) {
+        task();
+      }
+    }
+
+  private:
+    std::weak_ptr<Loop> loop_;
+    uint64_t connection_id_;
+    ThreadPool &workers_;
+  };
+
+  ThreadPool &workers_;
+  Options options_;
+  std::vector<Route> routes_;
+  std::vector<WebSocketRoute> websocket_routes_;
+  Handler fallback_handler_;
+  Handler error_handler_;
+  ExceptionHandler exception_handler_;
+  ExpectContinueHandler expect_continue_handler_;
+  PreRoutingHandler pre_routing_handler_;
+
+  std::vector<std::shared_ptr<Loop>> loops_;
+  int unix_fd_ = -1; // Shared by all loops
+  std::atomic<bool> running_{false};
+  std::mutex state_mutex_;
+  std::condition_variable state_cv_;
+
+  // ---------------------------------------------------------------------
+  // Setup
+  // ---------------------------------------------------------------------
+
+  bool open_loop(Loop &loop) {
+    if (options_.tcp) {
+      loop.listen_fd = open_listener();
+      if (loop.listen_fd < 0)
+        return false;
+    }
+
+    loop.epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    loop.wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop.epoll_fd < 0 || loop.wake_fd < 0) {
+      LOG_ERROR("Failed to create epoll instance: {}", std::strerror(errno));
+      return false;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    if (loop.listen_fd >= 0) {
+      ev.data.u64 = LISTEN_ID;
+      ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, loop.listen_fd, &ev);
+    }
+    ev.data.u64 = WAKE_ID;
+    ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, loop.wake_fd, &ev);
+
+    if (unix_fd_ >= 0) {
+      // SO_REUSEPORT does not apply to Unix sockets; every loop watches the
+      // one listener and EPOLLEXCLUSIVE wakes a single loop per connection
+      ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+      ev.data.u64 = UNIX_LISTEN_ID;
+      ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, unix_fd_, &ev);
+    }
+    return true;
+  }
+
+  int open_unix_listener() {
+    const std::string &path = options_.unix_path;
+    if (!unix_socket::prepare_path(path))
+      return -1;
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      LOG_ERROR("Failed to create Unix socket: {}", std::strerror(errno));
+      return -1;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        !unix_socket::set_mode(path, options_.unix_mode) ||
+        ::listen(fd, SOMAXCONN) != 0) {
+      LOG_ERROR("Failed to listen on unix:{}: {}", path, std::strerror(errno));
+      ::close(fd);
+      unix_socket::remove(path);
+      return -1;
+    }
+    return fd;
+  }
+
+  void close_unix_listener() {
+    if (unix_fd_ < 0)
+      return;
+    ::close(unix_fd_);
+    unix_fd_ = -1;
+    unix_socket::remove(options_.unix_path);
+  }
+
+  int open_listener() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo *result = nullptr;
+    std::string port = std::to_string(options_.port);
+    const char *host = options_.host.empty() ? nullptr : options_.host.c_str();
+    if (::getaddrinfo(host, port.c_str(), &hints, &result) != 0) {
+      LOG_ERROR("Failed to resolve {}:{}", options_.host, options_.port);
+      return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo *ai = result; ai; ai = ai->ai_next) {
+      fd = ::socket(ai->ai_family,
+                    ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    ai->ai_protocol);
+      if (fd < 0)
+        continue;
+
+      int yes = 1;
+      ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+      ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+
+      if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+          ::listen(fd, SOMAXCONN) == 0) {
+        break;
+      }
+      ::close(fd);
+      fd = -1;
+    }
+    ::freeaddrinfo(result);
+
+    if (fd < 0) {
+      LOG_ERROR("Failed to bind {}:{}: {}", options_.host, options_.port,
+                std::strerror(errno));
+    }
+    return fd;
+  }
+
+  // ---------------------------------------------------------------------
+  // Event loop
+  // ---------------------------------------------------------------------
+
+  void run_loop(std::shared_ptr<Loop> loop) {
+    constexpr int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    auto last_sweep = std::chrono::steady_clock::now();
+
+    while (running_) {
+      int n = ::epoll_wait(loop->epoll_fd, events, MAX_EVENTS, 1000);
+      if (n < 0 && errno != EINTR) {
+        LOG_ERROR("epoll_wait failed: {}", std::strerror(errno));
+        break;
+      }
+
+      for (int i = 0; i < n; ++i) {
+        uint64_t id = events[i].data.u64;
+        uint32_t flags = events[i].events;
+
+        if (id == LISTEN_ID) {
+          accept_connections(loop, loop->listen_fd);
+        } else if (id == UNIX_LISTEN_ID) {
+          accept_connections(loop, unix_fd_);
+        } else if (id == WAKE_ID) {
+          drain_completions(loop);
+        } else {
+          auto it = loop->connections.find(id);
+          if (it == loop->connections.end())
+            continue;
+          Connection &conn = *it->second;
+
+          if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            if (!on_readable(*loop, conn))
+              continue;
+          }
+          if (flags & EPOLLOUT) {
+            // A WebSocket paused on its output backlog may read again
+            if (flush(*loop, conn) && conn.ws && conn.ws_paused)
+              process(*loop, conn);
+          }
+        }
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      if (now - last_sweep >= std::chrono::seconds(1)) {
+        sweep_idle(*loop, now);
+        last_sweep = now;
+      }
+    }
+  }
+
+  void accept_connections(const std::shared_ptr<Loop> &loop, int listen_fd) {
+    while (true) {
+      sockaddr_storage addr{};
+      socklen_t len = sizeof(addr);
+      int fd = ::accept4(listen_fd, reinterpret_cast<sockaddr *>(&addr), &len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+          LOG_WARN("accept failed: {}", std::strerror(errno));
+        return;
+      }
+
+      auto conn = std::make_unique<Connection>();
+      conn->fd = fd;
+      conn->id = loop->next_id++;
+      conn->last_activity = std::chrono::steady_clock::now();
+
+      if (listen_fd == unix_fd_) {
+        conn->local_addr = options_.unix_path;
+      } else {
+        int yes = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        describe_address(reinterpret_cast<sockaddr *>(&addr),
+                         conn->remote_addr, conn->remote_port);
+        sockaddr_storage local{};
+        socklen_t local_len = sizeof(local);
+        if (::getsockname(fd, reinterpret_cast<sockaddr *>(&local),
+                          &local_len) == 0) {
+          describe_address(reinterpret_cast<sockaddr *>(&local),
+                           conn->local_addr, conn->local_port);
+        }
+      }
+
+      epoll_event ev{};
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      ev.data.u64 = conn->id;
+      if (::epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        ::close(fd);
+        continue;
+      }
+      loop->connections.emplace(conn->id, std::move(conn));
+    }
+  }
+
+  static void describe_address(const sockaddr *addr, std::string &host,
+                               int &port) {
+    char buf[NI_MAXHOST];
+    char serv[NI_MAXSERV];
+    socklen_t len = addr->sa_family == AF_INET6 ? sizeof(sockaddr_in6)
+                                                : sizeof(sockaddr_in);
+    if (::getnameinfo(addr, len, buf, sizeof(buf), serv, sizeof(serv),
+                      NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+      host = buf;
+      port = std::atoi(serv);
+    }
+  }
+
+  /**
+   * Read everything available and try to dispatch a request. Returns false
+   * if the connection was closed.
+   */
+  bool on_readable(Loop &loop, Connection &conn) {
+    char buffer[64 * 1024];
+    size_t limit = options_.header_max_length + options_.payload_max_length;
+
+    while (true) {
+      ssize_t n = ::recv(conn.fd, buffer, sizeof(buffer), 0);
+      if (n > 0) {
+        conn.in.append(buffer, static_cast<size_t>(n));
+        if (conn.in.size() > limit) {
+          close_connection(loop, conn);
+          return false;
+        }
+      } else if (n == 0) {
+        // Stop watching for input: the loop is level-triggered and would
+        // otherwise report the half-close until the handler finishes
+        conn.peer_closed = true;
+        update_events(loop, conn);
+        break;
+      } else if (errno == EINTR) {
+        continue;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      } else {
+        close_connection(loop, conn);
+        return false;
+      }
+    }
+
+    conn.last_activity = std::chrono::steady_clock::now();
+    return process(loop, conn);
+  }
+
+  /**
+   * Parse and dispatch the next request if the connection is idle. Returns
+   * false if the connection was closed.
+   */
+  bool process(Loop &loop, Connection &conn) {
+    if (conn.ws)
+      return process_frames(loop, conn);
+
+    if (!conn.busy && !conn.close_after_write) {
+      int status = 0;
+      httplib::Request req;
+      switch (parse_request(conn, req, status)) {
+      case ParseResult::Ready:
+        if (is_websocket_upgrade(req))
+          return upgrade(loop, conn, req);
+        if (!dispatch(conn, loop.self, std::move(req)))
+          return flush(loop, conn);
+        break;
+      case ParseResult::Error:
+        queue_error(conn, status);
+        return flush(loop, conn);
+      case ParseResult::Rejected:
+        return flush(loop, conn);
+      case ParseResult::Incomplete:
+        // A 100 Continue may be waiting to go out
+        if (conn.out_offset < conn.out.size() && !flush(loop, conn))
+          return false;
+        break;
+      }
+    }
+
+    if (conn.peer_closed && !conn.busy && conn.out_offset >= conn.out.size()) {
+      close_connection(loop, conn);
+      return false;
+    }
+    return true;
+  }
+
+  // Rejected: a response to the header block is queued, body unread
+  enum class ParseResult { Incomplete, Ready, Error, Rejected };
+
+  ParseResult parse_request(Connection &conn, httplib::Request &req,
+                            int &status) {
+    if (!conn.head) {
+      size_t end = conn.in.find("\r\n\r\n");
+      if (end == std::string::npos) {
+        if (conn.in.size() > options_.header_max_length) {
+          status = 431;
+          return ParseResult::Error;
+        }
+        return ParseResult::Incomplete;
+      }
+
+      conn.head = std::make_unique<httplib::Request>();
+      conn.head_received = conn.last_activity;
+      conn.header_end = end + 4;
+      if (!parse_head(conn, *conn.head, end, status))
+        return ParseResult::Error;
+    }
+
+    httplib::Request &head = *conn.head;
+    size_t available = conn.in.size() - conn.header_end;
+
+    if (conn.chunked) {
+      // The body ends with the last-chunk line plus optional trailers
+      // followed by CRLF CRLF; only attempt a decode once that appears
+      if (available < 5 || conn.in.compare(conn.in.size() - 4, 4,
+                                           "\r\n\r\n") != 0) {
+        return await_body(conn);
+      }
+      size_t consumed = 0;
+      int result = decode_chunked(conn.in, conn.header_end, head.body,
+                                  consumed, options_.payload_max_length);
+      if (result < 0) {
+        status = result == -2 ? 413 : 400;
+        return ParseResult::Error;
+      }
+      if (result == 0) {
+        head.body.clear();
+        return ParseResult::Incomplete;
+      }
+      conn.in.erase(0, consumed);
+    } else {
+      if (available < conn.content_length) {
+        if (conn.in.capacity() < conn.header_end + conn.content_length)
+          conn.in.reserve(conn.header_end + conn.content_length);
+        return await_body(conn);
+      }
+      size_t consumed = conn.header_end + conn.content_length;
+      if (consumed == conn.in.size()) {
+        // Common case: nothing pipelined behind the body, reuse the buffer
+        head.body = std::move(conn.in);
+        head.body.erase(0, conn.header_end);
+        conn.in.clear();
+      } else {
+        head.body.assign(conn.in, conn.header_end, conn.content_length);
+        conn.in.erase(0, consumed);
+      }
+    }
+
+    head.content_length_ = head.body.size();
+    req = std::move(head);
+    conn.head.reset();
+    conn.continue_sent = false;
+    return ParseResult::Ready;
+  }
+
+  /**
+   * Request line and header fields of the block ending at `end`
+   */
+  bool parse_head(Connection &conn, httplib::Request &req, size_t end,
+                  int &status) {
+    status = 400;
+    size_t line_end = conn.in.find("\r\n");
+    std::string line = conn.in.substr(0, line_end);
+
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1)
+      return false;
+    req.method = line.substr(0, sp1);
+    req.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    req.version = line.substr(sp2 + 1);
+    if (req.version != "HTTP/1.1" && req.version != "HTTP/1.0") {
+      status = 505;
+      return false;
+    }
+
+    size_t query = req.target.find('?');
+    req.path = decode_percent(req.target.substr(0, query), false);
+    if (query != std::string::npos) {
+      parse_query(req.target.substr(query + 1), req.params);
+    }
+
+    size_t pos = line_end + 2;
+    while (pos < end) {
+      size_t next = conn.in.find("\r\n", pos);
+      size_t colon = conn.in.find(':', pos);
+      if (colon == std::string::npos || colon > next)
+        return false;
+      std::string name = conn.in.substr(pos, colon - pos);
+      size_t value_start = conn.in.find_first_not_of(" \t", colon + 1);
+      std::string value;
+      if (value_start < next) {
+        value = conn.in.substr(value_start, next - value_start);
+        value.erase(value.find_last_not_of(" \t") + 1);
+      }
+      req.headers.emplace(std::move(name), std::move(value));
+      pos = next + 2;
+    }
+
+    req.remote_addr = conn.remote_addr;
+    req.remote_port = conn.remote_port;
+    req.local_addr = conn.local_addr;
+    req.local_port = conn.local_port;
+
+    conn.chunked = false;
+    conn.content_length = 0;
+    std::string transfer_encoding = req.get_header_value("Transfer-Encoding");
+    if (!transfer_encoding.empty()) {
+      if (transfer_encoding.find("chunked") == std::string::npos) {
+        status = 501;
+        return false;
+      }
+      conn.chunked = true;
+    } else if (req.has_header("Content-Length")) {
+      const std::string value = req.get_header_value("Content-Length");
+      char *parse_end = nullptr;
+      unsigned long long length = std::strtoull(value.c_str(), &parse_end, 10);
+      if (value.empty() || *parse_end != '\0')
+        return false;
+      if (length > options_.payload_max_length) {
+        status = 413;
+        return false;
+      }
+      conn.content_length = static_cast<size_t>(length);
+    }
+    return true;
+  }
+
+  /**
+   * The body is still incomplete. Answer `Expect: 100-continue` once:
+   * the expect handler sees the header block and either invites the body
+   * or rejects the request before any of it is sent. Queues output only;
+   * process() flushes it.
+   */
+  ParseResult await_body(Connection &conn) {
+    if (conn.continue_sent || !conn.head)
+      return ParseResult::Incomplete;
+    std::string expect = conn.head->get_header_value("Expect");
+    if (expect.empty() || expect.find("100-continue") == std::string::npos)
+      return ParseResult::Incomplete;
+    conn.continue_sent = true;
+
+    if (expect_continue_handler_) {
+      httplib::Response res;
+      res.version = conn.head->version;
+      int status;
+      try {
+        status = expect_continue_handler_(*conn.head, res);
+      } catch (...) {
+        status = 500;
+      }
+      if (status != 100) {
+        res.status = status;
+        if (res.body.empty() && error_handler_)
+          error_handler_(*conn.head, res);
+        bool keep_alive = false;
+        conn.out += serialize(*conn.head, res, keep_alive);
+        conn.close_after_write = true;
+        conn.head.reset();
+        return ParseResult::Rejected;
+      }
+    }
+
+    conn.out += "HTTP/1.1 100 Continue\r\n\r\n";
+    return ParseResult::Incomplete;
+  }
+
+  /**
+   * Hand a parsed request to the worker pool. Returns false (with a 503
+   * queued on the connection) if the pool refused it.
+   */
+  bool dispatch(Connection &conn, std::weak_ptr<Loop> weak,
+                httplib::Request &&req) {
+    conn.busy = true;
+    ++conn.requests;
+
+    auto exchange = std::make_shared<Exchange>();
+    exchange->req = std::move(req);
+    exchange->keep_alive = wants_keep_alive(exchange->req) &&
+                           !conn.peer_closed &&
+                           conn.requests < options_.keep_alive_max_count;
+    uint64_t id = conn.id;
+    // The reads that completed the header block and the body
+    auto received = conn.head_received;
+    auto body_read = conn.last_activity;
+
+    bool queued = workers_.try_enqueue(
+        [this, weak, id, exchange, received, body_read] {
+          RequestTrace::ArrivalScope arrival(received, body_read);
+          // Sends the response, here or from whichever thread completes a
+          // handler that detached it
+          auto respond = [this, weak, id, exchange] {
+            send_response(weak, id, *exchange);
+          };
+          DeferredResponse::Scope scope(respond,
+                                        DeferredResponse::Scope::Role::Backend);
+          handle(exchange->req, exchange->res);
+          if (!scope.detached())
+            respond();
+        });
+    if (!queued) {
+      // Worker queue is full or the pool is shutting down
+      conn.busy = false;
+      queue_error(conn, 503);
+    }
+    return queued;
+  }
+
+  // ---------------------------------------------------------------------
+  // WebSocket
+  // ---------------------------------------------------------------------
+
+  bool is_websocket_upgrade(const httplib::Request &req) const {
+    if (websocket_routes_.empty())
+      return false;
+    std::string upgrade = req.get_header_value("Upgrade");
+    std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return upgrade.find("websocket") != std::string::npos;
+  }
+
+  /**
+   * Complete the opening handshake on the loop thread, or answer the
+   * upgrade request with an error and close. Returns false if the
+   * connection was closed.
+   */
+  bool upgrade(Loop &loop, Connection &conn, httplib::Request &req) {
+    httplib::Response res;
+    res.version = req.version;
+    std::shared_ptr<websocket::Session> session;
+    std::string key = req.get_header_value("Sec-WebSocket-Key");
+
+    if (pre_routing_handler_)
+      pre_routing_handler_(req, res);
+    if (req.method != "GET" || key.empty()) {
+      res.status = 400;
+    } else if (req.get_header_value("Sec-WebSocket-Version") != "13") {
+      res.status = 426;
+      res.set_header("Sec-WebSocket-Version", "13");
+    } else {
+      res.status = 404;
+      for (const auto &route : websocket_routes_) {
+        if (!std::regex_match(req.path, req.matches, route.pattern))
+          continue;
+        res.status = -1;
+        try {
+          session = route.open(req, res,
+                               std::make_shared<LoopChannel>(
+                                   loop.self, conn.id, workers_));
+        } catch (...) {
+          session.reset();
+          res.status = 500;
+        }
+        break;
+      }
+    }
+
+    if (!session) {
+      if (res.status < 400)
+        res.status = 400;
+      if (res.body.empty() && error_handler_)
+        error_handler_(req, res);
+      bool keep_alive = false;
+      conn.out += serialize(req, res, keep_alive);
+      conn.close_after_write = true;
+      return flush(loop, conn);
+    }
+
+    ++conn.requests;
+    conn.ws = std::move(session);
+    conn.out += "HTTP/1.1 101 Switching Protocols\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Accept: " +
+                websocket::accept_key(key) + "\r\n\r\n";
+    // Frames may already be buffered behind the handshake
+    return process_frames(loop, conn);
+  }
+
+  /**
+   * Decode buffered frames and hand complete data messages to workers
+   * until `websocket_max_in_flight` are unanswered; reading then pauses
+   * until replies free a slot. It also pauses while more than
+   * WS_OUTPUT_HIGH_WATER bytes are unsent, so a peer that sends pings
+   * without reading the pongs cannot grow the output without bound.
+   * Returns false if the connection was closed.
+   */
+  bool process_frames(Loop &loop, Connection &conn) {
+    size_t pos = 0;
+    while (!conn.close_after_write &&
+           conn.ws_in_flight < options_.websocket_max_in_flight) {
+      if (ws_backlogged(conn)) {
+        if (!flush(loop, conn))
+          return false;
+        if (ws_backlogged(conn))
+          break; // Resumed from EPOLLOUT once the peer reads
+      }
+      websocket::Frame frame;
+      size_t consumed = 0;
+      auto status = websocket::parse_frame(
+          conn.in.data() + pos, conn.in.size() - pos,
+          options_.payload_max_length, frame, consumed);
+      if (status == websocket::ParseStatus::Incomplete)
+        break;
+      if (status != websocket::ParseStatus::Ok) {
+        bool too_big = status == websocket::ParseStatus::TooBig;
+        close_websocket(conn,
+                        too_big ? websocket::CLOSE_TOO_BIG
+                                : websocket::CLOSE_PROTOCOL_ERROR,
+                        too_big ? "Message too big" : "Malformed frame");
+        break;
+      }
+      pos += consumed;
+      on_frame(conn, std::move(frame));
+    }
+    conn.in.erase(0, pos);
+
+    set_paused(loop, conn,
+               !conn.close_after_write &&
+                   (conn.ws_in_flight >= options_.websocket_max_in_flight ||
+                    ws_backlogged(conn)));
+
+    if (conn.out_offset < conn.out.size() || conn.close_after_write)
+      return flush(loop, conn);
+    if (conn.peer_closed && conn.ws_in_flight == 0) {
+      close_connection(loop, conn);
+      return false;
+    }
+    return true;
+  }
+
+  void on_frame(Connection &conn, websocket::Frame &&frame) {
+    using websocket::Opcode;
+    switch (frame.opcode) {
+    case Opcode::Ping:
+      conn.out += websocket::encode_frame(Opcode::Pong, frame.payload);
+      break;
+    case Opcode::Pong:
+      break;
+    case Opcode::Close: {
+      // Echo the peer's status code, then close
+      uint16_t code = websocket::CLOSE_NORMAL;
+      if (frame.payload.size() >= 2)
+        code = static_cast<uint16_t>(
+            (static_cast<uint8_t>(frame.payload[0]) << 8) |
+            static_cast<uint8_t>(frame.payload[1]));
+      close_websocket(conn, code, "");
+      break;
+    }
+    case Opcode::Text:
+    case Opcode::Binary:
+      if (conn.ws_fragmented) {
+        close_websocket(conn, websocket::CLOSE_PROTOCOL_ERROR,
+                        "Expected continuation frame");
+      } else if (frame.fin) {
+        deliver(conn, std::move(frame.payload),
+                frame.opcode == Opcode::Binary);
+      } else {
+        conn.ws_fragmented = true;
+        conn.ws_binary = frame.opcode == Opcode::Binary;
+        conn.ws_message = std::move(frame.payload);
+      }
+      break;
+    case Opcode::Continuation:
+      if (!conn.ws_fragmented) {
+        close_websocket(conn, websocket::CLOSE_PROTOCOL_ERROR,
+                        "Unexpected continuation frame");
+      } else if (conn.ws_message.size() + frame.payload.size() >
+                 options_.payload_max_length) {
+        close_websocket(conn, websocket::CLOSE_TOO_BIG, "Message too big");
+      } else {
+        conn.ws_message += frame.payload;
+        if (frame.fin) {
+          conn.ws_fragmented = false;
+          deliver(conn, std::move(conn.ws_message), conn.ws_binary);
+          conn.ws_message.clear();
+        }
+      }
+      break;
+    default:
+      close_websocket(conn, websocket::CLOSE_PROTOCOL_ERROR,
+                      "Unknown opcode");
+      break;
+    }
+  }
+
+  /**
+   * Hand one data message to a worker; the session replies through its
+   * channel, which frees the slot in drain_completions()
+   */
+  void deliver(Connection &conn, std::string payload, bool binary) {
+    auto session = conn.ws;
+    ++conn.ws_in_flight;
+    bool queued = workers_.try_enqueue(
+        [session, payload = std::move(payload), binary]() mutable {
+          try {
+            session->on_message(std::move(payload), binary);
+          } catch (const std::exception &e) {
+            LOG_ERROR("WebSocket message handler failed: {}", e.what());
+          }
+        });
+    if (!queued) {
+      --conn.ws_in_flight;
+      close_websocket(conn, websocket::CLOSE_TRY_AGAIN_LATER,
+                      "Server overloaded");
+    }
+  }
+
+  static void close_websocket(Connection &conn, uint16_t code,
+                              const std::string &reason) {
+    if (conn.close_after_write)
+      return;
+    conn.out += websocket::encode_close(code, reason);
+    conn.close_after_write = true;
+  }
+
+  static bool ws_backlogged(const Connection &conn) {
+    return conn.out.size() - conn.out_offset > WS_OUTPUT_HIGH_WATER;
+  }
+
+  void set_paused(Loop &loop, Connection &conn, bool paused) {
+    if (conn.ws_paused == paused)
+      return;
+    conn.ws_paused = paused;
+    update_events(loop, conn);
+  }
+
+  static bool wants_keep_alive(const httplib::Request &req) {
+    std::string connection = req.get_header_value("Connection");
+    std::transform(connection.begin(), connection.end(), connection.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (req.version == "HTTP/1.0")
+      return connection.find("keep-alive") != std::string::npos;
+    return connection.find("close") == std::string::npos;
+  }
+
+  void drain_completions(const std::shared_ptr<Loop> &loop) {
+    uint64_t count = 0;
+    ssize_t ignored = ::read(loop->wake_fd, &count, sizeof(count));
+    (void)ignored;
+
+    std::vector<Completion> completions;
+    {
+      std::lock_guard<std::mutex> lock(loop->mutex);
+      completions.swap(loop->completions);
+    }
+
+    for (auto &completion : completions) {
+      auto it = loop->connections.find(completion.connection_id);
+      if (it == loop->connections.end()) {
+        // Client went away while the handler ran
+        if (completion.stream)
+          completion.stream->abort();
+        continue;
+      }
+      Connection &conn = *it->second;
+
+      if (completion.stream) {
+        // More of this response follows; the connection stays busy
+        conn.stream = std::move(completion.stream);
+        conn.last_activity = std::chrono::steady_clock::now();
+        conn.out += completion.wire;
+        flush(*loop, conn);
+        continue;
+      }
+
+      if (completion.frame) {
+        // A WebSocket reply frees a flow-control slot; more buffered
+        // frames may now be dispatched
+        if (conn.ws_in_flight > 0)
+          --conn.ws_in_flight;
+        conn.last_activity = std::chrono::steady_clock::now();
+        if (!conn.close_after_write)
+          conn.out += completion.wire;
+        if (flush(*loop, conn))
+          process(*loop, conn);
+        continue;
+      }
+
+      conn.busy = false;
+      conn.stream.reset();
+      conn.last_activity = std::chrono::steady_clock::now();
+      conn.out += completion.wire;
+      if (!completion.keep_alive)
+        conn.close_after_write = true;
+
+      // Writing may close the connection; otherwise continue with any
+      // request pipelined behind this one
+      if (flush(*loop, conn))
+        process(*loop, conn);
+    }
+  }
+
+  /**
+   * Write pending output. Returns false if the connection was closed.
+   */
+  bool flush(Loop &loop, Connection &conn) {
+    while (conn.out_offset < conn.out.size()) {
+      ssize_t n = ::send(conn.fd, conn.out.data() + conn.out_offset,
+                         conn.out.size() - conn.out_offset, MSG_NOSIGNAL);
+      if (n > 0) {
+        conn.out_offset += static_cast<size_t>(n);
+        conn.last_activity = std::chrono::steady_clock::now();
+        if (conn.stream)
+          conn.stream->sent(static_cast<size_t>(n));
+      } else if (n < 0 && errno == EINTR) {
+        continue;
+      } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        set_want_write(loop, conn, true);
+        return true;
+      } else {
+        close_connection(loop, conn);
+        return false;
+      }
+    }
+
+    conn.out.clear();
+    conn.out_offset = 0;
+    set_want_write(loop, conn, false);
+
+    if (conn.close_after_write ||
+        (conn.peer_closed && !conn.busy && conn.ws_in_flight == 0)) {
+      ::shutdown(conn.fd, SHUT_WR);
+      close_connection(loop, conn);
+      return false;
+    }
+    return true;
+  }
+
+  void set_want_write(Loop &loop, Connection &conn, bool enabled) {
+    if (conn.want_write == enabled)
+      return;
+    conn.want_write = enabled;
+    update_events(loop, conn);
+  }
+
+  void update_events(Loop &loop, Connection &conn) {
+    epoll_event ev{};
+    bool reading = !conn.ws_paused && !conn.peer_closed;
+    ev.events = reading ? (EPOLLIN | EPOLLRDHUP) : 0;
+    if (conn.want_write)
+      ev.events |= EPOLLOUT;
+    ev.data.u64 = conn.id;
+    ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+  }
+
+  void close_connection(Loop &loop, Connection &conn) {
+    if (conn.ws)
+      conn.ws->on_close();
+    ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+    ::close(conn.fd);
+    loop.connections.erase(conn.id); // Destroys `conn`
+  }
+
+  /**
+   * Close connections idle longer than the keep-alive timeout, stuck
+   * mid-request longer than the read timeout, or WebSockets silent for
+   * longer than their idle timeout
+   */
+  void sweep_idle(Loop &loop, std::chrono::steady_clock::time_point now) {
+    std::vector<Connection *> expired;
+    for (auto &[id, conn] : loop.connections) {
+      if (conn->busy || conn->ws_in_flight > 0)
+        continue;
+      bool idle = conn->in.empty() && conn->out.empty();
+      int seconds = conn->ws ? options_.websocket_idle_timeout_sec
+                    : idle   ? options_.keep_alive_timeout_sec
+                             : options_.read_timeout_sec;
+      auto timeout = std::chrono::seconds(seconds);
+      if (now - conn->last_activity > timeout)
+        expired.push_back(conn.get());
+    }
+    for (Connection *conn : expired) {
+      close_connection(loop, *conn);
+    }
+  }
+
+  // ---------------------------------------------------------------------
+  // Request handling (worker threads)
+  // ---------------------------------------------------------------------
+
+  /**
+   * Run the handlers for a request. The response is sent by send_response(),
+   * right away or once a handler that detached it completes it.
+   */
+  void handle(httplib::Request &req, httplib::Response &res) {
+    res.version = req.version;
+
+    try {
+      bool handled =
+          pre_routing_handler_ && pre_routing_handler_(req, res) ==
+                                      httplib::Server::HandlerResponse::Handled;
+      if (!handled && !route_request(req, res) && res.status == -1) {
+        res.status = 404;
+      }
+    } catch (...) {
+      if (exception_handler_) {
+        exception_handler_(req, res, std::current_exception());
+      } else {
+        res.status = 500;
+      }
+    }
+  }
+
+  /**
+   * Fill in the status and error body the handlers left unset and
+   * serialize the response
+   */
+  void finish(Exchange &exchange) {
+    httplib::Request &req = exchange.req;
+    httplib::Response &res = exchange.res;
+    if (res.status == -1)
+      res.status = 200;
+    if (res.status >= 400 && res.body.empty() && !res.content_provider_ &&
+        error_handler_) {
+      error_handler_(req, res);
+    }
+  }
+
+  /**
+   * Finish an exchange and post it to its loop. A content provider's body
+   * is streamed, except for HEAD and for HTTP/1.0 requests whose body
+   * length is unknown (no chunked coding); those are drained first.
+   */
+  void send_response(const std::weak_ptr<Loop> &weak, uint64_t id,
+                     Exchange &exchange) {
+    finish(exchange);
+    httplib::Request &req = exchange.req;
+    httplib::Response &res = exchange.res;
+    bool chunked = res.content_length_ == 0;
+    if (!res.content_provider_ || req.method == "HEAD" ||
+        !has_body(res.status) || (chunked && req.version != "HTTP/1.1")) {
+      std::string wire = serialize(req, res, exchange.keep_alive);
+      if (auto loop = weak.lock())
+        loop->post({id, std::move(wire), exchange.keep_alive});
+      return;
+    }
+
+    bool ok = stream_provider(weak, id, res, chunked, exchange.keep_alive);
+    if (res.content_provider_resource_releaser_)
+      res.content_provider_resource_releaser_(ok);
+    // The status is already sent; a body cut short by closing the
+    // connection is how the client learns that it failed
+    if (auto loop = weak.lock())
+      loop->post({id, ok && chunked ? "0\r\n\r\n" : "",
+                  ok && exchange.keep_alive});
+  }
+
+  /**
+   * Post the response head, then each piece the provider writes, waiting
+   * whenever STREAM_WINDOW bytes are still unsent. False if the provider
+   * failed or the client went away or stopped reading.
+   */
+  bool stream_provider(const std::weak_ptr<Loop> &weak, uint64_t id,
+                       httplib::Response &res, bool chunked,
+                       bool keep_alive) {
+    auto window = std::make_shared<StreamWindow>();
+    auto timeout = std::chrono::seconds(options_.write_timeout_sec);
+    auto post = [&](std::string wire) {
+      auto loop = weak.lock();
+      if (!loop)
+        return false;
+      window->posted(wire.size());
+      loop->post({id, std::move(wire), keep_alive, false, window});
+      loop.reset(); // Never keep a stopped loop alive while waiting
+      return window->wait(STREAM_WINDOW, timeout);
+    };
+
+    std::string head = status_head(res, true);
+    if (chunked) {
+      head += "Transfer-Encoding: chunked\r\n";
+    } else {
+      head += "Content-Length: ";
+      head += std::to_string(res.content_length_);
+      head += "\r\n";
+    }
+    head += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    head += "\r\n";
+    if (!post(std::move(head)))
+      return false;
+
+    bool done = false;
+    bool failed = false; // Providers may ignore a failed write
+    size_t offset = 0;
+    httplib::DataSink sink;
+    sink.write = [&](const char *data, size_t length) {
+      if (failed)
+        return false;
+      if (length == 0)
+        return true;
+      std::string piece;
+      if (chunked) {
+        char size[20];
+        int n = std::snprintf(size, sizeof(size), "%zx\r\n", length);
+        piece.reserve(n + length + 2);
+        piece.append(size, static_cast<size_t>(n));
+        piece.append(data, length);
+        piece += "\r\n";
+      } else {
+        piece.assign(data, length);
+      }
+      offset += length;
+      failed = !post(std::move(piece));
+      return !failed;
+    };
+    sink.is_writable = [&] { return !failed && !window->aborted(); };
+    sink.done = [&] { done = true; };
+    sink.done_with_trailer = [&](const httplib::Headers &) { done = true; };
+
+    return run_provider(res, sink, offset, done) && !failed;
+  }
+
+  bool route_request(httplib::Request &req, httplib::Response &res) {
+    const std::string &method = req.method == "HEAD" ? "GET" : req.method;
+    bool path_matched = false;
+
+    for (const auto &route : routes_) {
+      if (!std::regex_match(req.path, req.matches, route.pattern))
+        continue;
+      if (route.method != method) {
+        path_matched = true;
+        continue;
+      }
+      route.handler(req, res);
+      return true;
+    }
+
+    if (!path_matched && fallback_handler_) {
+      fallback_handler_(req, res);
+      return true;
+    }
+    if (path_matched)
+      res.status = 405;
+    return false;
+  }
+
+  /**
+   * Serialize status line, headers and body. Content providers are drained
+   * here on the worker, so the loop only ever copies bytes.
+   */
+  std::string serialize(const httplib::Request &req, httplib::Response &res,
+                        bool &keep_alive) {
+    std::string body;
+    bool provider_ok = true;
+    if (res.content_provider_) {
+      provider_ok = drain_provider(res, body);
+      if (res.content_provider_resource_releaser_)
+        res.content_provider_resource_releaser_(provider_ok);
+      if (!provider_ok) {
+        // Nothing sensible was sent yet; report the failure instead
+        res.status = 500;
+        body.clear();
+        keep_alive = false;
+      }
+    }
+    const std::string &payload = res.content_provider_ ? body : res.body;
+
+    std::string wire = status_head(res, provider_ok);
+    bool with_body = has_body(res.status);
+    if (with_body) {
+      wire += "Content-Length: ";
+      wire += std::to_string(payload.size());
+      wire += "\r\n";
+    }
+    wire += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    wire += "\r\n";
+
+    if (with_body && req.method != "HEAD")
+      wire += payload;
+    return wire;
+  }
+
+  static bool has_body(int status) {
+    return status >= 200 && status != 204 && status != 304;
+  }
+
+  /**
+   * Status line and the handler's headers, without the framing and
+   * connection headers the server sets itself
+   */
+  static std::string status_head(const httplib::Response &res,
+                                 bool content_type) {
+    std::string head;
+    head.reserve(256);
+    head += "HTTP/1.1 ";
+    head += std::to_string(res.status);
+    head += ' ';
+    head += reason_phrase(res.status);
+    head += "\r\n";
+
+    for (const auto &[name, value] : res.headers) {
+      if (equals_ignore_case(name, "Content-Length") ||
+          equals_ignore_case(name, "Connection") ||
+          equals_ignore_case(name, "Transfer-Encoding") ||
+          (!content_type && equals_ignore_case(name, "Content-Type")))
+        continue;
+      head += name;
+      head += ": ";
+      head += value;
+      head += "\r\n";
+    }
+    return head;
+  }
+
+  static bool drain_provider(httplib::Response &res, std::string &body) {
+    bool done = false;
+    size_t offset = 0;
+
+    httplib::DataSink sink;
+    sink.write = [&](const char *data, size_t length) {
+      body.append(data, length);
+      offset += length;
+      return true;
+    };
+    sink.is_writable = [] { return true; };
+    sink.done = [&] { done = true; };
+    sink.done_with_trailer = [&](const httplib::Headers &) { done = true; };
+
+    if (res.content_length_ > 0)
+      body.reserve(res.content_length_);
+    return run_provider(res, sink, offset, done);
+  }
+
+  /**
+   * Call a content provider until it has written `content_length_` bytes,
+   * or (length unknown) until it calls done(). `offset` and `done` are
+   * updated by `sink`.
+   */
+  static bool run_provider(httplib::Response &res, httplib::DataSink &sink,
+                           size_t &offset, bool &done) {
+    if (res.content_length_ > 0) {
+      while (offset < res.content_length_) {
+        size_t before = offset;
+        if (!res.content_provider_(offset, res.content_length_ - offset, sink))
+          return false;
+        if (offset == before)
+          return false; // Provider made no progress
+      }
+      return true;
+    }
+
+    // Length unknown (chunked providers): call until done()
+    while (!done) {
+      size_t before = offset;
+      if (!res.content_provider_(offset, 0, sink))
+        return false;
+      if (offset == before && !done)
+        return false;
+    }
+    return true;
+  }
+
+  // ---------------------------------------------------------------------
+  // Helpers
+  // ---------------------------------------------------------------------
+
+  void queue_error(Connection &conn, int status) {
+    std::string body = "{\"error\":{\"code\":" + std::to_string(status) +
+                       ",\"message\":\"" + reason_phrase(status) + "\"}}";
+    conn.out += "HTTP/1.1 " + std::to_string(status) + " " +
+                reason_phrase(status) +
+                "\r\nContent-Type: application/json\r\nContent-Length: " +
+                std::to_string(body.size()) +
+                (status == 503 ? "\r\nRetry-After: 1" : "") +
+                "\r\nConnection: close\r\n\r\n" + body;
+    conn.close_after_write = true;
+    conn.head.reset();
+  }
+
+  static bool equals_ignore_case(const std::string &a, const char *b) {
+    size_t n = std::strlen(b);
+    if (a.size() != n)
+      return false;
+    for (size_t i = 0; i < n; ++i) {
+      if (std::tolower(static_cast<unsigned char>(a[i])) !=
+          std::tolower(static_cast<unsigned char>(b[i])))
+        return false;
+    }
+    return true;
+  }
+
+  static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  }
+
+  static std::string decode_percent(const std::string &s,
+                                    bool plus_as_space) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+      if (s[i] == '%' && i + 2 < s.size() &&
+          std::isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+          std::isxdigit(static_cast<unsigned char>(s[i + 2]))) {
+        out += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+        i += 2;
+      } else if (plus_as_space && s[i] == '+') {
+        out += ' ';
+      } else {
+        out += s[i];
+      }
+    }
+    return out;
+  }
+
+  static void parse_query(const std::string &query, httplib::Params &params) {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+      size_t amp = query.find('&', pos);
+      if (amp == std::string::npos)
+        amp = query.size();
+      std::string pair = query.substr(pos, amp - pos);
+      if (!pair.empty()) {
+        size_t eq = pair.find('=');
+        std::string key = decode_percent(pair.substr(0, eq), true);
+        std::string value = eq == std::string::npos
+                                ? std::string()
+                                : decode_percent(pair.substr(eq + 1), true);
+        params.emplace(std::move(key), std::move(value));
+      }
+      pos = amp + 1;
+    }
+  }
+
+  static const char *reason_phrase(int status) {
+    switch (status) {
+    case 100:
+      return "Continue";
+    case 101:
+      return "Switching Protocols";
+    case 200:
+      return "OK";
+    case 201:
+      return "Created";
+    case 202:
+      return "Accepted";
+    case 204:
+      return "No Content";
+    case 206:
+      return "Partial Content";
+    case 304:
+      return "Not Modified";
+    case 400:
+      return "Bad Request";
+    case 401:
+      return "Unauthorized";
+    case 403:
+      return "Forbidden";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 406:
+      return "Not Acceptable";
+    case 408:
+      return "Request Timeout";
+    case 413:
+      return "Payload Too Large";
+    case 415:
+      return "Unsupported Media Type";
+    case 422:
+      return "Unprocessable Entity";
+    case 426:
+      return "Upgrade Required";
+    case 429:
+      return "Too Many Requests";
+    case 431:
+      return "Request Header Fields Too Large";
+    case 500:
+      return "Internal Server Error";
+    case 501:
+      return "Not Implemented";
+    case 503:
+      return "Service Unavailable";
+    case 505:
+      return "HTTP Version Not Supported";
+    default:
+      return "Unknown";
+    }
+  }
+};
+
+} // namespace onnx_server
+
+#endif // __linux__
@@ -1,17 +1,36 @@
 #pragma once
 
+#include <algorithm>
+#include <future>
 #include <memory>
+#include <regex>
 #include <string>
 
 #include "httplib.h"
 #include "inference/batch_executor.hpp"
 #include "inference/model_registry.hpp"
+#include "compression.hpp"
+#include "content_codec.hpp"
+#include "deferred_response.hpp"
+#include "inference_socket.hpp"
 #include "inference/session_manager.hpp"
+#include "job_store.hpp"
 #include "json.hpp"
+#include "json_tensor_parser.hpp"
+#include "json_writer.hpp"
+#include "kserve_v2.hpp"
 #include "metrics/collector.hpp"
+#include "ndjson_stream.hpp"
+#include "npy.hpp"
+#include "response_stream.hpp"
 #include "router.hpp"
+#include "shared_memory.hpp"
+#include "stage_pipeline.hpp"
+#include "tensor_codec.hpp"
 #include "utils/config.hpp"
 #include "utils/logging.hpp"
+#include "utils/request_trace.hpp"
+#include "utils/thread_pool.hpp"
 
 namespace onnx_server {
 
@@ -26,7 +45,37 @@ public:
            MetricsCollector &metrics, const Config &config)
       : model_registry_(model_registry), batch_executor_(batch_executor),
         metrics_(metrics), config_(config),
-        start_time_(std::chrono::steady_clock::now()) {}
+        shared_memory_(config.shared_memory.max_regions), jobs_(config.jobs),
+        start_time_(std::chrono::steady_clock::now()) {
+    if (config.jobs.enabled) {
+      job_pool_ = std::make_unique<ThreadPool>(
+          static_cast<size_t>(std::max(1, config.jobs.workers)));
+    }
+    if (config.pipeline.enabled) {
+      pipeline_ = std::make_unique<StagePipeline>(config.pipeline, metrics);
+      execute_metrics_ = &metrics.register_stage(
+          StagePipeline::name(StagePipeline::Stage::Execute));
+    }
+  }
+
+  /**
+   * Stop accepting async jobs; queued ones fail with 503, running ones
+   * finish. Call before stopping the batch executor.
+   */
+  void stop_jobs() {
+    jobs_.close();
+    if (job_pool_)
+      job_pool_->shutdown();
+  }
+
+  /**
+   * Finish queued decode work so staged requests reach the batcher. Call
+   * before stopping the batch executor.
+   */
+  void stop_pipeline() {
+    if (pipeline_)
+      pipeline_->stop_decode();
+  }
 
   /**
    * Register all API routes
@@ -47,25 +96,102 @@ public:
     router.get("/v1/models", [this](auto &req, auto &res, auto &ctx) {
       handle_list_models(req, res, ctx);
     });
-    router.get(R"(/v1/models/([^/]+))",
+    router.get("/v1/models/:name",
                [this](auto &req, auto &res, auto &ctx) {
                  handle_get_model(req, res, ctx);
                });
-    router.post(R"(/v1/models/([^/]+)/reload)",
+    router.post("/v1/models/:name/reload",
                 [this](auto &req, auto &res, auto &ctx) {
                   handle_reload_model(req, res, ctx);
                 });
 
-    // Inference endpoint
-    router.post(R"(/v1/models/([^/]+)/infer)",
-                [this](auto &req, auto &res, auto &ctx) {
-                  handle_infer(req, res, ctx);
-                });
+    // Inference endpoint; requests are vetted from their headers before
+    // the body is uploaded
+    router.post(
+        "/v1/models/:name/infer",
+        [this](auto &req, auto &res, auto &ctx) {
+          handle_infer(req, res, ctx);
+        },
+        [this](auto &req, auto &res, auto &ctx) {
+          return check_infer(req, res, ctx);
+        });
+    router.post(
+        "/v1/models/:name/infer:stream",
+        [this](auto &req, auto &res, auto &ctx) {
+          handle_infer_stream(req, res, ctx);
+        },
+        [this](auto &req, auto &res, auto &ctx) {
+          return check_infer_stream(req, res, ctx);
+        });
+
+    // Several models in one request
+    router.post(
+        "/v1/infer:multi",
+        [this](auto &req, auto &res, auto &ctx) {
+          handle_infer_multi(req, res, ctx);
+        },
+        [this](auto &req, auto &res, auto &) { return admit(res); });
+
+    // Persistent inference channel (epoll backend)
+    router.websocket("/v1/models/:name/ws",
+                     [this](auto &req, auto &res, auto &ctx, auto channel) {
+                       return open_inference_socket(req, res, ctx,
+                                                    std::move(channel));
+                     });
+
+    // KServe v2 protocol inference endpoint
+    router.post(
+        "/v2/models/:name/infer",
+        [this](auto &req, auto &res, auto &ctx) {
+          handle_v2_infer(req, res, ctx);
+        },
+        [this](auto &req, auto &res, auto &ctx) {
+          return check_v2_infer(req, res, ctx);
+        });
+
+    // KServe v2 system shared memory extension
+    if (config_.shared_memory.enabled) {
+      router.get("/v2/systemsharedmemory/status",
+                 [this](auto &req, auto &res, auto &ctx) {
+                   handle_shm_status(req, res, ctx);
+                 });
+      router.get("/v2/systemsharedmemory/region/:name/status",
+                 [this](auto &req, auto &res, auto &ctx) {
+                   handle_shm_status(req, res, ctx);
+                 });
+      router.post("/v2/systemsharedmemory/region/:name/register",
+                  [this](auto &req, auto &res, auto &ctx) {
+                    handle_shm_register(req, res, ctx);
+                  });
+      router.post("/v2/systemsharedmemory/unregister",
+                  [this](auto &req, auto &res, auto &ctx) {
+                    handle_shm_unregister(req, res, ctx);
+                  });
+      router.post("/v2/systemsharedmemory/region/:name/unregister",
+                  [this](auto &req, auto &res, auto &ctx) {
+                    handle_shm_unregister(req, res, ctx);
+                  });
+    }
+
+    // Asynchronous inference jobs
+    if (config_.jobs.enabled) {
+      router.get("/v1/jobs/:id",
+                 [this](auto &req, auto &res, auto &ctx) {
+                   handle_get_job(req, res, ctx);
+                 });
+      router.del("/v1/jobs/:id",
+                 [this](auto &req, auto &res, auto &ctx) {
+                   handle_delete_job(req, res, ctx);
+                 });
+    }
 
     // Metrics endpoint
     router.get(config_.metrics.path, [this](auto &req, auto &res, auto &ctx) {
       handle_metrics(req, res, ctx);
     });
+    router.get("/v1/stats", [this](auto &req, auto &res, auto &ctx) {
+      handle_stats(req, res, ctx);
+    });
 
     LOG_INFO("Registered API routes");
   }
@@ -75,7 +201,13 @@ private:
   BatchExecutor &batch_executor_;
   MetricsCollector &metrics_;
   const Config &config_;
+  SharedMemoryRegistry shared_memory_;
+  JobStore jobs_;
   std::chrono::steady_clock::time_point start_time_;
+  MetricsCollector::StageMetrics *execute_metrics_ = nullptr;
+  // Last: joined before the members their tasks use are destroyed
+  std::unique_ptr<StagePipeline> pipeline_;
+  std::unique_ptr<ThreadPool> job_pool_;
 
   /**
    * GET /health - Liveness probe
@@ -140,8 +272,7 @@ private:
                                     {"output_names", model.output_names}});
     }
 
-    res.status = 200;
-    res.set_content(response.dump(), "application/json");
+    send_document(req, res, 200, response);
   }
 
   /**
@@ -149,7 +280,7 @@ private:
    */
   void handle_get_model(const httplib::Request &req, httplib::Response &res,
                         RequestContext &ctx) {
-    std::string model_name = req.matches[1].str();
+    std::string model_name = ctx.param("name");
 
     auto model_opt = model_registry_.get(model_name);
     if (!model_opt) {
@@ -187,8 +318,7 @@ private:
                                                    : "unknown"}});
     }
 
-    res.status = 200;
-    res.set_content(response.dump(), "application/json");
+    send_document(req, res, 200, response);
   }
 
   /**
@@ -196,7 +326,7 @@ private:
    */
   void handle_reload_model(const httplib::Request &req, httplib::Response &res,
                            RequestContext &ctx) {
-    std::string model_name = req.matches[1].str();
+    std::string model_name = ctx.param("name");
 
     LOG_INFO("Reloading model: {}", model_name);
 
@@ -227,34 +357,237 @@ private:
     }
   }
 
+  /**
+   * Header-only checks for POST /v1/models/:name/infer, run before the
+   * body is read (or `100 Continue` is sent): unknown model, unusable
+   * async or raw requests, a raw body whose Content-Length cannot match
+   * X-Tensor-Shape, and overload
+   */
+  bool check_infer(const httplib::Request &req, httplib::Response &res,
+                   RequestContext &ctx) {
+    std::string model_name = ctx.param("name");
+    auto model = model_registry_.get(model_name);
+    if (!model) {
+      send_error(res, 404, "Model not found: " + model_name);
+      return false;
+    }
+
+    std::string content_type = req.get_header_value("Content-Type");
+    bool raw = content_type.find("application/octet-stream") !=
+               std::string::npos;
+    bool numpy =
+        content_type.find(npy::NPY_CONTENT_TYPE) != std::string::npos ||
+        content_type.find(npy::NPZ_CONTENT_TYPE) != std::string::npos;
+
+    if (req.get_param_value("async") == "true") {
+      if (!config_.jobs.enabled) {
+        send_error(res, 400, "Async jobs are disabled");
+        return false;
+      }
+      if (raw || numpy) {
+        send_error(res, 400,
+                   "async=true needs a JSON, MessagePack or CBOR body");
+        return false;
+      }
+      if (jobs_.full()) {
+        res.set_header("Retry-After", "1");
+        send_error(res, 503, "Too many pending jobs");
+        return false;
+      }
+    }
+
+    if (raw) {
+      if (model->input_names.size() != 1) {
+        send_error(res, 400,
+                   "Raw tensor requests require a single-input model");
+        return false;
+      }
+      // Content-Length is the decoded size unless a coding is applied
+      std::string length = req.get_header_value("Content-Length");
+      if (req.has_header("X-Tensor-Shape") && !length.empty() &&
+          !req.has_header("Content-Encoding")) {
+        auto shape =
+            parse_shape_header(req.get_header_value("X-Tensor-Shape"));
+        std::string dtype_name =
+            req.has_header("X-Tensor-Dtype")
+                ? req.get_header_value("X-Tensor-Dtype")
+                : (model->input_types.empty() ? "float32"
+                                              : model->input_types[0]);
+        size_t width = dtype::element_size(dtype_name);
+        if (shape && width > 0) {
+          auto bytes = dtype::checked_byte_size(*shape, width);
+          if (!bytes ||
+              *bytes != std::strtoull(length.c_str(), nullptr, 10)) {
+            send_error(res, 400, "Body size does not match tensor shape");
+            return false;
+          }
+        }
+      }
+    }
+
+    return admit(res);
+  }
+
+  /**
+   * Header-only checks for POST /v1/models/:name/infer:stream
+   */
+  bool check_infer_stream(const httplib::Request &req,
+                          httplib::Response &res, RequestContext &ctx) {
+    std::string model_name = ctx.param("name");
+    if (!model_registry_.has(model_name)) {
+      send_error(res, 404, "Model not found: " + model_name);
+      return false;
+    }
+    return admit(res);
+  }
+
+  /**
+   * Header-only checks for POST /v2/models/:name/infer (v2 error format)
+   */
+  bool check_v2_infer(const httplib::Request &req, httplib::Response &res,
+                      RequestContext &ctx) {
+    std::string model_name = ctx.param("name");
+    if (!model_registry_.has(model_name)) {
+      res.status = 404;
+      res.set_content(json{{"error", "Model not found: " + model_name}}.dump(),
+                      "application/json");
+      return false;
+    }
+    return admit(res);
+  }
+
+  /**
+   * Refuse new work while `batching.max_queue_size` requests are queued
+   */
+  bool admit(httplib::Response &res) {
+    size_t limit = config_.batching.max_queue_size;
+    if (!config_.batching.enabled || limit == 0 ||
+        batch_executor_.queue_size() < limit)
+      return true;
+    res.set_header("Retry-After", "1");
+    send_error(res, 503, "Inference queue is full");
+    return false;
+  }
+
   /**
    * POST /v1/models/:name/infer - Run inference
    */
   void handle_infer(const httplib::Request &req, httplib::Response &res,
                     RequestContext &ctx) {
-    std::string model_name = req.matches[1].str();
+    std::string model_name = ctx.param("name");
+    ctx.model = model_name;
+    bool async = req.get_param_value("async") == "true";
+    if (async && !config_.jobs.enabled) {
+      send_error(res, 400, "Async jobs are disabled");
+      return;
+    }
 
-    // Parse request body
-    json request_body;
-    try {
-      request_body = json::parse(req.body);
-    } catch (const std::exception &e) {
-      res.status = 400;
-      json error = {{"error",
-                     {{"code", 400},
-                      {"message", "Invalid JSON body"},
-                      {"detail", e.what()}}}};
-      res.set_content(error.dump(), "application/json");
+    // Raw single-tensor fast path
+    if (req.get_header_value("Content-Type").find("application/octet-stream") !=
+        std::string::npos) {
+      if (async) {
+        send_error(res, 400,
+                   "async=true needs a JSON, MessagePack or CBOR body");
+        return;
+      }
+      handle_raw_infer(req, res, ctx, model_name);
       return;
     }
 
-    // Validate inputs
-    if (!request_body.contains("inputs")) {
-      res.status = 400;
-      json error = {
-          {"error", {{"code", 400}, {"message", "Missing 'inputs' field"}}}};
-      res.set_content(error.dump(), "application/json");
+    // NumPy .npy / .npz payloads
+    std::string content_type = req.get_header_value("Content-Type");
+    if (content_type.find(npy::NPY_CONTENT_TYPE) != std::string::npos ||
+        content_type.find(npy::NPZ_CONTENT_TYPE) != std::string::npos) {
+      if (async) {
+        send_error(res, 400,
+                   "async=true needs a JSON, MessagePack or CBOR body");
+        return;
+      }
+      handle_npy_infer(req, res, ctx, model_name);
+      return;
+    }
+
+    Encoding request_encoding = content_codec::request_encoding(req);
+
+    InferenceRequest infer_req;
+    infer_req.model_name = model_name;
+    infer_req.request_id = ctx.request_id;
+    infer_req.trace = ctx.trace;
+
+    if (pipeline_ && !async) {
+      run_staged(req, res, std::move(infer_req), request_encoding,
+                 ctx.trace);
+      return;
+    }
+
+    if (!decode_infer_request(req, res, request_encoding, infer_req))
       return;
+
+    if (async) {
+      submit_infer_job(req, res, model_name, std::move(infer_req),
+                       request_encoding);
+      return;
+    }
+
+    run_infer(req, res, model_name, std::move(infer_req), request_encoding,
+              true, &ctx.trace);
+  }
+
+  /**
+   * Decode a JSON, MessagePack or CBOR v1 body into `infer_req.inputs`,
+   * packed as the declared dtypes, marking both steps on its trace. On
+   * failure the error response has been written and false is returned.
+   */
+  bool decode_infer_request(const httplib::Request &req,
+                            httplib::Response &res, Encoding request_encoding,
+                            InferenceRequest &infer_req) {
+    const std::string &model_name = infer_req.model_name;
+
+    // JSON bodies go through the streaming decoder first; it scans numeric
+    // arrays straight into tensor buffers and declines anything unusual
+    bool parsed = false;
+    if (request_encoding == Encoding::Json) {
+      JsonTensorParser::Result result;
+      try {
+        parsed = JsonTensorParser(req.body).parse(result);
+      } catch (const std::exception &e) {
+        send_error(res, 400, "Invalid JSON body", e.what());
+        return false;
+      }
+      if (parsed) {
+        if (!result.has_inputs) {
+          send_error(res, 400, "Missing 'inputs' field");
+          return false;
+        }
+        infer_req.inputs = std::move(result.inputs);
+      }
+    }
+
+    // Parse request body (JSON, MessagePack or CBOR)
+    json request_body;
+    if (!parsed) {
+      try {
+        request_body = content_codec::decode(req.body, request_encoding);
+      } catch (const std::exception &e) {
+        res.status = 400;
+        json error = {{"error",
+                       {{"code", 400},
+                        {"message", std::string("Invalid ") +
+                                        content_codec::name(request_encoding) +
+                                        " body"},
+                        {"detail", e.what()}}}};
+        res.set_content(error.dump(), "application/json");
+        return false;
+      }
+
+      // Validate inputs
+      if (!request_body.contains("inputs")) {
+        res.status = 400;
+        json error = {
+            {"error", {{"code", 400}, {"message", "Missing 'inputs' field"}}}};
+        res.set_content(error.dump(), "application/json");
+        return false;
+      }
     }
 
     // Check model exists
@@ -264,119 +597,1636 @@ private:
           {"error",
            {{"code", 404}, {"message", "Model not found: " + model_name}}}};
       res.set_content(error.dump(), "application/json");
+      return false;
+    }
+
+    try {
+      // Parse inputs
+      if (!parsed) {
+        content_codec::decode_inputs(request_body["inputs"], request_encoding,
+                                     infer_req.inputs);
+      }
+      infer_req.trace.mark(RequestTrace::Decoded);
+
+      // JSON numbers arrive as float32/int64; pack them as the declared dtype
+      for (auto &input : infer_req.inputs) {
+        coerce_to_dtype(input);
+      }
+      infer_req.trace.mark(RequestTrace::Validated);
+    } catch (const std::invalid_argument &e) {
+      send_error(res, 400, "Invalid input", e.what());
+      return false;
+    } catch (const std::exception &e) {
+      LOG_ERROR("Inference error for model {}: {}", model_name, e.what());
+      send_error(res, 500, "Inference failed", e.what());
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Execute a parsed v1 request and write its response. Shared by
+   * synchronous requests and async job workers; only the former may stream
+   * (a job's result is stored as a buffered body) or report a `trace`.
+   */
+  void run_infer(const httplib::Request &req, httplib::Response &res,
+                 const std::string &model_name, InferenceRequest &&infer_req,
+                 Encoding request_encoding, bool allow_stream,
+                 RequestTrace *trace = nullptr) {
+    InferenceResponse infer_res;
+    try {
+      // Run inference (through batch executor if enabled)
+      infer_res = execute(std::move(infer_req));
+    } catch (const std::invalid_argument &e) {
+      send_error(res, 400, "Invalid input", e.what());
+      return;
+    } catch (const std::exception &e) {
+      LOG_ERROR("Inference error for model {}: {}", model_name, e.what());
+      send_error(res, 500, "Inference failed", e.what());
+      return;
+    }
+
+    finish_infer(req, res, model_name, std::move(infer_res), request_encoding,
+                 allow_stream, trace);
+  }
+
+  /**
+   * Write the response for a finished v1 inference; `trace`, if given,
+   * receives the inference's marks and the encode mark
+   */
+  void finish_infer(const httplib::Request &req, httplib::Response &res,
+                    const std::string &model_name,
+                    InferenceResponse &&infer_res, Encoding request_encoding,
+                    bool allow_stream, RequestTrace *trace = nullptr) {
+    if (!infer_res.success) {
+      send_error(res, 500, "Inference failed", infer_res.error);
       return;
     }
+    if (trace)
+      trace->merge(infer_res.trace);
 
     try {
-      // Create inference request
-      InferenceRequest infer_req;
-      infer_req.model_name = model_name;
-      infer_req.request_id = ctx.request_id;
+      // Record inference metrics
+      metrics_.record_inference(model_name,
+                                infer_res.inference_time_ms / 1000.0,
+                                infer_res.queue_time_ms / 1000.0);
 
-      // Parse inputs
-      for (auto &[name, tensor] : request_body["inputs"].items()) {
-        TensorData input;
-        input.name = name;
+      // Build response
+      write_infer_response(req, res, model_name, std::move(infer_res),
+                           request_encoding, allow_stream);
+      if (trace)
+        trace->mark(RequestTrace::Encoded);
 
-        if (tensor.contains("shape")) {
-          input.shape = tensor["shape"].get<std::vector<int64_t>>();
-        }
+    } catch (const std::invalid_argument &e) {
+      send_error(res, 400, "Invalid input", e.what());
+    } catch (const std::exception &e) {
+      LOG_ERROR("Inference error for model {}: {}", model_name, e.what());
+      send_error(res, 500, "Inference failed", e.what());
+    }
+  }
 
-        if (tensor.contains("data")) {
-          // Handle different data types
-          if (tensor["data"].is_array()) {
-            parse_tensor_data(tensor["data"], input);
-          }
+  /**
+   * Completes a staged request exactly once. If the last stage holding it
+   * lets go without completing it, e.g. because it threw, it answers 500
+   * then, so neither a waiting worker nor the connection hangs.
+   */
+  class StagedCompletion {
+  public:
+    StagedCompletion(httplib::Response &res,
+                     DeferredResponse::Completion done)
+        : res_(res), done_(std::move(done)) {}
+
+    ~StagedCompletion() {
+      if (!done_)
+        return;
+      try {
+        send_error(res_, 500, "Inference failed",
+                   "Request was dropped by the pipeline");
+        done_();
+      } catch (const std::exception &e) {
+        LOG_ERROR("Could not complete a dropped staged request: {}",
+                  e.what());
+      }
+    }
+
+    StagedCompletion(const StagedCompletion &) = delete;
+    StagedCompletion &operator=(const StagedCompletion &) = delete;
+
+    void operator()() {
+      auto done = std::move(done_);
+      done_ = nullptr;
+      if (done)
+        done();
+    }
+
+  private:
+    httplib::Response &res_;
+    DeferredResponse::Completion done_;
+  };
+
+  /**
+   * Run a synchronous v1 request through the stage pipeline: decode on the
+   * decode pool, execute on the batcher, write the response on the encode
+   * pool. A full stage queue answers 503.
+   *
+   * Where the backend can complete the response later (epoll), the HTTP
+   * worker returns as soon as the decode stage has the request, and the
+   * stage that finishes it completes the response. Otherwise the worker
+   * waits for that stage. Either way `req`, `res` and `trace`, which the
+   * encode stage completes, stay valid until then.
+   */
+  void run_staged(const httplib::Request &req, httplib::Response &res,
+                  InferenceRequest &&infer_req, Encoding request_encoding,
+                  RequestTrace &trace) {
+    using Stage = StagePipeline::Stage;
+
+    DeferredResponse::Completion done = DeferredResponse::detach();
+    std::future<void> finished;
+    if (!done) {
+      auto waiting = std::make_shared<std::promise<void>>();
+      finished = waiting->get_future();
+      done = [waiting] { waiting->set_value(); };
+    }
+    auto complete = std::make_shared<StagedCompletion>(res, std::move(done));
+    auto request = std::make_shared<InferenceRequest>(std::move(infer_req));
+
+    auto encode = [this, &req, &res, &trace, request_encoding,
+                   complete](const std::string &model_name,
+                             InferenceResponse response) {
+      auto result = std::make_shared<InferenceResponse>(std::move(response));
+      bool queued = pipeline_->run(Stage::Encode, [this, &req, &res, &trace,
+                                                  model_name, result,
+                                                  request_encoding, complete] {
+        try {
+          finish_infer(req, res, model_name, std::move(*result),
+                       request_encoding, true, &trace);
+        } catch (const std::exception &e) {
+          send_error(res, 500, "Inference failed", e.what());
         }
+        (*complete)();
+      });
+      if (!queued) {
+        res.set_header("Retry-After", "1");
+        send_error(res, 503, "Encode queue is full");
+        (*complete)();
+      }
+    };
 
-        if (tensor.contains("dtype")) {
-          input.dtype = tensor["dtype"];
+    auto decode = [this, &req, &res, request, request_encoding, complete,
+                   encode] {
+      auto *stage = execute_metrics_;
+      try {
+        if (!decode_infer_request(req, res, request_encoding, *request)) {
+          (*complete)();
+          return;
         }
 
-        infer_req.inputs.push_back(std::move(input));
+        std::string model_name = request->model_name;
+        batch_executor_.submit(
+            std::move(*request),
+            [model_name, stage, encode](InferenceResponse response) {
+              stage->wait.observe(response.queue_time_ms / 1000.0);
+              stage->duration.observe(response.inference_time_ms / 1000.0);
+              encode(model_name, std::move(response));
+            });
+      } catch (const std::exception &e) {
+        // Thrown before the batcher took the request
+        send_error(res, 500, "Inference failed", e.what());
+        (*complete)();
+        return;
       }
+      stage->depth.set(static_cast<double>(batch_executor_.queue_size()));
+    };
 
-      // Run inference (through batch executor if enabled)
-      InferenceResponse infer_res;
-      if (config_.batching.enabled) {
-        infer_res = batch_executor_.submit(std::move(infer_req)).get();
-      } else {
-        infer_res = model_registry_.run_inference(infer_req);
-      }
+    if (!pipeline_->run(Stage::Decode, std::move(decode))) {
+      res.set_header("Retry-After", "1");
+      send_error(res, 503, "Decode queue is full");
+      (*complete)();
+      return;
+    }
+    if (finished.valid())
+      finished.wait();
+  }
 
-      // Build response
-      json response = {{"model_name", model_name}, {"outputs", json::object()}};
+  /**
+   * GET /v1/models/:name/ws - upgrade to a WebSocket inference channel.
+   * Messages go to the batcher through completion callbacks, so pipelined
+   * requests hold neither a worker nor a batch slot while they wait.
+   */
+  std::shared_ptr<websocket::Session>
+  open_inference_socket(const httplib::Request &req, httplib::Response &res,
+                        RequestContext &ctx,
+                        std::shared_ptr<websocket::Channel> channel) {
+    std::string model_name = ctx.param("name");
+    if (!model_registry_.has(model_name)) {
+      send_error(res, 404, "Model not found: " + model_name);
+      return nullptr;
+    }
 
-      for (const auto &output : infer_res.outputs) {
-        response["outputs"][output.name] = {
-            {"shape", output.shape},
-            {"data", output.float_data.empty() ? json(output.int_data)
-                                               : json(output.float_data)}};
+    auto submit = [this](InferenceRequest &&request,
+                         InferenceSocket::Done done) {
+      if (!config_.batching.enabled) {
+        done(model_registry_.run_inference(request));
+        return true;
       }
+      size_t limit = config_.batching.max_queue_size;
+      if (limit > 0 && batch_executor_.queue_size() >= limit)
+        return false;
+      batch_executor_.submit(std::move(request), std::move(done));
+      return true;
+    };
+    auto on_result = [this, model_name](const InferenceResponse &response) {
+      metrics_.record_inference(model_name,
+                                response.inference_time_ms / 1000.0,
+                                response.queue_time_ms / 1000.0);
+    };
+    return std::make_shared<InferenceSocket>(
+        model_name, ctx.request_id, json_precision(req), std::move(channel),
+        std::move(submit), std::move(on_result));
+  }
 
-      // Include timing info if available
-      if (infer_res.inference_time_ms > 0) {
-        response["timing"] = {{"inference_ms", infer_res.inference_time_ms},
-                              {"queue_ms", infer_res.queue_time_ms}};
+  /**
+   * POST /v1/models/:name/infer:stream - NDJSON bulk inference
+   *
+   * Each body line is an independent v1 request document (optionally with
+   * an "id"). Instances are fed to the batcher as they are parsed, with at
+   * most `max_in_flight` outstanding, and one result line per instance is
+   * streamed back in input order. Per-instance failures become error lines
+   * and do not end the stream.
+   */
+  void handle_infer_stream(const httplib::Request &req, httplib::Response &res,
+                           RequestContext &ctx) {
+    std::string model_name = ctx.param("name");
+    if (!model_registry_.has(model_name)) {
+      send_error(res, 404, "Model not found: " + model_name);
+      return;
+    }
+
+    size_t max_in_flight = config_.streaming.max_in_flight;
+    if (req.has_param("max_in_flight")) {
+      try {
+        max_in_flight = std::clamp<size_t>(
+            std::stoul(req.get_param_value("max_in_flight")), 1,
+            max_in_flight);
+      } catch (const std::exception &) {
+        send_error(res, 400, "Invalid max_in_flight parameter");
+        return;
       }
+    }
 
-      res.status = 200;
-      res.set_content(response.dump(), "application/json");
+    int precision = json_precision(req);
+    auto stream = std::make_shared<NdjsonStream>(
+        req.body, max_in_flight,
+        [this, model_name, request_id = ctx.request_id](
+            std::string_view line, NdjsonStream::Instance &instance) {
+          submit_stream_instance(model_name, request_id, line, instance);
+        },
+        [this, model_name, precision](NdjsonStream::Instance &instance) {
+          return write_stream_result(model_name, precision, instance);
+        });
 
-      // Record inference metrics
-      metrics_.record_inference(model_name,
-                                infer_res.inference_time_ms / 1000.0);
+    res.status = 200;
+    res.set_chunked_content_provider(
+        "application/x-ndjson", [stream](size_t, httplib::DataSink &sink) {
+          std::string chunk;
+          if (!stream->next(chunk)) {
+            sink.done();
+            return true;
+          }
+          return sink.write(chunk.data(), chunk.size());
+        });
+  }
+
+  /**
+   * Parse one NDJSON instance and submit it without waiting for the result
+   */
+  void submit_stream_instance(const std::string &model_name,
+                              const std::string &request_id,
+                              std::string_view line,
+                              NdjsonStream::Instance &instance) {
+    InferenceRequest infer_req;
+    infer_req.model_name = model_name;
+    infer_req.request_id = request_id + "." + std::to_string(instance.index);
 
+    try {
+      json extra = content_codec::decode_json_instance(line, infer_req.inputs);
+      if (extra.contains("id"))
+        instance.id = std::move(extra["id"]);
     } catch (const std::exception &e) {
-      LOG_ERROR("Inference error for model {}: {}", model_name, e.what());
-      res.status = 500;
-      json error = {{"error",
-                     {{"code", 500},
-                      {"message", "Inference failed"},
-                      {"detail", e.what()}}}};
-      res.set_content(error.dump(), "application/json");
+      instance.error_status = 400;
+      instance.error = e.what();
+      return;
     }
+
+    instance.result = submit_inference(std::move(infer_req));
   }
 
   /**
-   * GET /metrics - Prometheus metrics
+   * Render one NDJSON result line:
+   * {"index": n, "id": ..., "outputs": {...}} or {"index": n, "error": {...}}
    */
-  void handle_metrics(const httplib::Request &req, httplib::Response &res,
-                      RequestContext &ctx) {
-    std::string output = metrics_.export_prometheus();
-    res.status = 200;
-    res.set_content(output, "text/plain; version=0.0.4; charset=utf-8");
+  std::string write_stream_result(const std::string &model_name,
+                                  int precision,
+                                  NdjsonStream::Instance &instance) {
+    std::string message = "Invalid input";
+    if (instance.error_status == 0) {
+      try {
+        InferenceResponse infer_res = instance.result.get();
+        if (!infer_res.success)
+          throw std::runtime_error(infer_res.error);
+        metrics_.record_inference(model_name,
+                                  infer_res.inference_time_ms / 1000.0,
+                                  infer_res.queue_time_ms / 1000.0);
+
+        JsonWriter writer(precision);
+        size_t estimate = 128;
+        for (const auto &output : infer_res.outputs) {
+          estimate += writer.estimate_size(output);
+        }
+        writer.reserve(estimate);
+
+        writer.begin_object();
+        writer.key("index").value(instance.index);
+        if (!instance.id.is_null())
+          writer.key("id").value(instance.id);
+        writer.key("outputs").tensors(infer_res.outputs);
+        writer.end_object();
+        return writer.take();
+      } catch (const std::invalid_argument &e) {
+        instance.error_status = 400;
+        instance.error = e.what();
+      } catch (const std::exception &e) {
+        LOG_ERROR("Inference error for model {}: {}", model_name, e.what());
+        instance.error_status = 500;
+        instance.error = e.what();
+        message = "Inference failed";
+      }
+    }
+
+    json line = {{"index", instance.index}};
+    if (!instance.id.is_null())
+      line["id"] = instance.id;
+    line["error"] = {{"code", instance.error_status},
+                     {"message", message},
+                     {"detail", instance.error}};
+    return line.dump();
   }
 
   /**
-   * Helper to get ISO timestamp
+   * POST /v1/infer:multi - run several models on one request
+   *
+   * {"inputs": {<shared tensors>},
+   *  "items": [{"id": ..., "model": "m", "inputs": {...}}, ...]}
+   *
+   * An item input given as a string names a shared tensor, which is
+   * decoded once and borrowed by every item referencing it. All items are
+   * submitted before any result is awaited, so they wait on their models'
+   * batchers at the same time. Results come back in item order; a failing
+   * item gets an error entry and does not fail the others.
    */
-  static std::string get_iso_timestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto time = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::gmtime(&time), "%Y-%m-%dT%H:%M:%SZ");
-    return ss.str();
+  void handle_infer_multi(const httplib::Request &req, httplib::Response &res,
+                          RequestContext &ctx) {
+    Encoding request_encoding = content_codec::request_encoding(req);
+
+    json body;
+    try {
+      body = content_codec::decode(req.body, request_encoding);
+    } catch (const std::exception &e) {
+      send_error(res, 400,
+                 std::string("Invalid ") +
+                     content_codec::name(request_encoding) + " body",
+                 e.what());
+      return;
+    }
+    if (!body.is_object() || !body.contains("items") ||
+        !body["items"].is_array() || body["items"].empty()) {
+      send_error(res, 400, "Missing 'items' array");
+      return;
+    }
+
+    // Shared tensors outlive every item borrowing them: all results are
+    // collected before this function returns
+    std::vector<TensorData> shared;
+    try {
+      if (body.contains("inputs")) {
+        content_codec::decode_inputs(body["inputs"], request_encoding,
+                                     shared);
+      }
+      for (auto &input : shared) {
+        coerce_to_dtype(input);
+      }
+    } catch (const std::exception &e) {
+      send_error(res, 400, "Invalid input", e.what());
+      return;
+    }
+
+    json &specs = body["items"];
+    std::vector<MultiItem> items(specs.size());
+    for (size_t i = 0; i < specs.size(); ++i) {
+      MultiItem &item = items[i];
+      try {
+        InferenceRequest infer_req;
+        if (!prepare_multi_item(specs[i], shared, request_encoding, item,
+                                infer_req))
+          continue;
+        infer_req.request_id = ctx.request_id + "." + std::to_string(i);
+        item.result = submit_inference(std::move(infer_req));
+      } catch (const std::exception &e) {
+        item.error_status = 400;
+        item.error = e.what();
+      }
+    }
+
+    for (auto &item : items) {
+      if (item.error_status != 0)
+        continue;
+      try {
+        item.response = item.result.get();
+        if (!item.response.success)
+          throw std::runtime_error(item.response.error);
+        metrics_.record_inference(item.model,
+                                  item.response.inference_time_ms / 1000.0,
+                                  item.response.queue_time_ms / 1000.0);
+      } catch (const std::exception &e) {
+        LOG_ERROR("Inference error for model {}: {}", item.model, e.what());
+        item.error_status = 500;
+        item.message = "Inference failed";
+        item.error = e.what();
+      }
+    }
+
+    write_multi_response(req, res, items,
+                         content_codec::response_encoding(req,
+                                                          request_encoding));
   }
 
+  struct MultiItem {
+    json id;
+    std::string model;
+    std::future<InferenceResponse> result;
+    InferenceResponse response;
+    int error_status = 0; // Set when the item failed
+    std::string message = "Invalid input";
+    std::string error;
+  };
+
   /**
-   * Helper to parse tensor data from JSON
+   * Build one item's request; false (with the error set on `item`) if the
+   * model does not exist. Throws std::invalid_argument on malformed items.
    */
-  static void parse_tensor_data(const json &data, TensorData &tensor) {
-    // Flatten nested arrays and store as float data by default
-    std::function<void(const json &)> flatten = [&](const json &arr) {
-      if (arr.is_array()) {
-        for (const auto &item : arr) {
-          flatten(item);
-        }
-      } else if (arr.is_number_float()) {
-        tensor.float_data.push_back(arr.get<float>());
-      } else if (arr.is_number_integer()) {
-        tensor.float_data.push_back(static_cast<float>(arr.get<int64_t>()));
+  bool prepare_multi_item(json &spec, const std::vector<TensorData> &shared,
+                          Encoding encoding, MultiItem &item,
+                          InferenceRequest &infer_req) {
+    if (!spec.is_object() || !spec.contains("model") ||
+        !spec["model"].is_string())
+      throw std::invalid_argument("Item needs a 'model' name");
+    item.model = spec["model"].get<std::string>();
+    if (spec.contains("id"))
+      item.id = spec["id"];
+    if (!model_registry_.has(item.model)) {
+      item.error_status = 404;
+      item.message = "Model not found";
+      item.error = "Model not found: " + item.model;
+      return false;
+    }
+    if (!spec.contains("inputs") || !spec["inputs"].is_object())
+      throw std::invalid_argument("Missing 'inputs' field");
+
+    infer_req.model_name = item.model;
+    json own = json::object();
+    for (auto &[name, value] : spec["inputs"].items()) {
+      if (!value.is_string()) {
+        own[name] = std::move(value);
+        continue;
       }
+
+      // Reference to a shared tensor: borrow its buffer
+      const std::string &ref = value.get_ref<const std::string &>();
+      auto it = std::find_if(
+          shared.begin(), shared.end(),
+          [&ref](const TensorData &tensor) { return tensor.name == ref; });
+      if (it == shared.end())
+        throw std::invalid_argument("Unknown shared input '" + ref + "'");
+
+      TensorData input;
+      input.name = name;
+      input.dtype = it->dtype;
+      input.shape = it->shape;
+      input.external_data = it->data();
+      input.external_size = it->byte_size();
+      infer_req.inputs.push_back(std::move(input));
+    }
+
+    size_t borrowed = infer_req.inputs.size();
+    content_codec::decode_inputs(own, encoding, infer_req.inputs);
+    for (size_t i = borrowed; i < infer_req.inputs.size(); ++i) {
+      coerce_to_dtype(infer_req.inputs[i]);
+    }
+    return true;
+  }
+
+  /**
+   * {"results": [{"id", "model", "outputs", "timing"} or
+   *              {"id", "model", "error": {...}}, ...]}
+   */
+  void write_multi_response(const httplib::Request &req,
+                            httplib::Response &res,
+                            const std::vector<MultiItem> &items,
+                            Encoding encoding) {
+    auto error_entry = [](const MultiItem &item) {
+      return json{{"code", item.error_status},
+                  {"message", item.message},
+                  {"detail", item.error}};
     };
 
-    flatten(data);
+    res.status = 200;
+    if (encoding == Encoding::Json) {
+      JsonWriter writer(json_precision(req));
+      size_t estimate = 64;
+      for (const auto &item : items) {
+        for (const auto &output : item.response.outputs) {
+          estimate += writer.estimate_size(output);
+        }
+        estimate += 128;
+      }
+      writer.reserve(estimate);
+
+      writer.begin_object();
+      writer.key("results").begin_array();
+      for (const auto &item : items) {
+        writer.begin_object();
+        if (!item.id.is_null())
+          writer.key("id").value(item.id);
+        writer.key("model").value(item.model);
+        if (item.error_status != 0) {
+          writer.key("error").value(error_entry(item));
+        } else {
+          writer.key("outputs").tensors(item.response.outputs);
+          writer.key("timing").begin_object();
+          writer.key("inference_ms").value(item.response.inference_time_ms);
+          writer.key("queue_ms").value(item.response.queue_time_ms);
+          writer.end_object();
+        }
+        writer.end_object();
+      }
+      writer.end_array();
+      writer.end_object();
+      res.set_content(writer.take(), "application/json");
+      return;
+    }
+
+    // Binary encodings carry outputs as typed byte arrays
+    json results = json::array();
+    for (const auto &item : items) {
+      json entry = json::object();
+      if (!item.id.is_null())
+        entry["id"] = item.id;
+      entry["model"] = item.model;
+      if (item.error_status != 0) {
+        entry["error"] = error_entry(item);
+      } else {
+        json outputs = json::object();
+        for (const auto &output : item.response.outputs) {
+          outputs[output.name] = {
+              {"shape", output.shape},
+              {"dtype", output.dtype},
+              {"data", content_codec::binary_tensor(output, encoding)}};
+        }
+        entry["outputs"] = std::move(outputs);
+        entry["timing"] = {
+            {"inference_ms", item.response.inference_time_ms},
+            {"queue_ms", item.response.queue_time_ms}};
+      }
+      results.push_back(std::move(entry));
+    }
+    res.set_content(content_codec::encode(json{{"results", results}}, encoding),
+                    content_codec::content_type(encoding));
+  }
+
+  /**
+   * Encode a v1 inference response in the format the client accepts:
+   * NumPy (.npy for one output, .npz for several) or a JSON-family document.
+   * With `allow_stream`, large JSON and NumPy responses are sent straight
+   * from the output tensors instead of being assembled in memory first.
+   */
+  void write_infer_response(const httplib::Request &req,
+                            httplib::Response &res,
+                            const std::string &model_name,
+                            InferenceResponse &&infer_res,
+                            Encoding request_encoding, bool allow_stream) {
+    std::string accept = req.get_header_value("Accept");
+    auto result =
+        std::make_shared<const InferenceResponse>(std::move(infer_res));
+
+    if (accept.find(npy::NPY_CONTENT_TYPE) != std::string::npos) {
+      const TensorData *output = nullptr;
+      std::string wanted = req.get_header_value("X-Output-Name");
+      for (const auto &candidate : result->outputs) {
+        if (wanted.empty() ? result->outputs.size() == 1
+                           : candidate.name == wanted) {
+          output = &candidate;
+          break;
+        }
+      }
+      if (!output) {
+        send_error(res, 406,
+                   "application/x-npy needs a single output; select one "
+                   "with X-Output-Name or accept application/x-npz");
+        return;
+      }
+      res.status = 200;
+      res.set_header("X-Output-Name", output->name);
+      std::vector<const TensorData *> outputs = {output};
+      send_npy(req, res, result, outputs, npy::NPY_CONTENT_TYPE,
+               allow_stream);
+      return;
+    }
+
+    if (accept.find(npy::NPZ_CONTENT_TYPE) != std::string::npos) {
+      std::vector<const TensorData *> outputs;
+      for (const auto &output : result->outputs) {
+        outputs.push_back(&output);
+      }
+      res.status = 200;
+      send_npy(req, res, result, outputs, npy::NPZ_CONTENT_TYPE,
+               allow_stream);
+      return;
+    }
+
+    Encoding response_encoding =
+        content_codec::response_encoding(req, request_encoding);
+
+    if (response_encoding == Encoding::Json) {
+      res.status = 200;
+      if (allow_stream) {
+        JsonWriter writer(json_precision(req));
+        size_t estimate = 256;
+        for (const auto &output : result->outputs) {
+          estimate += writer.estimate_size(output);
+        }
+        if (stream_response(req, estimate, "application/json")) {
+          auto stream = std::make_shared<JsonResponseStream>(
+              result, model_name, json_precision(req),
+              config_.streaming.response_chunk_bytes);
+          res.set_chunked_content_provider(
+              "application/json", [stream](size_t, httplib::DataSink &sink) {
+                std::string chunk;
+                if (!stream->next(chunk)) {
+                  sink.done();
+                  return true;
+                }
+                return sink.write(chunk.data(), chunk.size());
+              });
+          return;
+        }
+      }
+      res.set_content(write_json_response(req, model_name, *result),
+                      "application/json");
+      return;
+    }
+
+    json response = {{"model_name", model_name}, {"outputs", json::object()}};
+
+    // Binary encodings carry outputs as typed byte arrays
+    for (const auto &output : result->outputs) {
+      response["outputs"][output.name] = {
+          {"shape", output.shape},
+          {"dtype", output.dtype},
+          {"data", content_codec::binary_tensor(output, response_encoding)}};
+    }
+
+    // Include timing info if available
+    if (result->inference_time_ms > 0) {
+      response["timing"] = {{"inference_ms", result->inference_time_ms},
+                            {"queue_ms", result->queue_time_ms}};
+    }
+
+    res.status = 200;
+    res.set_content(content_codec::encode(response, response_encoding),
+                    content_codec::content_type(response_encoding));
+  }
+
+  /**
+   * Send outputs as .npy (one) or .npz (several). Large archives are served
+   * from the output buffers through a fixed-length content provider.
+   */
+  void send_npy(const httplib::Request &req, httplib::Response &res,
+                std::shared_ptr<const InferenceResponse> result,
+                const std::vector<const TensorData *> &outputs,
+                const char *content_type, bool allow_stream) {
+    size_t estimate = 0;
+    for (const auto *output : outputs) {
+      estimate += output->byte_size();
+    }
+    bool single = std::string(content_type) == npy::NPY_CONTENT_TYPE;
+
+    if (!allow_stream || !stream_response(req, estimate, content_type)) {
+      res.set_content(single ? npy::write_npy(*outputs.front())
+                             : npy::write_npz(outputs),
+                      content_type);
+      return;
+    }
+
+    auto body = std::make_shared<SegmentedBody>();
+    if (single) {
+      const TensorData &output = *outputs.front();
+      body->append(npy::npy_preamble(output));
+      if (output.dtype == "int32" && !output.int_data.empty()) {
+        std::string bytes;
+        append_tensor_bytes(bytes, output);
+        body->append(std::move(bytes));
+      } else {
+        body->append_view(static_cast<const char *>(output.data()),
+                          output.byte_size());
+      }
+    } else {
+      npy::write_npz_to(outputs, *body);
+    }
+
+    res.set_content_provider(
+        body->size(), content_type,
+        [result, body](size_t offset, size_t length,
+                       httplib::DataSink &sink) {
+          return body->write(offset, length, sink);
+        });
+  }
+
+  /**
+   * Whether a response of about `estimate` bytes should be streamed rather
+   * than buffered. Only large responses are, and only when the client would
+   * not get them compressed: compression works on buffered bodies.
+   */
+  bool stream_response(const httplib::Request &req, size_t estimate,
+                       const std::string &content_type) const {
+    size_t threshold = config_.streaming.response_threshold_bytes;
+    if (threshold == 0 || estimate < threshold)
+      return false;
+
+    const auto &settings = config_.compression;
+    if (!settings.enabled || !compression::compressible(content_type))
+      return true;
+
+    std::vector<compression::Codec> codecs;
+    for (const auto &algorithm : settings.algorithms) {
+      compression::Codec codec;
+      if (compression::from_name(algorithm, codec))
+        codecs.push_back(codec);
+    }
+    return compression::negotiate(req.get_header_value("Accept-Encoding"),
+                                  codecs) == compression::Codec::Identity;
+  }
+
+  /**
+   * Serialize a v1 JSON inference response without building a DOM
+   */
+  std::string write_json_response(const httplib::Request &req,
+                                  const std::string &model_name,
+                                  const InferenceResponse &infer_res) const {
+    JsonWriter writer(json_precision(req));
+
+    size_t estimate = 256;
+    for (const auto &output : infer_res.outputs) {
+      estimate += writer.estimate_size(output);
+    }
+    writer.reserve(estimate);
+
+    writer.begin_object();
+    writer.key("model_name").value(model_name);
+    writer.key("outputs").tensors(infer_res.outputs);
+
+    // Include timing info if available
+    if (infer_res.inference_time_ms > 0) {
+      writer.key("timing").begin_object();
+      writer.key("inference_ms").value(infer_res.inference_time_ms);
+      writer.key("queue_ms").value(infer_res.queue_time_ms);
+      writer.end_object();
+    }
+    writer.end_object();
+
+    return writer.take();
+  }
+
+  /**
+   * Significant digits for JSON floats: `?precision=N` overrides
+   * server.json_float_precision; 0 means shortest round-trip
+   */
+  int json_precision(const httplib::Request &req) const {
+    if (req.has_param("precision")) {
+      try {
+        int precision = std::stoi(req.get_param_value("precision"));
+        return std::clamp(precision, 0, 17);
+      } catch (const std::exception &) {
+      }
+    }
+    return config_.server.json_float_precision;
+  }
+
+  /**
+   * POST /v1/models/:name/infer with a NumPy body
+   *
+   * application/x-npy carries the single input of the model (or the one named
+   * by X-Input-Name); application/x-npz carries one member per input name.
+   * Array data is used in place as the tensor buffer.
+   */
+  void handle_npy_infer(const httplib::Request &req, httplib::Response &res,
+                        RequestContext &ctx, const std::string &model_name) {
+    auto model_opt = model_registry_.get(model_name);
+    if (!model_opt) {
+      send_error(res, 404, "Model not found: " + model_name);
+      return;
+    }
+    const auto &model = *model_opt;
+
+    InferenceRequest infer_req;
+    infer_req.model_name = model_name;
+    infer_req.request_id = ctx.request_id;
+    infer_req.trace = ctx.trace;
+
+    try {
+      if (req.get_header_value("Content-Type").find(npy::NPZ_CONTENT_TYPE) !=
+          std::string::npos) {
+        infer_req.inputs = npy::parse_npz(req.body);
+      } else {
+        TensorData input;
+        if (req.has_header("X-Input-Name")) {
+          input.name = req.get_header_value("X-Input-Name");
+        } else if (model.input_names.size() == 1) {
+          input.name = model.input_names[0];
+        } else {
+          send_error(res, 400,
+                     "Model has multiple inputs; send application/x-npz or "
+                     "set X-Input-Name");
+          return;
+        }
+        npy::parse_npy(req.body.data(), req.body.size(), input);
+        infer_req.inputs.push_back(std::move(input));
+      }
+    } catch (const std::exception &e) {
+      send_error(res, 400, "Invalid NumPy payload", e.what());
+      return;
+    }
+    infer_req.trace.mark(RequestTrace::Decoded);
+
+    for (const auto &input : infer_req.inputs) {
+      if (std::find(model.input_names.begin(), model.input_names.end(),
+                    input.name) == model.input_names.end()) {
+        send_error(res, 400, "Unknown input for model " + model_name + ": " +
+                                 input.name);
+        return;
+      }
+    }
+    infer_req.trace.mark(RequestTrace::Validated);
+
+    try {
+      InferenceResponse infer_res = execute(std::move(infer_req));
+      if (!infer_res.success) {
+        send_error(res, 500, "Inference failed", infer_res.error);
+        return;
+      }
+      ctx.trace.merge(infer_res.trace);
+      metrics_.record_inference(model_name,
+                                infer_res.inference_time_ms / 1000.0,
+                                infer_res.queue_time_ms / 1000.0);
+      write_infer_response(req, res, model_name, std::move(infer_res),
+                           Encoding::Json, true);
+      ctx.trace.mark(RequestTrace::Encoded);
+    } catch (const std::exception &e) {
+      LOG_ERROR("Inference error for model {}: {}", model_name, e.what());
+      send_error(res, 500, "Inference failed", e.what());
+    }
+  }
+
+  /**
+   * POST /v1/models/:name/infer with Content-Type: application/octet-stream
+   *
+   * The body is the raw little-endian buffer of the model's single input and
+   * is handed to ONNX Runtime without copying. Shape and dtype come from the
+   * X-Tensor-Shape / X-Tensor-Dtype headers or the model signature. The
+   * response body is the raw output tensor, described by the same headers.
+   */
+  void handle_raw_infer(const httplib::Request &req, httplib::Response &res,
+                        RequestContext &ctx, const std::string &model_name) {
+    auto model_opt = model_registry_.get(model_name);
+    if (!model_opt) {
+      send_error(res, 404, "Model not found: " + model_name);
+      return;
+    }
+    const auto &model = *model_opt;
+
+    if (model.input_names.size() != 1) {
+      send_error(res, 400,
+                 "Raw tensor requests require a single-input model");
+      return;
+    }
+
+    // Select the output to return
+    std::string output_name;
+    if (req.has_header("X-Output-Name")) {
+      output_name = req.get_header_value("X-Output-Name");
+      if (std::find(model.output_names.begin(), model.output_names.end(),
+                    output_name) == model.output_names.end()) {
+        send_error(res, 400, "Unknown output: " + output_name);
+        return;
+      }
+    } else if (model.output_names.size() == 1) {
+      output_name = model.output_names[0];
+    } else {
+      send_error(res, 400,
+                 "Model has multiple outputs; select one with X-Output-Name");
+      return;
+    }
+
+    TensorData input;
+    input.name = model.input_names[0];
+    input.dtype = req.has_header("X-Tensor-Dtype")
+                      ? req.get_header_value("X-Tensor-Dtype")
+                      : (model.input_types.empty() ? "float32"
+                                                   : model.input_types[0]);
+
+    size_t element_size = dtype::element_size(input.dtype);
+    if (element_size == 0 || req.body.size() % element_size != 0) {
+      send_error(res, 400, "Body size is not a multiple of dtype " +
+                               input.dtype);
+      return;
+    }
+    size_t element_count = req.body.size() / element_size;
+
+    if (req.has_header("X-Tensor-Shape")) {
+      auto shape = parse_shape_header(req.get_header_value("X-Tensor-Shape"));
+      if (!shape) {
+        send_error(res, 400, "Invalid X-Tensor-Shape header");
+        return;
+      }
+      input.shape = std::move(*shape);
+    } else if (!model.input_shapes.empty()) {
+      // Resolve a single dynamic dimension from the body size
+      input.shape = model.input_shapes[0];
+      size_t known = 1;
+      int dynamic = -1;
+      for (size_t i = 0; i < input.shape.size(); ++i) {
+        if (input.shape[i] < 0) {
+          if (dynamic >= 0) {
+            send_error(res, 400,
+                       "Model input has several dynamic dimensions; "
+                       "send X-Tensor-Shape");
+            return;
+          }
+          dynamic = static_cast<int>(i);
+        } else {
+          known *= static_cast<size_t>(input.shape[i]);
+        }
+      }
+      if (dynamic >= 0 && known > 0) {
+        input.shape[dynamic] = static_cast<int64_t>(element_count / known);
+      }
+    }
+
+    auto count = dtype::checked_element_count(input.shape);
+    if (!count || *count != element_count) {
+      send_error(res, 400, "Body size does not match tensor shape");
+      return;
+    }
+
+    if (reinterpret_cast<uintptr_t>(req.body.data()) % element_size == 0) {
+      input.external_data = req.body.data();
+      input.external_size = req.body.size();
+    } else {
+      input.raw_data.assign(req.body.begin(), req.body.end());
+    }
+
+    InferenceRequest infer_req;
+    infer_req.model_name = model_name;
+    infer_req.request_id = ctx.request_id;
+    infer_req.inputs.push_back(std::move(input));
+    // The body is used as is, so there is no decode phase
+    infer_req.trace = ctx.trace;
+    infer_req.trace.mark(RequestTrace::Validated);
+
+    auto result = std::make_shared<InferenceResponse>();
+    try {
+      *result = execute(std::move(infer_req));
+    } catch (const std::exception &e) {
+      LOG_ERROR("Inference error for model {}: {}", model_name, e.what());
+      send_error(res, 500, "Inference failed", e.what());
+      return;
+    }
+    if (!result->success) {
+      send_error(res, 500, "Inference failed", result->error);
+      return;
+    }
+    ctx.trace.merge(result->trace);
+
+    const TensorData *output = nullptr;
+    for (const auto &candidate : result->outputs) {
+      if (candidate.name == output_name) {
+        output = &candidate;
+        break;
+      }
+    }
+    if (!output) {
+      send_error(res, 500, "Model produced no output named " + output_name);
+      return;
+    }
+
+    res.status = 200;
+    res.set_header("X-Output-Name", output->name);
+    res.set_header("X-Tensor-Dtype", output->dtype);
+    res.set_header("X-Tensor-Shape", format_shape_header(output->shape));
+
+    if (output->dtype == "int32" && !output->int_data.empty()) {
+      std::string bytes;
+      append_tensor_bytes(bytes, *output);
+      res.set_content(std::move(bytes), "application/octet-stream");
+    } else if (output->byte_size() == 0) {
+      res.set_content("", "application/octet-stream");
+    } else {
+      // Stream straight from the output tensor without an extra copy
+      res.set_content_provider(
+          output->byte_size(), "application/octet-stream",
+          [result, output](size_t offset, size_t length,
+                           httplib::DataSink &sink) {
+            return sink.write(static_cast<const char *>(output->data()) +
+                                  offset,
+                              length);
+          });
+    }
+    ctx.trace.mark(RequestTrace::Encoded);
+
+    metrics_.record_inference(model_name,
+                              result->inference_time_ms / 1000.0,
+                              result->queue_time_ms / 1000.0);
+  }
+
+  /**
+   * POST /v2/models/:name/infer - KServe v2 inference with binary tensor
+   * data extension
+   */
+  void handle_v2_infer(const httplib::Request &req, httplib::Response &res,
+                       RequestContext &ctx) {
+    std::string model_name = ctx.param("name");
+    ctx.model = model_name;
+
+    auto v2_error = [&res](int status, const std::string &message) {
+      res.status = status;
+      json error = {{"error", message}};
+      res.set_content(error.dump(), "application/json");
+    };
+
+    auto model_opt = model_registry_.get(model_name);
+    if (!model_opt) {
+      v2_error(404, "Model not found: " + model_name);
+      return;
+    }
+    const auto &model = *model_opt;
+
+    kserve_v2::Request v2_req;
+    try {
+      size_t header_length = 0;
+      if (req.has_header(kserve_v2::HEADER_LENGTH)) {
+        header_length =
+            std::stoull(req.get_header_value(kserve_v2::HEADER_LENGTH));
+      }
+      v2_req = kserve_v2::parse_request(req.body, header_length);
+    } catch (const std::exception &e) {
+      v2_error(400, e.what());
+      return;
+    }
+    ctx.trace.mark(RequestTrace::Decoded);
+
+    // Validate inputs against the model signature
+    for (const auto &input : v2_req.inputs) {
+      auto it = std::find(model.input_names.begin(), model.input_names.end(),
+                          input.name);
+      if (it == model.input_names.end()) {
+        v2_error(400, "Unknown input for model " + model_name + ": " +
+                          input.name);
+        return;
+      }
+      size_t index = it - model.input_names.begin();
+      if (index < model.input_types.size() &&
+          model.input_types[index] != input.dtype) {
+        v2_error(400, "Input '" + input.name + "' expects datatype " +
+                          kserve_v2::to_datatype(model.input_types[index]) +
+                          ", got " + kserve_v2::to_datatype(input.dtype));
+        return;
+      }
+      if (index < model.input_shapes.size() &&
+          !kserve_v2::shape_matches(model.input_shapes[index], input.shape)) {
+        v2_error(400, "Input '" + input.name + "' expects shape " +
+                          json(model.input_shapes[index]).dump() + ", got " +
+                          json(input.shape).dump());
+        return;
+      }
+    }
+    for (const auto &name : v2_req.outputs) {
+      if (std::find(model.output_names.begin(), model.output_names.end(),
+                    name) == model.output_names.end()) {
+        v2_error(400, "Unknown output for model " + model_name + ": " + name);
+        return;
+      }
+    }
+
+    InferenceRequest infer_req;
+    infer_req.model_name = model_name;
+    infer_req.request_id = v2_req.id.empty() ? ctx.request_id : v2_req.id;
+
+    // Point shared memory tensors at the mapped regions; `pinned` keeps
+    // them mapped until the response is written
+    std::vector<std::shared_ptr<const SharedMemoryRegion>> pinned;
+    if (!v2_req.shared_memory_inputs.empty() ||
+        !v2_req.shared_memory_outputs.empty()) {
+      if (!config_.shared_memory.enabled) {
+        v2_error(400, "Shared memory is disabled on this server");
+        return;
+      }
+      try {
+        for (auto &input : v2_req.inputs) {
+          auto ref = v2_req.shared_memory_inputs.find(input.name);
+          if (ref == v2_req.shared_memory_inputs.end())
+            continue;
+          auto view = shared_memory_.resolve(
+              ref->second.region, ref->second.offset, ref->second.byte_size);
+          if (reinterpret_cast<uintptr_t>(view.data) %
+                  dtype::element_size(input.dtype) ==
+              0) {
+            input.external_data = view.data;
+            input.external_size = view.size;
+          } else {
+            input.raw_data.assign(view.data, view.data + view.size);
+          }
+          pinned.push_back(std::move(view.region));
+        }
+        for (const auto &[name, ref] : v2_req.shared_memory_outputs) {
+          auto view =
+              shared_memory_.resolve(ref.region, ref.offset, ref.byte_size);
+          infer_req.output_buffers.push_back({name, view.data, view.size});
+          pinned.push_back(std::move(view.region));
+        }
+      } catch (const SharedMemoryError &e) {
+        v2_error(e.status(), e.what());
+        return;
+      }
+    }
+    infer_req.inputs = std::move(v2_req.inputs);
+    infer_req.trace = ctx.trace;
+    infer_req.trace.mark(RequestTrace::Validated);
+
+    InferenceResponse infer_res;
+    try {
+      infer_res = execute(std::move(infer_req));
+    } catch (const std::exception &e) {
+      LOG_ERROR("Inference error for model {}: {}", model_name, e.what());
+      v2_error(500, e.what());
+      return;
+    }
+
+    if (!infer_res.success) {
+      v2_error(500, infer_res.error);
+      return;
+    }
+    ctx.trace.merge(infer_res.trace);
+
+    auto encoded = kserve_v2::encode_response(model_name, v2_req, infer_res,
+                                                 json_precision(req));
+    if (encoded.header_length > 0) {
+      res.set_header(kserve_v2::HEADER_LENGTH,
+                     std::to_string(encoded.header_length));
+    }
+    res.status = 200;
+    res.set_content(std::move(encoded.body), encoded.content_type);
+    ctx.trace.mark(RequestTrace::Encoded);
+
+    metrics_.record_inference(model_name,
+                              infer_res.inference_time_ms / 1000.0,
+                              infer_res.queue_time_ms / 1000.0);
+  }
+
+  /**
+   * GET /v2/systemsharedmemory[/region/:name]/status
+   */
+  void handle_shm_status(const httplib::Request &req, httplib::Response &res,
+                         RequestContext &ctx) {
+    std::string name = ctx.param("name");
+    try {
+      res.status = 200;
+      res.set_content(shared_memory_.status(name).dump(), "application/json");
+    } catch (const SharedMemoryError &e) {
+      res.status = e.status();
+      res.set_content(json{{"error", e.what()}}.dump(), "application/json");
+    }
+  }
+
+  /**
+   * POST /v2/systemsharedmemory/region/:name/register
+   * Body: {"key": "/shm_key", "offset": 0, "byte_size": N}
+   */
+  void handle_shm_register(const httplib::Request &req,
+                           httplib::Response &res, RequestContext &ctx) {
+    std::string name = ctx.param("name");
+    try {
+      json body = json::parse(req.body);
+      if (!body.contains("key") || !body.contains("byte_size")) {
+        throw SharedMemoryError(400, "'key' and 'byte_size' are required");
+      }
+      shared_memory_.register_region(name, body["key"].get<std::string>(),
+                                     body.value("offset", size_t{0}),
+                                     body["byte_size"].get<size_t>());
+      res.status = 200;
+      res.set_content("{}", "application/json");
+    } catch (const SharedMemoryError &e) {
+      res.status = e.status();
+      res.set_content(json{{"error", e.what()}}.dump(), "application/json");
+    } catch (const json::exception &e) {
+      res.status = 400;
+      res.set_content(
+          json{{"error", std::string("Invalid register request: ") + e.what()}}
+              .dump(),
+          "application/json");
+    }
+  }
+
+  /**
+   * POST /v2/systemsharedmemory[/region/:name]/unregister
+   */
+  void handle_shm_unregister(const httplib::Request &req,
+                             httplib::Response &res, RequestContext &ctx) {
+    std::string name = ctx.param("name");
+    if (!name.empty()) {
+      shared_memory_.unregister(name);
+    } else {
+      shared_memory_.unregister_all();
+    }
+    res.status = 200;
+    res.set_content("{}", "application/json");
+  }
+
+  /**
+   * Run a request through the batch executor when batching is enabled,
+   * otherwise directly on the model session
+   */
+  InferenceResponse execute(InferenceRequest &&request) {
+    if (config_.batching.enabled) {
+      return batch_executor_.submit(std::move(request)).get();
+    }
+    return model_registry_.run_inference(request);
+  }
+
+  /**
+   * Like execute(), but hands back the pending result; without batching
+   * the inference runs inline and the future is already set
+   */
+  std::future<InferenceResponse> submit_inference(InferenceRequest &&request) {
+    if (config_.batching.enabled) {
+      return batch_executor_.submit(std::move(request));
+    }
+    std::promise<InferenceResponse> promise;
+    try {
+      promise.set_value(model_registry_.run_inference(request));
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+    }
+    return promise.get_future();
+  }
+
+  /**
+   * Queue a parsed v1 request as an async job and answer 202 with its id
+   */
+  void submit_infer_job(const httplib::Request &req, httplib::Response &res,
+                        const std::string &model_name,
+                        InferenceRequest &&infer_req,
+                        Encoding request_encoding) {
+    std::string callback_url = req.get_param_value("callback_url");
+    if (!callback_url.empty()) {
+      if (!config_.jobs.callbacks_enabled) {
+        send_error(res, 400, "Job callbacks are disabled");
+        return;
+      }
+      std::smatch match;
+      if (!std::regex_match(callback_url, match, callback_url_pattern())) {
+        send_error(res, 400, "Invalid callback_url",
+                   "Expected an absolute http:// or https:// URL");
+        return;
+      }
+      if (!callback_host_allowed(match[2].str(), match[3].str())) {
+        send_error(res, 400, "Invalid callback_url",
+                   "Host is not in jobs.callback_hosts");
+        return;
+      }
+#ifndef CPPHTTPLIB_OPENSSL_SUPPORT
+      if (match[1].str().rfind("https://", 0) == 0) {
+        send_error(res, 400, "Invalid callback_url",
+                   "This server was built without HTTPS client support");
+        return;
+      }
+#endif
+    }
+
+    auto job = jobs_.create(model_name, callback_url);
+    if (!job) {
+      res.set_header("Retry-After", "1");
+      send_error(res, 503, "Too many pending jobs");
+      return;
+    }
+
+    // Keep only what the response encoder reads (Accept, X-Output-Name,
+    // ?precision); the request body is already decoded into tensors
+    auto job_req = std::make_shared<httplib::Request>();
+    job_req->headers = req.headers;
+    job_req->params = req.params;
+    auto job_input = std::make_shared<InferenceRequest>(std::move(infer_req));
+
+    bool queued = job_pool_->try_enqueue(
+        [this, id = job->id, model_name, callback_url, job_req, job_input,
+         request_encoding] {
+          run_job(id, model_name, callback_url, *job_req,
+                  std::move(*job_input), request_encoding);
+        });
+    if (!queued) {
+      httplib::Response failed;
+      send_error(failed, 503, "Server is shutting down");
+      jobs_.finish(job->id, failed);
+      send_error(res, 503, "Server is shutting down");
+      return;
+    }
+
+    res.status = 202;
+    res.set_header("Location", "/v1/jobs/" + job->id);
+    res.set_content(job->to_json().dump(), "application/json");
+  }
+
+  /**
+   * Job worker: run the inference, store the result, notify the callback
+   */
+  void run_job(const std::string &id, const std::string &model_name,
+               const std::string &callback_url, const httplib::Request &req,
+               InferenceRequest &&infer_req, Encoding request_encoding) {
+    httplib::Response result;
+    if (jobs_.closing()) {
+      send_error(result, 503, "Server is shutting down");
+      jobs_.finish(id, result);
+      return;
+    }
+
+    jobs_.mark_running(id);
+    run_infer(req, result, model_name, std::move(infer_req), request_encoding,
+              false);
+    jobs_.finish(id, result);
+
+    if (!callback_url.empty()) {
+      send_job_callback(id, callback_url, result);
+    }
+  }
+
+  /**
+   * POST a finished job's result to its callback URL (single attempt)
+   */
+  void send_job_callback(const std::string &id, const std::string &url,
+                         const httplib::Response &result) {
+    std::smatch match;
+    if (!std::regex_match(url, match, callback_url_pattern()) ||
+        !callback_host_allowed(match[2].str(), match[3].str()))
+      return;
+
+    std::string path = match[4].matched ? match[4].str() : "/";
+    bool succeeded = result.status >= 200 && result.status < 300;
+
+    httplib::Client client(match[1].str());
+    client.set_connection_timeout(config_.jobs.callback_timeout_sec);
+    client.set_read_timeout(config_.jobs.callback_timeout_sec);
+    client.set_write_timeout(config_.jobs.callback_timeout_sec);
+
+    httplib::Headers headers = {
+        {"X-Job-Id", id},
+        {"X-Job-Status", succeeded ? "succeeded" : "failed"},
+        {"X-Job-Result-Status", std::to_string(result.status)}};
+    std::string content_type = result.get_header_value("Content-Type");
+    if (content_type.empty())
+      content_type = "application/json";
+
+    auto response = client.Post(path, headers, result.body, content_type);
+    if (!response) {
+      LOG_WARN("Callback for job {} to {} failed: {}", id, url,
+               httplib::to_string(response.error()));
+    } else if (response->status >= 300) {
+      LOG_WARN("Callback for job {} to {} returned HTTP {}", id, url,
+               response->status);
+    }
+  }
+
+  /**
+   * scheme://host[:port] and path[?query] of a callback URL, with host
+   * (brackets kept for IPv6) and port captured apart. User info is not
+   * accepted, so the host checked is the host connected to.
+   */
+  static const std::regex &callback_url_pattern() {
+    static const std::regex pattern(
+        R"(^(https?://(\[[0-9A-Fa-f:.]+\]|[^/?#@\s:\[\]]+)(?::([0-9]+))?))"
+        R"((/[^#\s]*)?$)");
+    return pattern;
+  }
+
+  /**
+   * Whether jobs.callback_hosts lets callbacks reach `host` on `port`
+   * (empty for the scheme default). An entry without a port allows every
+   * port of its host. Callbacks are server-side requests to client-chosen
+   * URLs, so only configured hosts are reachable.
+   */
+  bool callback_host_allowed(std::string host, const std::string &port) {
+    std::transform(host.begin(), host.end(), host.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    for (std::string allowed : config_.jobs.callback_hosts) {
+      std::transform(allowed.begin(), allowed.end(), allowed.begin(),
+                     [](unsigned char c) { return std::tolower(c); });
+      if (allowed == host || (!port.empty() && allowed == host + ":" + port))
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * GET /v1/jobs/:id - Job status, or its result once finished.
+   * `?wait=N` long-polls up to N seconds (capped by jobs.max_wait_sec).
+   * Where the backend can complete the response later (epoll), the
+   * long-poll is answered by whoever finishes the job, or by the job
+   * store's timer, and holds no worker meanwhile.
+   */
+  void handle_get_job(const httplib::Request &req, httplib::Response &res,
+                      RequestContext &ctx) {
+    std::string id = ctx.param("id");
+    if (!req.has_param("wait")) {
+      write_job(res, id, jobs_.get(id));
+      return;
+    }
+
+    int wait_sec = 0;
+    try {
+      wait_sec = std::stoi(req.get_param_value("wait"));
+    } catch (const std::exception &) {
+      send_error(res, 400, "Invalid wait parameter");
+      return;
+    }
+    wait_sec = std::clamp(wait_sec, 0, config_.jobs.max_wait_sec);
+    auto timeout = std::chrono::seconds(wait_sec);
+
+    DeferredResponse::Completion done = DeferredResponse::detach();
+    if (!done) {
+      write_job(res, id, jobs_.wait(id, timeout));
+      return;
+    }
+    jobs_.watch(id, timeout,
+                [&res, id, done](std::shared_ptr<const Job> job) {
+                  try {
+                    write_job(res, id, job);
+                  } catch (const std::exception &e) {
+                    send_error(res, 500, "Internal error", e.what());
+                  }
+                  done();
+                });
+  }
+
+  /**
+   * Answer a job request with its status, or replay its stored response
+   */
+  static void write_job(httplib::Response &res, const std::string &id,
+                        const std::shared_ptr<const Job> &job) {
+    if (!job) {
+      send_error(res, 404, "Job not found: " + id);
+      return;
+    }
+
+    res.set_header("X-Job-Id", id);
+    res.set_header("X-Job-Status", Job::state_name(job->state));
+
+    if (!job->done()) {
+      res.status = 202;
+      res.set_header("Retry-After", "1");
+      res.set_content(job->to_json().dump(), "application/json");
+      return;
+    }
+
+    // Replay the stored inference response
+    std::string content_type = "application/json";
+    for (const auto &[name, value] : job->headers) {
+      if (name == "Content-Type") {
+        content_type = value;
+      } else if (name != "Content-Length") {
+        res.set_header(name, value);
+      }
+    }
+    res.status = job->status;
+    res.set_content(job->body, content_type);
+  }
+
+  /**
+   * DELETE /v1/jobs/:id - Drop a finished job's result
+   */
+  void handle_delete_job(const httplib::Request &req, httplib::Response &res,
+                         RequestContext &ctx) {
+    std::string id = ctx.param("id");
+    auto job = jobs_.get(id);
+    if (!job) {
+      send_error(res, 404, "Job not found: " + id);
+      return;
+    }
+    if (!jobs_.remove(id)) {
+      send_error(res, 409, "Job has not finished yet");
+      return;
+    }
+    res.status = 204;
+  }
+
+  /**
+   * GET /metrics - Prometheus metrics
+   */
+  void handle_metrics(const httplib::Request &req, httplib::Response &res,
+                      RequestContext &ctx) {
+    std::string output = metrics_.export_prometheus();
+    res.status = 200;
+    res.set_content(output, "text/plain; version=0.0.4; charset=utf-8");
+  }
+
+  /**
+   * GET /v1/stats - per-model latency quantiles over the last 1, 5 and 15
+   * minutes, optionally for one model (?model=)
+   */
+  void handle_stats(const httplib::Request &req, httplib::Response &res,
+                    RequestContext &ctx) {
+    static const std::vector<double> quantiles = {0.5, 0.9, 0.95, 0.99};
+    static const std::vector<std::pair<std::string, std::chrono::seconds>>
+        windows = {{"1m", std::chrono::minutes(1)},
+                   {"5m", std::chrono::minutes(5)},
+                   {"15m", std::chrono::minutes(15)}};
+    std::string only = req.get_param_value("model");
+
+    auto describe = [](const WindowedSketch &sketch) {
+      json stats = json::object();
+      auto now = WindowedSketch::Clock::now();
+      for (const auto &[label, window] : windows) {
+        auto summary = sketch.summarize(window, quantiles, now);
+        stats[label] = {{"count", summary.count},
+                        {"p50_ms", summary.values[0] * 1000.0},
+                        {"p90_ms", summary.values[1] * 1000.0},
+                        {"p95_ms", summary.values[2] * 1000.0},
+                        {"p99_ms", summary.values[3] * 1000.0}};
+      }
+      return stats;
+    };
+
+    json models = json::object();
+    metrics_.for_each_model([&](const std::string &name,
+                                const MetricsCollector::ModelMetrics &model) {
+      if (!only.empty() && name != only)
+        return;
+      models[name] = {{"end_to_end", describe(model.end_to_end)},
+                      {"queue", describe(model.queue)},
+                      {"run", describe(model.run)}};
+    });
+
+    if (!only.empty() && models.empty()) {
+      send_error(res, 404, "No statistics for model: " + only);
+      return;
+    }
+
+    json response = {{"relative_accuracy", metrics_.quantile_accuracy()},
+                     {"models", std::move(models)}};
+    send_document(req, res, 200, response);
+  }
+
+  /**
+   * Helper to write a document in the encoding the client accepts
+   */
+  static void send_document(const httplib::Request &req,
+                            httplib::Response &res, int status,
+                            const json &document) {
+    Encoding encoding = content_codec::response_encoding(req);
+    res.status = status;
+    res.set_content(content_codec::encode(document, encoding),
+                    content_codec::content_type(encoding));
+  }
+
+  /**
+   * Helper to write the standard JSON error body
+   */
+  static void send_error(httplib::Response &res, int status,
+                         const std::string &message,
+                         const std::string &detail = "") {
+    json error = {{"error", {{"code", status}, {"message", message}}}};
+    if (!detail.empty()) {
+      error["error"]["detail"] = detail;
+    }
+    res.status = status;
+    res.set_content(error.dump(), "application/json");
+  }
+
+  /**
+   * Helper to get ISO timestamp
+   */
+  static std::string get_iso_timestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    std::stringstream ss;
+    ss << std::put_time(std::gmtime(&time), "%Y-%m-%dT%H:%M:%SZ");
+    return ss.str();
   }
 };
 
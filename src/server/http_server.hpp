@@ -1,30 +1,130 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <condition_variable>
+#include <cstdlib>
 #include <functional>
 #include <memory>
+#include <regex>
 #include <string>
+#include <vector>
 
+#include "epoll_server.hpp"
 #include "httplib.h"
+#include "unix_socket.hpp"
 #include "utils/config.hpp"
 #include "utils/logging.hpp"
+#include "utils/request_trace.hpp"
 #include "utils/thread_pool.hpp"
+#include "websocket.hpp"
 
 namespace onnx_server {
 
+/**
+ * cpp-httplib task queue backed by the server's ThreadPool, so
+ * `server.threads` and `server.max_queued_requests` govern httplib too.
+ * httplib queues one task per accepted connection; when the pool refuses
+ * it, httplib closes the connection.
+ */
+class PoolTaskQueue : public httplib::TaskQueue {
+public:
+  explicit PoolTaskQueue(ThreadPool &pool) : pool_(pool) {}
+
+  bool enqueue(std::function<void()> fn) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++in_flight_;
+    }
+    bool queued = pool_.try_enqueue([this, fn = std::move(fn)]() {
+      fn();
+      finish();
+    });
+    if (!queued)
+      finish();
+    return queued;
+  }
+
+  /**
+   * Wait for this queue's connections; the pool itself outlives listen()
+   */
+  void shutdown() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return in_flight_ == 0; });
+  }
+
+private:
+  ThreadPool &pool_;
+  std::mutex mutex_;
+  std::condition_variable idle_;
+  size_t in_flight_ = 0;
+
+  void finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--in_flight_ == 0)
+      idle_.notify_all();
+  }
+};
+
 /**
  * HTTP Server wrapper around cpp-httplib
  * Provides a clean interface for the ONNX server with graceful shutdown
+ *
+ * `server.backend: epoll` (Linux) serves the same routes from EpollServer
+ * instead of httplib's thread-per-connection listener.
+ *
+ * With `server.unix_socket` set, the routes are also (or, with
+ * `tcp_enabled: false`, only) served on a Unix domain socket for
+ * co-located clients.
  */
 class HttpServer {
 public:
   using Handler =
       std::function<void(const httplib::Request &, httplib::Response &)>;
+  // Checks a request from its header block alone; false once it has
+  // written a rejection into the response
+  using BodyGate =
+      std::function<bool(const httplib::Request &, httplib::Response &)>;
+  // Accepts a WebSocket upgrade by returning the connection's session, or
+  // refuses it by returning nullptr with an error status set in `res`
+  using WebSocketOpener = std::function<std::shared_ptr<websocket::Session>(
+      const httplib::Request &, httplib::Response &,
+      std::shared_ptr<websocket::Channel>)>;
 
   explicit HttpServer(const ServerConfig &config)
-      : config_(config), running_(false), thread_pool_(config.threads) {}
+      : config_(config), running_(false),
+        thread_pool_(worker_count(config),
+                     static_cast<size_t>(
+                         std::max(0, config.max_queued_requests)))
+#ifdef __linux__
+        ,
+        epoll_(thread_pool_)
+#endif
+  {
+    for (auto *server : servers()) {
+      server->new_task_queue = [this] {
+        return new PoolTaskQueue(thread_pool_);
+      };
+      server->set_expect_100_continue_handler(
+          [this](const httplib::Request &req, httplib::Response &res) {
+            return expect_continue(req, res);
+          });
+    }
+#ifdef __linux__
+    epoll_.set_expect_continue_handler(
+        [this](const httplib::Request &req, httplib::Response &res) {
+          return expect_continue(req, res);
+        });
+#endif
+  }
 
-  ~HttpServer() { stop(); }
+  ~HttpServer() {
+    stop();
+    // Handlers may still be running on the pool; finish them before the
+    // routes they belong to are destroyed
+    thread_pool_.shutdown();
+  }
 
   // Non-copyable
   HttpServer(const HttpServer &) = delete;
@@ -34,48 +134,120 @@ public:
    * Register a GET handler
    */
   void get(const std::string &pattern, Handler handler) {
-    server_.Get(pattern,
-                [handler](const httplib::Request &req, httplib::Response &res) {
-                  handler(req, res);
-                });
+    add_epoll_route("GET", pattern, handler);
+    for (auto *server : servers()) {
+      server->Get(pattern, [handler](const httplib::Request &req,
+                                     httplib::Response &res) {
+        handler(req, res);
+      });
+    }
   }
 
   /**
    * Register a POST handler
    */
   void post(const std::string &pattern, Handler handler) {
-    server_.Post(pattern,
-                 [handler](const httplib::Request &req,
-                           httplib::Response &res) { handler(req, res); });
+    add_epoll_route("POST", pattern, handler);
+    for (auto *server : servers()) {
+      server->Post(pattern, [handler](const httplib::Request &req,
+                                      httplib::Response &res) {
+        handler(req, res);
+      });
+    }
+  }
+
+  /**
+   * Register a POST handler whose requests can be refused before their
+   * body is transferred. `gate` sees the header block and path matches:
+   * for `Expect: 100-continue` it decides between `100 Continue` and an
+   * immediate rejection, and otherwise it runs before the body is read
+   * (httplib) or before the handler (epoll). Accepted bodies are read
+   * into a buffer sized from Content-Length.
+   */
+  void post(const std::string &pattern, Handler handler, BodyGate gate) {
+    gates_.push_back({std::regex(pattern), gate});
+    add_epoll_route("POST", pattern, gate_then(gate, handler));
+    for (auto *server : servers()) {
+      server->Post(pattern, gated(gate, handler));
+    }
+  }
+
+  /**
+   * Send every request that no registered route matches to `handler`, for
+   * callers that resolve paths themselves (Router's trie) instead of
+   * through one regex per route. `gate` screens POST and PUT requests
+   * before their body, as in post(). The epoll backend then runs no regex
+   * at all; httplib still matches one catch-all `.*` per request.
+   */
+  void set_fallback(Handler handler, BodyGate gate) {
+    fallback_ = handler;
+    fallback_gate_ = gate;
+#ifdef __linux__
+    epoll_.set_fallback_handler(gate_then(gate, handler));
+#endif
+  }
+
+  /**
+   * Register a WebSocket endpoint. Only the epoll backend upgrades
+   * connections; httplib answers the endpoint with 501.
+   */
+  void websocket(const std::string &pattern, WebSocketOpener opener) {
+#ifdef __linux__
+    epoll_.websocket(pattern, std::move(opener));
+#else
+    (void)opener;
+#endif
+    for (auto *server : servers()) {
+      server->Get(pattern, [](const httplib::Request &,
+                              httplib::Response &res) {
+        res.status = 501;
+        res.set_content("{\"error\":{\"code\":501,\"message\":"
+                        "\"WebSocket endpoints require server.backend: "
+                        "epoll\"}}",
+                        "application/json");
+      });
+    }
   }
 
   /**
    * Register a PUT handler
    */
   void put(const std::string &pattern, Handler handler) {
-    server_.Put(pattern,
-                [handler](const httplib::Request &req, httplib::Response &res) {
-                  handler(req, res);
-                });
+    add_epoll_route("PUT", pattern, handler);
+    for (auto *server : servers()) {
+      server->Put(pattern, [handler](const httplib::Request &req,
+                                     httplib::Response &res) {
+        handler(req, res);
+      });
+    }
   }
 
   /**
    * Register a DELETE handler
    */
   void del(const std::string &pattern, Handler handler) {
-    server_.Delete(pattern,
-                   [handler](const httplib::Request &req,
-                             httplib::Response &res) { handler(req, res); });
+    add_epoll_route("DELETE", pattern, handler);
+    for (auto *server : servers()) {
+      server->Delete(pattern, [handler](const httplib::Request &req,
+                                        httplib::Response &res) {
+        handler(req, res);
+      });
+    }
   }
 
   /**
    * Set error handler for uncaught exceptions
    */
   void set_error_handler(Handler handler) {
-    server_.set_error_handler(
-        [handler](const httplib::Request &req, httplib::Response &res) {
-          handler(req, res);
-        });
+#ifdef __linux__
+    epoll_.set_error_handler(handler);
+#endif
+    for (auto *server : servers()) {
+      server->set_error_handler(
+          [handler](const httplib::Request &req, httplib::Response &res) {
+            handler(req, res);
+          });
+    }
   }
 
   /**
@@ -85,7 +257,11 @@ public:
       std::function<void(const httplib::Request &, httplib::Response &,
                          std::exception_ptr)>
           handler) {
-    server_.set_exception_handler(handler);
+#ifdef __linux__
+    epoll_.set_exception_handler(handler);
+#endif
+    for (auto *server : servers())
+      server->set_exception_handler(handler);
   }
 
   /**
@@ -95,7 +271,11 @@ public:
       std::function<httplib::Server::HandlerResponse(const httplib::Request &,
                                                      httplib::Response &)>
           handler) {
-    server_.set_pre_routing_handler(handler);
+#ifdef __linux__
+    epoll_.set_pre_routing_handler(handler);
+#endif
+    for (auto *server : servers())
+      server->set_pre_routing_handler(handler);
   }
 
   /**
@@ -109,20 +289,61 @@ public:
 
     running_ = true;
 
+    if (config_.backend == "epoll") {
+      return start_epoll();
+    }
+
+    if (!config_.tcp_enabled && config_.unix_socket.empty()) {
+      LOG_ERROR("No listener configured: tcp_enabled is false and "
+                "unix_socket is empty");
+      running_ = false;
+      return false;
+    }
+
     // Configure server settings
-    server_.set_keep_alive_max_count(100);
-    server_.set_keep_alive_timeout(30);
-    server_.set_read_timeout(30);
-    server_.set_write_timeout(30);
-    server_.set_payload_max_length(1024 * 1024 * 100); // 100MB max payload
+    for (auto *server : servers()) {
+      if (fallback_) {
+        // httplib tries routes in registration order: catch-alls go last
+        server->Get(".*", fallback_);
+        server->Delete(".*", fallback_);
+        server->Post(".*", gated(fallback_gate_, fallback_));
+        server->Put(".*", gated(fallback_gate_, fallback_));
+      }
+      server->set_keep_alive_max_count(config_.keep_alive_max_count);
+      server->set_keep_alive_timeout(config_.keep_alive_timeout_sec);
+      server->set_read_timeout(config_.read_timeout_sec);
+      server->set_write_timeout(config_.write_timeout_sec);
+      server->set_payload_max_length(config_.max_payload_mb * 1024 * 1024);
+    }
 
-    LOG_INFO("Starting HTTP server on {}:{}", config_.host, config_.port);
+    bool success = true;
+    if (!config_.unix_socket.empty()) {
+      if (!bind_unix_socket()) {
+        running_ = false;
+        return false;
+      }
+      if (config_.tcp_enabled) {
+        unix_thread_ =
+            std::thread([this]() { unix_server_.listen_after_bind(); });
+      } else {
+        success = unix_server_.listen_after_bind();
+      }
+    }
 
-    bool success = server_.listen(config_.host, config_.port);
+    if (config_.tcp_enabled) {
+      LOG_INFO("Starting HTTP server on {}:{} ({} workers, queue limit {})",
+               config_.host, config_.port, thread_pool_.size(),
+               thread_pool_.max_queue());
+      success = server_.listen(config_.host, config_.port);
+      if (!success) {
+        LOG_ERROR("Failed to start server on {}:{}", config_.host,
+                  config_.port);
+      }
+    }
 
     if (!success) {
-      LOG_ERROR("Failed to start server on {}:{}", config_.host, config_.port);
       running_ = false;
+      stop_unix_socket();
     }
 
     return success;
@@ -161,6 +382,10 @@ public:
     LOG_INFO("Shutting down HTTP server...");
     running_ = false;
     server_.stop();
+#ifdef __linux__
+    epoll_.stop();
+#endif
+    stop_unix_socket();
 
     if (server_thread_.joinable()) {
       server_thread_.join();
@@ -169,6 +394,28 @@ public:
     LOG_INFO("HTTP server stopped");
   }
 
+  /**
+   * Cap on request bodies after Content-Encoding. httplib inflates gzip
+   * and deflate bodies while reading them, and its payload limit only
+   * counts the bytes on the wire.
+   */
+  void set_max_decompressed_length(size_t bytes) {
+    max_decompressed_length_ = bytes;
+  }
+
+  /**
+   * Whether request bodies reach handlers with gzip/deflate already
+   * inflated: httplib does this when built with zlib, the epoll backend
+   * leaves it to the handler
+   */
+  bool inflates_gzip_bodies() const {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    return config_.backend != "epoll";
+#else
+    return false;
+#endif
+  }
+
   /**
    * Check if server is running
    */
@@ -185,11 +432,209 @@ public:
   ThreadPool &thread_pool() { return thread_pool_; }
 
 private:
+  struct Gate {
+    std::regex pattern;
+    BodyGate check;
+  };
+
   ServerConfig config_;
   httplib::Server server_;
+  httplib::Server unix_server_; // Only listens when unix_socket is set
   std::atomic<bool> running_;
   std::thread server_thread_;
+  std::thread unix_thread_;
   ThreadPool thread_pool_;
+#ifdef __linux__
+  EpollServer epoll_;
+#endif
+  std::vector<Gate> gates_; // Registered before start(), read-only after
+  Handler fallback_;
+  BodyGate fallback_gate_;
+  size_t max_decompressed_length_ =
+      CompressionConfig{}.max_decompressed_mb * 1024 * 1024;
+
+  std::array<httplib::Server *, 2> servers() {
+    return {&server_, &unix_server_};
+  }
+
+  /**
+   * `Expect: 100-continue`: run the gate of the matching POST route, if
+   * any, on the header block. Returns 100 or the rejection status.
+   */
+  int expect_continue(const httplib::Request &req, httplib::Response &res) {
+    if (req.method != "POST")
+      return 100;
+    for (const auto &gate : gates_) {
+      httplib::Request head = req;
+      if (!std::regex_match(head.path, head.matches, gate.pattern))
+        continue;
+      if (gate.check(head, res))
+        return 100;
+      return res.status >= 400 ? res.status : 417;
+    }
+    if (fallback_gate_ && !fallback_gate_(req, res))
+      return res.status >= 400 ? res.status : 417;
+    return 100;
+  }
+
+  static Handler gate_then(BodyGate gate, Handler handler) {
+    return [gate, handler](const httplib::Request &req,
+                           httplib::Response &res) {
+      if (gate(req, res))
+        handler(req, res);
+    };
+  }
+
+  /**
+   * httplib handler that runs `gate` before reading the body; accepted
+   * bodies are read into a buffer sized from Content-Length
+   */
+  httplib::Server::HandlerWithContentReader gated(BodyGate gate,
+                                                  Handler handler) const {
+    size_t max_length = config_.max_payload_mb * 1024 * 1024;
+    return [this, gate, handler, max_length](
+               const httplib::Request &req, httplib::Response &res,
+               const httplib::ContentReader &content_reader) {
+      auto received = RequestTrace::Clock::now();
+      if (!gate(req, res)) {
+        // Discard whatever of the body is already on its way
+        content_reader([](const char *, size_t) { return true; });
+        return;
+      }
+
+      httplib::Request full = req;
+      size_t limit = req.has_header("Content-Encoding")
+                         ? max_decompressed_length_
+                         : max_length;
+      bool too_large = false;
+      if (!read_body(req, content_reader, limit, full.body, too_large)) {
+        if (too_large)
+          res.status = 413;
+        else if (res.status < 400)
+          res.status = 400;
+        return;
+      }
+      RequestTrace::ArrivalScope arrival(received,
+                                         RequestTrace::Clock::now());
+      handler(full, res);
+    };
+  }
+
+  /**
+   * Read a request body through httplib's ContentReader into `body`,
+   * reserving Content-Length (up to `max_length`) up front so the buffer
+   * is never regrown. Stops, setting `too_large`, once the (inflated)
+   * body would exceed `max_length`.
+   */
+  static bool read_body(const httplib::Request &req,
+                        const httplib::ContentReader &content_reader,
+                        size_t max_length, std::string &body,
+                        bool &too_large) {
+    std::string length = req.get_header_value("Content-Length");
+    if (!length.empty()) {
+      char *end = nullptr;
+      unsigned long long expected = std::strtoull(length.c_str(), &end, 10);
+      if (end && *end == '\0' && expected <= max_length)
+        body.reserve(static_cast<size_t>(expected));
+    }
+    return content_reader([&](const char *data, size_t size) {
+      if (size > max_length - body.size()) {
+        too_large = true;
+        return false;
+      }
+      body.append(data, size);
+      return true;
+    });
+  }
+
+  bool bind_unix_socket() {
+    const std::string &path = config_.unix_socket;
+    int mode = unix_socket::parse_mode(config_.unix_socket_mode);
+    if (mode < 0) {
+      LOG_ERROR("Invalid unix_socket_mode '{}'", config_.unix_socket_mode);
+      return false;
+    }
+    if (!unix_socket::prepare_path(path))
+      return false;
+
+    unix_server_.set_address_family(AF_UNIX);
+    if (!unix_server_.bind_to_port(path, 80)) {
+      LOG_ERROR("Failed to bind unix:{}", path);
+      return false;
+    }
+    if (!unix_socket::set_mode(path, mode)) {
+      unix_server_.stop();
+      unix_socket::remove(path);
+      return false;
+    }
+
+    LOG_INFO("Starting HTTP server on unix:{}", path);
+    return true;
+  }
+
+  void stop_unix_socket() {
+    if (config_.unix_socket.empty())
+      return;
+    unix_server_.stop();
+    if (unix_thread_.joinable())
+      unix_thread_.join();
+    unix_socket::remove(config_.unix_socket);
+  }
+
+  static size_t worker_count(const ServerConfig &config) {
+    if (config.threads > 0)
+      return static_cast<size_t>(config.threads);
+    size_t cores = std::thread::hardware_concurrency();
+    return std::max<size_t>(8, cores > 1 ? cores - 1 : 1);
+  }
+
+  void add_epoll_route(const std::string &method, const std::string &pattern,
+                       const Handler &handler) {
+#ifdef __linux__
+    epoll_.route(method, pattern, handler);
+#endif
+  }
+
+  /**
+   * Serve through the epoll backend until stop() (blocking)
+   */
+  bool start_epoll() {
+#ifdef __linux__
+    EpollServer::Options options;
+    options.host = config_.host;
+    options.port = config_.port;
+    options.tcp = config_.tcp_enabled;
+    options.unix_path = config_.unix_socket;
+    options.unix_mode = unix_socket::parse_mode(config_.unix_socket_mode);
+    if (!options.unix_path.empty() && options.unix_mode < 0) {
+      LOG_ERROR("Invalid unix_socket_mode '{}'", config_.unix_socket_mode);
+      running_ = false;
+      return false;
+    }
+    options.loops = static_cast<size_t>(std::max(0, config_.event_loops));
+    options.keep_alive_max_count =
+        static_cast<size_t>(std::max(1, config_.keep_alive_max_count));
+    options.keep_alive_timeout_sec = config_.keep_alive_timeout_sec;
+    options.read_timeout_sec = config_.read_timeout_sec;
+    options.write_timeout_sec = config_.write_timeout_sec;
+    options.payload_max_length = config_.max_payload_mb * 1024 * 1024;
+    options.websocket_max_in_flight =
+        static_cast<size_t>(std::max(1, config_.websocket_max_in_flight));
+    options.websocket_idle_timeout_sec = config_.websocket_idle_timeout_sec;
+
+    if (!epoll_.start(options)) {
+      LOG_ERROR("Failed to start server on {}:{}", config_.host, config_.port);
+      running_ = false;
+      return false;
+    }
+    epoll_.wait();
+    return true;
+#else
+    LOG_ERROR("The epoll server backend requires Linux");
+    running_ = false;
+    return false;
+#endif
+  }
 };
 
 } // namespace onnx_server
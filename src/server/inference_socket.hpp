@@ -0,0 +1,247 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "content_codec.hpp"
+#include "inference/session_manager.hpp"
+#include "json.hpp"
+#include "json_writer.hpp"
+#include "tensor_codec.hpp"
+#include "utils/logging.hpp"
+#include "websocket.hpp"
+
+namespace onnx_server {
+
+using json = nlohmann::json;
+
+/**
+ * WebSocket session of /v1/models/:name/ws, a persistent inference channel
+ * to one model.
+ *
+ * Every data message is one v1 request document, JSON in a text frame or
+ * MessagePack in a binary frame, optionally tagged with an "id". Messages
+ * are submitted as they arrive without waiting for earlier ones, so they
+ * batch with each other and with HTTP traffic; each reply is sent as soon
+ * as its inference completes, in the frame type and encoding of its
+ * request and carrying the same "id". Replies may therefore arrive out of
+ * order. They are encoded on the channel's workers, not on the thread
+ * that completed the inference.
+ */
+class InferenceSocket : public websocket::Session,
+                        public std::enable_shared_from_this<InferenceSocket> {
+public:
+  using Done = std::function<void(InferenceResponse)>;
+  // Starts an inference and eventually calls `done` exactly once, on any
+  // thread; false if the request was refused (queue full). If it throws,
+  // `done` is not called.
+  using Submit = std::function<bool(InferenceRequest &&, Done)>;
+  // Sees every successful inference, e.g. for metrics
+  using Observer = std::function<void(const InferenceResponse &)>;
+
+  InferenceSocket(std::string model_name, std::string request_id,
+                  int precision, std::shared_ptr<websocket::Channel> channel,
+                  Submit submit, Observer on_result)
+      : model_name_(std::move(model_name)),
+        request_id_(std::move(request_id)), precision_(precision),
+        channel_(std::move(channel)), submit_(std::move(submit)),
+        on_result_(std::move(on_result)) {}
+
+  /**
+   * Answers every message exactly once, whatever throws: the backend
+   * counts unanswered messages, and a missing reply would hold a slot
+   * for the life of the connection
+   */
+  void on_message(std::string payload, bool binary) override {
+    json id;
+    try {
+      submit(payload, binary, id);
+    } catch (const std::exception &e) {
+      LOG_ERROR("WebSocket message for model {} failed: {}", model_name_,
+                e.what());
+      reply_error(id, binary, 500, "Internal server error", e.what());
+    } catch (...) {
+      reply_error(id, binary, 500, "Internal server error", "");
+    }
+  }
+
+private:
+  std::string model_name_;
+  std::string request_id_;
+  int precision_;
+  std::shared_ptr<websocket::Channel> channel_;
+  Submit submit_;
+  Observer on_result_;
+  std::atomic<uint64_t> messages_{0};
+
+  /**
+   * Decode and submit one message, or reply with why it was refused.
+   * Throws only before the request is handed to `submit_`, or if
+   * `submit_` throws without having taken it.
+   */
+  void submit(const std::string &payload, bool binary, json &id) {
+    InferenceRequest request;
+    request.model_name = model_name_;
+    request.request_id = request_id_ + "." + std::to_string(++messages_);
+
+    try {
+      id = decode(payload, binary, request.inputs);
+    } catch (const std::exception &e) {
+      reply_error(id, binary, 400, "Invalid input", e.what());
+      return;
+    }
+
+    // The callback runs on the thread that finished the inference, the
+    // batcher's for batched runs; encoding the reply there would hold up
+    // every batch behind it
+    auto self = shared_from_this();
+    bool accepted = submit_(
+        std::move(request), [self, id, binary](InferenceResponse response) {
+          self->channel_->defer(
+              [self, id, binary, response = std::move(response)] {
+                self->reply_result(id, binary, response);
+              });
+        });
+    if (!accepted)
+      reply_error(id, binary, 503, "Inference queue is full", "");
+  }
+
+  /**
+   * Decode one request document into packed inputs; returns its "id"
+   */
+  static json decode(const std::string &payload, bool binary,
+                     std::vector<TensorData> &inputs) {
+    if (!binary) {
+      json extra = content_codec::decode_json_instance(payload, inputs);
+      return extra.contains("id") ? extra["id"] : json();
+    }
+
+    json document = content_codec::decode(payload, Encoding::MsgPack);
+    if (!document.is_object() || !document.contains("inputs"))
+      throw std::invalid_argument("Missing 'inputs' field");
+    content_codec::decode_inputs(document["inputs"], Encoding::MsgPack,
+                                 inputs);
+    for (auto &input : inputs) {
+      coerce_to_dtype(input);
+    }
+    return document.contains("id") ? document["id"] : json();
+  }
+
+  void reply_result(const json &id, bool binary,
+                    const InferenceResponse &response) {
+    if (!response.success) {
+      LOG_ERROR("Inference error for model {}: {}", model_name_,
+                response.error);
+      reply_error(id, binary, 500, "Inference failed", response.error);
+      return;
+    }
+    std::string payload;
+    try {
+      if (on_result_)
+        on_result_(response);
+      payload = binary ? encode_binary(id, response)
+                       : encode_text(id, response);
+    } catch (const std::exception &e) {
+      reply_error(id, binary, 500, "Inference failed", e.what());
+      return;
+    } catch (...) {
+      reply_error(id, binary, 500, "Inference failed", "");
+      return;
+    }
+    send(std::move(payload), binary);
+  }
+
+  /**
+   * {"id": ..., "outputs": {...}, "timing": {...}} as JSON
+   */
+  std::string encode_text(const json &id,
+                          const InferenceResponse &response) const {
+    JsonWriter writer(precision_);
+    size_t estimate = 128;
+    for (const auto &output : response.outputs) {
+      estimate += writer.estimate_size(output);
+    }
+    writer.reserve(estimate);
+
+    writer.begin_object();
+    if (!id.is_null())
+      writer.key("id").value(id);
+    writer.key("outputs").tensors(response.outputs);
+    if (response.inference_time_ms > 0) {
+      writer.key("timing").begin_object();
+      writer.key("inference_ms").value(response.inference_time_ms);
+      writer.key("queue_ms").value(response.queue_time_ms);
+      writer.end_object();
+    }
+    writer.end_object();
+    return writer.take();
+  }
+
+  /**
+   * The same document as MessagePack, outputs as typed byte arrays
+   */
+  static std::string encode_binary(const json &id,
+                                   const InferenceResponse &response) {
+    json document = json::object();
+    if (!id.is_null())
+      document["id"] = id;
+    document["outputs"] = json::object();
+    for (const auto &output : response.outputs) {
+      document["outputs"][output.name] = {
+          {"shape", output.shape},
+          {"dtype", output.dtype},
+          {"data", content_codec::binary_tensor(output, Encoding::MsgPack)}};
+    }
+    if (response.inference_time_ms > 0) {
+      document["timing"] = {{"inference_ms", response.inference_time_ms},
+                            {"queue_ms", response.queue_time_ms}};
+    }
+    return content_codec::encode(document, Encoding::MsgPack);
+  }
+
+  /**
+   * {"id": ..., "error": {"code", "message", "detail"}}. Never throws: an
+   * error that cannot be encoded, e.g. a detail that is not UTF-8, is sent
+   * as the bare error object instead.
+   */
+  void reply_error(const json &id, bool binary, int code,
+                   const std::string &message,
+                   const std::string &detail) noexcept {
+    std::string payload;
+    try {
+      json document = json::object();
+      if (!id.is_null())
+        document["id"] = id;
+      document["error"] = {
+          {"code", code}, {"message", message}, {"detail", detail}};
+      payload = binary ? content_codec::encode(document, Encoding::MsgPack)
+                       : document.dump(-1, ' ', false,
+                                       json::error_handler_t::replace);
+    } catch (const std::exception &e) {
+      LOG_ERROR("Could not encode WebSocket error reply: {}", e.what());
+      // {"error": {"code": 500}}
+      static const char msgpack[] = {'\x81', '\xa5', 'e',    'r',
+                                     'r',    'o',    'r',    '\x81',
+                                     '\xa4', 'c',    'o',    'd',
+                                     'e',    '\xcd', '\x01', '\xf4'};
+      payload = binary ? std::string(msgpack, sizeof(msgpack))
+                       : R"({"error":{"code":500}})";
+    }
+    send(std::move(payload), binary);
+  }
+
+  void send(std::string payload, bool binary) noexcept {
+    try {
+      channel_->reply(std::move(payload), binary);
+    } catch (const std::exception &e) {
+      LOG_ERROR("WebSocket reply for model {} failed: {}", model_name_,
+                e.what());
+    } catch (...) {
+    }
+  }
+};
+
+} // namespace onnx_server
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "httplib.h"
+#include "json.hpp"
+#include "utils/config.hpp"
+
+namespace onnx_server {
+
+using json = nlohmann::json;
+
+/**
+ * One asynchronous inference job (`POST .../infer?async=true`)
+ */
+struct Job {
+  enum class State { Queued, Running, Succeeded, Failed };
+
+  std::string id;
+  std::string model_name;
+  std::string callback_url;
+  State state = State::Queued;
+  std::chrono::steady_clock::time_point created_at;
+  std::chrono::steady_clock::time_point finished_at;
+
+  // The finished HTTP response, replayed by GET /v1/jobs/:id
+  int status = 0;
+  std::string body;
+  httplib::Headers headers;
+
+  bool done() const {
+    return state == State::Succeeded || state == State::Failed;
+  }
+
+  static const char *state_name(State state) {
+    switch (state) {
+    case State::Queued:
+      return "queued";
+    case State::Running:
+      return "running";
+    case State::Succeeded:
+      return "succeeded";
+    default:
+      return "failed";
+    }
+  }
+
+  json to_json() const {
+    return {{"id", id},
+            {"model_name", model_name},
+            {"status", state_name(state)},
+            {"status_url", "/v1/jobs/" + id}};
+  }
+};
+
+/**
+ * In-memory store for asynchronous jobs and their results.
+ *
+ * Finished results are kept for `result_ttl_sec` and, beyond
+ * `max_result_memory_mb` in total, the oldest results are evicted first.
+ * Expiry is applied lazily on every store operation, so no sweeper thread
+ * is needed. Readers can long-poll a job with wait(), which blocks, or
+ * watch(), which calls back instead; at most `max_waiters` of either are
+ * held at once. A timer thread, started by the first watch(), answers
+ * watches that time out.
+ */
+class JobStore {
+public:
+  explicit JobStore(const JobsConfig &config)
+      : config_(config), urandom_(std::fopen("/dev/urandom", "rb")) {}
+
+  ~JobStore() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    timer_cv_.notify_all();
+    if (timer_.joinable())
+      timer_.join();
+    if (urandom_)
+      std::fclose(urandom_);
+  }
+
+  JobStore(const JobStore &) = delete;
+  JobStore &operator=(const JobStore &) = delete;
+
+  /**
+   * Create a queued job; nullptr once `max_pending` jobs are unfinished
+   */
+  std::shared_ptr<const Job> create(const std::string &model_name,
+                                    const std::string &callback_url) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    purge_locked(std::chrono::steady_clock::now());
+    if (config_.max_pending > 0 && pending_ >= config_.max_pending)
+      return nullptr;
+
+    auto job = std::make_shared<Job>();
+    job->id = next_id_locked();
+    job->model_name = model_name;
+    job->callback_url = callback_url;
+    job->created_at = std::chrono::steady_clock::now();
+    jobs_.emplace(job->id, job);
+    ++pending_;
+    return std::make_shared<const Job>(*job);
+  }
+
+  /**
+   * Snapshot of a job (copy, safe to read without the lock)
+   */
+  std::shared_ptr<const Job> get(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    purge_locked(std::chrono::steady_clock::now());
+    auto it = jobs_.find(id);
+    if (it == jobs_.end())
+      return nullptr;
+    return std::make_shared<const Job>(*it->second);
+  }
+
+  /**
+   * Wait up to `timeout` for a job to finish, then return its snapshot.
+   * Returns early once the store is closing, and at once when
+   * `max_waiters` long-polls are already held.
+   */
+  std::shared_ptr<const Job> wait(const std::string &id,
+                                  std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (waiters_locked() < config_.max_waiters) {
+      ++blocked_;
+      auto deadline = std::chrono::steady_clock::now() + timeout;
+      changed_.wait_until(lock, deadline, [&] {
+        auto it = jobs_.find(id);
+        return closing_ || it == jobs_.end() || it->second->done();
+      });
+      --blocked_;
+    }
+    return snapshot_locked(id);
+  }
+
+  using Watcher = std::function<void(std::shared_ptr<const Job>)>;
+
+  /**
+   * Non-blocking wait(): call `on_ready` with the job's snapshot (nullptr
+   * if unknown) once it finishes, `timeout` passes or the store closes.
+   * It runs on the thread that finished the job or on the timer thread,
+   * or before watch() returns when there is nothing to wait for or
+   * `max_waiters` long-polls are already held.
+   */
+  void watch(const std::string &id, std::chrono::milliseconds timeout,
+             Watcher on_ready) {
+    std::shared_ptr<const Job> job;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job = snapshot_locked(id);
+      if (job && !job->done() && !closing_ && timeout.count() > 0 &&
+          waiters_locked() < config_.max_waiters) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        watches_.push_back({id, deadline, std::move(on_ready)});
+        if (!timer_.joinable())
+          timer_ = std::thread([this] { run_timer(); });
+        timer_cv_.notify_all();
+        return;
+      }
+    }
+    on_ready(std::move(job));
+  }
+
+  void mark_running(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it != jobs_.end() && it->second->state == Job::State::Queued)
+      it->second->state = Job::State::Running;
+  }
+
+  /**
+   * Store a job's final response and wake long-pollers. A body larger than
+   * the whole `max_result_memory_mb` budget would be evicted as soon as it
+   * is stored, so the job is failed with an explanation instead.
+   */
+  void finish(const std::string &id, const httplib::Response &response) {
+    std::vector<Ready> ready;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = jobs_.find(id);
+      if (it == jobs_.end() || it->second->done())
+        return;
+
+      Job &job = *it->second;
+      job.state = response.status >= 200 && response.status < 300
+                      ? Job::State::Succeeded
+                      : Job::State::Failed;
+      job.status = response.status;
+      job.body = response.body;
+      job.headers = response.headers;
+      size_t max_bytes = config_.max_result_memory_mb * 1024 * 1024;
+      if (max_bytes > 0 && job.body.size() > max_bytes) {
+        job.state = Job::State::Failed;
+        job.status = 500;
+        job.body = json{{"error",
+                         {{"code", 500},
+                          {"message", "Job result too large"},
+                          {"detail", std::to_string(response.body.size()) +
+                                         " bytes exceeds "
+                                         "jobs.max_result_memory_mb"}}}}
+                       .dump();
+        job.headers = {{"Content-Type", "application/json"}};
+      }
+      job.finished_at = std::chrono::steady_clock::now();
+
+      --pending_;
+      result_bytes_ += job.body.size();
+      finished_.push_back(job.id);
+      ready = take_watches_locked(
+          [&](const Watch &watch) { return watch.id == id; });
+      purge_locked(job.finished_at);
+    }
+    changed_.notify_all();
+    notify(ready);
+  }
+
+  /**
+   * Drop a finished job's result early; false if unknown or still pending
+   */
+  bool remove(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end() || !it->second->done())
+      return false;
+    result_bytes_ -= it->second->body.size();
+    jobs_.erase(it);
+    return true;
+  }
+
+  /**
+   * Refuse new work and release long-pollers; queued jobs are failed by
+   * their runner
+   */
+  void close() {
+    std::vector<Ready> ready;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closing_ = true;
+      ready = take_watches_locked([](const Watch &) { return true; });
+    }
+    changed_.notify_all();
+    notify(ready);
+  }
+
+  bool closing() const { return closing_; }
+
+  /**
+   * Whether create() would currently refuse a job
+   */
+  bool full() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return config_.max_pending > 0 && pending_ >= config_.max_pending;
+  }
+
+  json stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {{"jobs", jobs_.size()},
+            {"pending", pending_},
+            {"result_bytes", result_bytes_}};
+  }
+
+private:
+  JobsConfig config_;
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  std::unordered_map<std::string, std::shared_ptr<Job>> jobs_;
+  std::deque<std::string> finished_; // Finish order, oldest first
+  size_t pending_ = 0;
+  size_t result_bytes_ = 0;
+  std::atomic<bool> closing_{false};
+  std::FILE *urandom_; // Guarded by mutex_
+
+  struct Watch {
+    std::string id;
+    std::chrono::steady_clock::time_point deadline;
+    Watcher on_ready;
+  };
+  using Ready = std::pair<Watcher, std::shared_ptr<const Job>>;
+
+  std::vector<Watch> watches_;
+  size_t blocked_ = 0; // Threads inside wait()
+  std::condition_variable timer_cv_;
+  std::thread timer_;
+  bool stopping_ = false;
+
+  size_t waiters_locked() const { return blocked_ + watches_.size(); }
+
+  std::shared_ptr<const Job> snapshot_locked(const std::string &id) const {
+    auto it = jobs_.find(id);
+    if (it == jobs_.end())
+      return nullptr;
+    return std::make_shared<const Job>(*it->second);
+  }
+
+  /**
+   * Remove the watches matching `pred`, paired with their job snapshots
+   */
+  template <typename Pred>
+  std::vector<Ready> take_watches_locked(Pred pred) {
+    std::vector<Ready> ready;
+    for (auto it = watches_.begin(); it != watches_.end();) {
+      if (pred(*it)) {
+        ready.emplace_back(std::move(it->on_ready), snapshot_locked(it->id));
+        it = watches_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return ready;
+  }
+
+  /**
+   * Run watchers outside the lock; they may call back into the store
+   */
+  static void notify(std::vector<Ready> &ready) {
+    for (auto &[on_ready, job] : ready)
+      on_ready(std::move(job));
+  }
+
+  /**
+   * Answer watches whose timeout passed
+   */
+  void run_timer() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+      auto now = std::chrono::steady_clock::now();
+      auto ready = take_watches_locked(
+          [&](const Watch &watch) { return watch.deadline <= now; });
+      if (!ready.empty()) {
+        lock.unlock();
+        notify(ready);
+        lock.lock();
+        continue;
+      }
+
+      if (watches_.empty()) {
+        timer_cv_.wait(lock);
+      } else {
+        auto next = watches_.front().deadline;
+        for (const auto &watch : watches_)
+          next = std::min(next, watch.deadline);
+        timer_cv_.wait_until(lock, next);
+      }
+    }
+  }
+
+  /**
+   * A job ID is the only thing guarding its result, so it takes 128 bits
+   * from the OS CSPRNG. A seeded PRNG would let a client that has seen a
+   * few IDs predict the others.
+   */
+  std::string next_id_locked() {
+    unsigned char bytes[16];
+    if (!urandom_ ||
+        std::fread(bytes, 1, sizeof(bytes), urandom_) != sizeof(bytes)) {
+      // No /dev/urandom (e.g. chroot): std::random_device is still
+      // non-deterministic on the supported platforms
+      std::random_device device;
+      for (size_t i = 0; i < sizeof(bytes); i += 4) {
+        uint32_t word = device();
+        std::memcpy(bytes + i, &word, 4);
+      }
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    std::string id = "job-";
+    for (unsigned char byte : bytes) {
+      id += digits[byte >> 4];
+      id += digits[byte & 0x0f];
+    }
+    return id;
+  }
+
+  /**
+   * Evict expired results, then the oldest ones while over the memory cap
+   */
+  void purge_locked(std::chrono::steady_clock::time_point now) {
+    auto ttl = std::chrono::seconds(config_.result_ttl_sec);
+    size_t max_bytes = config_.max_result_memory_mb * 1024 * 1024;
+
+    while (!finished_.empty()) {
+      auto it = jobs_.find(finished_.front());
+      if (it == jobs_.end()) {
+        finished_.pop_front(); // Already removed
+        continue;
+      }
+      bool expired = now - it->second->finished_at >= ttl;
+      bool over_budget = max_bytes > 0 && result_bytes_ > max_bytes;
+      if (!expired && !over_budget)
+        break;
+
+      result_bytes_ -= it->second->body.size();
+      jobs_.erase(it);
+      finished_.pop_front();
+    }
+  }
+};
+
+} // namespace onnx_server
@@ -0,0 +1,449 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "inference/dtype.hpp"
+#include "inference/session_manager.hpp"
+#include "json.hpp"
+
+namespace onnx_server {
+
+using json = nlohmann::json;
+
+/**
+ * Single-pass decoder for v1 inference bodies:
+ *
+ *   {"inputs": {"name": {"shape": [...], "dtype": "...", "data": [[...]]}}}
+ *
+ * Numeric `data` arrays are scanned straight into the tensor's typed buffer
+ * (presized when `shape` precedes `data`, never beyond what the remaining
+ * body could hold) with std::from_chars, and nesting
+ * is checked for a consistent rectangular shape while scanning. No DOM nodes
+ * are created for tensor data; other top-level members are small and are
+ * handed to nlohmann::json as-is.
+ *
+ * Constructs the fast path does not handle (escaped keys, non-numeric data,
+ * a `dtype` after `data` that changes how it is stored) make parse() return
+ * false so the caller can fall back to the DOM parser.
+ */
+class JsonTensorParser {
+public:
+  /**
+   * Invalid document or inconsistent tensor (maps to HTTP 400)
+   */
+  class ParseError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  struct Result {
+    std::vector<TensorData> inputs;
+    json extra = json::object(); // Top-level members other than "inputs"
+    bool has_inputs = false;
+  };
+
+  explicit JsonTensorParser(std::string_view body)
+      : begin_(body.data()), p_(body.data()), end_(body.data() + body.size()) {
+  }
+
+  /**
+   * Parse the body into `out`. Returns false when the document needs the
+   * generic parser; throws ParseError for malformed documents.
+   */
+  bool parse(Result &out) {
+    skip_ws();
+    expect('{');
+    skip_ws();
+    if (peek() == '}') {
+      ++p_;
+      return finish();
+    }
+
+    while (true) {
+      skip_ws();
+      std::string key;
+      if (!parse_key(key))
+        return false;
+      skip_ws();
+      expect(':');
+      skip_ws();
+
+      if (key == "inputs") {
+        if (peek() != '{' || !parse_inputs(out.inputs))
+          return false;
+        out.has_inputs = true;
+      } else {
+        const char *start = p_;
+        skip_value(0);
+        out.extra[key] = json::parse(start, p_);
+      }
+
+      skip_ws();
+      if (peek() == ',') {
+        ++p_;
+        continue;
+      }
+      expect('}');
+      break;
+    }
+    return finish();
+  }
+
+private:
+  static constexpr int MAX_DEPTH = 32;
+
+  const char *begin_;
+  const char *p_;
+  const char *end_;
+
+  // Per-tensor scan state
+  std::vector<int64_t> dims_;
+  int leaf_depth_ = -1;
+
+  [[noreturn]] void fail(const std::string &message) const {
+    throw ParseError(message + " at offset " + std::to_string(p_ - begin_));
+  }
+
+  char peek() const { return p_ < end_ ? *p_ : '\0'; }
+
+  void skip_ws() {
+    while (p_ < end_ &&
+           (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+      ++p_;
+  }
+
+  void expect(char c) {
+    if (peek() != c)
+      fail(std::string("Expected '") + c + "'");
+    ++p_;
+  }
+
+  bool finish() {
+    skip_ws();
+    if (p_ != end_)
+      fail("Trailing characters after document");
+    return true;
+  }
+
+  /**
+   * Object key without escapes; false if it needs unescaping
+   */
+  bool parse_key(std::string &key) {
+    expect('"');
+    const char *start = p_;
+    while (p_ < end_ && *p_ != '"') {
+      if (*p_ == '\\')
+        return false;
+      ++p_;
+    }
+    if (p_ == end_)
+      fail("Unterminated string");
+    key.assign(start, p_);
+    ++p_;
+    return true;
+  }
+
+  /**
+   * Skip any JSON value (validated later by nlohmann for extras)
+   */
+  void skip_value(int depth) {
+    if (depth > MAX_DEPTH)
+      fail("Document nested too deeply");
+    skip_ws();
+    char c = peek();
+    if (c == '"') {
+      ++p_;
+      while (p_ < end_ && *p_ != '"') {
+        p_ += (*p_ == '\\') ? 2 : 1;
+      }
+      if (p_ >= end_)
+        fail("Unterminated string");
+      ++p_;
+    } else if (c == '{' || c == '[') {
+      char close = c == '{' ? '}' : ']';
+      ++p_;
+      skip_ws();
+      if (peek() == close) {
+        ++p_;
+        return;
+      }
+      while (true) {
+        if (c == '{') {
+          skip_value(depth + 1); // key
+          skip_ws();
+          expect(':');
+        }
+        skip_value(depth + 1);
+        skip_ws();
+        if (peek() == ',') {
+          ++p_;
+          continue;
+        }
+        expect(close);
+        break;
+      }
+    } else {
+      while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' &&
+             *p_ != ' ' && *p_ != '\n' && *p_ != '\r' && *p_ != '\t')
+        ++p_;
+    }
+  }
+
+  bool parse_inputs(std::vector<TensorData> &inputs) {
+    expect('{');
+    skip_ws();
+    if (peek() == '}') {
+      ++p_;
+      return true;
+    }
+
+    while (true) {
+      skip_ws();
+      TensorData tensor;
+      if (!parse_key(tensor.name))
+        return false;
+      skip_ws();
+      expect(':');
+      skip_ws();
+      if (peek() != '{' || !parse_tensor(tensor))
+        return false;
+      inputs.push_back(std::move(tensor));
+
+      skip_ws();
+      if (peek() == ',') {
+        ++p_;
+        continue;
+      }
+      expect('}');
+      return true;
+    }
+  }
+
+  bool parse_tensor(TensorData &tensor) {
+    expect('{');
+    bool has_shape = false;
+    bool has_data = false;
+    bool data_as_int = false;
+    std::vector<int64_t> data_shape;
+
+    skip_ws();
+    if (peek() == '}') {
+      ++p_;
+      return true;
+    }
+
+    while (true) {
+      skip_ws();
+      std::string key;
+      if (!parse_key(key))
+        return false;
+      skip_ws();
+      expect(':');
+      skip_ws();
+
+      if (key == "shape") {
+        parse_shape(tensor.shape);
+        has_shape = true;
+      } else if (key == "dtype") {
+        if (!parse_key(tensor.dtype))
+          return false;
+        // The data was already stored by the previous dtype
+        if (has_data && (tensor.dtype == "int64") != data_as_int)
+          return false;
+      } else if (key == "data") {
+        if (peek() != '[')
+          return false;
+        if (!parse_data(tensor, has_shape, data_shape))
+          return false;
+        has_data = true;
+        data_as_int = tensor.dtype == "int64";
+      } else {
+        skip_value(0);
+      }
+
+      skip_ws();
+      if (peek() == ',') {
+        ++p_;
+        continue;
+      }
+      expect('}');
+      break;
+    }
+
+    if (has_data) {
+      size_t count = tensor.float_data.size() + tensor.int_data.size();
+      if (!has_shape) {
+        tensor.shape = data_shape;
+      } else if (data_shape.size() > 1 && data_shape != tensor.shape) {
+        fail("Nested data of input '" + tensor.name +
+             "' does not match its declared shape");
+      } else if (dtype::checked_element_count(tensor.shape) != count) {
+        fail("Element count of input '" + tensor.name +
+             "' does not match its declared shape");
+      }
+    }
+    return true;
+  }
+
+  void parse_shape(std::vector<int64_t> &shape) {
+    expect('[');
+    shape.clear();
+    skip_ws();
+    if (peek() == ']') {
+      ++p_;
+      return;
+    }
+    while (true) {
+      skip_ws();
+      int64_t dim = 0;
+      auto [ptr, ec] = std::from_chars(p_, end_, dim);
+      if (ec != std::errc() || dim < 0)
+        fail("Invalid shape dimension");
+      p_ = ptr;
+      shape.push_back(dim);
+      skip_ws();
+      if (peek() == ',') {
+        ++p_;
+        continue;
+      }
+      expect(']');
+      return;
+    }
+  }
+
+  /**
+   * Scan a nested numeric array into the tensor buffer. Returns false if an
+   * element is not a number (generic parser required).
+   */
+  bool parse_data(TensorData &tensor, bool has_shape,
+                  std::vector<int64_t> &data_shape) {
+    dims_.clear();
+    leaf_depth_ = -1;
+
+    bool as_int = tensor.dtype == "int64";
+    // Every element takes at least two bytes ("0,"), so a declared shape
+    // larger than that is rejected later and must not size the buffer
+    size_t expected = 0;
+    if (has_shape) {
+      auto count = dtype::checked_element_count(tensor.shape);
+      size_t limit = static_cast<size_t>(end_ - p_) / 2 + 1;
+      expected = count ? std::min(*count, limit) : 0;
+    }
+    if (as_int) {
+      tensor.int_data.clear();
+      tensor.int_data.reserve(expected);
+    } else {
+      tensor.float_data.clear();
+      tensor.float_data.reserve(expected);
+    }
+
+    if (!scan_array(tensor, as_int, 0))
+      return false;
+
+    if (leaf_depth_ < 0) {
+      data_shape.assign(dims_.begin(), dims_.end());
+    } else {
+      data_shape.assign(dims_.begin(), dims_.begin() + leaf_depth_ + 1);
+    }
+    return true;
+  }
+
+  bool scan_array(TensorData &tensor, bool as_int, int depth) {
+    if (depth >= MAX_DEPTH)
+      fail("Tensor data nested too deeply");
+    expect('[');
+
+    int64_t count = 0;
+    skip_ws();
+    if (peek() == ']') {
+      ++p_;
+      record_dim(depth, 0);
+      return true;
+    }
+
+    while (true) {
+      skip_ws();
+      char c = peek();
+      if (c == '[') {
+        if (leaf_depth_ >= 0 && leaf_depth_ <= depth)
+          fail("Ragged tensor data in input '" + tensor.name + "'");
+        if (!scan_array(tensor, as_int, depth + 1))
+          return false;
+      } else if ((c >= '0' && c <= '9') ||
+                 (c == '-' && p_ + 1 < end_ && p_[1] >= '0' && p_[1] <= '9')) {
+        if (leaf_depth_ < 0)
+          leaf_depth_ = depth;
+        else if (leaf_depth_ != depth)
+          fail("Ragged tensor data in input '" + tensor.name + "'");
+        if (as_int)
+          tensor.int_data.push_back(scan_int());
+        else
+          tensor.float_data.push_back(scan_float());
+      } else {
+        return false;
+      }
+
+      ++count;
+      skip_ws();
+      if (peek() == ',') {
+        ++p_;
+        continue;
+      }
+      expect(']');
+      break;
+    }
+
+    record_dim(depth, count);
+    return true;
+  }
+
+  void record_dim(int depth, int64_t count) {
+    if (static_cast<int>(dims_.size()) <= depth) {
+      dims_.resize(depth + 1, -1);
+    }
+    if (dims_[depth] < 0) {
+      dims_[depth] = count;
+    } else if (dims_[depth] != count) {
+      fail("Ragged tensor data");
+    }
+  }
+
+  float scan_float() {
+    float value = 0.0f;
+    auto result = std::from_chars(p_, end_, value);
+    if (result.ec == std::errc::result_out_of_range) {
+      // Match the DOM path: out-of-range values saturate rather than fail
+      double wide = 0.0;
+      result = std::from_chars(p_, end_, wide);
+      value = static_cast<float>(wide);
+    }
+    if (result.ec != std::errc() &&
+        result.ec != std::errc::result_out_of_range)
+      fail("Invalid number");
+    p_ = result.ptr;
+    return value;
+  }
+
+  int64_t scan_int() {
+    int64_t value = 0;
+    auto result = std::from_chars(p_, end_, value);
+    if (result.ec != std::errc())
+      fail("Invalid integer");
+    if (result.ptr < end_ &&
+        (*result.ptr == '.' || *result.ptr == 'e' || *result.ptr == 'E')) {
+      double wide = 0.0;
+      result = std::from_chars(p_, end_, wide);
+      value = static_cast<int64_t>(wide);
+    }
+    p_ = result.ptr;
+    return value;
+  }
+};
+
+} // namespace onnx_server
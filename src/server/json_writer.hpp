@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "inference/dtype.hpp"
+#include "inference/session_manager.hpp"
+#include "json.hpp"
+
+namespace onnx_server {
+
+using json = nlohmann::json;
+
+/**
+ * Streaming JSON writer for inference responses.
+ *
+ * Writes the document straight into a single pre-sized std::string instead
+ * of building a nlohmann::json tree, so tensor arrays cost one std::to_chars
+ * call per element and no per-element allocations. Floats use the shortest
+ * round-trip form by default, or `precision` significant digits when set.
+ * Non-finite values are written as null, as nlohmann::json::dump() does.
+ */
+class JsonWriter {
+public:
+  explicit JsonWriter(int precision = 0) : precision_(precision) {}
+
+  /**
+   * Grow the buffer ahead of time (e.g. from estimate_size())
+   */
+  void reserve(size_t bytes) {
+    if (bytes > out_.size())
+      out_.resize(bytes);
+  }
+
+  /**
+   * Finish and take the document
+   */
+  std::string take() {
+    out_.resize(size_);
+    size_ = 0;
+    return std::move(out_);
+  }
+
+  /**
+   * Upper-bound-ish byte estimate for a tensor's values
+   */
+  size_t estimate_size(const TensorData &tensor) const {
+    size_t count = tensor.float_data.size() + tensor.int_data.size();
+    if (count == 0) {
+      size_t width = dtype::element_size(tensor.dtype);
+      count = width ? tensor.byte_size() / width : 0;
+    }
+    bool floating = !tensor.float_data.empty() ||
+                    tensor.dtype.compare(0, 5, "float") == 0;
+    size_t per_value = floating ? (precision_ > 0 ? precision_ + 8 : 16) : 12;
+    return count * per_value + 64;
+  }
+
+  JsonWriter &begin_object() { return open('{'); }
+  JsonWriter &end_object() { return close('}'); }
+  JsonWriter &begin_array() { return open('['); }
+  JsonWriter &end_array() { return close(']'); }
+
+  JsonWriter &key(std::string_view name) {
+    separator();
+    write_string(name);
+    put(':');
+    comma_ = false;
+    return *this;
+  }
+
+  JsonWriter &value(std::string_view text) {
+    separator();
+    write_string(text);
+    comma_ = true;
+    return *this;
+  }
+
+  JsonWriter &value(const char *text) { return value(std::string_view(text)); }
+
+  JsonWriter &value(const std::string &text) {
+    return value(std::string_view(text));
+  }
+
+  JsonWriter &value(bool flag) {
+    separator();
+    flag ? append("true", 4) : append("false", 5);
+    comma_ = true;
+    return *this;
+  }
+
+  template <typename T,
+            typename = std::enable_if_t<std::is_arithmetic_v<T> &&
+                                        !std::is_same_v<T, bool>>>
+  JsonWriter &value(T number) {
+    separator();
+    write_number(number);
+    comma_ = true;
+    return *this;
+  }
+
+  /**
+   * Small nested values (shapes, parameters) through nlohmann::json
+   */
+  JsonWriter &value(const json &document) {
+    separator();
+    std::string dumped = document.dump();
+    append(dumped.data(), dumped.size());
+    comma_ = true;
+    return *this;
+  }
+
+  /**
+   * Flat array of a tensor's values, read from whichever buffer holds them
+   */
+  JsonWriter &tensor(const TensorData &tensor) {
+    separator();
+    reserve(size_ + estimate_size(tensor));
+    put('[');
+    elements(tensor, 0, value_count(tensor));
+    put(']');
+    comma_ = true;
+    return *this;
+  }
+
+  /**
+   * Number of values tensor() writes for a tensor
+   */
+  static size_t value_count(const TensorData &tensor) {
+    if (!tensor.float_data.empty())
+      return tensor.float_data.size();
+    if (!tensor.int_data.empty())
+      return tensor.int_data.size();
+    size_t width = dtype::element_size(tensor.dtype);
+    return width && tensor.data() ? tensor.byte_size() / width : 0;
+  }
+
+  /**
+   * Values [begin, begin + count) of a tensor without the brackets, so one
+   * array can be written across several chunks. A chunk after the first
+   * starts with its separating comma.
+   */
+  JsonWriter &elements(const TensorData &tensor, size_t begin, size_t count) {
+    if (count == 0)
+      return *this;
+    size_t start = size_;
+    if (begin > 0)
+      put(',');
+    size_t first = size_;
+
+    if (!tensor.float_data.empty()) {
+      write_values(tensor.float_data.data() + begin, count);
+    } else if (!tensor.int_data.empty()) {
+      write_values(tensor.int_data.data() + begin, count);
+    } else if (tensor.data()) {
+      write_raw(tensor, begin, count);
+    }
+    // A dtype without a JSON form writes nothing; drop its separator too
+    // rather than leave "[,,]" behind
+    if (size_ == first)
+      size_ = start;
+    return *this;
+  }
+
+  /**
+   * Bytes written so far
+   */
+  size_t size() const { return size_; }
+
+  /**
+   * Object of named tensors: {"name": {"shape": [...], "data": [...]}}
+   */
+  JsonWriter &tensors(const std::vector<TensorData> &tensors) {
+    begin_object();
+    for (const auto &tensor : tensors) {
+      key(tensor.name).begin_object();
+      key("shape").begin_array();
+      for (int64_t dim : tensor.shape) {
+        value(dim);
+      }
+      end_array();
+      key("data").tensor(tensor);
+      end_object();
+    }
+    return end_object();
+  }
+
+private:
+  std::string out_;
+  size_t size_ = 0;
+  bool comma_ = false;
+  int precision_;
+
+  // Longest to_chars output for a double in general format plus sign
+  static constexpr size_t MAX_NUMBER_CHARS = 32;
+
+  void ensure(size_t n) {
+    if (size_ + n > out_.size()) {
+      out_.resize(std::max(out_.size() * 2, size_ + n));
+    }
+  }
+
+  void put(char c) {
+    ensure(1);
+    out_[size_++] = c;
+  }
+
+  void append(const char *text, size_t n) {
+    ensure(n);
+    std::memcpy(&out_[size_], text, n);
+    size_ += n;
+  }
+
+  void separator() {
+    if (comma_)
+      put(',');
+  }
+
+  JsonWriter &open(char c) {
+    separator();
+    put(c);
+    comma_ = false;
+    return *this;
+  }
+
+  JsonWriter &close(char c) {
+    put(c);
+    comma_ = true;
+    return *this;
+  }
+
+  void write_string(std::string_view text) {
+    static const char *hex = "0123456789abcdef";
+    ensure(text.size() + 2);
+    put('"');
+    for (char ch : text) {
+      unsigned char c = static_cast<unsigned char>(ch);
+      if (c == '"' || c == '\\') {
+        put('\\');
+        put(ch);
+      } else if (c < 0x20) {
+        char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+        append(escaped, sizeof(escaped));
+      } else {
+        put(ch);
+      }
+    }
+    put('"');
+  }
+
+  template <typename T> void write_number(T number) {
+    ensure(MAX_NUMBER_CHARS);
+    char *first = &out_[size_];
+    char *last = first + MAX_NUMBER_CHARS;
+    std::to_chars_result result;
+
+    if constexpr (std::is_floating_point_v<T>) {
+      if (!std::isfinite(number)) {
+        append("null", 4);
+        return;
+      }
+      result = precision_ > 0
+                   ? std::to_chars(first, last, number,
+                                   std::chars_format::general, precision_)
+                   : std::to_chars(first, last, number);
+      // A precision too large for the buffer; the shortest form always fits
+      if (result.ec != std::errc())
+        result = std::to_chars(first, last, number);
+    } else {
+      result = std::to_chars(first, last, number);
+    }
+    if (result.ec != std::errc()) {
+      append("null", 4);
+      return;
+    }
+    size_ = result.ptr - out_.data();
+  }
+
+  template <typename T> void write_values(const T *values, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      if (i > 0)
+        put(',');
+      if constexpr (std::is_same_v<T, bool>)
+        values[i] ? append("true", 4) : append("false", 5);
+      else
+        write_number(values[i]);
+    }
+  }
+
+  void write_raw(const TensorData &tensor, size_t begin, size_t count) {
+    const void *data = tensor.data();
+    const std::string &type = tensor.dtype;
+
+    auto typed = [&](auto tag) {
+      using T = decltype(tag);
+      write_values(static_cast<const T *>(data) + begin, count);
+    };
+
+    if (type == "float32")
+      typed(float{});
+    else if (type == "float64")
+      typed(double{});
+    else if (type == "int8")
+      typed(int8_t{});
+    else if (type == "int16")
+      typed(int16_t{});
+    else if (type == "int32")
+      typed(int32_t{});
+    else if (type == "int64")
+      typed(int64_t{});
+    else if (type == "uint8")
+      typed(uint8_t{});
+    else if (type == "uint16")
+      typed(uint16_t{});
+    else if (type == "uint32")
+      typed(uint32_t{});
+    else if (type == "uint64")
+      typed(uint64_t{});
+    else if (type == "bool")
+      typed(bool{});
+    else if (type == "float16" || type == "bfloat16")
+      write_halves(static_cast<const uint16_t *>(data) + begin, count,
+                   type == "bfloat16");
+  }
+
+  // 16-bit floats have no C++ type; they are widened to float
+  void write_halves(const uint16_t *values, size_t count, bool bfloat) {
+    for (size_t i = 0; i < count; ++i) {
+      if (i > 0)
+        put(',');
+      write_number(bfloat ? dtype::bfloat16_to_float(values[i])
+                          : dtype::half_to_float(values[i]));
+    }
+  }
+};
+
+} // namespace onnx_server
@@ -0,0 +1,418 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "inference/dtype.hpp"
+#include "inference/session_manager.hpp"
+#include "json.hpp"
+#include "json_writer.hpp"
+#include "tensor_codec.hpp"
+#include "utils/base64.hpp"
+
+namespace onnx_server {
+
+using json = nlohmann::json;
+
+/**
+ * KServe / Triton v2 inference protocol codec, including the binary tensor
+ * data extension: the body starts with a JSON header of
+ * `Inference-Header-Content-Length` bytes, followed by the raw little-endian
+ * bytes of every tensor that declares `parameters.binary_data_size`.
+ *
+ * Tensors may instead reference a registered system shared memory region
+ * through `shared_memory_region`, `shared_memory_offset` and
+ * `shared_memory_byte_size` parameters; the handler resolves them.
+ */
+namespace kserve_v2 {
+
+constexpr const char *HEADER_LENGTH = "Inference-Header-Content-Length";
+
+/**
+ * Client-side protocol error (maps to HTTP 400)
+ */
+class RequestError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * Tensor reference into a registered shared memory region
+ */
+struct SharedMemoryRef {
+  std::string region;
+  size_t offset = 0;
+  size_t byte_size = 0;
+};
+
+/**
+ * Decoded v2 inference request
+ */
+struct Request {
+  std::string id;
+  // Inputs referencing shared memory are left without data
+  std::vector<TensorData> inputs;
+  std::unordered_map<std::string, SharedMemoryRef> shared_memory_inputs;
+  std::unordered_map<std::string, SharedMemoryRef> shared_memory_outputs;
+  // Requested outputs in order; empty means "all model outputs"
+  std::vector<std::string> outputs;
+  std::unordered_map<std::string, bool> binary_outputs;
+  bool binary_data_output = false;
+
+  bool wants_binary(const std::string &name) const {
+    auto it = binary_outputs.find(name);
+    return it != binary_outputs.end() ? it->second : binary_data_output;
+  }
+};
+
+/**
+ * Encoded v2 inference response
+ */
+struct Response {
+  std::string body;
+  std::string content_type;
+  size_t header_length = 0; // Non-zero when binary data is appended
+};
+
+/**
+ * v2 datatype ("FP32") -> dtype name ("float32"); empty if unsupported
+ */
+inline std::string from_datatype(const std::string &datatype) {
+  static const std::unordered_map<std::string, std::string> table = {
+      {"BOOL", "bool"},     {"UINT8", "uint8"},    {"UINT16", "uint16"},
+      {"UINT32", "uint32"}, {"UINT64", "uint64"},  {"INT8", "int8"},
+      {"INT16", "int16"},   {"INT32", "int32"},    {"INT64", "int64"},
+      {"FP16", "float16"},  {"BF16", "bfloat16"},  {"FP32", "float32"},
+      {"FP64", "float64"}};
+  auto it = table.find(datatype);
+  return it != table.end() ? it->second : std::string();
+}
+
+/**
+ * dtype name ("float32") -> v2 datatype ("FP32")
+ */
+inline std::string to_datatype(const std::string &dtype) {
+  static const std::unordered_map<std::string, std::string> table = {
+      {"bool", "BOOL"},     {"uint8", "UINT8"},    {"uint16", "UINT16"},
+      {"uint32", "UINT32"}, {"uint64", "UINT64"},  {"int8", "INT8"},
+      {"int16", "INT16"},   {"int32", "INT32"},    {"int64", "INT64"},
+      {"float16", "FP16"},  {"bfloat16", "BF16"},  {"float32", "FP32"},
+      {"float64", "FP64"},  {"string", "BYTES"}};
+  auto it = table.find(dtype);
+  return it != table.end() ? it->second : "BYTES";
+}
+
+/**
+ * Flatten a (possibly nested) JSON number array into a typed buffer
+ */
+inline void flatten_json_data(const json &data, const std::string &dtype,
+                              std::vector<uint8_t> &buffer) {
+  if (data.is_array()) {
+    for (const auto &item : data) {
+      flatten_json_data(item, dtype, buffer);
+    }
+  } else if (data.is_boolean()) {
+    dtype::append_number(buffer, dtype, data.get<bool>() ? 1.0 : 0.0);
+  } else if (data.is_number_integer() && dtype == "int64") {
+    dtype::append_value(buffer, data.get<int64_t>());
+  } else if (data.is_number_unsigned() && dtype == "uint64") {
+    dtype::append_value(buffer, data.get<uint64_t>());
+  } else if (data.is_number()) {
+    dtype::append_number(buffer, dtype, data.get<double>());
+  } else {
+    throw RequestError("Tensor data must contain only numbers");
+  }
+}
+
+/**
+ * Whether a request shape has the rank of the model's declared shape and
+ * agrees with every fixed (non-negative) dimension of it
+ */
+inline bool shape_matches(const std::vector<int64_t> &declared,
+                          const std::vector<int64_t> &shape) {
+  if (declared.size() != shape.size())
+    return false;
+  for (size_t i = 0; i < shape.size(); ++i) {
+    if (declared[i] >= 0 && declared[i] != shape[i])
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Read shared memory parameters; false if `params` names no region
+ */
+inline bool parse_shared_memory_ref(const json *params,
+                                    const std::string &tensor_name,
+                                    SharedMemoryRef &ref) {
+  if (!params || !params->contains("shared_memory_region"))
+    return false;
+  try {
+    ref.region = (*params)["shared_memory_region"].get<std::string>();
+    ref.offset = params->value("shared_memory_offset", size_t{0});
+    if (!params->contains("shared_memory_byte_size")) {
+      throw RequestError("shared_memory_byte_size is required for '" +
+                         tensor_name + "'");
+    }
+    ref.byte_size = (*params)["shared_memory_byte_size"].get<size_t>();
+  } catch (const json::exception &) {
+    throw RequestError("Invalid shared memory parameters for '" +
+                       tensor_name + "'");
+  }
+  return true;
+}
+
+/**
+ * Parse a v2 inference request. `header_length` is the value of the
+ * Inference-Header-Content-Length header, or 0 when the body is pure JSON.
+ *
+ * Binary tensors are referenced in place inside `body` whenever the slice is
+ * suitably aligned, so `body` must outlive the returned request.
+ */
+inline Request parse_request(const std::string &body, size_t header_length) {
+  if (header_length == 0) {
+    header_length = body.size();
+  }
+  if (header_length > body.size()) {
+    throw RequestError(std::string(HEADER_LENGTH) + " exceeds body size");
+  }
+
+  json header;
+  try {
+    header = json::parse(body.begin(), body.begin() + header_length);
+  } catch (const json::parse_error &e) {
+    throw RequestError(std::string("Invalid JSON header: ") + e.what());
+  }
+
+  if (!header.is_object() || !header.contains("inputs") ||
+      !header["inputs"].is_array()) {
+    throw RequestError("Missing 'inputs' array");
+  }
+
+  Request request;
+  if (header.contains("id") && header["id"].is_string()) {
+    request.id = header["id"];
+  }
+  if (header.contains("parameters")) {
+    request.binary_data_output =
+        header["parameters"].value("binary_data_output", false);
+  }
+
+  size_t binary_offset = header_length;
+
+  for (const auto &input : header["inputs"]) {
+    TensorData tensor;
+    tensor.name = input.value("name", "");
+    if (tensor.name.empty()) {
+      throw RequestError("Input is missing 'name'");
+    }
+
+    std::string datatype = input.value("datatype", "");
+    tensor.dtype = from_datatype(datatype);
+    if (tensor.dtype.empty()) {
+      throw RequestError("Unsupported datatype '" + datatype +
+                         "' for input '" + tensor.name + "'");
+    }
+
+    if (!input.contains("shape") || !input["shape"].is_array()) {
+      throw RequestError("Input '" + tensor.name + "' is missing 'shape'");
+    }
+    tensor.shape = input["shape"].get<std::vector<int64_t>>();
+
+    auto checked_bytes = dtype::checked_byte_size(
+        tensor.shape, dtype::element_size(tensor.dtype));
+    if (!checked_bytes) {
+      throw RequestError("Shape of input '" + tensor.name +
+                         "' is negative or too large");
+    }
+    size_t expected_bytes = *checked_bytes;
+
+    const json *params =
+        input.contains("parameters") ? &input["parameters"] : nullptr;
+
+    SharedMemoryRef shm;
+    if (parse_shared_memory_ref(params, tensor.name, shm)) {
+      if (shm.byte_size != expected_bytes) {
+        throw RequestError("shared_memory_byte_size of input '" + tensor.name +
+                           "' does not match its shape and datatype");
+      }
+      request.shared_memory_inputs[tensor.name] = std::move(shm);
+    } else if (params && params->contains("binary_data_size")) {
+      // Binary data extension: next slice of the appended bytes
+      size_t size = (*params)["binary_data_size"].get<size_t>();
+      if (size > body.size() - binary_offset) {
+        throw RequestError("Binary data for input '" + tensor.name +
+                           "' exceeds body size");
+      }
+      if (size != expected_bytes) {
+        throw RequestError("binary_data_size of input '" + tensor.name +
+                           "' does not match its shape and datatype");
+      }
+
+      const char *ptr = body.data() + binary_offset;
+      if (reinterpret_cast<uintptr_t>(ptr) %
+              dtype::element_size(tensor.dtype) ==
+          0) {
+        tensor.external_data = ptr;
+        tensor.external_size = size;
+      } else {
+        tensor.raw_data.assign(ptr, ptr + size);
+      }
+      binary_offset += size;
+    } else if (input.contains("data") && input["data"].is_string()) {
+      // Base64 form for JSON-only clients
+      auto decoded = base64::decode(input["data"].get<std::string>());
+      if (!decoded) {
+        throw RequestError("Invalid base64 data for input '" + tensor.name +
+                           "'");
+      }
+      if (decoded->size() != expected_bytes) {
+        throw RequestError("Decoded data of input '" + tensor.name +
+                           "' does not match its shape and datatype");
+      }
+      tensor.raw_data = std::move(*decoded);
+    } else if (input.contains("data")) {
+      if (tensor.dtype == "float16" || tensor.dtype == "bfloat16") {
+        throw RequestError("Datatype " + datatype +
+                           " requires binary or base64 data");
+      }
+      // Each JSON element takes at least two header bytes, which bounds
+      // what the declared shape may reserve
+      tensor.raw_data.reserve(
+          std::min(expected_bytes, (header_length / 2 + 1) *
+                                       dtype::element_size(tensor.dtype)));
+      flatten_json_data(input["data"], tensor.dtype, tensor.raw_data);
+      if (tensor.raw_data.size() != expected_bytes) {
+        throw RequestError("Element count of input '" + tensor.name +
+                           "' does not match its shape");
+      }
+    } else {
+      throw RequestError("Input '" + tensor.name + "' has no data");
+    }
+
+    request.inputs.push_back(std::move(tensor));
+  }
+
+  if (binary_offset != body.size()) {
+    throw RequestError("Unconsumed binary data after the last tensor");
+  }
+
+  if (header.contains("outputs") && header["outputs"].is_array()) {
+    for (const auto &output : header["outputs"]) {
+      std::string name = output.value("name", "");
+      if (name.empty()) {
+        throw RequestError("Requested output is missing 'name'");
+      }
+      request.outputs.push_back(name);
+      const json *params =
+          output.contains("parameters") ? &output["parameters"] : nullptr;
+      SharedMemoryRef shm;
+      if (parse_shared_memory_ref(params, name, shm)) {
+        request.shared_memory_outputs[name] = std::move(shm);
+      } else if (params && params->contains("binary_data")) {
+        request.binary_outputs[name] = (*params)["binary_data"].get<bool>();
+      }
+    }
+  }
+
+  return request;
+}
+
+/**
+ * Encode a v2 inference response, appending binary outputs after the JSON
+ * header when the client asked for them. JSON tensor data is written by
+ * JsonWriter with `precision` significant digits (0 = shortest round-trip).
+ */
+inline Response encode_response(const std::string &model_name,
+                                const Request &request,
+                                const InferenceResponse &result,
+                                int precision = 0) {
+  JsonWriter writer(precision);
+  std::string binary;
+
+  std::vector<const TensorData *> selected;
+  if (request.outputs.empty()) {
+    for (const auto &output : result.outputs) {
+      selected.push_back(&output);
+    }
+  } else {
+    for (const auto &name : request.outputs) {
+      for (const auto &output : result.outputs) {
+        if (output.name == name) {
+          selected.push_back(&output);
+          break;
+        }
+      }
+    }
+  }
+
+  size_t estimate = 256;
+  for (const auto *output : selected) {
+    if (!request.wants_binary(output->name) &&
+        !request.shared_memory_outputs.count(output->name))
+      estimate += writer.estimate_size(*output);
+  }
+  writer.reserve(estimate);
+
+  writer.begin_object();
+  writer.key("model_name").value(model_name);
+  writer.key("model_version").value("1");
+  if (!request.id.empty()) {
+    writer.key("id").value(request.id);
+  }
+
+  writer.key("outputs").begin_array();
+  for (const auto *output : selected) {
+    writer.begin_object();
+    writer.key("name").value(output->name);
+    writer.key("datatype").value(to_datatype(output->dtype));
+    writer.key("shape").begin_array();
+    for (int64_t dim : output->shape) {
+      writer.value(dim);
+    }
+    writer.end_array();
+
+    auto shm = request.shared_memory_outputs.find(output->name);
+    if (shm != request.shared_memory_outputs.end()) {
+      // Data already sits in the client's region
+      writer.key("parameters").begin_object();
+      writer.key("shared_memory_region").value(shm->second.region);
+      writer.key("shared_memory_offset").value(shm->second.offset);
+      writer.key("shared_memory_byte_size").value(output->byte_size());
+      writer.end_object();
+    } else if (request.wants_binary(output->name) &&
+               output->dtype != "string") {
+      size_t before = binary.size();
+      append_tensor_bytes(binary, *output);
+      writer.key("parameters").begin_object();
+      writer.key("binary_data_size").value(binary.size() - before);
+      writer.end_object();
+    } else {
+      writer.key("data").tensor(*output);
+    }
+    writer.end_object();
+  }
+  writer.end_array();
+  writer.end_object();
+
+  Response response;
+  response.body = writer.take();
+
+  if (binary.empty()) {
+    response.content_type = "application/json";
+  } else {
+    response.header_length = response.body.size();
+    response.body += binary;
+    response.content_type = "application/octet-stream";
+  }
+
+  return response;
+}
+
+} // namespace kserve_v2
+
+} // namespace onnx_server
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <string>
+#include <string_view>
+
+#include "inference/session_manager.hpp"
+#include "json.hpp"
+
+namespace onnx_server {
+
+using json = nlohmann::json;
+
+/**
+ * Ordered, bounded pipeline behind POST /v1/models/:name/infer:stream.
+ *
+ * Lines of an NDJSON body are parsed and submitted lazily, keeping at most
+ * `max_in_flight` instances at the inference backend: enough to keep the
+ * batcher full without decoding the whole job up front. Results are written
+ * in input order, one line per instance.
+ */
+class NdjsonStream {
+public:
+  /**
+   * One submitted instance: a pending result or a parse error
+   */
+  struct Instance {
+    size_t index = 0;
+    json id; // Client-supplied "id", echoed back when present
+    std::future<InferenceResponse> result;
+    int error_status = 0;
+    std::string error;
+  };
+
+  // Parse one line and submit it; parse failures set error_status
+  using Submit = std::function<void(std::string_view line, Instance &)>;
+  // Render a finished instance (waiting for its result) as one JSON line
+  using Format = std::function<std::string(Instance &)>;
+
+  NdjsonStream(std::string body, size_t max_in_flight, Submit submit,
+               Format format)
+      : body_(std::move(body)),
+        max_in_flight_(max_in_flight > 0 ? max_in_flight : 1),
+        submit_(std::move(submit)), format_(std::move(format)) {}
+
+  /**
+   * Append the next result line to `out`, plus any later ones that have
+   * already finished (up to `max_chunk_bytes`). Returns false once every
+   * instance has been written.
+   */
+  bool next(std::string &out, size_t max_chunk_bytes = 64 * 1024) {
+    fill();
+    if (window_.empty())
+      return false;
+
+    emit_front(out);
+    while (!window_.empty() && out.size() < max_chunk_bytes &&
+           ready(window_.front())) {
+      emit_front(out);
+    }
+    return true;
+  }
+
+  /**
+   * Instances read from the body so far
+   */
+  size_t submitted() const { return next_index_; }
+
+private:
+  std::string body_;
+  size_t pos_ = 0;
+  size_t max_in_flight_;
+  size_t next_index_ = 0;
+  std::deque<Instance> window_;
+  Submit submit_;
+  Format format_;
+
+  void fill() {
+    std::string_view line;
+    while (window_.size() < max_in_flight_ && next_line(line)) {
+      Instance instance;
+      instance.index = next_index_++;
+      submit_(line, instance);
+      window_.push_back(std::move(instance));
+    }
+  }
+
+  /**
+   * Next non-blank line (CRLF tolerated)
+   */
+  bool next_line(std::string_view &line) {
+    while (pos_ < body_.size()) {
+      size_t end = body_.find('\n', pos_);
+      if (end == std::string::npos)
+        end = body_.size();
+
+      std::string_view candidate(body_.data() + pos_, end - pos_);
+      pos_ = end + 1;
+
+      while (!candidate.empty() &&
+             (candidate.back() == '\r' || candidate.back() == ' ' ||
+              candidate.back() == '\t'))
+        candidate.remove_suffix(1);
+      if (candidate.find_first_not_of(" \t") == std::string_view::npos)
+        continue;
+
+      line = candidate;
+      return true;
+    }
+    return false;
+  }
+
+  static bool ready(const Instance &instance) {
+    return !instance.result.valid() ||
+           instance.result.wait_for(std::chrono::seconds(0)) ==
+               std::future_status::ready;
+  }
+
+  void emit_front(std::string &out) {
+    out += format_(window_.front());
+    out += '\n';
+    window_.pop_front();
+    fill();
+  }
+};
+
+} // namespace onnx_server
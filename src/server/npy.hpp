@@ -0,0 +1,490 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "inference/dtype.hpp"
+#include "inference/session_manager.hpp"
+#include "tensor_codec.hpp"
+
+namespace onnx_server {
+
+/**
+ * NumPy .npy / .npz tensor payloads.
+ *
+ * .npy: magic "\x93NUMPY", version, header length, then a Python dict
+ * literal ({'descr': '<f4', 'fortran_order': False, 'shape': (1, 3), })
+ * padded so the data starts on a 64-byte boundary. The data is referenced in
+ * place whenever it is little-endian and aligned.
+ *
+ * .npz: a zip archive of .npy members, one per named input. Only STORED
+ * (np.savez) members can be used in place; np.savez_compressed archives are
+ * rejected.
+ */
+namespace npy {
+
+constexpr const char *NPY_CONTENT_TYPE = "application/x-npy";
+constexpr const char *NPZ_CONTENT_TYPE = "application/x-npz";
+
+/**
+ * Malformed or unsupported payload (maps to HTTP 400)
+ */
+class FormatError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+
+inline uint16_t read_u16(const char *p) {
+  return static_cast<uint16_t>(static_cast<uint8_t>(p[0]) |
+                               (static_cast<uint8_t>(p[1]) << 8));
+}
+
+inline uint32_t read_u32(const char *p) {
+  return static_cast<uint32_t>(read_u16(p)) |
+         (static_cast<uint32_t>(read_u16(p + 2)) << 16);
+}
+
+inline void write_u16(std::string &out, uint16_t v) {
+  out += static_cast<char>(v & 0xFF);
+  out += static_cast<char>((v >> 8) & 0xFF);
+}
+
+inline void write_u32(std::string &out, uint32_t v) {
+  write_u16(out, static_cast<uint16_t>(v & 0xFFFF));
+  write_u16(out, static_cast<uint16_t>(v >> 16));
+}
+
+/**
+ * Value of `key` in the header dict, as the raw literal text
+ */
+inline std::string dict_value(const std::string &header,
+                              const std::string &key) {
+  auto pos = header.find("'" + key + "'");
+  if (pos == std::string::npos)
+    throw FormatError("npy header is missing '" + key + "'");
+  pos = header.find(':', pos);
+  if (pos == std::string::npos)
+    throw FormatError("Malformed npy header");
+  pos = header.find_first_not_of(' ', pos + 1);
+  if (pos == std::string::npos)
+    throw FormatError("Malformed npy header");
+
+  size_t end;
+  if (header[pos] == '(') {
+    end = header.find(')', pos);
+    if (end == std::string::npos)
+      throw FormatError("Malformed npy shape");
+    return header.substr(pos, end - pos + 1);
+  }
+  if (header[pos] == '\'') {
+    end = header.find('\'', pos + 1);
+    if (end == std::string::npos)
+      throw FormatError("Malformed npy header");
+    return header.substr(pos + 1, end - pos - 1);
+  }
+  end = header.find_first_of(",}", pos);
+  return header.substr(pos, end - pos);
+}
+
+/**
+ * NumPy type string (without byte-order char) -> dtype name
+ */
+inline std::string dtype_from_descr(const std::string &kind) {
+  if (kind == "f4")
+    return "float32";
+  if (kind == "f8")
+    return "float64";
+  if (kind == "f2")
+    return "float16";
+  if (kind == "i1")
+    return "int8";
+  if (kind == "i2")
+    return "int16";
+  if (kind == "i4")
+    return "int32";
+  if (kind == "i8")
+    return "int64";
+  if (kind == "u1")
+    return "uint8";
+  if (kind == "u2")
+    return "uint16";
+  if (kind == "u4")
+    return "uint32";
+  if (kind == "u8")
+    return "uint64";
+  if (kind == "b1")
+    return "bool";
+  return "";
+}
+
+inline std::string descr_from_dtype(const std::string &dtype) {
+  if (dtype == "float32")
+    return "<f4";
+  if (dtype == "float64")
+    return "<f8";
+  if (dtype == "float16")
+    return "<f2";
+  if (dtype == "int8")
+    return "|i1";
+  if (dtype == "int16")
+    return "<i2";
+  if (dtype == "int32")
+    return "<i4";
+  if (dtype == "int64")
+    return "<i8";
+  if (dtype == "uint8")
+    return "|u1";
+  if (dtype == "uint16")
+    return "<u2";
+  if (dtype == "uint32")
+    return "<u4";
+  if (dtype == "uint64")
+    return "<u8";
+  if (dtype == "bool")
+    return "|b1";
+  return "";
+}
+
+/**
+ * CRC-32 (IEEE) as required by zip members
+ */
+inline uint32_t crc32(const char *data, size_t size, uint32_t crc = 0) {
+  static const auto table = [] {
+    std::vector<uint32_t> t(256);
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i)
+    crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+} // namespace detail
+
+/**
+ * Parse one .npy payload into `tensor` (name is left untouched). The data is
+ * borrowed from `data` when possible, so it must outlive the tensor.
+ */
+inline void parse_npy(const char *data, size_t size, TensorData &tensor) {
+  if (size < 10 || std::memcmp(data, "\x93NUMPY", 6) != 0)
+    throw FormatError("Not a .npy payload");
+
+  uint8_t major = static_cast<uint8_t>(data[6]);
+  size_t header_len;
+  size_t header_start;
+  if (major == 1) {
+    header_len = detail::read_u16(data + 8);
+    header_start = 10;
+  } else if (major == 2 || major == 3) {
+    if (size < 12)
+      throw FormatError("Truncated .npy header");
+    header_len = detail::read_u32(data + 8);
+    header_start = 12;
+  } else {
+    throw FormatError("Unsupported .npy version");
+  }
+
+  if (header_len > size - header_start)
+    throw FormatError("Truncated .npy header");
+
+  std::string header(data + header_start, header_len);
+
+  std::string descr = detail::dict_value(header, "descr");
+  if (descr.size() < 3)
+    throw FormatError("Unsupported npy descr: " + descr);
+  char byte_order = descr[0];
+  tensor.dtype = detail::dtype_from_descr(descr.substr(1));
+  if (tensor.dtype.empty())
+    throw FormatError("Unsupported npy descr: " + descr);
+
+  if (detail::dict_value(header, "fortran_order") != "False")
+    throw FormatError("Fortran-ordered arrays are not supported");
+
+  // Shape tuple: "(1, 3, 224, 224)", "(5,)" or "()"
+  std::string shape = detail::dict_value(header, "shape");
+  tensor.shape.clear();
+  size_t pos = 1;
+  while (pos < shape.size()) {
+    size_t end = shape.find_first_of(",)", pos);
+    std::string dim = shape.substr(pos, end - pos);
+    dim.erase(0, dim.find_first_not_of(' '));
+    dim.erase(dim.find_last_not_of(" L") + 1);
+    if (!dim.empty())
+      tensor.shape.push_back(std::stoll(dim));
+    if (end == std::string::npos || shape[end] == ')')
+      break;
+    pos = end + 1;
+  }
+
+  size_t width = dtype::element_size(tensor.dtype);
+  auto checked_bytes = dtype::checked_byte_size(tensor.shape, width);
+  if (!checked_bytes)
+    throw FormatError("Invalid .npy shape: " + shape);
+  size_t bytes = *checked_bytes;
+  size_t header_end = header_start + header_len;
+  const char *payload = data + header_end;
+  if (bytes > size - header_end)
+    throw FormatError("Truncated .npy data");
+
+  bool swap = byte_order == '>' && width > 1;
+  bool aligned = reinterpret_cast<uintptr_t>(payload) % width == 0;
+
+  tensor.external_data = nullptr;
+  tensor.external_size = 0;
+  if (!swap && aligned) {
+    tensor.external_data = payload;
+    tensor.external_size = bytes;
+    return;
+  }
+
+  tensor.raw_data.assign(payload, payload + bytes);
+  if (swap) {
+    for (size_t i = 0; i + width <= bytes; i += width) {
+      std::reverse(tensor.raw_data.begin() + i,
+                   tensor.raw_data.begin() + i + width);
+    }
+  }
+}
+
+/**
+ * Parse a .npz archive into one tensor per member (named after the member,
+ * minus ".npy"). Members are borrowed from `data`.
+ */
+inline std::vector<TensorData> parse_npz(const std::string &data) {
+  // Locate the end-of-central-directory record
+  if (data.size() < 22)
+    throw FormatError("Not a .npz archive");
+  size_t eocd = std::string::npos;
+  for (size_t i = data.size() - 22; i + 1 > 0; --i) {
+    if (detail::read_u32(data.data() + i) == 0x06054b50) {
+      eocd = i;
+      break;
+    }
+    if (data.size() - i > 22 + 0xFFFF)
+      break;
+  }
+  if (eocd == std::string::npos)
+    throw FormatError("Not a .npz archive");
+
+  uint16_t entries = detail::read_u16(data.data() + eocd + 10);
+  size_t dir = detail::read_u32(data.data() + eocd + 16);
+
+  std::vector<TensorData> tensors;
+  for (uint16_t e = 0; e < entries; ++e) {
+    if (dir + 46 > data.size() ||
+        detail::read_u32(data.data() + dir) != 0x02014b50)
+      throw FormatError("Corrupt .npz central directory");
+
+    const char *entry = data.data() + dir;
+    uint16_t method = detail::read_u16(entry + 10);
+    uint32_t comp_size = detail::read_u32(entry + 20);
+    uint16_t name_len = detail::read_u16(entry + 28);
+    uint16_t extra_len = detail::read_u16(entry + 30);
+    uint16_t comment_len = detail::read_u16(entry + 32);
+    // Widened so that offset arithmetic cannot wrap
+    size_t local = detail::read_u32(entry + 42);
+    if (dir + 46 + name_len > data.size())
+      throw FormatError("Corrupt .npz central directory");
+    std::string name(entry + 46, name_len);
+    dir += 46 + name_len + extra_len + comment_len;
+
+    if (method != 0)
+      throw FormatError("Compressed .npz members are not supported; use "
+                        "np.savez instead of np.savez_compressed");
+
+    if (local + 30 > data.size() ||
+        detail::read_u32(data.data() + local) != 0x04034b50)
+      throw FormatError("Corrupt .npz local header");
+
+    size_t offset = local + 30 + detail::read_u16(data.data() + local + 26) +
+                    detail::read_u16(data.data() + local + 28);
+    if (offset > data.size() || comp_size > data.size() - offset)
+      throw FormatError("Truncated .npz member: " + name);
+
+    TensorData tensor;
+    tensor.name = name;
+    if (tensor.name.size() > 4 &&
+        tensor.name.compare(tensor.name.size() - 4, 4, ".npy") == 0) {
+      tensor.name.resize(tensor.name.size() - 4);
+    }
+    parse_npy(data.data() + offset, comp_size, tensor);
+    tensors.push_back(std::move(tensor));
+  }
+
+  return tensors;
+}
+
+/**
+ * .npy preamble for a tensor: magic, version and the padded header dict.
+ * The element bytes follow it directly.
+ */
+inline std::string npy_preamble(const TensorData &tensor) {
+  std::string descr = detail::descr_from_dtype(tensor.dtype);
+  if (descr.empty())
+    throw FormatError("Cannot encode dtype as npy: " + tensor.dtype);
+
+  std::string shape = "(";
+  for (size_t i = 0; i < tensor.shape.size(); ++i) {
+    shape += std::to_string(tensor.shape[i]);
+    if (i + 1 < tensor.shape.size() || tensor.shape.size() == 1)
+      shape += ",";
+    if (i + 1 < tensor.shape.size())
+      shape += " ";
+  }
+  shape += ")";
+
+  std::string header = "{'descr': '" + descr +
+                       "', 'fortran_order': False, 'shape': " + shape + ", }";
+  // Pad so magic + lengths + header (ending in '\n') is 64-byte aligned
+  size_t total = 10 + header.size() + 1;
+  header.append((64 - total % 64) % 64, ' ');
+  header += '\n';
+
+  std::string out;
+  out.reserve(10 + header.size());
+  out.append("\x93NUMPY\x01\x00", 8);
+  detail::write_u16(out, static_cast<uint16_t>(header.size()));
+  out += header;
+  return out;
+}
+
+/**
+ * Serialize one tensor as a .npy payload
+ */
+inline std::string write_npy(const TensorData &tensor) {
+  std::string out = npy_preamble(tensor);
+  out.reserve(out.size() + tensor.byte_size());
+  append_tensor_bytes(out, tensor);
+  return out;
+}
+
+namespace detail {
+
+/**
+ * write_npz_to() target that concatenates into a string
+ */
+struct StringOut {
+  std::string &out;
+
+  size_t size() const { return out.size(); }
+  void append(std::string bytes) { out += bytes; }
+  void append_view(const char *data, size_t size) { out.append(data, size); }
+};
+
+} // namespace detail
+
+/**
+ * Serialize tensors as an uncompressed .npz archive into `out`, which
+ * provides size(), append(std::string) for archive headers and
+ * append_view(data, size) for member data. Member data is passed as a view
+ * of the tensor's own buffer where its layout allows, so a streaming `out`
+ * can send it without copying; the tensors must then outlive `out`.
+ */
+template <typename Out>
+inline void write_npz_to(const std::vector<const TensorData *> &tensors,
+                         Out &out) {
+  std::string directory;
+
+  for (const auto *tensor : tensors) {
+    std::string preamble = npy_preamble(*tensor);
+    std::string name = tensor->name + ".npy";
+
+    // int32 outputs widened to int_data have to be narrowed first
+    std::string narrowed;
+    const char *data = static_cast<const char *>(tensor->data());
+    size_t size = tensor->byte_size();
+    if (tensor->dtype == "int32" && !tensor->int_data.empty()) {
+      append_tensor_bytes(narrowed, *tensor);
+      data = narrowed.data();
+      size = narrowed.size();
+    }
+
+    uint32_t member_size = static_cast<uint32_t>(preamble.size() + size);
+    uint32_t crc = detail::crc32(data, size,
+                                 detail::crc32(preamble.data(),
+                                               preamble.size()));
+    uint32_t offset = static_cast<uint32_t>(out.size());
+
+    // Local file header
+    std::string local;
+    detail::write_u32(local, 0x04034b50);
+    detail::write_u16(local, 20); // version needed
+    detail::write_u16(local, 0);  // flags
+    detail::write_u16(local, 0);  // method: stored
+    detail::write_u16(local, 0);  // mod time
+    detail::write_u16(local, 0x21); // mod date (1980-01-01)
+    detail::write_u32(local, crc);
+    detail::write_u32(local, member_size);
+    detail::write_u32(local, member_size);
+    detail::write_u16(local, static_cast<uint16_t>(name.size()));
+    detail::write_u16(local, 0);
+    local += name;
+    local += preamble;
+    out.append(std::move(local));
+    if (!narrowed.empty())
+      out.append(std::move(narrowed));
+    else if (size > 0)
+      out.append_view(data, size);
+
+    // Central directory entry
+    detail::write_u32(directory, 0x02014b50);
+    detail::write_u16(directory, 20); // version made by
+    detail::write_u16(directory, 20); // version needed
+    detail::write_u16(directory, 0);
+    detail::write_u16(directory, 0);
+    detail::write_u16(directory, 0);
+    detail::write_u16(directory, 0x21);
+    detail::write_u32(directory, crc);
+    detail::write_u32(directory, member_size);
+    detail::write_u32(directory, member_size);
+    detail::write_u16(directory, static_cast<uint16_t>(name.size()));
+    detail::write_u16(directory, 0); // extra
+    detail::write_u16(directory, 0); // comment
+    detail::write_u16(directory, 0); // disk
+    detail::write_u16(directory, 0); // internal attrs
+    detail::write_u32(directory, 0); // external attrs
+    detail::write_u32(directory, offset);
+    directory += name;
+  }
+
+  uint32_t dir_offset = static_cast<uint32_t>(out.size());
+  uint32_t dir_size = static_cast<uint32_t>(directory.size());
+
+  // End of central directory
+  detail::write_u32(directory, 0x06054b50);
+  detail::write_u16(directory, 0);
+  detail::write_u16(directory, 0);
+  detail::write_u16(directory, static_cast<uint16_t>(tensors.size()));
+  detail::write_u16(directory, static_cast<uint16_t>(tensors.size()));
+  detail::write_u32(directory, dir_size);
+  detail::write_u32(directory, dir_offset);
+  detail::write_u16(directory, 0);
+  out.append(std::move(directory));
+}
+
+/**
+ * Serialize tensors as an uncompressed .npz archive
+ */
+inline std::string write_npz(const std::vector<const TensorData *> &tensors) {
+  std::string out;
+  detail::StringOut sink{out};
+  write_npz_to(tensors, sink);
+  return out;
+}
+
+} // namespace npy
+
+} // namespace onnx_server
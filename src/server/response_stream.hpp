@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "httplib.h"
+#include "inference/session_manager.hpp"
+#include "json_writer.hpp"
+
+namespace onnx_server {
+
+/**
+ * Fixed-length response body made of owned pieces (headers) and views of
+ * tensor buffers, served by a content provider without concatenating them.
+ * Whoever owns the viewed tensors must outlive the body.
+ */
+class SegmentedBody {
+public:
+  size_t size() const { return size_; }
+
+  void append(std::string bytes) {
+    if (bytes.empty())
+      return;
+    owned_.push_back(std::move(bytes));
+    append_view(owned_.back().data(), owned_.back().size());
+  }
+
+  void append_view(const char *data, size_t size) {
+    if (size == 0)
+      return;
+    segments_.push_back({data, size, size_});
+    size_ += size;
+  }
+
+  /**
+   * Content provider step: write from `offset` to the end of its segment
+   */
+  bool write(size_t offset, size_t length, httplib::DataSink &sink) const {
+    auto it = std::upper_bound(
+        segments_.begin(), segments_.end(), offset,
+        [](size_t value, const Segment &segment) {
+          return value < segment.start;
+        });
+    if (it == segments_.begin())
+      return false;
+    --it;
+
+    size_t skip = offset - it->start;
+    if (skip >= it->size)
+      return false;
+    return sink.write(it->data + skip, std::min(length, it->size - skip));
+  }
+
+private:
+  struct Segment {
+    const char *data;
+    size_t size;
+    size_t start; // Offset of the segment in the body
+  };
+
+  std::deque<std::string> owned_; // Stable addresses for the views
+  std::vector<Segment> segments_;
+  size_t size_ = 0;
+};
+
+/**
+ * The v1 JSON inference response written incrementally, for chunked
+ * transfer of large outputs: each call to next() serializes roughly
+ * `chunk_bytes` straight from the output tensors, so the whole document is
+ * never held in memory and the first bytes go out before the last values
+ * are formatted. (The epoll backend drains it into one body for HTTP/1.0
+ * clients, which cannot receive chunked coding.)
+ */
+class JsonResponseStream {
+public:
+  JsonResponseStream(std::shared_ptr<const InferenceResponse> response,
+                     std::string model_name, int precision,
+                     size_t chunk_bytes)
+      : response_(std::move(response)), model_name_(std::move(model_name)),
+        chunk_bytes_(std::max<size_t>(chunk_bytes, 1024)),
+        writer_(precision) {}
+
+  /**
+   * Replace `out` with the next part of the document; false once done
+   */
+  bool next(std::string &out) {
+    if (stage_ == Stage::Done)
+      return false;
+
+    writer_.reserve(chunk_bytes_ + 1024);
+    while (stage_ != Stage::Done && writer_.size() < chunk_bytes_) {
+      step();
+    }
+    out = writer_.take();
+    return true;
+  }
+
+private:
+  enum class Stage { Head, Outputs, Tail, Done };
+
+  // Values written per step; small enough to stay close to chunk_bytes_
+  static constexpr size_t VALUES_PER_STEP = 1024;
+
+  std::shared_ptr<const InferenceResponse> response_;
+  std::string model_name_;
+  size_t chunk_bytes_;
+  JsonWriter writer_; // Keeps separator state across chunks
+
+  Stage stage_ = Stage::Head;
+  size_t output_ = 0;  // Output being written
+  bool opened_ = false; // Its "data" array has been opened
+  size_t offset_ = 0;  // Values of it written so far
+  size_t count_ = 0;   // Values it has
+
+  void step() {
+    switch (stage_) {
+    case Stage::Head:
+      writer_.begin_object();
+      writer_.key("model_name").value(model_name_);
+      writer_.key("outputs").begin_object();
+      stage_ = Stage::Outputs;
+      break;
+
+    case Stage::Outputs: {
+      if (output_ == response_->outputs.size()) {
+        writer_.end_object();
+        stage_ = Stage::Tail;
+        break;
+      }
+
+      const TensorData &tensor = response_->outputs[output_];
+      if (!opened_) {
+        writer_.key(tensor.name).begin_object();
+        writer_.key("shape").begin_array();
+        for (int64_t dim : tensor.shape) {
+          writer_.value(dim);
+        }
+        writer_.end_array();
+        writer_.key("data").begin_array();
+        opened_ = true;
+        offset_ = 0;
+        count_ = JsonWriter::value_count(tensor);
+      }
+
+      size_t n = std::min(VALUES_PER_STEP, count_ - offset_);
+      writer_.elements(tensor, offset_, n);
+      offset_ += n;
+      if (offset_ == count_) {
+        writer_.end_array().end_object();
+        opened_ = false;
+        ++output_;
+      }
+      break;
+    }
+
+    case Stage::Tail:
+      // Include timing info if available
+      if (response_->inference_time_ms > 0) {
+        writer_.key("timing").begin_object();
+        writer_.key("inference_ms").value(response_->inference_time_ms);
+        writer_.key("queue_ms").value(response_->queue_time_ms);
+        writer_.end_object();
+      }
+      writer_.end_object();
+      stage_ = Stage::Done;
+      break;
+
+    case Stage::Done:
+      break;
+    }
+  }
+};
+
+} // namespace onnx_server
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace onnx_server {
+
+/**
+ * Path-segment trie for route lookup, built once at startup.
+ *
+ * Patterns are `/`-separated segments; a segment starting with `:` is a
+ * parameter matching any non-empty segment (like the `([^/]+)` groups it
+ * replaces), every other segment is literal (`infer:stream` included).
+ * A lookup walks the path once, preferring literal segments over
+ * parameters and backing off if a literal branch dead-ends, and records
+ * parameters as views into the path: it never allocates.
+ */
+template <typename T> class RouteTrie {
+public:
+  static constexpr size_t MAX_PARAMS = 8;
+
+  struct Match {
+    const T *value = nullptr;
+    std::array<std::string_view, MAX_PARAMS> params{};
+    size_t param_count = 0;
+  };
+
+  /**
+   * Value slot for `pattern`, created on first use. Appends the pattern's
+   * parameter names to `names`; returns nullptr if it has too many.
+   */
+  T *insert(std::string_view pattern, std::vector<std::string> &names) {
+    Node *node = &root_;
+    size_t params = 0;
+    for (std::string_view segment : split(pattern)) {
+      if (!segment.empty() && segment[0] == ':') {
+        if (++params > MAX_PARAMS)
+          return nullptr;
+        names.emplace_back(segment.substr(1));
+        if (!node->param)
+          node->param = std::make_unique<Node>();
+        node = node->param.get();
+        continue;
+      }
+
+      Node *child = nullptr;
+      for (auto &[literal, next] : node->literals) {
+        if (literal == segment) {
+          child = next.get();
+          break;
+        }
+      }
+      if (!child) {
+        node->literals.emplace_back(std::string(segment),
+                                    std::make_unique<Node>());
+        child = node->literals.back().second.get();
+      }
+      node = child;
+    }
+
+    if (!node->value)
+      node->value = std::make_unique<T>();
+    return node->value.get();
+  }
+
+  /**
+   * Resolve `path` (no query string); false if no pattern matches
+   */
+  bool match(std::string_view path, Match &match) const {
+    match.value = nullptr;
+    match.param_count = 0;
+    if (path.empty() || path[0] != '/')
+      return false;
+    if (path.size() == 1)
+      return (match.value = root_.value.get()) != nullptr;
+    return walk(root_, path, 0, match);
+  }
+
+private:
+  struct Node {
+    // Few children per node: a linear scan beats hashing here
+    std::vector<std::pair<std::string, std::unique_ptr<Node>>> literals;
+    std::unique_ptr<Node> param;
+    std::unique_ptr<T> value;
+  };
+
+  Node root_;
+
+  static std::vector<std::string_view> split(std::string_view pattern) {
+    std::vector<std::string_view> segments;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+      if (pattern[pos] == '/') {
+        ++pos;
+        continue;
+      }
+      size_t end = pattern.find('/', pos);
+      if (end == std::string_view::npos)
+        end = pattern.size();
+      segments.push_back(pattern.substr(pos, end - pos));
+      pos = end;
+    }
+    return segments;
+  }
+
+  /**
+   * Match the rest of `path` from `pos`, which is at a '/' or the end
+   */
+  static bool walk(const Node &node, std::string_view path, size_t pos,
+                   Match &match) {
+    if (pos == path.size()) {
+      match.value = node.value.get();
+      return match.value != nullptr;
+    }
+
+    size_t start = pos + 1;
+    size_t end = path.find('/', start);
+    if (end == std::string_view::npos)
+      end = path.size();
+    std::string_view segment = path.substr(start, end - start);
+
+    for (const auto &[literal, next] : node.literals) {
+      if (literal == segment && walk(*next, path, end, match))
+        return true;
+    }
+
+    if (node.param && !segment.empty() &&
+        match.param_count < MAX_PARAMS) {
+      match.params[match.param_count++] = segment;
+      if (walk(*node.param, path, end, match))
+        return true;
+      --match.param_count;
+    }
+    return false;
+  }
+};
+
+} // namespace onnx_server
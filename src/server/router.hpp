@@ -1,16 +1,23 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <functional>
+#include <memory>
 #include <regex>
 #include <string>
 #include <unordered_map>
 
+#include "compression.hpp"
+#include "deferred_response.hpp"
 #include "http_server.hpp"
 #include "httplib.h"
 #include "json.hpp"
 #include "metrics/collector.hpp"
+#include "route_trie.hpp"
+#include "utils/config.hpp"
 #include "utils/logging.hpp"
+#include "utils/request_trace.hpp"
 
 namespace onnx_server {
 
@@ -23,11 +30,23 @@ struct RequestContext {
   std::unordered_map<std::string, std::string> path_params;
   std::chrono::steady_clock::time_point start_time;
   std::string request_id;
+  // Model served, set by inference handlers for per-model latency metrics
+  std::string model;
+  // Phase timestamps, begun by the router and marked by handlers
+  RequestTrace trace;
 
   RequestContext()
       : start_time(std::chrono::steady_clock::now()),
         request_id(generate_request_id()) {}
 
+  /**
+   * Path parameter by name, empty if the route has none of that name
+   */
+  std::string param(const std::string &name) const {
+    auto it = path_params.find(name);
+    return it != path_params.end() ? it->second : std::string();
+  }
+
 private:
   static std::string generate_request_id() {
     static std::atomic<uint64_t> counter{0};
@@ -37,46 +56,112 @@ private:
 
 /**
  * Router for handling API endpoints with path parameter extraction
+ *
+ * Routes live in a RouteTrie that resolves method, path and parameters in
+ * one walk; HttpServer hands every request to it through a single fallback
+ * route instead of matching one regex per registered route.
  */
 class Router {
 public:
   using RouteHandler = std::function<void(
       const httplib::Request &, httplib::Response &, RequestContext &)>;
+  // Checks a request from its header block, before the body is uploaded
+  // (see HttpServer::post); false once it has written a rejection
+  using BodyGate = std::function<bool(const httplib::Request &,
+                                      httplib::Response &, RequestContext &)>;
+  using WebSocketOpener = std::function<std::shared_ptr<websocket::Session>(
+      const httplib::Request &, httplib::Response &, RequestContext &,
+      std::shared_ptr<websocket::Channel>)>;
 
   explicit Router(HttpServer &server, MetricsCollector *metrics = nullptr)
-      : server_(server), metrics_(metrics) {}
+      : server_(server), metrics_(metrics) {
+    if (metrics_) {
+      for (auto codec : {compression::Codec::Gzip, compression::Codec::Zstd}) {
+        auto index = static_cast<size_t>(codec);
+        inflate_metrics_[index] =
+            &metrics_->register_compression(compression::name(codec),
+                                            "request");
+        deflate_metrics_[index] =
+            &metrics_->register_compression(compression::name(codec),
+                                            "response");
+      }
+    }
+    server_.set_fallback(
+        [this](const httplib::Request &req, httplib::Response &res) {
+          dispatch(req, res);
+        },
+        [this](const httplib::Request &req, httplib::Response &res) {
+          return screen(req, res);
+        });
+  }
 
   /**
    * Register GET route with path parameter support
    * Pattern example: "/v1/models/:name/infer"
    */
   void get(const std::string &pattern, RouteHandler handler) {
-    auto regex_pattern = build_regex_pattern(pattern);
-    server_.get(regex_pattern, wrap_handler(pattern, "GET", handler));
+    add("GET", pattern, std::move(handler), nullptr);
   }
 
   /**
    * Register POST route with path parameter support
    */
   void post(const std::string &pattern, RouteHandler handler) {
-    auto regex_pattern = build_regex_pattern(pattern);
-    server_.post(regex_pattern, wrap_handler(pattern, "POST", handler));
+    add("POST", pattern, std::move(handler), nullptr);
+  }
+
+  /**
+   * Register POST route whose requests `gate` can refuse from the header
+   * block, before the body is uploaded (see HttpServer::post)
+   */
+  void post(const std::string &pattern, RouteHandler handler, BodyGate gate) {
+    add("POST", pattern, std::move(handler), std::move(gate));
   }
 
   /**
    * Register PUT route with path parameter support
    */
   void put(const std::string &pattern, RouteHandler handler) {
-    auto regex_pattern = build_regex_pattern(pattern);
-    server_.put(regex_pattern, wrap_handler(pattern, "PUT", handler));
+    add("PUT", pattern, std::move(handler), nullptr);
   }
 
   /**
    * Register DELETE route with path parameter support
    */
   void del(const std::string &pattern, RouteHandler handler) {
-    auto regex_pattern = build_regex_pattern(pattern);
-    server_.del(regex_pattern, wrap_handler(pattern, "DELETE", handler));
+    add("DELETE", pattern, std::move(handler), nullptr);
+  }
+
+  /**
+   * Register a WebSocket endpoint (see HttpServer::websocket). The upgrade
+   * request is logged and counted like any other request. Upgrades are
+   * matched by the backend (once per connection), not by the trie.
+   */
+  void websocket(const std::string &pattern, WebSocketOpener opener) {
+    std::vector<std::string> names;
+    auto regex_pattern = build_regex_pattern(pattern, names);
+    auto *route_metrics = register_metrics("GET", pattern);
+    server_.websocket(regex_pattern, [this, names, opener, route_metrics](
+                                         const httplib::Request &req,
+                                         httplib::Response &res,
+                                         std::shared_ptr<websocket::Channel>
+                                             channel) {
+      RequestContext ctx;
+      for (size_t i = 0; i < names.size() && i + 1 < req.matches.size(); ++i) {
+        ctx.path_params[names[i]] = req.matches[i + 1].str();
+      }
+      auto session = opener(req, res, ctx, std::move(channel));
+      int status = session ? 101 : res.status;
+
+      double latency_ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - ctx.start_time)
+                              .count();
+      if (route_metrics) {
+        metrics_->record_request(*route_metrics, status, latency_ms / 1000.0);
+      }
+      LOG_INFO("GET {} {} - {}ms (websocket)", req.path, status, latency_ms);
+      return session;
+    });
   }
 
   /**
@@ -85,6 +170,9 @@ public:
   void setup_error_handling() {
     server_.set_error_handler(
         [](const httplib::Request &req, httplib::Response &res) {
+          // Keep the detailed error a handler already wrote
+          if (!res.body.empty())
+            return;
           json error = {{"error",
                          {{"code", res.status},
                           {"message", get_status_message(res.status)}}}};
@@ -109,6 +197,27 @@ public:
     });
   }
 
+  /**
+   * Export HTTP worker queue depth, wait time and rejections
+   */
+  void setup_worker_metrics() {
+    if (!metrics_)
+      return;
+    MetricsCollector *metrics = metrics_;
+
+    ThreadPool::Observer observer;
+    observer.on_depth = [metrics](size_t depth) {
+      metrics->set_worker_queue_depth(depth);
+    };
+    observer.on_wait = [metrics](double wait_seconds) {
+      metrics->record_worker_queue_wait(wait_seconds);
+    };
+    observer.on_reject = [metrics]() {
+      metrics->record_worker_queue_rejection();
+    };
+    server_.thread_pool().set_observer(std::move(observer));
+  }
+
   /**
    * Setup request logging middleware
    */
@@ -120,128 +229,382 @@ public:
         });
   }
 
-private:
-  HttpServer &server_;
-  MetricsCollector *metrics_;
-
   /**
-   * Convert route pattern with :param to regex pattern
+   * Setup response compression and compressed request bodies
    */
-  std::string build_regex_pattern(const std::string &pattern) {
-    // Store param names for extraction later
-    std::vector<std::string> params;
-
-    std::string result;
-    bool in_param = false;
-    std::string param_name;
-
-    for (size_t i = 0; i < pattern.size(); ++i) {
-      char c = pattern[i];
-
-      if (c == ':') {
-        in_param = true;
-        param_name.clear();
-      } else if (in_param) {
-        if (std::isalnum(c) || c == '_') {
-          param_name += c;
-        } else {
-          params.push_back(param_name);
-          result += "([^/]+)";
-          result += c;
-          in_param = false;
-        }
+  void setup_compression(const CompressionConfig &config) {
+    compression_ = config;
+    preferred_codecs_.clear();
+    server_.set_max_decompressed_length(config.max_decompressed_mb * 1024 *
+                                        1024);
+
+    for (const auto &algorithm : config.algorithms) {
+      compression::Codec codec;
+      if (!compression::from_name(algorithm, codec) ||
+          codec == compression::Codec::Identity) {
+        LOG_WARN("Unknown compression algorithm: {}", algorithm);
+      } else if (!compression::available(codec)) {
+        LOG_WARN("Compression algorithm {} not available in this build",
+                 algorithm);
       } else {
-        result += c;
+        preferred_codecs_.push_back(codec);
       }
     }
 
-    if (in_param && !param_name.empty()) {
-      params.push_back(param_name);
-      result += "([^/]+)";
+    if (config.enabled && !preferred_codecs_.empty()) {
+      LOG_INFO("Response compression enabled ({} codec(s), min {} bytes)",
+               preferred_codecs_.size(), config.min_size_bytes);
     }
+  }
 
-    // Store pattern metadata
-    pattern_params_[result] = params;
-
-    return result;
+private:
+  HttpServer &server_;
+  MetricsCollector *metrics_;
+  CompressionConfig compression_{false}; // Off until setup_compression()
+  std::vector<compression::Codec> preferred_codecs_;
+  // Per codec, registered up front so a compressed body takes no lock
+  std::array<MetricsCollector::CompressionMetrics *, 3> inflate_metrics_{};
+  std::array<MetricsCollector::CompressionMetrics *, 3> deflate_metrics_{};
+
+  // What a request needs until its response is complete, on the heap for
+  // handlers that complete it after returning (see DeferredResponse)
+  struct Exchange {
+    RequestContext ctx;
+    httplib::Request inflated; // Body after Content-Encoding, if any
+  };
+  using BoundHandler =
+      std::function<void(const httplib::Request &, httplib::Response &,
+                         const std::shared_ptr<Exchange> &)>;
+
+  struct Route {
+    std::string method;
+    std::vector<std::string> params; // Parameter names, in path order
+    BoundHandler handler;            // Wrapped with logging and metrics
+    BodyGate gate;                   // May be empty
+  };
+  using Routes = std::vector<Route>; // The methods served on one path
+
+  RouteTrie<Routes> routes_; // Built before start(), read-only after
+
+  void add(const std::string &method, const std::string &pattern,
+           RouteHandler handler, BodyGate gate) {
+    std::vector<std::string> params;
+    Routes *routes = routes_.insert(pattern, params);
+    if (!routes) {
+      LOG_ERROR("Route {} has too many path parameters", pattern);
+      return;
+    }
+    routes->push_back({method, std::move(params),
+                       wrap_handler(pattern, method, std::move(handler)),
+                       gate ? wrap_gate(pattern, method, std::move(gate))
+                            : nullptr});
   }
 
   /**
-   * Extract path parameters from request using stored pattern info
+   * The route serving `req`, or nullptr; `match.value` is still set when
+   * only the method is wrong
    */
-  std::unordered_map<std::string, std::string>
-  extract_params(const httplib::Request &req, const std::string &pattern) {
-
-    std::unordered_map<std::string, std::string> params;
-
-    auto it = pattern_params_.find(pattern);
-    if (it == pattern_params_.end())
-      return params;
+  const Route *find(const httplib::Request &req,
+                    RouteTrie<Routes>::Match &match) const {
+    if (!routes_.match(req.path, match))
+      return nullptr;
+    const std::string &method = req.method == "HEAD" ? "GET" : req.method;
+    for (const auto &route : *match.value) {
+      if (route.method == method)
+        return &route;
+    }
+    return nullptr;
+  }
 
-    const auto &param_names = it->second;
-    for (size_t i = 0; i < param_names.size() && i < req.matches.size() - 1;
+  static void bind_params(const Route &route,
+                          const RouteTrie<Routes>::Match &match,
+                          RequestContext &ctx) {
+    for (size_t i = 0; i < route.params.size() && i < match.param_count;
          ++i) {
-      params[param_names[i]] = req.matches[i + 1].str();
+      ctx.path_params[route.params[i]] = std::string(match.params[i]);
     }
+  }
+
+  /**
+   * HttpServer fallback: every request goes through the trie
+   */
+  void dispatch(const httplib::Request &req, httplib::Response &res) {
+    RouteTrie<Routes>::Match match;
+    const Route *route = find(req, match);
+    if (!route) {
+      res.status = match.value ? 405 : 404;
+      return;
+    }
+    auto exchange = std::make_shared<Exchange>();
+    RequestContext &ctx = exchange->ctx;
+    ctx.trace.begin(ctx.start_time);
+    bind_params(*route, match, ctx);
+    route->handler(req, res, exchange);
+  }
 
-    return params;
+  /**
+   * HttpServer fallback gate: run the route's gate, if it has one
+   */
+  bool screen(const httplib::Request &req, httplib::Response &res) {
+    RouteTrie<Routes>::Match match;
+    const Route *route = find(req, match);
+    if (!route || !route->gate)
+      return true;
+    RequestContext ctx;
+    bind_params(*route, match, ctx);
+    return route->gate(req, res, ctx);
   }
 
   /**
-   * Wrap handler with context, logging, and metrics
+   * Regex for a `:param` pattern, for backends that match it themselves;
+   * a segment is a parameter only if it starts with ':'
    */
-  HttpServer::Handler wrap_handler(const std::string &pattern,
-                                   const std::string &method,
-                                   RouteHandler handler) {
-    std::string regex_pattern =
-        pattern_params_.count(pattern) ? pattern : build_regex_pattern(pattern);
-
-    // Find the regex pattern if we were given the original pattern
-    for (const auto &[regex, _] : pattern_params_) {
-      if (regex.find(pattern.substr(0, 5)) != std::string::npos) {
-        regex_pattern = regex;
-        break;
+  static std::string build_regex_pattern(const std::string &pattern,
+                                         std::vector<std::string> &params) {
+    std::string result;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+      size_t end = pattern.find('/', pos);
+      if (end == std::string::npos)
+        end = pattern.size();
+      if (pattern[pos] == ':') {
+        params.push_back(pattern.substr(pos + 1, end - pos - 1));
+        result += "([^/]+)";
+      } else {
+        result.append(pattern, pos, end - pos);
       }
+      if (end < pattern.size())
+        result += '/';
+      pos = end + 1;
     }
+    return result;
+  }
 
-    return [this, regex_pattern, method, handler,
-            pattern](const httplib::Request &req, httplib::Response &res) {
-      RequestContext ctx;
+  /**
+   * Metrics handle of a route, registered once so that recording a
+   * request builds no strings and takes no lock; nullptr without metrics
+   */
+  MetricsCollector::RouteMetrics *register_metrics(const std::string &method,
+                                                   const std::string &pattern) {
+    return metrics_ ? &metrics_->register_route(method, pattern) : nullptr;
+  }
 
-      // Extract path parameters
-      auto it = pattern_params_.find(regex_pattern);
-      if (it != pattern_params_.end()) {
-        const auto &param_names = it->second;
-        for (size_t i = 0; i < param_names.size() && i < req.matches.size() - 1;
-             ++i) {
-          ctx.path_params[param_names[i]] = req.matches[i + 1].str();
-        }
-      }
+  /**
+   * Wrap handler with request decoding, logging, and metrics. These run
+   * when the response is complete, which for a handler that detached it
+   * is after the handler returns.
+   */
+  BoundHandler wrap_handler(const std::string &pattern,
+                            const std::string &method, RouteHandler handler) {
+    auto *route_metrics = register_metrics(method, pattern);
+    return [this, method, handler, pattern,
+            route_metrics](const httplib::Request &req, httplib::Response &res,
+                           const std::shared_ptr<Exchange> &exchange) {
+      auto finish = [this, method, route_metrics, &req, &res, exchange] {
+        finish_response(req, res, exchange->ctx, method, route_metrics);
+      };
+      DeferredResponse::Scope scope(finish);
 
       // Call the actual handler
       try {
-        handler(req, res, ctx);
+        if (const auto *request =
+                decode_request(req, exchange->inflated, res)) {
+          handler(*request, res, exchange->ctx);
+        }
       } catch (const std::exception &e) {
         LOG_ERROR("Handler exception for {} {}: {}", method, pattern, e.what());
+        // The response now belongs to whoever completes it
+        if (scope.detached())
+          return;
         res.status = 500;
         json error = {{"error", {{"code", 500}, {"message", e.what()}}}};
         res.set_content(error.dump(), "application/json");
       }
 
-      // Record metrics
-      auto duration = std::chrono::steady_clock::now() - ctx.start_time;
-      double latency_ms =
-          std::chrono::duration<double, std::milli>(duration).count();
+      if (!scope.detached())
+        finish();
+    };
+  }
 
-      if (metrics_) {
-        metrics_->record_request(pattern, method, res.status,
-                                 latency_ms / 1000.0);
+  /**
+   * Compress a complete response, then record and log it
+   */
+  void finish_response(const httplib::Request &req, httplib::Response &res,
+                       RequestContext &ctx, const std::string &method,
+                       MetricsCollector::RouteMetrics *route_metrics) {
+    if (compression_.enabled) {
+      compress_response(req, res);
+      // Compressing is part of encoding the response
+      if (ctx.trace.has(RequestTrace::Encoded))
+        ctx.trace.mark(RequestTrace::Encoded);
+    }
+
+    // Record metrics
+    auto end = std::chrono::steady_clock::now();
+    double latency_ms =
+        std::chrono::duration<double, std::milli>(end - ctx.start_time)
+            .count();
+
+    if (route_metrics) {
+      metrics_->record_request(*route_metrics, res.status,
+                               latency_ms / 1000.0);
+      if (res.status == 200 && !ctx.model.empty()) {
+        metrics_->record_model_request(ctx.model, latency_ms / 1000.0);
+        metrics_->record_request_trace(ctx.trace);
       }
+    }
+
+    if (req.get_param_value("timing") == "true") {
+      res.set_header("Server-Timing", ctx.trace.server_timing(end));
+    }
 
-      LOG_INFO("{} {} {} - {}ms", method, req.path, res.status, latency_ms);
+    LOG_INFO("{} {} {} - {}ms", method, req.path, res.status, latency_ms);
+  }
+
+  /**
+   * Log and count requests a gate rejects; their handler never runs
+   */
+  BodyGate wrap_gate(const std::string &pattern, const std::string &method,
+                     BodyGate gate) {
+    auto *route_metrics = register_metrics(method, pattern);
+    return [this, method, gate, route_metrics](const httplib::Request &req,
+                                               httplib::Response &res,
+                                               RequestContext &ctx) {
+      auto start = std::chrono::steady_clock::now();
+      if (gate(req, res, ctx))
+        return true;
+
+      double latency_ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+      if (route_metrics) {
+        metrics_->record_request(*route_metrics, res.status,
+                                 latency_ms / 1000.0);
+      }
+      LOG_INFO("{} {} {} - {}ms (before body)", method, req.path, res.status,
+               latency_ms);
+      return false;
     };
   }
 
+  /**
+   * Inflate request bodies the backend left encoded: zstd always, gzip and
+   * deflate unless httplib already did (see HttpServer::inflates_gzip_bodies).
+   * Returns the request to dispatch, or nullptr after writing an error.
+   */
+  const httplib::Request *decode_request(const httplib::Request &req,
+                                         httplib::Request &inflated,
+                                         httplib::Response &res) {
+    compression::Codec codec;
+    std::string encoding = req.get_header_value("Content-Encoding");
+    if (encoding.empty() ||
+        !compression::from_content_encoding(encoding, codec) ||
+        codec == compression::Codec::Identity ||
+        (codec == compression::Codec::Gzip && server_.inflates_gzip_bodies())) {
+      return &req;
+    }
+
+    if (!compression::available(codec)) {
+      send_encoding_error(res, 415, "Unsupported Content-Encoding: " +
+                                        encoding);
+      return nullptr;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string body;
+    size_t max_size = compression_.max_decompressed_mb * 1024 * 1024;
+    auto result = codec == compression::Codec::Zstd
+                      ? compression::decompress_zstd(req.body, max_size, body)
+                      : compression::decompress_gzip(req.body, max_size, body);
+    switch (result) {
+    case compression::Inflate::Ok:
+      break;
+    case compression::Inflate::TooLarge:
+      send_encoding_error(res, 413,
+                          "Inflated request body exceeds "
+                          "compression.max_decompressed_mb");
+      return nullptr;
+    case compression::Inflate::Invalid:
+      send_encoding_error(res, 400, "Invalid " + encoding + " request body");
+      return nullptr;
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    if (auto *stats = inflate_metrics_[static_cast<size_t>(codec)]) {
+      metrics_->record_compression(*stats, body.size(), req.body.size(),
+                                   seconds);
+    }
+
+    inflated = req;
+    inflated.body = std::move(body);
+    inflated.headers.erase("Content-Encoding");
+    return &inflated;
+  }
+
+  /**
+   * Compress the response body with the best coding the client accepts
+   */
+  void compress_response(const httplib::Request &req, httplib::Response &res) {
+    // Content providers (raw tensor streaming) are sent as-is
+    if (res.body.empty() || res.has_header("Content-Encoding"))
+      return;
+
+    std::string content_type = res.get_header_value("Content-Type");
+    if (res.body.size() >= compression_.min_size_bytes &&
+        compression::compressible(content_type)) {
+      res.set_header("Vary", "Accept-Encoding");
+
+      auto codec = compression::negotiate(
+          req.get_header_value("Accept-Encoding"), preferred_codecs_);
+      if (codec != compression::Codec::Identity) {
+        int level = codec == compression::Codec::Zstd
+                        ? compression_.zstd_level
+                        : compression_.gzip_level;
+
+        auto start = std::chrono::steady_clock::now();
+        std::string compressed;
+        bool ok = compression::compress(codec, res.body.data(),
+                                        res.body.size(), level, compressed);
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+        if (ok && compressed.size() < res.body.size()) {
+          if (auto *stats = deflate_metrics_[static_cast<size_t>(codec)]) {
+            metrics_->record_compression(*stats, res.body.size(),
+                                         compressed.size(), seconds);
+          }
+          res.body.swap(compressed);
+          res.set_header("Content-Encoding", compression::name(codec));
+        }
+      }
+    }
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    // With zlib enabled cpp-httplib would gzip plain bodies on its own,
+    // ignoring our threshold and level (or compressing twice). It leaves
+    // fixed-length content providers alone, so hand the final body over
+    // as one.
+    auto body = std::make_shared<std::string>(std::move(res.body));
+    res.body.clear();
+    res.headers.erase("Content-Type");
+    res.set_content_provider(
+        body->size(), content_type,
+        [body](size_t offset, size_t length, httplib::DataSink &sink) {
+          return sink.write(body->data() + offset, length);
+        });
+#endif
+  }
+
+  static void send_encoding_error(httplib::Response &res, int status,
+                                  const std::string &message) {
+    json error = {{"error", {{"code", status}, {"message", message}}}};
+    res.status = status;
+    res.set_content(error.dump(), "application/json");
+  }
+
   static std::string get_status_message(int status) {
     switch (status) {
     case 400:
@@ -254,6 +617,8 @@ private:
       return "Not Found";
     case 405:
       return "Method Not Allowed";
+    case 415:
+      return "Unsupported Media Type";
     case 422:
       return "Unprocessable Entity";
     case 500:
@@ -264,9 +629,6 @@ private:
       return "Unknown Error";
     }
   }
-
-  // Map from regex pattern to list of param names
-  std::unordered_map<std::string, std::vector<std::string>> pattern_params_;
 };
 
 } // namespace onnx_server
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json.hpp"
+#include "utils/logging.hpp"
+
+namespace onnx_server {
+
+using json = nlohmann::json;
+
+/**
+ * Shared memory request error carrying the HTTP status to report
+ */
+class SharedMemoryError : public std::runtime_error {
+public:
+  SharedMemoryError(int status, const std::string &message)
+      : std::runtime_error(message), status_(status) {}
+
+  int status() const { return status_; }
+
+private:
+  int status_;
+};
+
+/**
+ * A client-registered window [offset, offset + byte_size) of a POSIX shared
+ * memory object, mapped read/write into the server. Unmapped when the last
+ * reference is dropped, so unregistering never pulls a region out from
+ * under an inference that is still using it.
+ */
+struct SharedMemoryRegion {
+  std::string name;
+  std::string key;
+  size_t offset = 0;
+  size_t byte_size = 0;
+
+  void *mapping = MAP_FAILED;
+  size_t mapping_size = 0;
+
+  SharedMemoryRegion() = default;
+  SharedMemoryRegion(const SharedMemoryRegion &) = delete;
+  SharedMemoryRegion &operator=(const SharedMemoryRegion &) = delete;
+
+  ~SharedMemoryRegion() {
+    if (mapping != MAP_FAILED)
+      ::munmap(mapping, mapping_size);
+  }
+
+  char *data() const { return static_cast<char *>(mapping) + offset; }
+
+  json to_json() const {
+    return {{"name", name},
+            {"key", key},
+            {"offset", offset},
+            {"byte_size", byte_size}};
+  }
+};
+
+/**
+ * Registry of system shared memory regions, following the Triton / KServe
+ * v2 system shared memory extension: clients create and fill a POSIX shm
+ * object, register it under a name, and then reference
+ * (name, offset, byte_size) windows of it from infer requests instead of
+ * sending tensor bytes over HTTP.
+ */
+class SharedMemoryRegistry {
+public:
+  /**
+   * Bounds-checked window of a registered region
+   */
+  struct View {
+    std::shared_ptr<const SharedMemoryRegion> region; // Keeps it mapped
+    char *data = nullptr;
+    size_t size = 0;
+  };
+
+  explicit SharedMemoryRegistry(size_t max_regions = 0)
+      : max_regions_(max_regions) {}
+
+  /**
+   * Map `byte_size` bytes at `offset` of the shm object `key` as `name`
+   */
+  void register_region(const std::string &name, const std::string &key,
+                       size_t offset, size_t byte_size) {
+    if (name.empty() || key.empty()) {
+      throw SharedMemoryError(400, "Region name and key are required");
+    }
+    if (byte_size == 0) {
+      throw SharedMemoryError(400, "byte_size must be greater than zero");
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (regions_.count(name)) {
+        throw SharedMemoryError(
+            400, "Shared memory region '" + name + "' is already registered");
+      }
+      if (max_regions_ > 0 && regions_.size() >= max_regions_) {
+        throw SharedMemoryError(400, "Too many shared memory regions (max " +
+                                         std::to_string(max_regions_) + ")");
+      }
+    }
+
+    auto region = map_region(name, key, offset, byte_size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!regions_.emplace(name, std::move(region)).second) {
+      throw SharedMemoryError(
+          400, "Shared memory region '" + name + "' is already registered");
+    }
+    LOG_INFO("Registered shared memory region '{}' ({} bytes of {})", name,
+             byte_size, key);
+  }
+
+  /**
+   * Forget a region; in-flight requests keep their mapping until done.
+   * Unknown names are ignored, as in Triton.
+   */
+  void unregister(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (regions_.erase(name))
+      LOG_INFO("Unregistered shared memory region '{}'", name);
+  }
+
+  void unregister_all() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    regions_.clear();
+  }
+
+  /**
+   * Status of one region (404 if unknown) or, with an empty name, all of them
+   */
+  json status(const std::string &name = "") const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    json result = json::array();
+    if (name.empty()) {
+      for (const auto &[region_name, region] : regions_)
+        result.push_back(region->to_json());
+      return result;
+    }
+
+    auto it = regions_.find(name);
+    if (it == regions_.end()) {
+      throw SharedMemoryError(404, "Unable to find shared memory region '" +
+                                       name + "'");
+    }
+    result.push_back(it->second->to_json());
+    return result;
+  }
+
+  /**
+   * Resolve a tensor reference against a registered region
+   */
+  View resolve(const std::string &name, size_t offset,
+               size_t byte_size) const {
+    std::shared_ptr<const SharedMemoryRegion> region;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = regions_.find(name);
+      if (it == regions_.end()) {
+        throw SharedMemoryError(400, "Unable to find shared memory region '" +
+                                         name + "'");
+      }
+      region = it->second;
+    }
+
+    if (offset > region->byte_size || byte_size > region->byte_size - offset) {
+      throw SharedMemoryError(
+          400, "Reference of " + std::to_string(byte_size) + " bytes at " +
+                   std::to_string(offset) +
+                   " is outside shared memory region '" + name + "' (" +
+                   std::to_string(region->byte_size) + " bytes)");
+    }
+
+    View view;
+    view.data = region->data() + offset;
+    view.size = byte_size;
+    view.region = std::move(region);
+    return view;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return regions_.size();
+  }
+
+private:
+  size_t max_regions_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const SharedMemoryRegion>>
+      regions_;
+
+  static std::shared_ptr<SharedMemoryRegion>
+  map_region(const std::string &name, const std::string &key, size_t offset,
+             size_t byte_size) {
+    int fd = ::shm_open(key.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      throw SharedMemoryError(400, "Unable to open shared memory key '" + key +
+                                       "': " + std::strerror(errno));
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size < 0 ||
+        offset > static_cast<size_t>(st.st_size) ||
+        byte_size > static_cast<size_t>(st.st_size) - offset) {
+      ::close(fd);
+      throw SharedMemoryError(400, "Shared memory key '" + key +
+                                       "' is smaller than offset + byte_size");
+    }
+
+    // Map from the start of the object so `offset` needs no page alignment
+    auto region = std::make_shared<SharedMemoryRegion>();
+    region->name = name;
+    region->key = key;
+    region->offset = offset;
+    region->byte_size = byte_size;
+    region->mapping_size = offset + byte_size;
+    region->mapping = ::mmap(nullptr, region->mapping_size,
+                             PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (region->mapping == MAP_FAILED) {
+      throw SharedMemoryError(500, "Unable to map shared memory key '" + key +
+                                       "': " + std::strerror(errno));
+    }
+    return region;
+  }
+};
+
+} // namespace onnx_server
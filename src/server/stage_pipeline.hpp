@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <utility>
+
+#include "metrics/collector.hpp"
+#include "utils/config.hpp"
+#include "utils/thread_pool.hpp"
+
+namespace onnx_server {
+
+/**
+ * Pools for the CPU-bound stages of a v1 request. An HTTP worker hands the
+ * raw body to the decode stage; the decoded request goes to the batcher
+ * (the execute stage) and its result to the encode stage, which writes the
+ * response. Decode and encode each have their own threads and bounded
+ * queue, so they are sized independently of the HTTP workers and of each
+ * other, and a full queue sheds load instead of piling up work.
+ *
+ * Every stage reports queue depth, queue wait, run time and rejections as
+ * onnx_stage_* metrics labelled by stage; the execute stage is reported by
+ * the caller from the batcher's own timings.
+ */
+class StagePipeline {
+public:
+  enum class Stage { Decode, Execute, Encode };
+
+  static const char *name(Stage stage) {
+    switch (stage) {
+    case Stage::Decode:
+      return "decode";
+    case Stage::Execute:
+      return "execute";
+    case Stage::Encode:
+      return "encode";
+    }
+    return "unknown";
+  }
+
+  StagePipeline(const PipelineConfig &config, MetricsCollector &metrics)
+      : decode_metrics_(&metrics.register_stage(name(Stage::Decode))),
+        encode_metrics_(&metrics.register_stage(name(Stage::Encode))),
+        decode_(static_cast<size_t>(std::max(1, config.decode_threads)),
+                config.decode_queue),
+        encode_(static_cast<size_t>(std::max(1, config.encode_threads)),
+                config.encode_queue) {
+    observe(decode_, decode_metrics_);
+    observe(encode_, encode_metrics_);
+  }
+
+  /**
+   * Queue `task` on the decode or encode pool; false (counted as a
+   * rejection) if that stage's queue is full or the pool has stopped
+   */
+  bool run(Stage stage, std::function<void()> task) {
+    auto *metrics = stage == Stage::Encode ? encode_metrics_ : decode_metrics_;
+    return pool(stage).try_enqueue([task = std::move(task), metrics] {
+      auto start = std::chrono::steady_clock::now();
+      task();
+      metrics->duration.observe(std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count());
+    });
+  }
+
+  /**
+   * Stop taking decode work and finish what is queued, so every accepted
+   * request reaches the batcher. Encoding keeps running until destruction
+   * to answer requests still in flight.
+   */
+  void stop_decode() { decode_.shutdown(); }
+
+private:
+  MetricsCollector::StageMetrics *decode_metrics_;
+  MetricsCollector::StageMetrics *encode_metrics_;
+  ThreadPool decode_;
+  ThreadPool encode_;
+
+  ThreadPool &pool(Stage stage) {
+    return stage == Stage::Encode ? encode_ : decode_;
+  }
+
+  static void observe(ThreadPool &pool,
+                      MetricsCollector::StageMetrics *metrics) {
+    ThreadPool::Observer observer;
+    observer.on_depth = [metrics](size_t depth) {
+      metrics->depth.set(static_cast<double>(depth));
+    };
+    observer.on_wait = [metrics](double wait_seconds) {
+      metrics->wait.observe(wait_seconds);
+    };
+    observer.on_reject = [metrics]() { metrics->rejected.inc(); };
+    pool.set_observer(std::move(observer));
+  }
+};
+
+} // namespace onnx_server
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "inference/dtype.hpp"
+#include "inference/session_manager.hpp"
+
+namespace onnx_server {
+
+/**
+ * Helpers shared by the wire formats that move tensors in and out of
+ * TensorData (JSON, KServe v2, raw octet-stream)
+ */
+
+/**
+ * Append the little-endian bytes of an output tensor in its declared dtype
+ */
+template <typename Buffer>
+inline void append_tensor_bytes(Buffer &out, const TensorData &tensor) {
+  if (tensor.dtype == "int32" && !tensor.int_data.empty()) {
+    // int32 outputs are widened to int_data by the session manager
+    size_t start = out.size();
+    out.resize(start + tensor.int_data.size() * sizeof(int32_t));
+    auto *dst = reinterpret_cast<int32_t *>(&out[start]);
+    for (size_t i = 0; i < tensor.int_data.size(); ++i) {
+      dst[i] = static_cast<int32_t>(tensor.int_data[i]);
+    }
+    return;
+  }
+  const auto *bytes = static_cast<const char *>(tensor.data());
+  out.insert(out.end(), bytes, bytes + tensor.byte_size());
+}
+
+/**
+ * Convert JSON-decoded values (float_data / int_data) to the declared dtype:
+ * float32 stays in float_data, int64 in int_data and other fixed-width types
+ * are packed into raw_data. Throws std::invalid_argument for dtypes that
+ * cannot be expressed as JSON numbers.
+ */
+inline void coerce_to_dtype(TensorData &tensor) {
+  if (tensor.external_data || !tensor.raw_data.empty())
+    return;
+
+  if (tensor.dtype == "float32") {
+    if (!tensor.int_data.empty()) {
+      tensor.float_data.assign(tensor.int_data.begin(), tensor.int_data.end());
+      tensor.int_data.clear();
+    }
+    return;
+  }
+
+  if (tensor.dtype == "int64") {
+    if (!tensor.float_data.empty()) {
+      tensor.int_data.resize(tensor.float_data.size());
+      for (size_t i = 0; i < tensor.float_data.size(); ++i) {
+        tensor.int_data[i] = static_cast<int64_t>(tensor.float_data[i]);
+      }
+      tensor.float_data.clear();
+    }
+    return;
+  }
+
+  size_t count = tensor.float_data.size() + tensor.int_data.size();
+  if (count == 0)
+    return;
+
+  tensor.raw_data.reserve(count * dtype::element_size(tensor.dtype));
+  bool ok = true;
+  for (float v : tensor.float_data) {
+    ok = ok && dtype::append_number(tensor.raw_data, tensor.dtype, v);
+  }
+  for (int64_t v : tensor.int_data) {
+    ok = ok && dtype::append_number(tensor.raw_data, tensor.dtype,
+                                    static_cast<double>(v));
+  }
+  if (!ok) {
+    tensor.raw_data.clear();
+    throw std::invalid_argument("dtype '" + tensor.dtype + "' of input '" +
+                                tensor.name +
+                                "' cannot be sent as JSON numbers");
+  }
+  tensor.float_data.clear();
+  tensor.int_data.clear();
+}
+
+/**
+ * Parse a comma-separated shape header value ("1,3,224,224")
+ */
+inline std::optional<std::vector<int64_t>>
+parse_shape_header(const std::string &value) {
+  std::vector<int64_t> shape;
+  size_t pos = 0;
+  while (pos <= value.size()) {
+    size_t comma = value.find(',', pos);
+    if (comma == std::string::npos)
+      comma = value.size();
+    std::string dim = value.substr(pos, comma - pos);
+    dim.erase(0, dim.find_first_not_of(" []"));
+    dim.erase(dim.find_last_not_of(" []") + 1);
+    if (!dim.empty()) {
+      try {
+        size_t used = 0;
+        int64_t v = std::stoll(dim, &used);
+        if (used != dim.size() || v < 0)
+          return std::nullopt;
+        shape.push_back(v);
+      } catch (const std::exception &) {
+        return std::nullopt;
+      }
+    } else if (comma != value.size() || !shape.empty()) {
+      return std::nullopt;
+    }
+    pos = comma + 1;
+  }
+  return shape;
+}
+
+/**
+ * Format a shape as a header value ("1,1000")
+ */
+inline std::string format_shape_header(const std::vector<int64_t> &shape) {
+  std::string value;
+  for (size_t i = 0; i < shape.size(); ++i) {
+    if (i > 0)
+      value += ',';
+    value += std::to_string(shape[i]);
+  }
+  return value;
+}
+
+} // namespace onnx_server
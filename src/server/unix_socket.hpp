@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "utils/logging.hpp"
+
+namespace onnx_server {
+
+/**
+ * Helpers for the Unix domain socket listener (`server.unix_socket`),
+ * shared by the httplib and epoll backends.
+ */
+namespace unix_socket {
+
+/**
+ * Parse an octal permission string such as "0660"; -1 if invalid
+ */
+inline int parse_mode(const std::string &mode) {
+  if (mode.empty())
+    return -1;
+  char *end = nullptr;
+  long value = std::strtol(mode.c_str(), &end, 8);
+  if (*end != '\0' || value < 0 || value > 07777)
+    return -1;
+  return static_cast<int>(value);
+}
+
+/**
+ * Check that `path` fits in sockaddr_un and remove a stale socket left by a
+ * previous run. Anything at `path` that is not a socket is left alone and
+ * reported, so a typo cannot delete a regular file.
+ */
+inline bool prepare_path(const std::string &path) {
+  if (path.empty() || path.size() >= sizeof(sockaddr_un{}.sun_path)) {
+    LOG_ERROR("Invalid Unix socket path '{}' (max {} bytes)", path,
+              sizeof(sockaddr_un{}.sun_path) - 1);
+    return false;
+  }
+
+  struct stat st {};
+  if (::lstat(path.c_str(), &st) != 0)
+    return errno == ENOENT;
+
+  if (!S_ISSOCK(st.st_mode)) {
+    LOG_ERROR("Refusing to replace '{}': not a socket", path);
+    return false;
+  }
+  if (::unlink(path.c_str()) != 0) {
+    LOG_ERROR("Failed to remove stale socket '{}': {}", path,
+              std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Apply the configured permissions to a bound socket file
+ */
+inline bool set_mode(const std::string &path, int mode) {
+  if (::chmod(path.c_str(), static_cast<mode_t>(mode)) != 0) {
+    LOG_ERROR("Failed to chmod '{}': {}", path, std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Remove the socket file on shutdown
+ */
+inline void remove(const std::string &path) {
+  if (!path.empty())
+    ::unlink(path.c_str());
+}
+
+} // namespace unix_socket
+
+} // namespace onnx_server
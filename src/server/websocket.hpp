@@ -0,0 +1,265 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "utils/base64.hpp"
+
+namespace onnx_server {
+
+/**
+ * WebSocket (RFC 6455) framing and the interfaces between a server
+ * backend, which owns the socket, and the application session bound to
+ * one upgraded connection.
+ */
+namespace websocket {
+
+constexpr const char *GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+enum class Opcode : uint8_t {
+  Continuation = 0x0,
+  Text = 0x1,
+  Binary = 0x2,
+  Close = 0x8,
+  Ping = 0x9,
+  Pong = 0xA,
+};
+
+// Close status codes
+constexpr uint16_t CLOSE_NORMAL = 1000;
+constexpr uint16_t CLOSE_PROTOCOL_ERROR = 1002;
+constexpr uint16_t CLOSE_TOO_BIG = 1009;
+constexpr uint16_t CLOSE_TRY_AGAIN_LATER = 1013;
+
+/**
+ * Sends messages on one connection; safe to use from any thread, and a
+ * no-op once the connection is gone
+ */
+class Channel {
+public:
+  virtual ~Channel() = default;
+
+  /**
+   * Send the reply to one received data message. Every data message the
+   * session receives must be answered exactly once: the backend counts
+   * unanswered messages for flow control.
+   */
+  virtual void reply(std::string payload, bool binary) = 0;
+
+  /**
+   * Run `task` on one of the backend's workers instead of the calling
+   * thread, e.g. to encode a reply away from the thread that completed
+   * the inference. Runs it inline by default.
+   */
+  virtual void defer(std::function<void()> task) { task(); }
+};
+
+/**
+ * Application side of one upgraded connection
+ */
+class Session {
+public:
+  virtual ~Session() = default;
+
+  /**
+   * A complete data message; called on a worker thread, possibly
+   * concurrently with other messages of the same connection
+   */
+  virtual void on_message(std::string payload, bool binary) = 0;
+
+  /**
+   * The connection closed; replies sent afterwards are dropped
+   */
+  virtual void on_close() {}
+};
+
+namespace detail {
+
+inline uint32_t rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+/**
+ * SHA-1, needed only for the handshake's Sec-WebSocket-Accept
+ */
+inline std::array<uint8_t, 20> sha1(const std::string &message) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+
+  std::string data = message;
+  uint64_t bit_length = static_cast<uint64_t>(message.size()) * 8;
+  data += static_cast<char>(0x80);
+  while (data.size() % 64 != 56)
+    data += '\0';
+  for (int i = 7; i >= 0; --i)
+    data += static_cast<char>((bit_length >> (i * 8)) & 0xFF);
+
+  for (size_t chunk = 0; chunk < data.size(); chunk += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      const auto *p =
+          reinterpret_cast<const uint8_t *>(data.data() + chunk + i * 4);
+      w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+             (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+    for (int i = 16; i < 80; ++i)
+      w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = temp;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  std::array<uint8_t, 20> digest;
+  for (int i = 0; i < 5; ++i) {
+    digest[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+    digest[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+    digest[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+    digest[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+  }
+  return digest;
+}
+
+} // namespace detail
+
+/**
+ * Sec-WebSocket-Accept for a client's Sec-WebSocket-Key
+ */
+inline std::string accept_key(const std::string &key) {
+  auto digest = detail::sha1(key + GUID);
+  return base64::encode(digest.data(), digest.size());
+}
+
+/**
+ * One decoded (unmasked) frame
+ */
+struct Frame {
+  bool fin = true;
+  Opcode opcode = Opcode::Binary;
+  std::string payload;
+};
+
+enum class ParseStatus { Incomplete, Ok, Invalid, TooBig };
+
+/**
+ * Decode the client frame at `data`. Client frames must be masked. On Ok,
+ * `consumed` is the frame's length on the wire.
+ */
+inline ParseStatus parse_frame(const char *data, size_t size,
+                               size_t max_payload, Frame &frame,
+                               size_t &consumed) {
+  if (size < 2)
+    return ParseStatus::Incomplete;
+  const auto *p = reinterpret_cast<const uint8_t *>(data);
+
+  if (p[0] & 0x70)
+    return ParseStatus::Invalid; // No extensions negotiated
+  frame.fin = (p[0] & 0x80) != 0;
+  frame.opcode = static_cast<Opcode>(p[0] & 0x0F);
+  bool masked = (p[1] & 0x80) != 0;
+  if (!masked)
+    return ParseStatus::Invalid;
+
+  uint64_t length = p[1] & 0x7F;
+  size_t pos = 2;
+  if (length == 126) {
+    if (size < 4)
+      return ParseStatus::Incomplete;
+    length = (uint64_t(p[2]) << 8) | p[3];
+    pos = 4;
+  } else if (length == 127) {
+    if (size < 10)
+      return ParseStatus::Incomplete;
+    length = 0;
+    for (int i = 0; i < 8; ++i)
+      length = (length << 8) | p[2 + i];
+    pos = 10;
+  }
+
+  bool control = (p[0] & 0x08) != 0;
+  if (control && (length > 125 || !frame.fin))
+    return ParseStatus::Invalid;
+  if (length > max_payload)
+    return ParseStatus::TooBig;
+
+  if (size < pos + 4 + length)
+    return ParseStatus::Incomplete;
+  const uint8_t *mask = p + pos;
+  pos += 4;
+
+  frame.payload.assign(data + pos, static_cast<size_t>(length));
+  for (size_t i = 0; i < frame.payload.size(); ++i)
+    frame.payload[i] = static_cast<char>(frame.payload[i] ^ mask[i % 4]);
+
+  consumed = pos + static_cast<size_t>(length);
+  return ParseStatus::Ok;
+}
+
+/**
+ * Encode an unmasked server frame (single, final fragment)
+ */
+inline std::string encode_frame(Opcode opcode, const char *payload,
+                                size_t size) {
+  std::string out;
+  out.reserve(size + 10);
+  out += static_cast<char>(0x80 | static_cast<uint8_t>(opcode));
+  if (size < 126) {
+    out += static_cast<char>(size);
+  } else if (size <= 0xFFFF) {
+    out += static_cast<char>(126);
+    out += static_cast<char>((size >> 8) & 0xFF);
+    out += static_cast<char>(size & 0xFF);
+  } else {
+    out += static_cast<char>(127);
+    for (int i = 7; i >= 0; --i)
+      out += static_cast<char>((static_cast<uint64_t>(size) >> (i * 8)) & 0xFF);
+  }
+  out.append(payload, size);
+  return out;
+}
+
+inline std::string encode_frame(Opcode opcode, const std::string &payload) {
+  return encode_frame(opcode, payload.data(), payload.size());
+}
+
+/**
+ * Close frame with a status code and a short reason
+ */
+inline std::string encode_close(uint16_t code, const std::string &reason) {
+  std::string payload;
+  payload += static_cast<char>(code >> 8);
+  payload += static_cast<char>(code & 0xFF);
+  payload += reason.substr(0, 123);
+  return encode_frame(Opcode::Close, payload);
+}
+
+} // namespace websocket
+
+} // namespace onnx_server
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace onnx_server {
+
+/**
+ * Standard (RFC 4648) base64 encoding used for binary payloads carried in
+ * JSON documents
+ */
+namespace base64 {
+
+inline std::string encode(const uint8_t *data, size_t size) {
+  static const char *alphabet =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  std::string out;
+  out.reserve((size + 2) / 3 * 4);
+
+  size_t i = 0;
+  for (; i + 2 < size; i += 3) {
+    uint32_t n = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) |
+                 uint32_t(data[i + 2]);
+    out += alphabet[(n >> 18) & 63];
+    out += alphabet[(n >> 12) & 63];
+    out += alphabet[(n >> 6) & 63];
+    out += alphabet[n & 63];
+  }
+
+  if (i + 1 == size) {
+    uint32_t n = uint32_t(data[i]) << 16;
+    out += alphabet[(n >> 18) & 63];
+    out += alphabet[(n >> 12) & 63];
+    out += "==";
+  } else if (i + 2 == size) {
+    uint32_t n = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8);
+    out += alphabet[(n >> 18) & 63];
+    out += alphabet[(n >> 12) & 63];
+    out += alphabet[(n >> 6) & 63];
+    out += '=';
+  }
+
+  return out;
+}
+
+/**
+ * Decode base64 text; returns nullopt on malformed input
+ */
+inline std::optional<std::vector<uint8_t>> decode(const std::string &text) {
+  auto value_of = [](char c) -> int {
+    if (c >= 'A' && c <= 'Z')
+      return c - 'A';
+    if (c >= 'a' && c <= 'z')
+      return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+      return c - '0' + 52;
+    if (c == '+' || c == '-')
+      return 62;
+    if (c == '/' || c == '_')
+      return 63;
+    return -1;
+  };
+
+  std::vector<uint8_t> out;
+  out.reserve(text.size() / 4 * 3);
+
+  uint32_t acc = 0;
+  int bits = 0;
+  size_t padding = 0;
+
+  for (char c : text) {
+    if (c == '=') {
+      padding++;
+      continue;
+    }
+    if (c == '\n' || c == '\r' || c == ' ')
+      continue;
+    if (padding > 0)
+      return std::nullopt; // data after padding
+
+    int v = value_of(c);
+    if (v < 0)
+      return std::nullopt;
+
+    acc = (acc << 6) | static_cast<uint32_t>(v);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back(static_cast<uint8_t>((acc >> bits) & 0xFF));
+    }
+  }
+
+  if (padding > 2)
+    return std::nullopt;
+
+  return out;
+}
+
+} // namespace base64
+
+} // namespace onnx_server
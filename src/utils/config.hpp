@@ -1,8 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -20,7 +22,29 @@ using json = nlohmann::json;
 struct ServerConfig {
   std::string host = "0.0.0.0";
   int port = 8080;
-  int threads = 4;
+  bool tcp_enabled = true; // false = serve only on unix_socket
+  // Unix domain socket path for co-located clients (empty = off)
+  std::string unix_socket;
+  std::string unix_socket_mode = "0660"; // Octal permissions of the socket
+  // HTTP worker threads (0 = max(8, cores - 1), cpp-httplib's default).
+  // With the httplib backend each worker serves one connection at a time.
+  int threads = 0;
+  // Work waiting for a free worker beyond this is rejected (0 = unbounded)
+  int max_queued_requests = 256;
+  int keep_alive_max_count = 100;
+  int keep_alive_timeout_sec = 30;
+  int read_timeout_sec = 30;
+  int write_timeout_sec = 30;
+  size_t max_payload_mb = 100;
+  std::string backend = "httplib"; // "httplib" or "epoll" (Linux only)
+  int event_loops = 0;             // epoll backend: 0 = one per core
+  // WebSocket messages a connection may have awaiting replies before the
+  // server stops reading from it (epoll backend)
+  int websocket_max_in_flight = 64;
+  int websocket_idle_timeout_sec = 300;
+  // Significant digits for floats in JSON responses (0 = shortest
+  // round-trip representation), clamped to [0, 17] on load
+  int json_float_precision = 0;
 };
 
 /**
@@ -44,6 +68,14 @@ struct BatchingConfig {
   size_t min_batch_size = 1;
   uint32_t max_wait_ms = 10;
   bool adaptive_sizing = true;
+  // Run compatible requests as one call, concatenated along dimension 0.
+  // Only correct for models whose dimension 0 is a batch axis, so off by
+  // default: enable it for every model, or list the models it is for.
+  bool concatenate = false;
+  std::vector<std::string> concatenate_models;
+  // Refuse new inference requests with 503 while this many are queued,
+  // before their body is read (0 = unlimited)
+  size_t max_queue_size = 0;
 };
 
 /**
@@ -64,6 +96,73 @@ struct MetricsConfig {
   std::string path = "/metrics";
   std::vector<double> latency_buckets = {0.001, 0.005, 0.01, 0.025, 0.05,
                                          0.1,   0.25,  0.5,  1.0};
+  // Per-model latency quantiles (Prometheus summaries, GET /v1/stats)
+  double quantile_accuracy = 0.01; // Relative error of reported quantiles
+  int quantile_window_sec = 300;   // Window of the Prometheus summaries
+};
+
+/**
+ * HTTP compression configuration
+ */
+struct CompressionConfig {
+  bool enabled = true;
+  // Response codings in server preference order ("zstd", "gzip")
+  std::vector<std::string> algorithms = {"zstd", "gzip"};
+  size_t min_size_bytes = 1024; // Smaller responses are sent uncompressed
+  int gzip_level = 6;           // 1 (fastest) - 9 (smallest)
+  int zstd_level = 3;           // 1 (fastest) - 19 (smallest)
+  size_t max_decompressed_mb = 100; // Cap on inflated request bodies
+};
+
+/**
+ * System shared memory tensor transport (v2 shared memory extension)
+ */
+struct SharedMemoryConfig {
+  // Off by default: registered keys are opened with the server's privileges
+  bool enabled = false;
+  size_t max_regions = 64; // 0 = unlimited
+};
+
+/**
+ * NDJSON bulk inference (`POST /v1/models/:name/infer:stream`) and
+ * chunked transfer of large inference responses
+ */
+struct StreamingConfig {
+  // Instances submitted but not yet written back, per stream
+  size_t max_in_flight = 64;
+  // v1 responses estimated at this size or more are streamed from the
+  // output tensors instead of buffered (0 = always buffer)
+  size_t response_threshold_bytes = 1024 * 1024;
+  size_t response_chunk_bytes = 64 * 1024; // Target chunk size
+};
+
+/**
+ * Asynchronous inference jobs (`infer?async=true`, /v1/jobs)
+ */
+struct JobsConfig {
+  bool enabled = true;
+  int workers = 4;                   // Threads running queued jobs
+  size_t max_pending = 1024;         // Unfinished jobs before 503
+  int result_ttl_sec = 300;          // How long finished results are kept
+  size_t max_result_memory_mb = 256; // Oldest results evicted beyond this
+  int max_wait_sec = 30;             // Cap on GET /v1/jobs/:id?wait=N
+  size_t max_waiters = 64;           // Long-polls held at once
+  bool callbacks_enabled = false;    // Allow callback_url on submission
+  int callback_timeout_sec = 5;
+  // Hosts ("host" or "host:port") callbacks may target; none if empty
+  std::vector<std::string> callback_hosts;
+};
+
+/**
+ * Staged v1 inference: JSON/MessagePack/CBOR bodies are decoded and
+ * responses encoded on dedicated pools instead of the HTTP worker
+ */
+struct PipelineConfig {
+  bool enabled = false;
+  int decode_threads = 4;
+  int encode_threads = 4;
+  size_t decode_queue = 1024; // Bodies waiting for a decoder before 503
+  size_t encode_queue = 1024; // Results waiting for an encoder before 503
 };
 
 /**
@@ -84,6 +183,11 @@ struct Config {
   BatchingConfig batching;
   ModelsConfig models;
   MetricsConfig metrics;
+  CompressionConfig compression;
+  SharedMemoryConfig shared_memory;
+  StreamingConfig streaming;
+  JobsConfig jobs;
+  PipelineConfig pipeline;
   LoggingConfig logging;
 
   /**
@@ -122,9 +226,30 @@ struct Config {
     if (const char *val = std::getenv("ONNX_SERVER_PORT")) {
       server.port = std::stoi(val);
     }
+    if (const char *val = std::getenv("ONNX_SERVER_UNIX_SOCKET")) {
+      server.unix_socket = val;
+    }
     if (const char *val = std::getenv("ONNX_SERVER_THREADS")) {
       server.threads = std::stoi(val);
     }
+    if (const char *val = std::getenv("ONNX_SERVER_MAX_QUEUED_REQUESTS")) {
+      server.max_queued_requests = std::stoi(val);
+    }
+    if (const char *val = std::getenv("ONNX_SERVER_KEEP_ALIVE_TIMEOUT")) {
+      server.keep_alive_timeout_sec = std::stoi(val);
+    }
+    if (const char *val = std::getenv("ONNX_SERVER_MAX_PAYLOAD_MB")) {
+      server.max_payload_mb = std::stoull(val);
+    }
+    if (const char *val = std::getenv("ONNX_SERVER_BACKEND")) {
+      server.backend = val;
+    }
+    if (const char *val = std::getenv("ONNX_WEBSOCKET_MAX_IN_FLIGHT")) {
+      server.websocket_max_in_flight = std::stoi(val);
+    }
+    if (const char *val = std::getenv("ONNX_JSON_FLOAT_PRECISION")) {
+      server.json_float_precision = std::clamp(std::stoi(val), 0, 17);
+    }
 
     // Inference
     if (const char *val = std::getenv("ONNX_GPU_DEVICE_ID")) {
@@ -145,6 +270,9 @@ struct Config {
     if (const char *val = std::getenv("ONNX_MAX_WAIT_MS")) {
       batching.max_wait_ms = std::stoul(val);
     }
+    if (const char *val = std::getenv("ONNX_MAX_QUEUE_SIZE")) {
+      batching.max_queue_size = std::stoull(val);
+    }
 
     // Models
     if (const char *val = std::getenv("ONNX_MODELS_DIR")) {
@@ -160,6 +288,53 @@ struct Config {
       metrics.enabled = (std::string(val) == "true" || std::string(val) == "1");
     }
 
+    // Compression
+    if (const char *val = std::getenv("ONNX_COMPRESSION_ENABLED")) {
+      compression.enabled =
+          (std::string(val) == "true" || std::string(val) == "1");
+    }
+    if (const char *val = std::getenv("ONNX_COMPRESSION_MIN_SIZE")) {
+      compression.min_size_bytes = std::stoull(val);
+    }
+
+    // Shared memory
+    if (const char *val = std::getenv("ONNX_SHARED_MEMORY_ENABLED")) {
+      shared_memory.enabled =
+          (std::string(val) == "true" || std::string(val) == "1");
+    }
+
+    // NDJSON streaming
+    if (const char *val = std::getenv("ONNX_STREAM_MAX_IN_FLIGHT")) {
+      streaming.max_in_flight =
+          at_least_one(std::stoll(val), "ONNX_STREAM_MAX_IN_FLIGHT");
+    }
+    if (const char *val = std::getenv("ONNX_STREAM_RESPONSE_THRESHOLD")) {
+      streaming.response_threshold_bytes = std::stoull(val);
+    }
+
+    // Async jobs
+    if (const char *val = std::getenv("ONNX_JOBS_ENABLED")) {
+      jobs.enabled = (std::string(val) == "true" || std::string(val) == "1");
+    }
+    if (const char *val = std::getenv("ONNX_JOBS_WORKERS")) {
+      jobs.workers = std::stoi(val);
+    }
+    if (const char *val = std::getenv("ONNX_JOBS_RESULT_TTL")) {
+      jobs.result_ttl_sec = std::stoi(val);
+    }
+
+    // Staged pipeline
+    if (const char *val = std::getenv("ONNX_PIPELINE_ENABLED")) {
+      pipeline.enabled =
+          (std::string(val) == "true" || std::string(val) == "1");
+    }
+    if (const char *val = std::getenv("ONNX_PIPELINE_DECODE_THREADS")) {
+      pipeline.decode_threads = std::stoi(val);
+    }
+    if (const char *val = std::getenv("ONNX_PIPELINE_ENCODE_THREADS")) {
+      pipeline.encode_threads = std::stoi(val);
+    }
+
     // Logging
     if (const char *val = std::getenv("ONNX_LOG_LEVEL")) {
       logging.level = val;
@@ -174,7 +349,21 @@ struct Config {
         {"server",
          {{"host", server.host},
           {"port", server.port},
-          {"threads", server.threads}}},
+          {"tcp_enabled", server.tcp_enabled},
+          {"unix_socket", server.unix_socket},
+          {"unix_socket_mode", server.unix_socket_mode},
+          {"threads", server.threads},
+          {"max_queued_requests", server.max_queued_requests},
+          {"keep_alive_max_count", server.keep_alive_max_count},
+          {"keep_alive_timeout_sec", server.keep_alive_timeout_sec},
+          {"read_timeout_sec", server.read_timeout_sec},
+          {"write_timeout_sec", server.write_timeout_sec},
+          {"max_payload_mb", server.max_payload_mb},
+          {"backend", server.backend},
+          {"event_loops", server.event_loops},
+          {"websocket_max_in_flight", server.websocket_max_in_flight},
+          {"websocket_idle_timeout_sec", server.websocket_idle_timeout_sec},
+          {"json_float_precision", server.json_float_precision}}},
         {"inference",
          {{"providers", inference.providers},
           {"gpu_device_id", inference.gpu_device_id},
@@ -182,13 +371,63 @@ struct Config {
         {"batching",
          {{"enabled", batching.enabled},
           {"max_batch_size", batching.max_batch_size},
-          {"max_wait_ms", batching.max_wait_ms}}},
+          {"max_wait_ms", batching.max_wait_ms},
+          {"concatenate", batching.concatenate},
+          {"concatenate_models", batching.concatenate_models},
+          {"max_queue_size", batching.max_queue_size}}},
         {"models",
          {{"directory", models.directory}, {"hot_reload", models.hot_reload}}},
-        {"metrics", {{"enabled", metrics.enabled}, {"path", metrics.path}}}};
+        {"metrics",
+         {{"enabled", metrics.enabled},
+          {"path", metrics.path},
+          {"quantile_accuracy", metrics.quantile_accuracy},
+          {"quantile_window_sec", metrics.quantile_window_sec}}},
+        {"compression",
+         {{"enabled", compression.enabled},
+          {"algorithms", compression.algorithms},
+          {"min_size_bytes", compression.min_size_bytes},
+          {"gzip_level", compression.gzip_level},
+          {"zstd_level", compression.zstd_level},
+          {"max_decompressed_mb", compression.max_decompressed_mb}}},
+        {"shared_memory",
+         {{"enabled", shared_memory.enabled},
+          {"max_regions", shared_memory.max_regions}}},
+        {"streaming",
+         {{"max_in_flight", streaming.max_in_flight},
+          {"response_threshold_bytes", streaming.response_threshold_bytes},
+          {"response_chunk_bytes", streaming.response_chunk_bytes}}},
+        {"jobs",
+         {{"enabled", jobs.enabled},
+          {"workers", jobs.workers},
+          {"max_pending", jobs.max_pending},
+          {"result_ttl_sec", jobs.result_ttl_sec},
+          {"max_result_memory_mb", jobs.max_result_memory_mb},
+          {"max_wait_sec", jobs.max_wait_sec},
+          {"max_waiters", jobs.max_waiters},
+          {"callbacks_enabled", jobs.callbacks_enabled},
+          {"callback_timeout_sec", jobs.callback_timeout_sec},
+          {"callback_hosts", jobs.callback_hosts}}},
+        {"pipeline",
+         {{"enabled", pipeline.enabled},
+          {"decode_threads", pipeline.decode_threads},
+          {"encode_threads", pipeline.encode_threads},
+          {"decode_queue", pipeline.decode_queue},
+          {"encode_queue", pipeline.encode_queue}}}};
   }
 
 private:
+  /**
+   * Check a count that must be positive, e.g. a limit a window is clamped
+   * to, before it is stored as unsigned
+   */
+  static size_t at_least_one(int64_t value, const char *name) {
+    if (value < 1) {
+      throw std::invalid_argument(std::string(name) + " must be at least 1, " +
+                                  "got " + std::to_string(value));
+    }
+    return static_cast<size_t>(value);
+  }
+
   static Config parse_json(const json &j) {
     Config config;
 
@@ -198,8 +437,38 @@ private:
         config.server.host = s["host"];
       if (s.contains("port"))
         config.server.port = s["port"];
+      if (s.contains("tcp_enabled"))
+        config.server.tcp_enabled = s["tcp_enabled"];
+      if (s.contains("unix_socket"))
+        config.server.unix_socket = s["unix_socket"];
+      if (s.contains("unix_socket_mode"))
+        config.server.unix_socket_mode = s["unix_socket_mode"];
       if (s.contains("threads"))
         config.server.threads = s["threads"];
+      if (s.contains("max_queued_requests"))
+        config.server.max_queued_requests = s["max_queued_requests"];
+      if (s.contains("keep_alive_max_count"))
+        config.server.keep_alive_max_count = s["keep_alive_max_count"];
+      if (s.contains("keep_alive_timeout_sec"))
+        config.server.keep_alive_timeout_sec = s["keep_alive_timeout_sec"];
+      if (s.contains("read_timeout_sec"))
+        config.server.read_timeout_sec = s["read_timeout_sec"];
+      if (s.contains("write_timeout_sec"))
+        config.server.write_timeout_sec = s["write_timeout_sec"];
+      if (s.contains("max_payload_mb"))
+        config.server.max_payload_mb = s["max_payload_mb"];
+      if (s.contains("backend"))
+        config.server.backend = s["backend"];
+      if (s.contains("event_loops"))
+        config.server.event_loops = s["event_loops"];
+      if (s.contains("websocket_max_in_flight"))
+        config.server.websocket_max_in_flight = s["websocket_max_in_flight"];
+      if (s.contains("websocket_idle_timeout_sec"))
+        config.server.websocket_idle_timeout_sec =
+            s["websocket_idle_timeout_sec"];
+      if (s.contains("json_float_precision"))
+        config.server.json_float_precision =
+            std::clamp(s["json_float_precision"].get<int>(), 0, 17);
     }
 
     if (j.contains("inference")) {
@@ -231,6 +500,13 @@ private:
         config.batching.max_wait_ms = b["max_wait_ms"];
       if (b.contains("adaptive_sizing"))
         config.batching.adaptive_sizing = b["adaptive_sizing"];
+      if (b.contains("concatenate"))
+        config.batching.concatenate = b["concatenate"];
+      if (b.contains("concatenate_models"))
+        config.batching.concatenate_models =
+            b["concatenate_models"].get<std::vector<std::string>>();
+      if (b.contains("max_queue_size"))
+        config.batching.max_queue_size = b["max_queue_size"];
     }
 
     if (j.contains("models")) {
@@ -254,6 +530,86 @@ private:
       if (met.contains("latency_buckets"))
         config.metrics.latency_buckets =
             met["latency_buckets"].get<std::vector<double>>();
+      if (met.contains("quantile_accuracy"))
+        config.metrics.quantile_accuracy = met["quantile_accuracy"];
+      if (met.contains("quantile_window_sec"))
+        config.metrics.quantile_window_sec = met["quantile_window_sec"];
+    }
+
+    if (j.contains("compression")) {
+      auto &c = j["compression"];
+      if (c.contains("enabled"))
+        config.compression.enabled = c["enabled"];
+      if (c.contains("algorithms"))
+        config.compression.algorithms =
+            c["algorithms"].get<std::vector<std::string>>();
+      if (c.contains("min_size_bytes"))
+        config.compression.min_size_bytes = c["min_size_bytes"];
+      if (c.contains("gzip_level"))
+        config.compression.gzip_level = c["gzip_level"];
+      if (c.contains("zstd_level"))
+        config.compression.zstd_level = c["zstd_level"];
+      if (c.contains("max_decompressed_mb"))
+        config.compression.max_decompressed_mb = c["max_decompressed_mb"];
+    }
+
+    if (j.contains("shared_memory")) {
+      auto &sm = j["shared_memory"];
+      if (sm.contains("enabled"))
+        config.shared_memory.enabled = sm["enabled"];
+      if (sm.contains("max_regions"))
+        config.shared_memory.max_regions = sm["max_regions"];
+    }
+
+    if (j.contains("streaming")) {
+      auto &st = j["streaming"];
+      if (st.contains("max_in_flight"))
+        config.streaming.max_in_flight = at_least_one(
+            st["max_in_flight"].get<int64_t>(), "streaming.max_in_flight");
+      if (st.contains("response_threshold_bytes"))
+        config.streaming.response_threshold_bytes =
+            st["response_threshold_bytes"];
+      if (st.contains("response_chunk_bytes"))
+        config.streaming.response_chunk_bytes = st["response_chunk_bytes"];
+    }
+
+    if (j.contains("jobs")) {
+      auto &jb = j["jobs"];
+      if (jb.contains("enabled"))
+        config.jobs.enabled = jb["enabled"];
+      if (jb.contains("workers"))
+        config.jobs.workers = jb["workers"];
+      if (jb.contains("max_pending"))
+        config.jobs.max_pending = jb["max_pending"];
+      if (jb.contains("result_ttl_sec"))
+        config.jobs.result_ttl_sec = jb["result_ttl_sec"];
+      if (jb.contains("max_result_memory_mb"))
+        config.jobs.max_result_memory_mb = jb["max_result_memory_mb"];
+      if (jb.contains("max_wait_sec"))
+        config.jobs.max_wait_sec = jb["max_wait_sec"];
+      if (jb.contains("max_waiters"))
+        config.jobs.max_waiters = jb["max_waiters"];
+      if (jb.contains("callbacks_enabled"))
+        config.jobs.callbacks_enabled = jb["callbacks_enabled"];
+      if (jb.contains("callback_timeout_sec"))
+        config.jobs.callback_timeout_sec = jb["callback_timeout_sec"];
+      if (jb.contains("callback_hosts"))
+        config.jobs.callback_hosts =
+            jb["callback_hosts"].get<std::vector<std::string>>();
+    }
+
+    if (j.contains("pipeline")) {
+      auto &p = j["pipeline"];
+      if (p.contains("enabled"))
+        config.pipeline.enabled = p["enabled"];
+      if (p.contains("decode_threads"))
+        config.pipeline.decode_threads = p["decode_threads"];
+      if (p.contains("encode_threads"))
+        config.pipeline.encode_threads = p["encode_threads"];
+      if (p.contains("decode_queue"))
+        config.pipeline.decode_queue = p["decode_queue"];
+      if (p.contains("encode_queue"))
+        config.pipeline.encode_queue = p["encode_queue"];
     }
 
     if (j.contains("logging")) {
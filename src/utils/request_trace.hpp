@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace onnx_server {
+
+/**
+ * Timestamps of one request on its way through the server, from its
+ * header block arriving to its response being encoded.
+ *
+ * Each layer marks the points it passes. The time up to a mark, from the
+ * latest earlier mark that is set, is the phase named after it, so the
+ * phases of a request add up to its total however many marks its path
+ * skips: without the batcher, Enqueued and BatchFormed stay unset and
+ * tensor_build starts at Validated.
+ */
+struct RequestTrace {
+  using Clock = std::chrono::steady_clock;
+
+  enum Mark {
+    Received,    // Header block parsed
+    BodyRead,    // Body complete
+    Dispatched,  // Handler started
+    Decoded,     // Body decoded into tensors
+    Validated,   // Inputs checked and packed as their declared dtypes
+    Enqueued,    // Handed to the batcher
+    BatchFormed, // Taken from the batch queue for a run
+    RunStarted,  // Input tensors built, session Run called
+    RunFinished, // Run returned
+    Extracted,   // Outputs copied out, and split from a merged batch
+    Encoded,     // Response body written
+    MARK_COUNT
+  };
+
+  // Phase i ends at mark i + 1
+  static constexpr size_t PHASE_COUNT = MARK_COUNT - 1;
+  static constexpr std::array<const char *, PHASE_COUNT> PHASES = {
+      "read",  "dispatch",     "decode", "validate", "enqueue",
+      "queue", "tensor_build", "run",    "extract",  "encode"};
+
+  std::array<Clock::time_point, MARK_COUNT> marks{};
+
+  void mark(Mark m, Clock::time_point at = Clock::now()) { marks[m] = at; }
+
+  bool has(Mark m) const { return marks[m] != Clock::time_point{}; }
+
+  /**
+   * Take every mark set in `other`, e.g. the marks a response collected
+   * on the batcher and session threads
+   */
+  void merge(const RequestTrace &other) {
+    for (size_t i = 0; i < MARK_COUNT; ++i) {
+      if (other.marks[i] != Clock::time_point{})
+        marks[i] = other.marks[i];
+    }
+  }
+
+  /**
+   * Seconds spent in phase `phase`; negative if the phase was not reached
+   */
+  double phase_seconds(size_t phase) const {
+    size_t end = phase + 1;
+    if (!has(static_cast<Mark>(end)))
+      return -1;
+    for (size_t start = end; start-- > 0;) {
+      if (has(static_cast<Mark>(start))) {
+        return std::chrono::duration<double>(marks[end] - marks[start])
+            .count();
+      }
+    }
+    return -1;
+  }
+
+  /**
+   * Server-Timing header value of the phases reached, durations in ms,
+   * plus the total from receipt to `end`
+   */
+  std::string server_timing(Clock::time_point end = Clock::now()) const {
+    std::string out;
+    char buffer[64];
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+      double seconds = phase_seconds(i);
+      if (seconds < 0)
+        continue;
+      std::snprintf(buffer, sizeof(buffer), "%s;dur=%.3f, ", PHASES[i],
+                    seconds * 1000);
+      out += buffer;
+    }
+    if (has(Received)) {
+      std::snprintf(
+          buffer, sizeof(buffer), "total;dur=%.3f",
+          std::chrono::duration<double, std::milli>(end - marks[Received])
+              .count());
+      out += buffer;
+    } else if (!out.empty()) {
+      out.resize(out.size() - 2);
+    }
+    return out;
+  }
+
+  /**
+   * When the request being handled on this thread arrived, as the server
+   * backend saw it: published through an ArrivalScope around the handler
+   * call, since handlers only get the parsed request
+   */
+  struct Arrival {
+    Clock::time_point received;
+    Clock::time_point body_read;
+  };
+
+  class ArrivalScope {
+  public:
+    ArrivalScope(Clock::time_point received, Clock::time_point body_read)
+        : saved_(arrival()) {
+      arrival() = {received, body_read};
+    }
+    ~ArrivalScope() { arrival() = saved_; }
+
+    ArrivalScope(const ArrivalScope &) = delete;
+    ArrivalScope &operator=(const ArrivalScope &) = delete;
+
+  private:
+    Arrival saved_;
+  };
+
+  static Arrival &arrival() {
+    thread_local Arrival current;
+    return current;
+  }
+
+  /**
+   * Start the trace of a request whose handler starts at `start`. Arrival
+   * marks come from the enclosing ArrivalScope, or are `start` too if the
+   * backend published none.
+   */
+  void begin(Clock::time_point start) {
+    const Arrival &from = arrival();
+    marks[Received] =
+        from.received != Clock::time_point{} ? from.received : start;
+    marks[BodyRead] =
+        from.body_read != Clock::time_point{} ? from.body_read : start;
+    marks[Dispatched] = start;
+  }
+};
+
+} // namespace onnx_server
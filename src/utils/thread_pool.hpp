@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <future>
@@ -14,11 +15,26 @@ namespace onnx_server {
 
 /**
  * A simple thread pool for async task execution
+ *
+ * `max_queue` bounds the tasks waiting for a worker (0 = unbounded);
+ * try_enqueue() refuses work beyond it so callers can shed load.
  */
 class ThreadPool {
 public:
-  explicit ThreadPool(size_t num_threads = std::thread::hardware_concurrency())
-      : stop_(false) {
+  /**
+   * Optional hooks for queue instrumentation. on_depth runs under the queue
+   * lock so the reported depths stay in order and must not call back into
+   * the pool; the others are called without it.
+   */
+  struct Observer {
+    std::function<void(size_t depth)> on_depth;
+    std::function<void(double wait_seconds)> on_wait;
+    std::function<void()> on_reject;
+  };
+
+  explicit ThreadPool(size_t num_threads = std::thread::hardware_concurrency(),
+                      size_t max_queue = 0)
+      : max_queue_(max_queue), stop_(false) {
 
     if (num_threads == 0) {
       num_threads = 1;
@@ -56,7 +72,8 @@ public:
       if (stop_) {
         throw std::runtime_error("ThreadPool has been stopped");
       }
-      tasks_.emplace([task]() { (*task)(); });
+      tasks_.push({[task]() { (*task)(); }, Clock::now()});
+      notify_depth(tasks_.size());
     }
 
     condition_.notify_one();
@@ -72,11 +89,41 @@ public:
       if (stop_) {
         throw std::runtime_error("ThreadPool has been stopped");
       }
-      tasks_.emplace(std::forward<F>(f));
+      tasks_.push({std::forward<F>(f), Clock::now()});
+      notify_depth(tasks_.size());
+    }
+    condition_.notify_one();
+  }
+
+  /**
+   * Queue a task unless the pool is stopped or `max_queue` tasks are
+   * already waiting. Returns false (and reports a rejection) otherwise.
+   */
+  bool try_enqueue(std::function<void()> fn) {
+    bool accepted = false;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      if (!stop_ && (max_queue_ == 0 || tasks_.size() < max_queue_)) {
+        tasks_.push({std::move(fn), Clock::now()});
+        notify_depth(tasks_.size());
+        accepted = true;
+      }
+    }
+
+    if (!accepted) {
+      if (observer_.on_reject)
+        observer_.on_reject();
+      return false;
     }
     condition_.notify_one();
+    return true;
   }
 
+  /**
+   * Install instrumentation hooks; call before submitting work
+   */
+  void set_observer(Observer observer) { observer_ = std::move(observer); }
+
   /**
    * Get the number of pending tasks
    */
@@ -90,6 +137,11 @@ public:
    */
   size_t size() const { return workers_.size(); }
 
+  /**
+   * Get the queue bound (0 = unbounded)
+   */
+  size_t max_queue() const { return max_queue_; }
+
   /**
    * Gracefully shutdown the pool
    */
@@ -111,9 +163,16 @@ public:
   }
 
 private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Task {
+    std::function<void()> fn;
+    Clock::time_point queued;
+  };
+
   void worker_loop() {
     while (true) {
-      std::function<void()> task;
+      Task task;
 
       {
         std::unique_lock<std::mutex> lock(queue_mutex_);
@@ -125,14 +184,27 @@ private:
 
         task = std::move(tasks_.front());
         tasks_.pop();
+        notify_depth(tasks_.size());
+      }
+
+      if (observer_.on_wait) {
+        observer_.on_wait(
+            std::chrono::duration<double>(Clock::now() - task.queued).count());
       }
 
-      task();
+      task.fn();
     }
   }
 
+  void notify_depth(size_t depth) {
+    if (observer_.on_depth)
+      observer_.on_depth(depth);
+  }
+
   std::vector<std::thread> workers_;
-  std::queue<std::function<void()>> tasks_;
+  std::queue<Task> tasks_;
+  size_t max_queue_;
+  Observer observer_;
 
   mutable std::mutex queue_mutex_;
   std::condition_variable condition_;
@@ -0,0 +1,48 @@
+#pragma once
+
+/**
+ * Minimal assertions for the parser tests. A failed CHECK prints its
+ * location and is counted; main() returns check::result(), so ctest sees
+ * every failure of a run rather than only the first.
+ */
+
+#include <cstdio>
+
+namespace check {
+
+inline int &failures() {
+  static int count = 0;
+  return count;
+}
+
+inline int result() {
+  if (failures() > 0)
+    std::fprintf(stderr, "%d check(s) failed\n", failures());
+  return failures() > 0 ? 1 : 0;
+}
+
+} // namespace check
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,    \
+                   #cond);                                                     \
+      ++check::failures();                                                     \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_THROWS(type, expr)                                               \
+  do {                                                                         \
+    bool thrown = false;                                                       \
+    try {                                                                      \
+      (void)(expr);                                                            \
+    } catch (const type &) {                                                   \
+      thrown = true;                                                           \
+    }                                                                          \
+    if (!thrown) {                                                             \
+      std::fprintf(stderr, "%s:%d: %s did not throw %s\n", __FILE__,           \
+                   __LINE__, #expr, #type);                                    \
+      ++check::failures();                                                     \
+    }                                                                          \
+  } while (0)
@@ -0,0 +1,93 @@
+/**
+ * Chunked request body decoding in the epoll backend: hex sizes,
+ * extensions, trailers, partial input, and sizes that must not wrap the
+ * length checks
+ */
+
+#include <string>
+
+#include "check.hpp"
+#include "server/epoll_server.hpp"
+
+using namespace onnx_server;
+
+namespace {
+
+constexpr size_t MAX_LENGTH = 1024;
+
+int decode(const std::string &in, std::string &body, size_t &consumed,
+           size_t max_length = MAX_LENGTH) {
+  return EpollServer::decode_chunked(in, 0, body, consumed, max_length);
+}
+
+void test_complete() {
+  std::string body;
+  size_t consumed = 0;
+  std::string in = "5\r\nhello\r\n7;ext=1\r\n, world\r\n0\r\n\r\nNEXT";
+  CHECK(decode(in, body, consumed) == 1);
+  CHECK(body == "hello, world");
+  CHECK(in.substr(consumed) == "NEXT");
+
+  // Upper-case hex and a trailer field
+  in = "A\r\n0123456789\r\n0\r\nX-Trailer: 1\r\n\r\n";
+  CHECK(decode(in, body, consumed) == 1);
+  CHECK(body == "0123456789");
+  CHECK(consumed == in.size());
+
+  // Decoding starts at the given offset
+  in = "HEAD1\r\nx\r\n0\r\n\r\n";
+  CHECK(EpollServer::decode_chunked(in, 4, body, consumed, MAX_LENGTH) == 1);
+  CHECK(body == "x");
+}
+
+void test_incomplete() {
+  std::string body;
+  size_t consumed = 0;
+  CHECK(decode("5\r\nhel", body, consumed) == 0);
+  CHECK(decode("5\r\nhello", body, consumed) == 0);
+  CHECK(decode("5\r\nhello\r\n", body, consumed) == 0);
+  CHECK(decode("5", body, consumed) == 0);
+  CHECK(decode("0\r\nX-Trailer: 1\r\n", body, consumed) == 0);
+}
+
+void test_malformed() {
+  std::string body;
+  size_t consumed = 0;
+
+  // Only hex digits; strtoull would have accepted a sign, "0x" or spaces
+  CHECK(decode("-6\r\nhello!\r\n0\r\n\r\n", body, consumed) == -1);
+  CHECK(decode("+5\r\nhello\r\n0\r\n\r\n", body, consumed) == -1);
+  CHECK(decode("0x5\r\nhello\r\n0\r\n\r\n", body, consumed) == -1);
+  CHECK(decode(" 5\r\nhello\r\n0\r\n\r\n", body, consumed) == -1);
+  CHECK(decode("\r\nhello\r\n0\r\n\r\n", body, consumed) == -1);
+  CHECK(decode("5g\r\nhello\r\n0\r\n\r\n", body, consumed) == -1);
+
+  // Data not followed by CRLF
+  CHECK(decode("5\r\nhelloXX0\r\n\r\n", body, consumed) == -1);
+
+  // More than 16 hex digits cannot be a 64-bit size
+  CHECK(decode("00000000000000001\r\nx\r\n0\r\n\r\n", body, consumed) == -1);
+}
+
+void test_too_large() {
+  std::string body;
+  size_t consumed = 0;
+  CHECK(decode("5\r\nhello\r\n0\r\n\r\n", body, consumed, 4) == -2);
+  CHECK(decode("3\r\nabc\r\n3\r\ndef\r\n0\r\n\r\n", body, consumed, 5) ==
+        -2);
+
+  // Sizes near 2^64 must be refused, not wrapped past the checks
+  CHECK(decode("ffffffffffffffff\r\nx\r\n0\r\n\r\n", body, consumed) == -2);
+  CHECK(decode("fffffffffffffffe\r\nx\r\n", body, consumed,
+               static_cast<size_t>(-1)) == 0);
+}
+
+} // namespace
+
+int main() {
+  test_complete();
+  test_incomplete();
+  test_malformed();
+  test_too_large();
+  return check::result();
+}
@@ -0,0 +1,124 @@
+/**
+ * MessagePack and CBOR v1 request bodies: native binary tensor data,
+ * RFC 8746 typed arrays (both byte orders), and size checks against the
+ * declared shape
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "server/content_codec.hpp"
+
+using namespace onnx_server;
+
+namespace {
+
+std::vector<uint8_t> float_bytes(const std::vector<float> &values) {
+  std::vector<uint8_t> bytes(values.size() * sizeof(float));
+  std::memcpy(bytes.data(), values.data(), bytes.size());
+  return bytes;
+}
+
+/**
+ * Encode a one-input request document, then decode its inputs the way
+ * the server does
+ */
+std::vector<TensorData> round_trip(const json &tensor, Encoding encoding) {
+  json document = {{"inputs", {{"x", tensor}}}};
+  std::string body = content_codec::encode(document, encoding);
+
+  json decoded = content_codec::decode(body, encoding);
+  std::vector<TensorData> inputs;
+  content_codec::decode_inputs(decoded["inputs"], encoding, inputs);
+  return inputs;
+}
+
+float first_float(const TensorData &tensor) {
+  float value = 0;
+  if (tensor.byte_size() >= sizeof(value))
+    std::memcpy(&value, tensor.data(), sizeof(value));
+  return value;
+}
+
+void test_msgpack_binary() {
+  json tensor = {{"shape", {2}},
+                 {"dtype", "float32"},
+                 {"data", json::binary(float_bytes({1.5f, 2.5f}))}};
+  auto inputs = round_trip(tensor, Encoding::MsgPack);
+  CHECK(inputs.size() == 1);
+  if (!inputs.empty()) {
+    CHECK(inputs[0].dtype == "float32");
+    CHECK(inputs[0].raw_data.size() == 8);
+    CHECK(first_float(inputs[0]) == 1.5f);
+  }
+}
+
+void test_msgpack_array() {
+  json tensor = {{"shape", {1, 2}}, {"data", {{1, 2}}}};
+  auto inputs = round_trip(tensor, Encoding::MsgPack);
+  CHECK(inputs.size() == 1 &&
+        (inputs[0].float_data == std::vector<float>{1, 2}));
+}
+
+void test_cbor_typed_arrays() {
+  // Little-endian float32 typed array; the tag sets the dtype
+  json tensor = {{"shape", {2}},
+                 {"data", json::binary(float_bytes({3.0f, 4.0f}),
+                                       content_codec::cbor_tag_for(
+                                           "float32"))}};
+  auto inputs = round_trip(tensor, Encoding::Cbor);
+  CHECK(inputs.size() == 1);
+  if (!inputs.empty()) {
+    CHECK(inputs[0].dtype == "float32");
+    CHECK(first_float(inputs[0]) == 3.0f);
+  }
+
+  // Big-endian float32 (tag 81) is swapped into native order
+  std::vector<uint8_t> big = {0x3F, 0x80, 0x00, 0x00};
+  tensor = {{"shape", {1}}, {"data", json::binary(big, 81)}};
+  inputs = round_trip(tensor, Encoding::Cbor);
+  CHECK(inputs.size() == 1 && first_float(inputs[0]) == 1.0f);
+
+  // Big-endian int16 (tag 73)
+  std::vector<uint8_t> shorts = {0x01, 0x02};
+  tensor = {{"shape", {1}}, {"data", json::binary(shorts, 73)}};
+  inputs = round_trip(tensor, Encoding::Cbor);
+  CHECK(inputs.size() == 1 && inputs[0].dtype == "int16");
+  if (inputs.size() == 1 && inputs[0].raw_data.size() == 2) {
+    int16_t value;
+    std::memcpy(&value, inputs[0].raw_data.data(), sizeof(value));
+    CHECK(value == 0x0102);
+  }
+}
+
+void test_size_checks() {
+  // Binary data shorter than the shape needs
+  json tensor = {{"shape", {3}},
+                 {"dtype", "float32"},
+                 {"data", json::binary(float_bytes({1.0f, 2.0f}))}};
+  CHECK_THROWS(std::invalid_argument, round_trip(tensor, Encoding::MsgPack));
+
+  // A shape whose byte size wraps to 0 must not match empty data
+  tensor = {{"shape", {int64_t{1} << 32, int64_t{1} << 32}},
+            {"dtype", "float32"},
+            {"data", json::binary(std::vector<uint8_t>{})}};
+  CHECK_THROWS(std::invalid_argument, round_trip(tensor, Encoding::Cbor));
+
+  std::string garbage = "\xc1";
+  CHECK_THROWS(json::exception,
+               content_codec::decode(garbage, Encoding::MsgPack));
+}
+
+} // namespace
+
+int main() {
+  test_msgpack_binary();
+  test_msgpack_array();
+  test_cbor_typed_arrays();
+  test_size_checks();
+  return check::result();
+}
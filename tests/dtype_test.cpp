@@ -0,0 +1,62 @@
+/**
+ * dtype helpers: checked element counts and byte sizes for shapes taken
+ * from requests, and half-precision widening
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "check.hpp"
+#include "inference/dtype.hpp"
+
+using namespace onnx_server;
+
+namespace {
+
+void test_checked_element_count() {
+  CHECK(dtype::checked_element_count({}) == size_t{1});
+  CHECK(dtype::checked_element_count({2, 3, 4}) == size_t{24});
+  CHECK(dtype::checked_element_count({0, 1 << 30}) == size_t{0});
+
+  // Negative (dynamic) dimensions have no element count
+  CHECK(!dtype::checked_element_count({-1, 3}));
+
+  // 2^32 * 2^32 wraps to 0 with unchecked multiplication
+  CHECK(!dtype::checked_element_count({int64_t{1} << 32, int64_t{1} << 32}));
+  CHECK(!dtype::checked_element_count(
+      {std::numeric_limits<int64_t>::max(), 3}));
+}
+
+void test_checked_byte_size() {
+  CHECK(dtype::checked_byte_size({2, 3}, 4) == size_t{24});
+  CHECK(dtype::checked_byte_size({5}, 0) == size_t{0});
+
+  // The element count fits, its byte size does not
+  int64_t count = int64_t{1} << 62;
+  CHECK(dtype::checked_element_count({count}));
+  CHECK(!dtype::checked_byte_size({count}, 8));
+  CHECK(!dtype::checked_byte_size({-4}, 4));
+}
+
+void test_half_precision() {
+  CHECK(dtype::half_to_float(0x3C00) == 1.0f);
+  CHECK(dtype::half_to_float(0xC000) == -2.0f);
+  CHECK(dtype::half_to_float(0x3800) == 0.5f);
+  CHECK(dtype::half_to_float(0x0001) == std::ldexp(1.0f, -24)); // Subnormal
+  CHECK(std::isinf(dtype::half_to_float(0x7C00)));
+  CHECK(std::isnan(dtype::half_to_float(0x7E00)));
+
+  CHECK(dtype::bfloat16_to_float(0x3F80) == 1.0f);
+  CHECK(dtype::bfloat16_to_float(0xC040) == -3.0f);
+}
+
+} // namespace
+
+int main() {
+  test_checked_element_count();
+  test_checked_byte_size();
+  test_half_precision();
+  return check::result();
+}
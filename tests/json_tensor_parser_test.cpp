@@ -0,0 +1,106 @@
+/**
+ * Single-pass v1 JSON parser: typed scanning, shape checks, the cases it
+ * hands back to the DOM parser, and declared shapes that must not size
+ * its buffers
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "server/json_tensor_parser.hpp"
+
+using namespace onnx_server;
+using ParseError = JsonTensorParser::ParseError;
+
+namespace {
+
+bool parse(const std::string &body, JsonTensorParser::Result &result) {
+  result = {};
+  return JsonTensorParser(body).parse(result);
+}
+
+void test_typed_data() {
+  JsonTensorParser::Result result;
+  CHECK(parse(R"({"inputs":{"x":{"shape":[2,2],"data":[[1,2],[3,4.5]]},)"
+              R"("ids":{"dtype":"int64","data":[9007199254740993]}},)"
+              R"("id":"r1"})",
+              result));
+  CHECK(result.has_inputs);
+  CHECK(result.inputs.size() == 2);
+  if (result.inputs.size() == 2) {
+    const auto &x = result.inputs[0];
+    CHECK(x.name == "x");
+    CHECK((x.float_data == std::vector<float>{1, 2, 3, 4.5f}));
+    // int64 keeps integers a double would round
+    CHECK((result.inputs[1].int_data ==
+           std::vector<int64_t>{9007199254740993LL}));
+  }
+  CHECK(result.extra["id"] == "r1");
+}
+
+void test_shape_from_data() {
+  JsonTensorParser::Result result;
+  CHECK(parse(R"({"inputs":{"x":{"data":[[1,2,3],[4,5,6]]}}})", result));
+  CHECK(result.inputs.size() == 1 &&
+        (result.inputs[0].shape == std::vector<int64_t>{2, 3}));
+}
+
+void test_dom_fallback() {
+  JsonTensorParser::Result result;
+
+  // Non-numeric data
+  CHECK(!parse(R"({"inputs":{"x":{"data":["a"]}}})", result));
+
+  // dtype after data changes how the values are stored
+  CHECK(!parse(R"({"inputs":{"x":{"data":[1,2],"dtype":"int64"}}})",
+               result));
+
+  // ... unless it keeps the storage the data already has
+  CHECK(parse(R"({"inputs":{"x":{"data":[1,2],"dtype":"float32"}}})",
+              result));
+  CHECK(result.inputs.size() == 1 &&
+        result.inputs[0].float_data.size() == 2);
+}
+
+void test_shape_errors() {
+  JsonTensorParser::Result result;
+  CHECK_THROWS(ParseError,
+               parse(R"({"inputs":{"x":{"shape":[3],"data":[1,2]}}})",
+                     result));
+  CHECK_THROWS(ParseError,
+               parse(R"({"inputs":{"x":{"data":[[1,2],[3]]}}})", result));
+  CHECK_THROWS(ParseError,
+               parse(R"({"inputs":{"x":{"shape":[-1],"data":[1]}}})",
+                     result));
+  CHECK_THROWS(ParseError, parse(R"({"inputs":{"x":{"data":[1,2)", result));
+}
+
+void test_untrusted_shape() {
+  JsonTensorParser::Result result;
+
+  // A shape far larger than the body is rejected, not reserved
+  CHECK_THROWS(
+      ParseError,
+      parse(R"({"inputs":{"x":{"shape":[1000000000000],"data":[1]}}})",
+            result));
+
+  // A shape whose element count wraps to 0 must not match empty data
+  CHECK_THROWS(
+      ParseError,
+      parse(R"({"inputs":{"x":{"shape":[4294967296,4294967296],)"
+            R"("data":[]}}})",
+            result));
+}
+
+} // namespace
+
+int main() {
+  test_typed_data();
+  test_shape_from_data();
+  test_dom_fallback();
+  test_shape_errors();
+  test_untrusted_shape();
+  return check::result();
+}
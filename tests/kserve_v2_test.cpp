@@ -0,0 +1,132 @@
+/**
+ * KServe v2 request parsing: binary tensor extension, base64 and JSON
+ * data, and the size checks that keep hostile shapes and
+ * binary_data_size values from reading past the body
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "server/kserve_v2.hpp"
+
+using namespace onnx_server;
+using kserve_v2::RequestError;
+
+namespace {
+
+std::string with_binary(const std::string &header, const void *data,
+                        size_t size) {
+  return header + std::string(static_cast<const char *>(data), size);
+}
+
+void test_binary_input() {
+  std::string header =
+      R"({"id":"a","inputs":[{"name":"x","shape":[2],"datatype":"FP32",)"
+      R"("parameters":{"binary_data_size":8}}]})";
+  float values[2] = {1.5f, -2.0f};
+  std::string body = with_binary(header, values, sizeof(values));
+
+  auto request = kserve_v2::parse_request(body, header.size());
+  CHECK(request.id == "a");
+  CHECK(request.inputs.size() == 1);
+  const auto &input = request.inputs[0];
+  CHECK(input.dtype == "float32");
+  CHECK(input.byte_size() == sizeof(values));
+  CHECK(std::memcmp(input.data(), values, sizeof(values)) == 0);
+}
+
+void test_json_and_base64_inputs() {
+  std::string body =
+      R"({"inputs":[{"name":"y","shape":[2,1],"datatype":"INT64",)"
+      R"("data":[[1],[2]]},{"name":"z","shape":[1],"datatype":"FP32",)"
+      R"("data":"AACAPw=="}]})";
+  auto request = kserve_v2::parse_request(body, 0);
+  CHECK(request.inputs.size() == 2);
+
+  int64_t ints[2];
+  std::memcpy(ints, request.inputs[0].data(), sizeof(ints));
+  CHECK(ints[0] == 1 && ints[1] == 2);
+
+  float one;
+  std::memcpy(&one, request.inputs[1].data(), sizeof(one));
+  CHECK(one == 1.0f);
+}
+
+void test_binary_size_checks() {
+  float values[2] = {1.0f, 2.0f};
+
+  // binary_data_size past the end of the body
+  std::string header =
+      R"({"inputs":[{"name":"x","shape":[2],"datatype":"FP32",)"
+      R"("parameters":{"binary_data_size":16}}]})";
+  CHECK_THROWS(RequestError,
+               kserve_v2::parse_request(
+                   with_binary(header, values, sizeof(values)),
+                   header.size()));
+
+  // A size near SIZE_MAX must not wrap the bounds check
+  header = R"({"inputs":[{"name":"x","shape":[2],"datatype":"FP32",)"
+           R"("parameters":{"binary_data_size":18446744073709551615}}]})";
+  CHECK_THROWS(RequestError,
+               kserve_v2::parse_request(
+                   with_binary(header, values, sizeof(values)),
+                   header.size()));
+
+  // Size disagrees with shape and datatype
+  header = R"({"inputs":[{"name":"x","shape":[1],"datatype":"FP32",)"
+           R"("parameters":{"binary_data_size":8}}]})";
+  CHECK_THROWS(RequestError,
+               kserve_v2::parse_request(
+                   with_binary(header, values, sizeof(values)),
+                   header.size()));
+
+  // Bytes left over after the last tensor
+  header = R"({"inputs":[{"name":"x","shape":[1],"datatype":"FP32",)"
+           R"("parameters":{"binary_data_size":4}}]})";
+  CHECK_THROWS(RequestError,
+               kserve_v2::parse_request(
+                   with_binary(header, values, sizeof(values)),
+                   header.size()));
+
+  // Header length beyond the body
+  CHECK_THROWS(RequestError, kserve_v2::parse_request("{}", 10));
+}
+
+void test_shape_overflow() {
+  // 2^32 * 2^32 elements wraps to 0 bytes with unchecked arithmetic,
+  // which would match an empty binary slice
+  std::string header =
+      R"({"inputs":[{"name":"x","shape":[4294967296,4294967296],)"
+      R"("datatype":"FP32","parameters":{"binary_data_size":0}}]})";
+  CHECK_THROWS(RequestError, kserve_v2::parse_request(header, header.size()));
+
+  header = R"({"inputs":[{"name":"x","shape":[-1],"datatype":"FP32",)"
+           R"("data":[1]}]})";
+  CHECK_THROWS(RequestError, kserve_v2::parse_request(header, 0));
+
+  // A huge declared shape with little data is rejected, not reserved
+  header = R"({"inputs":[{"name":"x","shape":[100000000000],)"
+           R"("datatype":"FP32","data":[1]}]})";
+  CHECK_THROWS(RequestError, kserve_v2::parse_request(header, 0));
+}
+
+void test_shape_matches() {
+  CHECK(kserve_v2::shape_matches({-1, 3}, {8, 3}));
+  CHECK(kserve_v2::shape_matches({}, {}));
+  CHECK(!kserve_v2::shape_matches({-1, 3}, {8, 4}));
+  CHECK(!kserve_v2::shape_matches({-1, 3}, {24}));
+}
+
+} // namespace
+
+int main() {
+  test_binary_input();
+  test_json_and_base64_inputs();
+  test_binary_size_checks();
+  test_shape_overflow();
+  test_shape_matches();
+  return check::result();
+}
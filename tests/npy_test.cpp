@@ -0,0 +1,127 @@
+/**
+ * NumPy .npy/.npz reading and writing, including headers whose length or
+ * shape would read past the payload
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "server/npy.hpp"
+
+using namespace onnx_server;
+using npy::FormatError;
+
+namespace {
+
+TensorData float_tensor(const std::string &name, std::vector<int64_t> shape,
+                        std::vector<float> values) {
+  TensorData tensor;
+  tensor.name = name;
+  tensor.dtype = "float32";
+  tensor.shape = std::move(shape);
+  tensor.float_data = std::move(values);
+  return tensor;
+}
+
+/**
+ * A version 1.0 .npy payload with a hand-written header dict
+ */
+std::string npy_with_header(const std::string &dict,
+                            const std::string &data) {
+  std::string header = dict;
+  while ((10 + header.size() + 1) % 64 != 0)
+    header += ' ';
+  header += '\n';
+
+  std::string out("\x93NUMPY\x01\x00", 8);
+  out += static_cast<char>(header.size() & 0xFF);
+  out += static_cast<char>(header.size() >> 8);
+  return out + header + data;
+}
+
+void test_npy_round_trip() {
+  auto tensor = float_tensor("x", {2, 2}, {1.0f, 2.0f, 3.0f, 4.0f});
+  std::string payload = npy::write_npy(tensor);
+
+  TensorData parsed;
+  npy::parse_npy(payload.data(), payload.size(), parsed);
+  CHECK(parsed.dtype == "float32");
+  CHECK((parsed.shape == std::vector<int64_t>{2, 2}));
+  CHECK(parsed.byte_size() == 16);
+  float values[4];
+  std::memcpy(values, parsed.data(), sizeof(values));
+  CHECK(values[0] == 1.0f && values[3] == 4.0f);
+}
+
+void test_big_endian() {
+  const char data[4] = {0x3F, static_cast<char>(0x80), 0x00, 0x00};
+  std::string payload = npy_with_header(
+      "{'descr': '>f4', 'fortran_order': False, 'shape': (1,), }",
+      std::string(data, 4));
+
+  TensorData parsed;
+  npy::parse_npy(payload.data(), payload.size(), parsed);
+  float value;
+  std::memcpy(&value, parsed.data(), sizeof(value));
+  CHECK(value == 1.0f);
+}
+
+void test_npz_round_trip() {
+  auto a = float_tensor("a", {3}, {1.0f, 2.0f, 3.0f});
+  auto b = float_tensor("b", {1}, {5.0f});
+  std::string archive = npy::write_npz({&a, &b});
+
+  auto tensors = npy::parse_npz(archive);
+  CHECK(tensors.size() == 2);
+  if (tensors.size() == 2) {
+    CHECK(tensors[0].name == "a");
+    CHECK(tensors[1].name == "b");
+    CHECK((tensors[0].shape == std::vector<int64_t>{3}));
+    float value;
+    std::memcpy(&value, tensors[1].data(), sizeof(value));
+    CHECK(value == 5.0f);
+  }
+}
+
+void test_malformed() {
+  TensorData parsed;
+  std::string garbage = "not numpy at all";
+  CHECK_THROWS(FormatError,
+               npy::parse_npy(garbage.data(), garbage.size(), parsed));
+
+  // Header length beyond the payload
+  std::string payload = npy::write_npy(float_tensor("x", {1}, {1.0f}));
+  payload[8] = static_cast<char>(0xFF);
+  payload[9] = static_cast<char>(0xFF);
+  CHECK_THROWS(FormatError,
+               npy::parse_npy(payload.data(), payload.size(), parsed));
+
+  // Data shorter than the shape needs
+  payload = npy_with_header(
+      "{'descr': '<f4', 'fortran_order': False, 'shape': (10,), }",
+      std::string(8, '\0'));
+  CHECK_THROWS(FormatError,
+               npy::parse_npy(payload.data(), payload.size(), parsed));
+
+  // A shape whose byte size wraps to 0 with unchecked arithmetic
+  payload = npy_with_header("{'descr': '<f4', 'fortran_order': False, "
+                            "'shape': (4294967296, 4294967296), }",
+                            "");
+  CHECK_THROWS(FormatError,
+               npy::parse_npy(payload.data(), payload.size(), parsed));
+
+  CHECK_THROWS(FormatError, npy::parse_npz("PK"));
+}
+
+} // namespace
+
+int main() {
+  test_npy_round_trip();
+  test_big_endian();
+  test_npz_round_trip();
+  test_malformed();
+  return check::result();
+}
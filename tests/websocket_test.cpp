@@ -0,0 +1,148 @@
+/**
+ * WebSocket framing: the opening handshake key, client frame parsing
+ * (masking, extended lengths, control frame rules, size limits) and
+ * server frame encoding
+ */
+
+#include <cstdint>
+#include <string>
+
+#include "check.hpp"
+#include "server/websocket.hpp"
+
+using namespace onnx_server;
+using websocket::Opcode;
+using websocket::ParseStatus;
+
+namespace {
+
+/**
+ * A masked client frame with the given first byte and payload
+ */
+std::string client_frame(uint8_t first, const std::string &payload) {
+  const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+  std::string out;
+  out += static_cast<char>(first);
+  if (payload.size() < 126) {
+    out += static_cast<char>(0x80 | payload.size());
+  } else if (payload.size() <= 0xFFFF) {
+    out += static_cast<char>(0x80 | 126);
+    out += static_cast<char>(payload.size() >> 8);
+    out += static_cast<char>(payload.size() & 0xFF);
+  } else {
+    out += static_cast<char>(0x80 | 127);
+    for (int i = 7; i >= 0; --i)
+      out += static_cast<char>((uint64_t(payload.size()) >> (i * 8)) & 0xFF);
+  }
+  out.append(reinterpret_cast<const char *>(mask), 4);
+  for (size_t i = 0; i < payload.size(); ++i)
+    out += static_cast<char>(payload[i] ^ mask[i % 4]);
+  return out;
+}
+
+ParseStatus parse(const std::string &wire, websocket::Frame &frame,
+                  size_t &consumed, size_t max_payload = 1 << 20) {
+  return websocket::parse_frame(wire.data(), wire.size(), max_payload, frame,
+                                consumed);
+}
+
+void test_accept_key() {
+  // RFC 6455 section 1.3
+  CHECK(websocket::accept_key("dGhlIHNhbXBsZSBub25jZQ==") ==
+        "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+void test_parse() {
+  websocket::Frame frame;
+  size_t consumed = 0;
+
+  // RFC 6455 section 5.7: a masked "Hello"
+  const char hello[] = "\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58";
+  std::string wire(hello, sizeof(hello) - 1);
+  CHECK(parse(wire + "rest", frame, consumed) == ParseStatus::Ok);
+  CHECK(frame.fin && frame.opcode == Opcode::Text);
+  CHECK(frame.payload == "Hello");
+  CHECK(consumed == wire.size());
+
+  // 16-bit and 64-bit extended lengths
+  std::string medium(300, 'm');
+  CHECK(parse(client_frame(0x82, medium), frame, consumed) ==
+        ParseStatus::Ok);
+  CHECK(frame.payload == medium);
+  std::string large(70000, 'l');
+  CHECK(parse(client_frame(0x82, large), frame, consumed) ==
+        ParseStatus::Ok);
+  CHECK(frame.payload.size() == large.size());
+
+  // A non-final fragment
+  CHECK(parse(client_frame(0x01, "part"), frame, consumed) ==
+        ParseStatus::Ok);
+  CHECK(!frame.fin && frame.opcode == Opcode::Text);
+}
+
+void test_incomplete() {
+  websocket::Frame frame;
+  size_t consumed = 0;
+  std::string wire = client_frame(0x81, std::string(200, 'x'));
+  for (size_t size : {size_t{0}, size_t{1}, size_t{3}, size_t{7},
+                      wire.size() - 1}) {
+    CHECK(parse(wire.substr(0, size), frame, consumed) ==
+          ParseStatus::Incomplete);
+  }
+}
+
+void test_invalid() {
+  websocket::Frame frame;
+  size_t consumed = 0;
+
+  // Client frames must be masked
+  CHECK(parse(std::string("\x81\x00", 2), frame, consumed) ==
+        ParseStatus::Invalid);
+  // Reserved bits without a negotiated extension
+  CHECK(parse(client_frame(0xC1, "x"), frame, consumed) ==
+        ParseStatus::Invalid);
+  // Control frames are final and at most 125 bytes
+  CHECK(parse(client_frame(0x09, "ping"), frame, consumed) ==
+        ParseStatus::Invalid);
+  CHECK(parse(client_frame(0x89, std::string(126, 'p')), frame, consumed) ==
+        ParseStatus::Invalid);
+}
+
+void test_too_big() {
+  websocket::Frame frame;
+  size_t consumed = 0;
+  CHECK(parse(client_frame(0x82, std::string(100, 'x')), frame, consumed,
+              99) == ParseStatus::TooBig);
+
+  // A 64-bit length near 2^64 is refused before it can wrap the
+  // bounds check
+  std::string wire("\x82\xff", 2);
+  wire += std::string(8, '\xff');
+  wire += std::string(4, '\0');
+  CHECK(parse(wire, frame, consumed) == ParseStatus::TooBig);
+}
+
+void test_encode() {
+  std::string pong = websocket::encode_frame(Opcode::Pong, "abc");
+  CHECK(pong == std::string("\x8a\x03" "abc", 5));
+
+  std::string big = websocket::encode_frame(Opcode::Binary,
+                                            std::string(300, 'b'));
+  CHECK(big.size() == 4 + 300);
+  CHECK(static_cast<uint8_t>(big[1]) == 126);
+
+  std::string close = websocket::encode_close(websocket::CLOSE_NORMAL, "bye");
+  CHECK(close == std::string("\x88\x05\x03\xe8" "bye", 7));
+}
+
+} // namespace
+
+int main() {
+  test_accept_key();
+  test_parse();
+  test_incomplete();
+  test_invalid();
+  test_too_big();
+  test_encode();
+  return check::result();
+}